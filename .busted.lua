@@ -2,5 +2,6 @@ return {
     default = {
         verbose = true,
         lpath = "./src/?.lua;./src/?/init.lua;./src/?/?.lua;./tests/?.lua",
+        cpath = "./out/?.so",
     },
 }
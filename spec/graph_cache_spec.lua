@@ -0,0 +1,148 @@
+local pulseaudio = require("lua_libpulse_glib")
+
+-- The cache file is written by hand here. Its header is in native byte order, which is assumed to be little
+-- endian. Everything after it is encoded by `schema_encode`.
+
+local function varint(n)
+    local bytes = {}
+    repeat
+        local byte = n % 128
+        n = (n - byte) / 128
+        bytes[#bytes + 1] = string.char(n > 0 and byte + 128 or byte)
+    until n == 0
+    return table.concat(bytes)
+end
+
+local function u32(n)
+    return string.char(n % 256, math.floor(n / 0x100) % 256, math.floor(n / 0x10000) % 256,
+        math.floor(n / 0x1000000) % 256)
+end
+
+local function str(s)
+    if s == nil then
+        return varint(0)
+    end
+    return varint(#s + 1) .. s
+end
+
+-- Indices are written shifted by one, so that `PA_INVALID_INDEX` is `0`.
+local NO_INDEX = varint(0)
+local function index(i)
+    return varint(i + 1)
+end
+
+local HEADER = "LPGS" .. "\2\0" .. "\2\1"
+
+-- The fields of an entry, in schema order: index, parent, name, description, volume, has_volume, mute.
+local function entry(i, parent, name, description, volume, mute)
+    local fields = { index(i), parent, str(name), str(description) }
+    local mask = 0x7f
+    if volume then
+        fields[#fields + 1] = varint(#volume)
+        for _, value in ipairs(volume) do
+            fields[#fields + 1] = varint(value)
+        end
+        fields[#fields + 1] = varint(1)
+    else
+        mask = mask - 0x10
+        fields[#fields + 1] = varint(0)
+    end
+    fields[#fields + 1] = varint(mute and 1 or 0)
+    return varint(mask) .. table.concat(fields)
+end
+
+local CACHE = HEADER
+    .. varint(3) .. str("sink.speakers") .. str("source.mic")
+    .. u32(2)
+    .. entry(0, NO_INDEX, "sink.speakers", "Speakers", { 0x10000, 0x8000 }, false)
+    .. entry(300, NO_INDEX, "sink.headphones", nil, { 200000 }, true)
+    .. u32(1)
+    .. entry(1, NO_INDEX, "source.mic", "Microphone", { 0x10000 }, false)
+    .. u32(2)
+    .. entry(12, index(300), "Music", "player", { 0x4000, 0x4000 }, false)
+    .. entry(13, index(0), "Beep", nil, nil, false)
+    .. u32(0)
+
+
+local function read_file(path)
+    local f = assert(io.open(path, "rb"))
+    local data = f:read("*a")
+    f:close()
+    return data
+end
+
+local function write_file(path, data)
+    local f = assert(io.open(path, "wb"))
+    f:write(data)
+    f:close()
+end
+
+
+describe("Context graph cache", function()
+    local ctx, path, copy
+
+    before_each(function()
+        ctx = pulseaudio.new():context("graph_cache_spec")
+        path = os.tmpname()
+        copy = os.tmpname()
+        write_file(path, CACHE)
+    end)
+
+    after_each(function()
+        os.remove(path)
+        os.remove(copy)
+    end)
+
+    it("loads every field", function()
+        local graph = assert(ctx:load_graph(path))
+
+        assert.is_true(graph.stale)
+        assert.are.equal("sink.speakers", graph.default_sink_name)
+        assert.are.equal("source.mic", graph.default_source_name)
+        assert.are.equal(2, #graph.sinks)
+        assert.are.equal(1, #graph.sources)
+        assert.are.equal(2, #graph.sink_inputs)
+        assert.are.equal(0, #graph.source_outputs)
+
+        local speakers = graph.sinks[1]
+        assert.are.equal(1, speakers.index)
+        assert.is_nil(speakers.parent)
+        assert.are.equal("Speakers", speakers.description)
+        assert.are.equal(2, #speakers.volume)
+        assert.are.equal(0x8000, speakers.volume:get(2))
+        assert.is_false(speakers.mute)
+
+        local headphones = graph.sinks[2]
+        assert.are.equal(301, headphones.index)
+        assert.is_nil(headphones.description)
+        assert.are.equal(200000, headphones.volume:get(1))
+        assert.is_true(headphones.mute)
+
+        assert.are.equal(301, graph.sink_inputs[1].parent)
+        assert.are.equal(1, graph.sink_inputs[2].parent)
+        assert.is_nil(graph.sink_inputs[2].volume)
+    end)
+
+    it("writes back the same bytes", function()
+        assert(ctx:load_graph(path))
+        assert.is_true(ctx:save_graph(copy))
+        assert.are.equal(CACHE, read_file(copy))
+
+        local other = pulseaudio.new():context("graph_cache_spec")
+        assert.are.same(ctx:get_graph(), assert(other:load_graph(copy)))
+    end)
+
+    it("rejects truncated files", function()
+        for len = 0, #CACHE - 1 do
+            write_file(path, CACHE:sub(1, len))
+            local graph, err = ctx:load_graph(path)
+            assert.is_nil(graph)
+            assert.is_string(err)
+        end
+    end)
+
+    it("rejects other versions", function()
+        write_file(path, "LPGS" .. "\1\0" .. CACHE:sub(7))
+        assert.is_nil(ctx:load_graph(path))
+    end)
+end)
@@ -0,0 +1,224 @@
+-- The proplist library is registered as its own module when the main module is loaded.
+require("lua_libpulse_glib")
+local proplist = require("lua_libpulse_glib.proplist")
+
+local function sample()
+    return proplist.new({
+        [proplist.APPLICATION_NAME] = "Player",
+        [proplist.MEDIA_ROLE] = "music",
+        [proplist.MEDIA_TITLE] = "Track",
+    })
+end
+
+describe("PropList", function()
+    describe("to_table", function()
+        it("copies every string value", function()
+            assert.are.same({
+                [proplist.APPLICATION_NAME] = "Player",
+                [proplist.MEDIA_ROLE] = "music",
+                [proplist.MEDIA_TITLE] = "Track",
+            }, sample():to_table())
+        end)
+
+        it("returns an empty table for an empty proplist", function()
+            assert.are.same({}, proplist.new():to_table())
+        end)
+    end)
+
+    describe("iterate", function()
+        it("visits every string value once", function()
+            local seen = {}
+            for key, value in sample():iterate() do
+                assert.is_nil(seen[key])
+                seen[key] = value
+            end
+            assert.are.same(sample():to_table(), seen)
+        end)
+
+        it("allows changing the proplist within the loop", function()
+            local plist = sample()
+            local count = 0
+            for key in plist:iterate() do
+                plist[key] = nil
+                plist["added." .. key] = "value"
+                count = count + 1
+            end
+
+            assert.are.equal(3, count)
+            assert.are.equal(3, #plist)
+            assert.is_nil(plist[proplist.MEDIA_ROLE])
+            assert.are.equal("value", plist["added." .. proplist.MEDIA_ROLE])
+        end)
+
+        it("doesn't depend on the global next", function()
+            local next = _G.next
+            _G.next = nil
+            local ok, result = pcall(function()
+                local count = 0
+                for _ in sample():iterate() do
+                    count = count + 1
+                end
+                return count
+            end)
+            _G.next = next
+
+            assert.is_true(ok, result)
+            assert.are.equal(3, result)
+        end)
+    end)
+
+    describe("get_many", function()
+        it("returns a value for each key, in order", function()
+            local role, missing, name = sample():get_many({
+                proplist.MEDIA_ROLE,
+                proplist.WINDOW_NAME,
+                proplist.APPLICATION_NAME,
+            })
+            assert.are.equal("music", role)
+            assert.is_nil(missing)
+            assert.are.equal("Player", name)
+        end)
+
+        it("returns nothing for no keys", function()
+            assert.are.equal(0, select("#", sample():get_many({})))
+        end)
+
+        it("rejects invalid keys", function()
+            assert.has_error(function() sample():get_many({ "" }) end)
+        end)
+    end)
+
+    describe("update", function()
+        it("replaces existing keys by default", function()
+            local plist = sample()
+            plist:update({ [proplist.MEDIA_ROLE] = "video", [proplist.WINDOW_NAME] = "Window" })
+            assert.are.equal("video", plist[proplist.MEDIA_ROLE])
+            assert.are.equal("Window", plist[proplist.WINDOW_NAME])
+            assert.are.equal("Track", plist[proplist.MEDIA_TITLE])
+        end)
+
+        it("only adds missing keys when merging", function()
+            local plist = sample()
+            plist:update({ [proplist.MEDIA_ROLE] = "video", [proplist.WINDOW_NAME] = "Window" }, "merge")
+            assert.are.equal("music", plist[proplist.MEDIA_ROLE])
+            assert.are.equal("Window", plist[proplist.WINDOW_NAME])
+        end)
+
+        it("removes all other keys when setting", function()
+            local plist = sample()
+            plist:update({ [proplist.WINDOW_NAME] = "Window" }, "set")
+            assert.are.same({ [proplist.WINDOW_NAME] = "Window" }, plist:to_table())
+        end)
+
+        it("takes another proplist", function()
+            local plist = proplist.new({ [proplist.WINDOW_NAME] = "Window" })
+            plist:update(sample())
+            assert.are.equal(4, #plist)
+            assert.are.equal("Player", plist[proplist.APPLICATION_NAME])
+        end)
+
+        it("leaves the proplist unchanged when a value is invalid", function()
+            local plist = sample()
+            assert.has_error(function()
+                plist:update({ [proplist.MEDIA_ROLE] = "video", [proplist.WINDOW_NAME] = "\255" })
+            end)
+            assert.are.same(sample():to_table(), plist:to_table())
+        end)
+
+        it("rejects unknown modes", function()
+            assert.has_error(function() sample():update({}, "append") end)
+        end)
+    end)
+
+    describe("binary values", function()
+        local data = "\0\1\255binary"
+
+        it("are stored exactly", function()
+            local plist = proplist.new()
+            plist:set_binary("test.data", data)
+            assert.are.equal(data, plist:get_binary("test.data"))
+            assert.is_true(plist:contains("test.data"))
+        end)
+
+        it("are not read as strings", function()
+            local plist = sample()
+            plist:set_binary("test.data", data)
+            assert.is_nil(plist["test.data"])
+            assert.is_nil(plist:to_table()["test.data"])
+            assert.is_nil((plist:get_many({ "test.data" })))
+        end)
+
+        it("include the terminator of string values", function()
+            assert.are.equal("music\0", sample():get_binary(proplist.MEDIA_ROLE))
+        end)
+
+        it("are nil for missing keys", function()
+            assert.is_nil(sample():get_binary(proplist.WINDOW_NAME))
+        end)
+    end)
+
+    describe("equality", function()
+        it("doesn't depend on the order keys were set in", function()
+            local a = proplist.new()
+            a[proplist.MEDIA_ROLE] = "music"
+            a[proplist.APPLICATION_NAME] = "Player"
+            local b = proplist.new()
+            b[proplist.APPLICATION_NAME] = "Player"
+            b[proplist.MEDIA_ROLE] = "music"
+
+            assert.are.equal(a:hash(), b:hash())
+            assert.is_true(a == b)
+        end)
+
+        it("tells apart different values", function()
+            local a, b = sample(), sample()
+            b[proplist.MEDIA_ROLE] = "video"
+            assert.are_not.equal(a:hash(), b:hash())
+            assert.is_false(a == b)
+        end)
+
+        it("tells apart keys and values that concatenate to the same string", function()
+            local a = proplist.new({ ["a.b"] = "c" })
+            local b = proplist.new({ ["a"] = ".bc" })
+            assert.is_false(a == b)
+        end)
+
+        it("includes binary values", function()
+            local a, b = sample(), sample()
+            a:set_binary("test.data", "\0\1")
+            b:set_binary("test.data", "\0\2")
+            assert.is_false(a == b)
+
+            b:set_binary("test.data", "\0\1")
+            assert.is_true(a == b)
+        end)
+
+        it("notices every kind of change after the fingerprint was cached", function()
+            local changes = {
+                function(plist) plist[proplist.MEDIA_ROLE] = "video" end,
+                function(plist) plist[proplist.MEDIA_ROLE] = nil end,
+                function(plist) plist:update({ [proplist.WINDOW_NAME] = "Window" }) end,
+                function(plist) plist:update(proplist.new({ [proplist.WINDOW_NAME] = "Window" })) end,
+                function(plist) plist:set_binary("test.data", "\0") end,
+                function(plist) plist:clear() end,
+            }
+
+            for i, change in ipairs(changes) do
+                local plist, other = sample(), sample()
+                local hash = plist:hash()
+                assert.is_true(plist == other)
+
+                change(plist)
+                assert.are_not.equal(hash, plist:hash(), "change " .. i)
+                assert.is_false(plist == other, "change " .. i)
+            end
+        end)
+
+        it("is kept by copies", function()
+            local plist = sample()
+            local copy = plist:copy()
+            assert.are.equal(plist:hash(), copy:hash())
+            assert.is_true(plist == copy)
+        end)
+    end)
+end)
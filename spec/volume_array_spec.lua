@@ -0,0 +1,118 @@
+-- Compares the array kernels with the libpulse functions behind the `Volume` methods.
+--
+-- The SSE2 kernels are used wherever the compiler targets SSE2. Run this against a build with
+-- `make CFLAGS="-fPIC -U__SSE2__"` as well, to cover the scalar kernels.
+
+local volume = require("lua_libpulse_glib.volume")
+local volume_array = require("lua_libpulse_glib.volume_array")
+
+local PA_VOLUME_NORM = 0x10000
+local PA_VOLUME_MAX = 0x7fffffff
+
+-- Channel counts cycled through by the entries, including entries without channels and ones that don't fit
+-- inline in a `Volume`.
+local CHANNELS = { 0, 1, 2, 3, 5 }
+
+-- Lengths that fill whole SSE2 blocks, as well as ones that leave padding entries in the last block.
+local LENGTHS = { 1, 3, 4, 5, 7, 8, 13 }
+
+-- Operands for the scalar operations, from muted to ones that have to be clamped.
+local OPERANDS = { 0, 1, math.floor(PA_VOLUME_NORM / 3), PA_VOLUME_NORM, 5 * PA_VOLUME_NORM, PA_VOLUME_MAX }
+
+local function values_for(i, seed)
+    local channels = CHANNELS[(i - 1) % #CHANNELS + 1]
+    local values = {}
+    for c = 1, channels do
+        values[c] = (i * 7919 + c * 104729 + seed) % (3 * PA_VOLUME_NORM)
+    end
+    -- Some entries are muted entirely, which `scale` treats separately.
+    if i % 4 == 0 then
+        for c = 1, channels do
+            values[c] = 0
+        end
+    end
+    return values
+end
+
+local function build(length, seed)
+    local arr = volume_array.new(length)
+    for i = 1, length do
+        arr:set(i, values_for(i, seed or 0))
+    end
+    return arr
+end
+
+local function to_list(vol)
+    local values = {}
+    for i = 1, #vol do
+        values[i] = vol:get(i)
+    end
+    return values
+end
+
+-- Applies `fn` to a `Volume` of every entry, and checks that the array holds the same values afterwards.
+-- Entries without channels must stay empty.
+local function check(arr, fn)
+    for i = 1, #arr do
+        local actual = to_list(arr:get(i))
+        local values = values_for(i, 0)
+        if #values == 0 then
+            assert.are.same({}, actual, "entry " .. i)
+        else
+            local expected = volume.new(values)
+            fn(expected, i)
+            assert.are.same(to_list(expected), actual, "entry " .. i)
+        end
+    end
+end
+
+describe("VolumeArray", function()
+    for _, length in ipairs(LENGTHS) do
+        describe("with " .. length .. " entries", function()
+            for _, value in ipairs(OPERANDS) do
+                it("multiplies by " .. value .. " like pa_sw_volume_multiply", function()
+                    local arr = build(length)
+                    arr:multiply(value)
+                    check(arr, function(vol) vol:multiply(value) end)
+                end)
+
+                it("divides by " .. value .. " like pa_sw_volume_divide", function()
+                    local arr = build(length)
+                    arr:divide(value)
+                    check(arr, function(vol) vol:divide(value) end)
+                end)
+
+                it("scales to " .. value .. " like pa_cvolume_scale", function()
+                    local arr = build(length)
+                    arr:scale(value)
+                    check(arr, function(vol) vol:scale(value) end)
+                end)
+            end
+
+            it("multiplies and divides pairwise", function()
+                local arr = build(length)
+                local other = build(length, 31337)
+                arr:multiply(other)
+                check(arr, function(vol, i) vol:multiply(volume.new(values_for(i, 31337))) end)
+
+                arr = build(length)
+                arr:divide(other)
+                check(arr, function(vol, i) vol:divide(volume.new(values_for(i, 31337))) end)
+            end)
+
+            it("reduces like pa_cvolume_min, pa_cvolume_max and pa_cvolume_avg", function()
+                local arr = build(length)
+                local min, max, avg = arr:min(), arr:max(), arr:avg()
+                assert.are.equal(length, #min)
+
+                for i = 1, length do
+                    local vol = volume.new(values_for(i, 0))
+                    -- libpulse reduces volumes without channels to muted.
+                    assert.are.equal(vol:min(), min[i], "entry " .. i)
+                    assert.are.equal(vol:max(), max[i], "entry " .. i)
+                    assert.are.equal(vol:avg(), avg[i], "entry " .. i)
+                end
+            end)
+        end)
+    end
+end)
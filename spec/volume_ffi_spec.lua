@@ -0,0 +1,89 @@
+local volume = require("lua_libpulse_glib.volume")
+local vffi = require("lua_libpulse_glib.volume_ffi")
+
+local PA_VOLUME_NORM = 0x10000
+local PA_CHANNELS_MAX = 32
+
+-- Volumes with as many channels as the libpulse volumes on the C path handle, with uneven values.
+local function volumes()
+    local list = {}
+    for _, channels in ipairs({ 0, 1, 2, 3, PA_CHANNELS_MAX }) do
+        local values = {}
+        for i = 1, channels do
+            values[i] = (i * 7919 + 12345) % (2 * PA_VOLUME_NORM)
+        end
+        list[#list + 1] = volume.new(values)
+    end
+    -- Muted channels only, which scaling treats separately.
+    list[#list + 1] = volume.new({ 0, 0, 0 })
+    return list
+end
+
+local function to_list(vol)
+    local values = {}
+    for i = 1, #vol do
+        values[i] = vol:get(i)
+    end
+    return values
+end
+
+describe("volume_ffi", function()
+    for _, name in ipairs({ "min", "max", "avg" }) do
+        it("computes " .. name .. " like the C methods", function()
+            for _, vol in ipairs(volumes()) do
+                assert.are.equal(vol[name](vol), vffi[name](vol), #vol .. " channels")
+            end
+        end)
+    end
+
+    it("scales like the C methods", function()
+        for _, vol in ipairs(volumes()) do
+            for _, value in ipairs({ 0, 1, PA_VOLUME_NORM - 1, PA_VOLUME_NORM, 0x7fffffff }) do
+                local expected = volume.new(vol)
+                local actual = volume.new(vol)
+                local ok_c, err_c = pcall(expected.scale, expected, value)
+                local ok_ffi, err_ffi = pcall(vffi.scale, actual, value)
+
+                assert.are.equal(ok_c, ok_ffi, #vol .. " channels")
+                if ok_c then
+                    assert.are.same(to_list(expected), to_list(actual), #vol .. " channels")
+                else
+                    assert.is_truthy(err_ffi:find("failed to scale volume", 1, true))
+                    assert.is_truthy(err_c:find("failed to scale volume", 1, true))
+                end
+            end
+        end
+    end)
+
+    it("sets channels like the C methods", function()
+        for _, vol in ipairs(volumes()) do
+            for _, channel in ipairs({ 1, 2, 3, PA_CHANNELS_MAX }) do
+                local expected = volume.new(vol)
+                local actual = volume.new(vol)
+                expected:set(channel, PA_VOLUME_NORM)
+                vffi.set(actual, channel, PA_VOLUME_NORM)
+
+                assert.are.same(to_list(expected), to_list(actual), #vol .. " channels, channel " .. channel)
+                assert.are.equal(#expected, vffi.channels(actual))
+            end
+        end
+    end)
+
+    it("grows a volume past its inline channels", function()
+        local vol = volume.new({ PA_VOLUME_NORM })
+        vffi.set(vol, 4, PA_VOLUME_NORM)
+
+        assert.are.same({ PA_VOLUME_NORM, 0, 0, PA_VOLUME_NORM }, to_list(vol))
+        assert.are.equal(4, vffi.channels(vol))
+        assert.are.equal(PA_VOLUME_NORM, vffi.get(vol, 4))
+    end)
+
+    it("rejects the same channels and values as the C methods", function()
+        local vol = volume.new({ PA_VOLUME_NORM, PA_VOLUME_NORM })
+        for _, args in ipairs({ { 0, PA_VOLUME_NORM }, { PA_CHANNELS_MAX + 1, PA_VOLUME_NORM }, { 1, -1 } }) do
+            assert.has_error(function() vol:set(args[1], args[2]) end)
+            assert.has_error(function() vffi.set(vol, args[1], args[2]) end)
+        end
+        assert.are.same({ PA_VOLUME_NORM, PA_VOLUME_NORM }, to_list(vol))
+    end)
+end)
@@ -0,0 +1,80 @@
+local volume = require("lua_libpulse_glib.volume")
+local volume_array = require("lua_libpulse_glib.volume_array")
+
+local PA_VOLUME_NORM = 0x10000
+
+-- Converts every factor with `VolumeArray:from_linear`, as one single channel entry each.
+local function from_linear_batch(values)
+    local lists = {}
+    for i, value in ipairs(values) do
+        lists[i] = { value }
+    end
+
+    local arr = volume_array.new(#values, 1)
+    arr:from_linear(lists)
+
+    local out = {}
+    for i = 1, #values do
+        out[i] = arr:view(i)[1]
+    end
+    return out
+end
+
+-- What `pa_sw_volume_from_linear` computes before rounding.
+local function exact_from_linear(value)
+    if value > 0.999 and value < 1.001 then
+        return PA_VOLUME_NORM
+    end
+    return value ^ (1 / 3) * PA_VOLUME_NORM
+end
+
+-- `count` factors between `first` and `last`, spaced evenly on a log scale.
+local function sweep(first, last, count)
+    local values = {}
+    local step = (math.log(last) - math.log(first)) / (count - 1)
+    for i = 0, count - 1 do
+        values[#values + 1] = math.exp(math.log(first) + i * step)
+    end
+    return values
+end
+
+
+describe("VolumeArray:from_linear", function()
+    local bound = volume.lut_error().from_linear
+
+    it("stays within lut_error of the libpulse formula", function()
+        local values = sweep(1e-6, 1e4, 20000)
+        local results = from_linear_batch(values)
+
+        for i, value in ipairs(values) do
+            local exact = exact_from_linear(value)
+            local scalar = volume.from_linear(value)
+
+            -- Both round to an integer, so they may be one step apart on top of the table's error.
+            assert.is_true(math.abs(results[i] - exact) <= exact * bound + 0.5,
+                string.format("%.17g: %d, expected %.3f", value, results[i], exact))
+            assert.is_true(math.abs(results[i] - scalar) <= exact * bound + 1,
+                string.format("%.17g: %d, libpulse %d", value, results[i], scalar))
+        end
+    end)
+
+    it("snaps to normal volume close to 1.0 like libpulse", function()
+        local values = {}
+        for i = -2000, 2000 do
+            values[#values + 1] = 1 + i * 1e-6
+        end
+        local results = from_linear_batch(values)
+
+        for i, value in ipairs(values) do
+            if value > 0.999 and value < 1.001 then
+                assert.are.equal(PA_VOLUME_NORM, results[i])
+                assert.are.equal(volume.from_linear(value), results[i])
+            end
+        end
+    end)
+
+    it("mutes zero and negative factors", function()
+        local results = from_linear_batch({ 0, -1, -math.huge })
+        assert.are.same({ 0, 0, 0 }, results)
+    end)
+end)
@@ -0,0 +1,100 @@
+local volume = require("lua_libpulse_glib.volume")
+
+local PA_VOLUME_NORM = 0x10000
+local PA_CHANNELS_MAX = 32
+
+local function values_for(channels)
+    local values = {}
+    for c = 1, channels do
+        values[c] = c * 1000
+    end
+    return values
+end
+
+local function to_list(vol)
+    local values = {}
+    for i = 1, #vol do
+        values[i] = vol:get(i)
+    end
+    return values
+end
+
+describe("Volume", function()
+    it("stores up to two channels inline, and more on the heap", function()
+        local layout = volume.layout()
+        assert.are.equal(2, layout.inline_channels)
+        assert.are.equal(PA_CHANNELS_MAX, layout.channels_max)
+    end)
+
+    for _, channels in ipairs({ 1, 2, 3, PA_CHANNELS_MAX }) do
+        describe("with " .. channels .. " channels", function()
+            it("keeps every channel", function()
+                local vol = volume.new(values_for(channels))
+                assert.are.equal(channels, #vol)
+                assert.are.same(values_for(channels), to_list(vol))
+                assert.are.same(values_for(channels), to_list(volume.new(vol)))
+            end)
+
+            it("reduces over every channel", function()
+                local vol = volume.new(values_for(channels))
+                assert.are.equal(1000, vol:min())
+                assert.are.equal(channels * 1000, vol:max())
+                assert.are.equal(math.floor((channels + 1) * 1000 / 2), vol:avg())
+            end)
+
+            it("updates every channel", function()
+                local vol = volume.new(values_for(channels))
+                vol:scale(channels * 2000)
+                for c = 1, channels do
+                    assert.are.equal(c * 2000, vol:get(c))
+                end
+
+                vol:mute(channels)
+                assert.is_true(vol:is_muted())
+                vol:reset(channels)
+                assert.is_true(vol:is_norm())
+                assert.are.equal(channels, #vol)
+            end)
+
+            it("changes the channel count", function()
+                local vol = volume.new(values_for(channels))
+                vol:set_channels(PA_CHANNELS_MAX + 1 - channels, PA_VOLUME_NORM)
+                assert.are.equal(PA_CHANNELS_MAX + 1 - channels, #vol)
+                assert.is_true(vol:is_norm())
+            end)
+        end)
+    end
+
+    describe("set", function()
+        it("writes existing channels", function()
+            local vol = volume.new({ 1, 2 })
+            vol:set(2, PA_VOLUME_NORM)
+            assert.are.same({ 1, PA_VOLUME_NORM }, to_list(vol))
+        end)
+
+        it("grows a volume past its inline channels", function()
+            local vol = volume.new({ 1, 2 })
+            vol:set(5, PA_VOLUME_NORM)
+            assert.are.same({ 1, 2, 0, 0, PA_VOLUME_NORM }, to_list(vol))
+
+            vol:set(PA_CHANNELS_MAX, 3)
+            assert.are.equal(PA_CHANNELS_MAX, #vol)
+            assert.are.equal(PA_VOLUME_NORM, vol:get(5))
+            assert.are.equal(3, vol:get(PA_CHANNELS_MAX))
+        end)
+
+        it("mutes channels that were dropped before growing again", function()
+            local vol = volume.new(values_for(4))
+            vol:set_channels(1, PA_VOLUME_NORM)
+            vol:set(4, PA_VOLUME_NORM)
+            assert.are.same({ PA_VOLUME_NORM, 0, 0, PA_VOLUME_NORM }, to_list(vol))
+        end)
+
+        it("rejects channels beyond the maximum", function()
+            local vol = volume.new({ 1 })
+            assert.has_error(function() vol:set(0, 1) end)
+            assert.has_error(function() vol:set(PA_CHANNELS_MAX + 1, 1) end)
+            assert.are.same({ 1 }, to_list(vol))
+        end)
+    end)
+end)
@@ -0,0 +1,369 @@
+#include "adjust.h"
+
+#include "lua_util.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pulse/error.h>
+#include <pulse/introspect.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Calls the callbacks and frees them. A `NULL` error reports `success` instead.
+static void notify(GPtrArray* callbacks, const char* error, bool success) {
+    for (guint i = 0; i < callbacks->len; i++) {
+        simple_callback_data* data = g_ptr_array_index(callbacks, i);
+        lua_State* L = data->L;
+
+        lua_pushvalue(L, 1);
+        if (error != NULL) {
+            lua_pushstring(L, error);
+            lua_call(L, 1, 0);
+        } else {
+            lua_pushnil(L);
+            lua_pushboolean(L, success);
+            lua_call(L, 2, 0);
+        }
+
+        free_lua_callback(data);
+    }
+    g_ptr_array_set_size(callbacks, 0);
+}
+
+
+static void volume_adjust_free(volume_adjust* a) {
+    g_hash_table_remove(a->ctx->adjustments, a->key);
+    g_free(a->key);
+    g_free(a->name);
+    g_array_free(a->deltas, TRUE);
+    g_ptr_array_free(a->waiting, TRUE);
+    g_ptr_array_free(a->sending, TRUE);
+    g_free(a);
+}
+
+
+// Removes the adjustment and fails everything that was waiting on it.
+static void volume_adjust_fail(volume_adjust* a, const char* error) {
+    GPtrArray* waiting = a->waiting;
+    GPtrArray* sending = a->sending;
+    a->waiting = g_ptr_array_new();
+    a->sending = g_ptr_array_new();
+    volume_adjust_free(a);
+
+    // The callbacks may start new adjustments, so they're only called once this one is gone.
+    notify(sending, error, false);
+    notify(waiting, error, false);
+    g_ptr_array_free(sending, TRUE);
+    g_ptr_array_free(waiting, TRUE);
+}
+
+
+static void apply_delta(pa_cvolume* volume, const volume_delta* delta) {
+    pa_volume_t max = pa_cvolume_max(volume);
+
+    if (delta->dB) {
+        double scaled = (double) max * pow(10.0, delta->value / 60.0);
+        if (delta->value > 0) {
+            // Never lower a volume that's already beyond the limit.
+            scaled = MIN(scaled, (double) MAX(max, delta->limit));
+        }
+        pa_cvolume_scale(volume, (pa_volume_t) PA_CLAMP_VOLUME((uint64_t) lround(scaled)));
+        return;
+    }
+
+    double step = fabs(delta->value) * PA_VOLUME_NORM / 100.0;
+    pa_volume_t volume_step = (pa_volume_t) PA_CLAMP_VOLUME((uint64_t) lround(step));
+    if (delta->value < 0) {
+        pa_cvolume_dec(volume, volume_step);
+    } else if (max < delta->limit) {
+        pa_cvolume_inc_clamp(volume, volume_step, delta->limit);
+    }
+}
+
+
+static void volume_adjust_flush(volume_adjust*);
+
+
+static void write_callback(pa_context* c, int success, void* userdata) {
+    volume_adjust* a = userdata;
+    a->in_flight = false;
+
+    // Mirror what was written right away, so that a press right after this one doesn't build on a volume
+    // that the server's change event hasn't updated yet.
+    if (success && a->ctx->mirror != NULL) {
+        mirror_entry* entry = a->name != NULL ? mirror_find_name(a->ctx->mirror, a->kind, a->name)
+                                              : mirror_find(a->ctx->mirror, a->kind, a->index);
+        if (entry != NULL && entry->has_volume && entry->volume.channels == a->target.channels) {
+            entry->volume = a->target;
+        }
+    }
+
+    GPtrArray* done = a->sending;
+    a->sending = g_ptr_array_new();
+
+    if (a->dirty) {
+        volume_adjust_flush(a);
+    } else {
+        // Without anything left to do, the next delta starts over from the server's volume.
+        volume_adjust_free(a);
+    }
+
+    notify(done, NULL, success);
+    g_ptr_array_free(done, TRUE);
+}
+
+
+static void volume_adjust_flush(volume_adjust* a) {
+    if (!a->known || !a->dirty || a->in_flight) {
+        return;
+    }
+
+    pa_context* c = a->ctx->context;
+    pa_operation* op = NULL;
+    switch (a->kind) {
+    case MIRROR_SINK:
+        op = a->name != NULL ? pa_context_set_sink_volume_by_name(c, a->name, &a->target, write_callback, a)
+                             : pa_context_set_sink_volume_by_index(c, a->index, &a->target, write_callback, a);
+        break;
+    case MIRROR_SOURCE:
+        op = a->name != NULL ? pa_context_set_source_volume_by_name(c, a->name, &a->target, write_callback, a)
+                             : pa_context_set_source_volume_by_index(c, a->index, &a->target, write_callback, a);
+        break;
+    case MIRROR_SINK_INPUT:
+        op = pa_context_set_sink_input_volume(c, a->index, &a->target, write_callback, a);
+        break;
+    case MIRROR_SOURCE_OUTPUT:
+        op = pa_context_set_source_output_volume(c, a->index, &a->target, write_callback, a);
+        break;
+    default:
+        break;
+    }
+
+    if (op == NULL) {
+        volume_adjust_fail(a, pa_strerror(pa_context_errno(c)));
+        return;
+    }
+    pa_operation_unref(op);
+
+    a->dirty = false;
+    a->in_flight = true;
+    for (guint i = 0; i < a->waiting->len; i++) {
+        g_ptr_array_add(a->sending, g_ptr_array_index(a->waiting, i));
+    }
+    g_ptr_array_set_size(a->waiting, 0);
+}
+
+
+// Sets the object's current volume, once it's known, and applies the deltas that were held back.
+static void volume_adjust_resolve(volume_adjust* a, const pa_cvolume* volume) {
+    a->target = *volume;
+    a->known = true;
+    a->dirty = true;
+
+    for (guint i = 0; i < a->deltas->len; i++) {
+        apply_delta(&a->target, &g_array_index(a->deltas, volume_delta, i));
+    }
+    g_array_set_size(a->deltas, 0);
+}
+
+
+// The query callbacks only differ in their info type. libpulse always finishes with an `eol` call, which is
+// where the adjustment moves on, as it may be freed there.
+#define DEFINE_QUERY_CALLBACK(name, info_type)                                                                         \
+    static void name(pa_context* c, const info_type* info, int eol, void* userdata) {                                  \
+        volume_adjust* a = userdata;                                                                                   \
+        if (info != NULL) {                                                                                            \
+            volume_adjust_resolve(a, &info->volume);                                                                   \
+        } else if (eol != 0) {                                                                                         \
+            a->querying = false;                                                                                       \
+            if (a->known) {                                                                                            \
+                volume_adjust_flush(a);                                                                                \
+            } else {                                                                                                   \
+                volume_adjust_fail(a, eol < 0 ? pa_strerror(pa_context_errno(c)) : "no such object");                  \
+            }                                                                                                          \
+        }                                                                                                              \
+    }
+
+DEFINE_QUERY_CALLBACK(sink_query_callback, pa_sink_info)
+DEFINE_QUERY_CALLBACK(source_query_callback, pa_source_info)
+DEFINE_QUERY_CALLBACK(sink_input_query_callback, pa_sink_input_info)
+DEFINE_QUERY_CALLBACK(source_output_query_callback, pa_source_output_info)
+
+#undef DEFINE_QUERY_CALLBACK
+
+
+static void volume_adjust_query(volume_adjust* a) {
+    if (a->querying) {
+        return;
+    }
+
+    pa_context* c = a->ctx->context;
+    pa_operation* op = NULL;
+    switch (a->kind) {
+    case MIRROR_SINK:
+        op = a->name != NULL ? pa_context_get_sink_info_by_name(c, a->name, sink_query_callback, a)
+                             : pa_context_get_sink_info_by_index(c, a->index, sink_query_callback, a);
+        break;
+    case MIRROR_SOURCE:
+        op = a->name != NULL ? pa_context_get_source_info_by_name(c, a->name, source_query_callback, a)
+                             : pa_context_get_source_info_by_index(c, a->index, source_query_callback, a);
+        break;
+    case MIRROR_SINK_INPUT:
+        op = pa_context_get_sink_input_info(c, a->index, sink_input_query_callback, a);
+        break;
+    case MIRROR_SOURCE_OUTPUT:
+        op = pa_context_get_source_output_info(c, a->index, source_output_query_callback, a);
+        break;
+    default:
+        break;
+    }
+
+    if (op == NULL) {
+        volume_adjust_fail(a, pa_strerror(pa_context_errno(c)));
+        return;
+    }
+    pa_operation_unref(op);
+    a->querying = true;
+}
+
+
+// Parses the delta argument: a number in percent, or a string like `"+5%"`, `"-3dB"` or `"2"`.
+static void check_delta(lua_State* L, int arg, volume_delta* delta) {
+    delta->dB = false;
+
+    if (lua_type(L, arg) == LUA_TNUMBER) {
+        delta->value = lua_tonumber(L, arg);
+        return;
+    }
+
+    const char* str = luaL_checkstring(L, arg);
+    char* end = NULL;
+    errno = 0;
+    delta->value = strtod(str, &end);
+    luaL_argcheck(L, end != str && errno == 0 && isfinite(delta->value), arg, "invalid volume delta");
+
+    if (g_ascii_strcasecmp(end, "dB") == 0) {
+        delta->dB = true;
+    } else {
+        luaL_argcheck(L, *end == '\0' || strcmp(end, "%") == 0, arg, "expected a delta in percent or dB");
+    }
+}
+
+
+static int context_adjust_volume(lua_State* L, mirror_kind kind) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+
+    const char* name = NULL;
+    uint32_t index = PA_INVALID_INDEX;
+    if ((kind == MIRROR_SINK || kind == MIRROR_SOURCE) && lua_type(L, 2) == LUA_TSTRING) {
+        name = lua_tostring(L, 2);
+    } else {
+        lua_Integer value = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, value >= 1, 2, "index out of bounds");
+        index = (uint32_t) value - 1;
+    }
+
+    volume_delta delta;
+    check_delta(L, 3, &delta);
+
+    bool has_callback = !lua_isnoneornil(L, 4);
+    if (has_callback) {
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+    }
+
+    lua_Integer limit = luaL_optinteger(L, 5, PA_VOLUME_NORM);
+    luaL_argcheck(L, limit >= 0 && PA_VOLUME_IS_VALID(limit), 5, "volume out of bounds");
+    delta.limit = (pa_volume_t) limit;
+
+    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
+        if (has_callback) {
+            lua_pushvalue(L, 4);
+            lua_pushstring(L, "connection not ready");
+            lua_call(L, 1, 0);
+        }
+        return 0;
+    }
+
+    if (ctx->adjustments == NULL) {
+        ctx->adjustments = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    char* key = name != NULL ? g_strdup_printf("%d:%s", kind, name) : g_strdup_printf("%d#%u", kind, index);
+    volume_adjust* a = g_hash_table_lookup(ctx->adjustments, key);
+    if (a == NULL) {
+        a = g_new0(volume_adjust, 1);
+        a->ctx = ctx;
+        a->kind = kind;
+        a->index = index;
+        a->name = g_strdup(name);
+        a->key = key;
+        a->deltas = g_array_new(FALSE, FALSE, sizeof(volume_delta));
+        a->waiting = g_ptr_array_new();
+        a->sending = g_ptr_array_new();
+        g_hash_table_insert(ctx->adjustments, a->key, a);
+
+        // A tracked mirror already has the current volume, which saves the query.
+        if (ctx->mirror != NULL && ctx->mirror->tracking && !ctx->mirror->stale) {
+            mirror_entry* entry =
+                name != NULL ? mirror_find_name(ctx->mirror, kind, name) : mirror_find(ctx->mirror, kind, index);
+            if (entry != NULL && entry->has_volume) {
+                a->target = entry->volume;
+                a->known = true;
+            }
+        }
+    } else {
+        g_free(key);
+    }
+
+    if (has_callback) {
+        g_ptr_array_add(a->waiting, prepare_lua_callback(L, 4));
+    }
+
+    if (a->known) {
+        apply_delta(&a->target, &delta);
+        a->dirty = true;
+        volume_adjust_flush(a);
+    } else {
+        g_array_append_val(a->deltas, delta);
+        volume_adjust_query(a);
+    }
+
+    return 0;
+}
+
+
+int context_adjust_sink_volume(lua_State* L) {
+    return context_adjust_volume(L, MIRROR_SINK);
+}
+
+
+int context_adjust_source_volume(lua_State* L) {
+    return context_adjust_volume(L, MIRROR_SOURCE);
+}
+
+
+int context_adjust_sink_input_volume(lua_State* L) {
+    return context_adjust_volume(L, MIRROR_SINK_INPUT);
+}
+
+
+int context_adjust_source_output_volume(lua_State* L) {
+    return context_adjust_volume(L, MIRROR_SOURCE_OUTPUT);
+}
+
+
+void volume_adjust_abort_all(lua_pa_context* ctx, const char* reason) {
+    if (ctx->adjustments == NULL) {
+        return;
+    }
+
+    // Failing an adjustment removes it from the table.
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, ctx->adjustments);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        volume_adjust_fail(value, reason);
+        g_hash_table_iter_init(&iter, ctx->adjustments);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "callback.h"
+#include "context.h"
+#include "mirror.h"
+
+#include <glib.h>
+#include <lua.h>
+#include <pulse/volume.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// A single relative change, as passed to `Context:adjust_sink_volume` and friends.
+typedef struct volume_delta {
+    // Either in percent of `PA_VOLUME_NORM`, or in dB.
+    double value;
+    bool dB;
+    // Increases stop at this volume.
+    pa_volume_t limit;
+} volume_delta;
+
+
+// The relative changes that are being applied to one object.
+//
+// The current volume is taken from the mirror when it tracks the object, and queried from the server otherwise.
+// Deltas are applied to `target` in C as they arrive. Only one write per object is in flight at a time, and
+// deltas arriving in the meantime are folded into the next one, so that rapid key presses neither race each
+// other nor queue up writes.
+typedef struct volume_adjust {
+    lua_pa_context* ctx;
+    mirror_kind kind;
+    // The object, by index, or by name for devices that were addressed that way.
+    uint32_t index;
+    char* name;
+    // The key in `lua_pa_context.adjustments`.
+    char* key;
+
+    // The volume the next write sets. Only valid once `known` is set.
+    pa_cvolume target;
+    bool known;
+    // Deltas that arrived while the current volume was being queried.
+    GArray* deltas;
+    bool querying;
+    // Whether `target` has changed since the last write.
+    bool dirty;
+    bool in_flight;
+
+    // The callbacks of the deltas that are part of the next write, and of the write in flight.
+    GPtrArray* waiting;
+    GPtrArray* sending;
+} volume_adjust;
+
+
+// Fails all adjustments of a context, e.g. when the connection is lost, and frees them.
+void volume_adjust_abort_all(lua_pa_context*, const char* reason);
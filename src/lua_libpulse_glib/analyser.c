@@ -0,0 +1,233 @@
+#include "analyser.h"
+
+#include "mixdown.h"
+
+#include <glib.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+
+analyser* analyser_new(const pa_sample_spec* spec, size_t size, size_t bands, double min_freq, double max_freq) {
+    analyser* a = g_new0(analyser, 1);
+    a->spec = *spec;
+
+    size_t n = 1;
+    while (n < size) {
+        n <<= 1;
+    }
+    a->size = n;
+    a->bands = bands;
+    a->attack = 0.5f;
+    a->decay = 0.1f;
+    a->floor = -70.0f;
+
+    a->history = g_new0(float, n);
+    a->window = g_new(float, n);
+    a->twiddle_re = g_new(float, n);
+    a->twiddle_im = g_new(float, n);
+    a->reverse = g_new(size_t, n);
+    a->re = g_new(float, n);
+    a->im = g_new(float, n);
+    a->power = g_new(float, n);
+    a->edges = g_new(size_t, bands + 1);
+    a->levels = g_new0(float, bands);
+
+    // A periodic Hann window. Scaling by `2 / sum` makes a full-scale sine come out at an amplitude of 1.
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        a->window[i] = (float) (0.5 - 0.5 * cos(2.0 * M_PI * (double) i / (double) n));
+        sum += a->window[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+        a->window[i] = (float) (a->window[i] * 2.0 / sum);
+    }
+
+    for (size_t h = 1; h < n; h <<= 1) {
+        for (size_t j = 0; j < h; j++) {
+            a->twiddle_re[h - 1 + j] = (float) cos(-M_PI * (double) j / (double) h);
+            a->twiddle_im[h - 1 + j] = (float) sin(-M_PI * (double) j / (double) h);
+        }
+    }
+
+    int bits = 0;
+    while (((size_t) 1 << bits) < n) {
+        bits++;
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t r = 0;
+        for (int b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        a->reverse[i] = r;
+    }
+
+    // Spread the bands logarithmically over the frequency range, giving each at least one bin.
+    double resolution = (double) spec->rate / (double) n;
+    size_t nyquist = n / 2;
+    min_freq = CLAMP(min_freq, resolution, spec->rate / 2.0);
+    max_freq = CLAMP(max_freq, min_freq, spec->rate / 2.0);
+
+    for (size_t i = 0; i <= bands; i++) {
+        double freq = min_freq * pow(max_freq / min_freq, (double) i / (double) bands);
+        size_t bin = (size_t) lround(freq / resolution);
+        if (i > 0 && bin <= a->edges[i - 1]) {
+            bin = a->edges[i - 1] + 1;
+        }
+        a->edges[i] = MIN(bin, nyquist + 1);
+    }
+
+    return a;
+}
+
+
+void analyser_free(analyser* a) {
+    g_free(a->history);
+    g_free(a->window);
+    g_free(a->twiddle_re);
+    g_free(a->twiddle_im);
+    g_free(a->reverse);
+    g_free(a->re);
+    g_free(a->im);
+    g_free(a->power);
+    g_free(a->edges);
+    g_free(a->levels);
+    g_free(a);
+}
+
+
+void analyser_feed(analyser* a, const void* data, size_t length) {
+    size_t frames = length / pa_frame_size(&a->spec);
+    float mono[MIXDOWN_CHUNK_FRAMES];
+
+    // Only the last `size` frames can end up in the history.
+    size_t f = frames > a->size ? frames - a->size : 0;
+
+    while (f < frames) {
+        size_t count = MIN(frames - f, MIXDOWN_CHUNK_FRAMES);
+        mixdown(&a->spec, data, f, count, mono);
+
+        for (size_t i = 0; i < count; i++) {
+            a->history[a->head] = mono[i];
+            a->head = (a->head + 1) & (a->size - 1);
+        }
+        f += count;
+    }
+}
+
+
+// Multiplies `count` values with the window, in place.
+static void apply_window(float* restrict values, const float* restrict window, size_t count) {
+    size_t i = 0;
+#if defined(__SSE__)
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(values + i, _mm_mul_ps(_mm_loadu_ps(values + i), _mm_loadu_ps(window + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        values[i] *= window[i];
+    }
+}
+
+
+// An in-place radix-2 decimation-in-time transform. The input must be in bit-reversed order.
+static void transform(analyser* a) {
+    size_t n = a->size;
+    float* re = a->re;
+    float* im = a->im;
+
+    for (size_t h = 1; h < n; h <<= 1) {
+        const float* wr = a->twiddle_re + h - 1;
+        const float* wi = a->twiddle_im + h - 1;
+
+        for (size_t start = 0; start < n; start += 2 * h) {
+            float* ar = re + start;
+            float* ai = im + start;
+            float* br = ar + h;
+            float* bi = ai + h;
+            size_t j = 0;
+
+#if defined(__SSE__)
+            for (; j + 4 <= h; j += 4) {
+                __m128 w_re = _mm_loadu_ps(wr + j);
+                __m128 w_im = _mm_loadu_ps(wi + j);
+                __m128 b_re = _mm_loadu_ps(br + j);
+                __m128 b_im = _mm_loadu_ps(bi + j);
+                __m128 a_re = _mm_loadu_ps(ar + j);
+                __m128 a_im = _mm_loadu_ps(ai + j);
+
+                __m128 t_re = _mm_sub_ps(_mm_mul_ps(w_re, b_re), _mm_mul_ps(w_im, b_im));
+                __m128 t_im = _mm_add_ps(_mm_mul_ps(w_re, b_im), _mm_mul_ps(w_im, b_re));
+
+                _mm_storeu_ps(br + j, _mm_sub_ps(a_re, t_re));
+                _mm_storeu_ps(bi + j, _mm_sub_ps(a_im, t_im));
+                _mm_storeu_ps(ar + j, _mm_add_ps(a_re, t_re));
+                _mm_storeu_ps(ai + j, _mm_add_ps(a_im, t_im));
+            }
+#endif
+            for (; j < h; j++) {
+                float t_re = wr[j] * br[j] - wi[j] * bi[j];
+                float t_im = wr[j] * bi[j] + wi[j] * br[j];
+                br[j] = ar[j] - t_re;
+                bi[j] = ai[j] - t_im;
+                ar[j] += t_re;
+                ai[j] += t_im;
+            }
+        }
+    }
+}
+
+
+static void compute_power(analyser* a) {
+    size_t count = a->size / 2 + 1;
+    size_t k = 0;
+#if defined(__SSE__)
+    for (; k + 4 <= count; k += 4) {
+        __m128 re = _mm_loadu_ps(a->re + k);
+        __m128 im = _mm_loadu_ps(a->im + k);
+        _mm_storeu_ps(a->power + k, _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)));
+    }
+#endif
+    for (; k < count; k++) {
+        a->power[k] = a->re[k] * a->re[k] + a->im[k] * a->im[k];
+    }
+}
+
+
+void analyser_process(analyser* a) {
+    size_t n = a->size;
+    float* scratch = a->power;
+
+    // Put the history in chronological order, window it, and scatter it into bit-reversed order.
+    memcpy(scratch, a->history + a->head, (n - a->head) * sizeof(float));
+    memcpy(scratch + (n - a->head), a->history, a->head * sizeof(float));
+    apply_window(scratch, a->window, n);
+
+    for (size_t i = 0; i < n; i++) {
+        a->re[a->reverse[i]] = scratch[i];
+    }
+    memset(a->im, 0, n * sizeof(float));
+
+    transform(a);
+    compute_power(a);
+
+    size_t nyquist = n / 2;
+    for (size_t b = 0; b < a->bands; b++) {
+        size_t start = MIN(a->edges[b], nyquist);
+        size_t end = MAX(a->edges[b + 1], start + 1);
+
+        float peak = 0;
+        for (size_t k = start; k < end && k <= nyquist; k++) {
+            peak = MAX(peak, a->power[k]);
+        }
+
+        float db = 10.0f * log10f(peak + 1e-20f);
+        float target = CLAMP((db - a->floor) / -a->floor, 0.0f, 1.0f);
+        float coefficient = target > a->levels[b] ? a->attack : a->decay;
+        a->levels[b] += coefficient * (target - a->levels[b]);
+    }
+}
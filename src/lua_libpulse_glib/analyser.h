@@ -0,0 +1,55 @@
+#pragma once
+
+#include <pulse/sample.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+// A spectrum analyser for a single stream.
+//
+// Samples are mixed down to mono and kept in a history of the last `size` samples. When a frame is requested,
+// the history is windowed, transformed and reduced to log-spaced bands, which are then smoothed over time.
+//
+// Buffers are laid out as separate real and imaginary arrays, so that the transform can be vectorised.
+typedef struct analyser {
+    pa_sample_spec spec;
+    // The transform size, a power of two.
+    size_t size;
+    // The most recent mono samples, as a circular buffer of `size` samples starting at `head`.
+    float* history;
+    size_t head;
+    // The Hann window, pre-multiplied with the amplitude normalization.
+    float* window;
+    // Twiddle factors for every stage of the transform. The stage with butterflies of span `h` uses the `h`
+    // factors starting at offset `h - 1`, so that they can be loaded contiguously.
+    float* twiddle_re;
+    float* twiddle_im;
+    // Bit-reversed sample order.
+    size_t* reverse;
+    float* re;
+    float* im;
+    // The power of each bin up to the Nyquist frequency.
+    float* power;
+    size_t bands;
+    // The first bin of each band. The band `i` ends where band `i + 1` starts.
+    size_t* edges;
+    // The smoothed band levels, between 0 and 1.
+    float* levels;
+    float attack;
+    float decay;
+    // The level range, in dB. Levels at or below `floor` are reported as 0.
+    float floor;
+} analyser;
+
+
+// Creates an analyser. The size is rounded up to a power of two, and the frequency range is clamped to
+// what the sample rate and size can resolve.
+analyser* analyser_new(const pa_sample_spec*, size_t size, size_t bands, double min_freq, double max_freq);
+void analyser_free(analyser*);
+
+// Appends interleaved frames to the history. When `data` is `NULL`, silence is appended instead.
+// The stream's format has to be one that `mixdown_supports_format` accepts.
+void analyser_feed(analyser*, const void* data, size_t length);
+
+// Transforms the current history and updates `levels`.
+void analyser_process(analyser*);
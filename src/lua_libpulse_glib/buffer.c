@@ -0,0 +1,100 @@
+#include "buffer.h"
+
+#include "lua_util.h"
+
+#include <string.h>
+
+
+lua_pa_buffer* buffer_push(lua_State* L, size_t capacity) {
+    lua_pa_buffer* buf = lua_newuserdata(L, sizeof(lua_pa_buffer) + capacity);
+    buf->capacity = capacity;
+    buf->length = 0;
+
+    luaL_getmetatable(L, LUA_PA_BUFFER);
+    lua_setmetatable(L, -2);
+
+    return buf;
+}
+
+
+const void* buffer_check_data(lua_State* L, int index, size_t* length) {
+    if (lua_type(L, index) == LUA_TSTRING) {
+        return lua_tolstring(L, index, length);
+    }
+
+    lua_pa_buffer* buf = luaU_testudata(L, index, LUA_PA_BUFFER);
+    if (buf == NULL) {
+        luaL_argerror(L, index, "string or buffer expected");
+        return NULL;
+    }
+
+    *length = buf->length;
+    return buf->data;
+}
+
+
+int buffer_new(lua_State* L) {
+    lua_Integer capacity = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, capacity >= 0, 1, "capacity must not be negative");
+
+    buffer_push(L, (size_t) capacity);
+    return 1;
+}
+
+
+int buffer_set(lua_State* L) {
+    lua_pa_buffer* buf = luaL_checkudata(L, 1, LUA_PA_BUFFER);
+    size_t length;
+    const char* data = luaL_checklstring(L, 2, &length);
+    lua_Integer offset = luaL_optinteger(L, 3, 1) - 1;
+
+    luaL_argcheck(L, offset >= 0 && (size_t) offset <= buf->capacity, 3, "offset out of range");
+    luaL_argcheck(L, length <= buf->capacity - (size_t) offset, 2, "data exceeds the buffer's capacity");
+
+    memcpy(buf->data + offset, data, length);
+    buf->length = (size_t) offset + length;
+    return 0;
+}
+
+
+int buffer_to_string(lua_State* L) {
+    lua_pa_buffer* buf = luaL_checkudata(L, 1, LUA_PA_BUFFER);
+    lua_Integer i = luaL_optinteger(L, 2, 1);
+    lua_Integer j = luaL_optinteger(L, 3, (lua_Integer) buf->length);
+
+    if (i < 1) {
+        i = 1;
+    }
+    if (j > (lua_Integer) buf->length) {
+        j = (lua_Integer) buf->length;
+    }
+
+    if (i > j) {
+        lua_pushliteral(L, "");
+    } else {
+        lua_pushlstring(L, (const char*) buf->data + i - 1, (size_t) (j - i + 1));
+    }
+
+    return 1;
+}
+
+
+int buffer_clear(lua_State* L) {
+    lua_pa_buffer* buf = luaL_checkudata(L, 1, LUA_PA_BUFFER);
+    buf->length = 0;
+    return 0;
+}
+
+
+int buffer_get_capacity(lua_State* L) {
+    lua_pa_buffer* buf = luaL_checkudata(L, 1, LUA_PA_BUFFER);
+    lua_pushinteger(L, (lua_Integer) buf->capacity);
+    return 1;
+}
+
+
+int buffer__len(lua_State* L) {
+    lua_pa_buffer* buf = luaL_checkudata(L, 1, LUA_PA_BUFFER);
+    lua_pushinteger(L, (lua_Integer) buf->length);
+    return 1;
+}
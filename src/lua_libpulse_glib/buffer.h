@@ -0,0 +1,108 @@
+/** Fixed-size byte buffers for audio data.
+ *
+ * A @{Buffer} is a block of memory owned by Lua, that streams can read from and write into without
+ * creating intermediate Lua strings. The memory is allocated once, together with the userdata, so a
+ * buffer can be reused for every write or read.
+ *
+ *    local buffer = require("lua_libpulse_glib.buffer")
+ *    local buf = buffer.new(4096)
+ *    buf:set(samples)
+ *    stream:write(buf)
+ *
+ * @module lua_libpulse_glib.buffer
+ */
+#pragma once
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <stddef.h>
+
+#define LUA_PA_BUFFER "pulseaudio.buffer"
+
+
+typedef struct lua_pa_buffer {
+    size_t capacity;
+    // The number of bytes that hold data, starting at the beginning.
+    size_t length;
+    unsigned char data[];
+} lua_pa_buffer;
+
+
+// Creates a new buffer userdata and pushes it onto the stack.
+lua_pa_buffer* buffer_push(lua_State*, size_t);
+
+// Returns the data of a Lua string or @{Buffer} at the given index, and stores its length.
+// Raises an argument error for other types.
+const void* buffer_check_data(lua_State*, int, size_t*);
+
+
+/** Creates a new buffer.
+ *
+ * @function new
+ * @tparam number capacity The size of the buffer in bytes.
+ * @treturn Buffer
+ */
+int buffer_new(lua_State*);
+
+
+/// Buffer
+/// @type Buffer
+
+
+/** Copies a string into the buffer.
+ *
+ * The buffer's length is set to the end of the copied data.
+ *
+ * @function Buffer:set
+ * @tparam string data
+ * @tparam[opt=1] number offset The position to copy to.
+ */
+int buffer_set(lua_State*);
+
+/** Returns the buffer's data as a string.
+ *
+ * @function Buffer:to_string
+ * @tparam[opt=1] number i The first byte.
+ * @tparam[opt=#buffer] number j The last byte.
+ * @treturn string
+ */
+int buffer_to_string(lua_State*);
+
+/** Sets the length to zero. The memory is kept.
+ *
+ * @function Buffer:clear
+ */
+int buffer_clear(lua_State*);
+
+/** Returns the size of the buffer's memory.
+ *
+ * @function Buffer:get_capacity
+ * @treturn number
+ */
+int buffer_get_capacity(lua_State*);
+
+/* Implements the `#` length operator, returning the number of bytes that hold data.
+ */
+int buffer__len(lua_State*);
+
+
+static const struct luaL_Reg buffer_f[] = {
+    {"set",           buffer_set         },
+    { "to_string",    buffer_to_string   },
+    { "clear",        buffer_clear       },
+    { "get_capacity", buffer_get_capacity},
+    { NULL,           NULL               }
+};
+
+
+static const struct luaL_Reg buffer_mt[] = {
+    {"__len",       buffer__len     },
+    { "__tostring", buffer_to_string},
+    { NULL,         NULL            }
+};
+
+
+static const struct luaL_Reg buffer_lib[] = {
+    {"new", buffer_new},
+    { NULL, NULL      }
+};
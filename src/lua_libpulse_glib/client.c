@@ -0,0 +1,649 @@
+#include "client.h"
+
+#include "context.h"
+#include "lua_util.h"
+#include "proxy.h"
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <pulse/context.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CLIENT_READ_SIZE 4096
+
+
+static lua_pa_client* client_check(lua_State* L) {
+    return luaL_checkudata(L, 1, LUA_PA_CLIENT);
+}
+
+
+static bool client_send(lua_pa_client* client, const GByteArray* frame) {
+    size_t offset = 0;
+
+    while (offset < frame->len) {
+        ssize_t written = send(client->fd, frame->data + offset, frame->len - offset, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        offset += (size_t) written;
+    }
+
+    return true;
+}
+
+
+// Reads what's available into the input buffer. Returns `false` on end of file or error.
+static bool client_receive(lua_pa_client* client, bool block) {
+    guint8 buffer[CLIENT_READ_SIZE];
+    int flags = block ? 0 : MSG_DONTWAIT;
+
+    for (;;) {
+        ssize_t len = recv(client->fd, buffer, sizeof(buffer), flags);
+        if (len > 0) {
+            g_byte_array_append(client->in, buffer, (guint) len);
+            if ((size_t) len < sizeof(buffer)) {
+                return true;
+            }
+            // There might be more. Don't block for it.
+            flags = MSG_DONTWAIT;
+            continue;
+        }
+
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+
+        return false;
+    }
+}
+
+
+// Calls the state callback, if any, with the given state.
+static void client_report_state(lua_pa_client* client, pa_context_state_t state) {
+    lua_State* L = client->data->L;
+    if (!lua_isfunction(L, 4)) {
+        return;
+    }
+
+    lua_pushvalue(L, 4);
+    lua_pushnil(L);
+    lua_pushinteger(L, state);
+    lua_call(L, 2, 0);
+}
+
+
+static void client_close(lua_pa_client* client) {
+    if (client->read_id != 0) {
+        g_source_remove(client->read_id);
+        client->read_id = 0;
+    }
+
+    if (client->state_id != 0) {
+        g_source_remove(client->state_id);
+        client->state_id = 0;
+    }
+
+    if (client->pending_id != 0) {
+        g_source_remove(client->pending_id);
+        client->pending_id = 0;
+    }
+
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+
+    g_byte_array_set_size(client->in, 0);
+}
+
+
+// Closes the connection after the serving process went away, and fails all requests in flight.
+static void client_lost(lua_pa_client* client) {
+    lua_State* L = client->data->L;
+
+    client_close(client);
+
+    // Collect the callbacks first, as they may issue new requests.
+    lua_newtable(L);
+    int list_index = lua_gettop(L);
+    lua_pushnil(L);
+    while (lua_next(L, 3) != 0) {
+        lua_rawseti(L, list_index, lua_rawlen(L, list_index) + 1);
+    }
+    lua_newtable(L);
+    lua_replace(L, 3);
+
+    for (size_t i = 1; i <= lua_rawlen(L, list_index); ++i) {
+        lua_rawgeti(L, list_index, i);
+        lua_pushstring(L, "connection to the serving process lost");
+        lua_call(L, 1, 0);
+    }
+    lua_pop(L, 1);
+
+    client_report_state(client, PA_CONTEXT_TERMINATED);
+}
+
+
+// Pushes the values from a reply's payload. Returns the number of values.
+static int client_push_reply(lua_State* L, const proxy_frame* frame) {
+    proxy_reader r = { frame->payload, frame->length, 0, false };
+    uint8_t count = proxy_read_u8(&r);
+    int pushed = 0;
+
+    luaL_checkstack(L, count, "too many values in reply");
+    for (; pushed < count; ++pushed) {
+        if (!proxy_decode_value(L, &r)) {
+            break;
+        }
+    }
+
+    return pushed;
+}
+
+
+static void client_push_error(lua_State* L, const proxy_frame* frame) {
+    proxy_reader r = { frame->payload, frame->length, 0, false };
+    uint32_t len = proxy_read_u32(&r);
+    if (r.error || len > frame->length - r.pos) {
+        lua_pushstring(L, "malformed error reply");
+    } else {
+        lua_pushlstring(L, (const char*) frame->payload + r.pos, len);
+    }
+}
+
+
+static void client_dispatch_frame(lua_pa_client* client, const proxy_frame* frame) {
+    lua_State* L = client->data->L;
+
+    switch (frame->type) {
+    case PROXY_FRAME_REPLY:
+    case PROXY_FRAME_ERROR: {
+        lua_rawgeti(L, 3, frame->id);
+        if (!lua_isfunction(L, -1)) {
+            lua_pop(L, 1);
+            return;
+        }
+
+        lua_pushnil(L);
+        lua_rawseti(L, 3, frame->id);
+
+        if (frame->type == PROXY_FRAME_ERROR) {
+            client_push_error(L, frame);
+            lua_call(L, 1, 0);
+        } else {
+            lua_call(L, client_push_reply(L, frame), 0);
+        }
+        break;
+    }
+    case PROXY_FRAME_EVENT: {
+        proxy_reader r = { frame->payload, frame->length, 0, false };
+        uint32_t event_type = proxy_read_u32(&r);
+        uint32_t index = proxy_read_u32(&r);
+        uint32_t facility = event_type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+
+        if (r.error || (client->subscription_mask & (1U << facility)) == 0) {
+            return;
+        }
+
+        // The list of callbacks may change while we're calling them, so we need to check the length every time.
+        for (size_t i = 1; i <= lua_rawlen(L, 1); ++i) {
+            lua_rawgeti(L, 1, i);
+            if (!lua_isfunction(L, -1)) {
+                lua_pop(L, 1);
+                continue;
+            }
+
+            lua_rawgeti(L, 2, 1);
+            lua_pushinteger(L, event_type);
+            lua_pushinteger(L, index);
+            lua_call(L, 3, 0);
+        }
+        break;
+    }
+    default: {
+        break;
+    }
+    }
+}
+
+
+static void client_process_input(lua_pa_client* client) {
+    proxy_frame frame;
+    ssize_t consumed;
+
+    while (client->fd >= 0 && (consumed = proxy_frame_parse(client->in, &frame)) > 0) {
+        // Callbacks may make blocking calls, which read into the same buffer. So the frame is taken out first.
+        GByteArray* copy = g_byte_array_new();
+        g_byte_array_append(copy, client->in->data, (guint) consumed);
+        g_byte_array_remove_range(client->in, 0, (guint) consumed);
+
+        proxy_frame_parse(copy, &frame);
+        client_dispatch_frame(client, &frame);
+        g_byte_array_free(copy, TRUE);
+    }
+
+    if (client->fd >= 0 && consumed < 0) {
+        client_lost(client);
+    }
+}
+
+
+static gboolean client_readable(gint fd, GIOCondition condition, gpointer userdata) {
+    lua_pa_client* client = (lua_pa_client*) userdata;
+
+    if (!client_receive(client, false)) {
+        // `client_lost` removes this source.
+        client_lost(client);
+        return G_SOURCE_REMOVE;
+    }
+
+    client_process_input(client);
+    return client->fd >= 0 ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+
+static gboolean client_process_pending(gpointer userdata) {
+    lua_pa_client* client = (lua_pa_client*) userdata;
+    client->pending_id = 0;
+    client_process_input(client);
+    return G_SOURCE_REMOVE;
+}
+
+
+// Blocks until the reply to the given request has arrived, and takes it out of the input buffer.
+// Other frames are left in the buffer and handled from the main loop later.
+static GByteArray* client_wait_reply(lua_pa_client* client, uint32_t id) {
+    for (;;) {
+        size_t offset = 0;
+
+        while (offset < client->in->len) {
+            GByteArray view = { client->in->data + offset, client->in->len - (guint) offset };
+            proxy_frame frame;
+            ssize_t consumed = proxy_frame_parse(&view, &frame);
+            if (consumed <= 0) {
+                break;
+            }
+
+            if (frame.id == id && (frame.type == PROXY_FRAME_REPLY || frame.type == PROXY_FRAME_ERROR)) {
+                GByteArray* reply = g_byte_array_new();
+                g_byte_array_append(reply, view.data, (guint) consumed);
+                g_byte_array_remove_range(client->in, (guint) offset, (guint) consumed);
+
+                if (client->in->len > 0 && client->pending_id == 0) {
+                    client->pending_id = g_idle_add(client_process_pending, client);
+                }
+
+                return reply;
+            }
+
+            offset += (size_t) consumed;
+        }
+
+        if (!client_receive(client, true)) {
+            return NULL;
+        }
+    }
+}
+
+
+// Forwards a method call to the serving process. The upvalue is the method name.
+static int client_forward(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+    const char* name = lua_tostring(L, lua_upvalueindex(1));
+    int nargs = lua_gettop(L) - 1;
+
+    int callback_index = 0;
+    for (int i = 2; i <= lua_gettop(L); ++i) {
+        if (lua_isfunction(L, i)) {
+            callback_index = i;
+        }
+    }
+
+    if (client->fd < 0) {
+        if (callback_index != 0) {
+            lua_pushvalue(L, callback_index);
+            lua_pushstring(L, "not connected");
+            lua_call(L, 1, 0);
+            return 0;
+        }
+        return luaL_error(L, "not connected");
+    }
+
+    uint32_t id = ++client->next_id;
+    GByteArray* frame = g_byte_array_new();
+    size_t start = proxy_frame_begin(frame, PROXY_FRAME_REQUEST, id);
+    proxy_write_string(frame, name, strlen(name));
+    proxy_write_u8(frame, (uint8_t) nargs);
+    for (int i = 2; i <= lua_gettop(L); ++i) {
+        proxy_encode_value(L, i, frame);
+    }
+    proxy_frame_end(frame, start);
+
+    bool sent = client_send(client, frame);
+    g_byte_array_free(frame, TRUE);
+
+    if (callback_index != 0) {
+        if (!sent) {
+            client_lost(client);
+            lua_pushvalue(L, callback_index);
+            lua_pushstring(L, "connection to the serving process lost");
+            lua_call(L, 1, 0);
+            return 0;
+        }
+
+        lua_State* thread_L = client->data->L;
+        lua_pushvalue(L, callback_index);
+        lua_xmove(L, thread_L, 1);
+        lua_rawseti(thread_L, 3, id);
+        return 0;
+    }
+
+    GByteArray* reply = sent ? client_wait_reply(client, id) : NULL;
+    if (reply == NULL) {
+        client_lost(client);
+        return luaL_error(L, "connection to the serving process lost");
+    }
+
+    proxy_frame reply_frame;
+    proxy_frame_parse(reply, &reply_frame);
+
+    int base = lua_gettop(L);
+    if (reply_frame.type == PROXY_FRAME_ERROR) {
+        client_push_error(L, &reply_frame);
+        g_byte_array_free(reply, TRUE);
+        return lua_error(L);
+    }
+
+    client_push_reply(L, &reply_frame);
+    g_byte_array_free(reply, TRUE);
+    return lua_gettop(L) - base;
+}
+
+
+static void client_send_mask(lua_pa_client* client) {
+    if (client->fd < 0) {
+        return;
+    }
+
+    pa_subscription_mask_t mask = lua_rawlen(client->data->L, 1) > 0 ? client->subscription_mask
+                                                                      : PA_SUBSCRIPTION_MASK_NULL;
+
+    GByteArray* frame = g_byte_array_new();
+    size_t start = proxy_frame_begin(frame, PROXY_FRAME_SUBSCRIBE, 0);
+    proxy_write_u32(frame, mask);
+    proxy_frame_end(frame, start);
+
+    client_send(client, frame);
+    g_byte_array_free(frame, TRUE);
+}
+
+
+int client_new(lua_State* L) {
+    luaL_checkstring(L, 1);
+
+    lua_pa_client* client = lua_newuserdata(L, sizeof(lua_pa_client));
+    if (client == NULL) {
+        return luaL_error(L, "failed to create client userdata");
+    }
+    int client_index = lua_gettop(L);
+
+    client->fd = -1;
+    client->read_id = 0;
+    client->state_id = 0;
+    client->pending_id = 0;
+    client->in = g_byte_array_new();
+    client->next_id = 0;
+    client->subscription_mask = PA_SUBSCRIPTION_MASK_ALL;
+    client->data = prepare_lua_callback(L, 0);
+
+    lua_State* thread_L = client->data->L;
+
+    // Subscription callbacks
+    lua_newtable(thread_L);
+
+    // The event callbacks receive the client as parameter. To not keep the client alive forever through
+    // the thread's registry reference, it is stored in a table with weak values.
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, client_index);
+    lua_rawseti(L, -2, 1);
+    lua_xmove(L, thread_L, 1);
+
+    // Callbacks for requests in flight, and the state callback
+    lua_newtable(thread_L);
+    lua_pushnil(thread_L);
+
+    luaL_getmetatable(L, LUA_PA_CLIENT);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+
+static gboolean client_connected(gpointer userdata) {
+    lua_pa_client* client = (lua_pa_client*) userdata;
+    client->state_id = 0;
+
+    lua_State* L = client->data->L;
+    int base = lua_gettop(L);
+
+    // Ask for the serving process' state. This also confirms that it talks our protocol.
+    lua_pushcfunction(L, client_get_state);
+    lua_rawgeti(L, 2, 1);
+    if (lua_isnil(L, -1) || lua_pcall(L, 1, 1, 0) != 0) {
+        lua_settop(L, base);
+        client_lost(client);
+        return G_SOURCE_REMOVE;
+    }
+
+    pa_context_state_t state = (pa_context_state_t) lua_tointeger(L, -1);
+    lua_settop(L, base);
+
+    client_report_state(client, state);
+    return G_SOURCE_REMOVE;
+}
+
+
+int client_connect(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+    const char* path = luaL_optstring(L, 2, NULL);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    char* default_path = NULL;
+
+    client_close(client);
+
+    // Store the state callback
+    lua_State* thread_L = client->data->L;
+    lua_pushvalue(L, 3);
+    lua_xmove(L, thread_L, 1);
+    lua_replace(thread_L, 4);
+
+    if (path == NULL) {
+        default_path = proxy_default_path();
+        path = default_path;
+    }
+
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+    g_free(default_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        int error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        lua_pushvalue(L, 3);
+        lua_pushfstring(L, "failed to connect: %s", strerror(error));
+        lua_call(L, 1, 0);
+        return 0;
+    }
+
+    client->fd = fd;
+    client->read_id = g_unix_fd_add(fd, G_IO_IN | G_IO_HUP | G_IO_ERR, client_readable, client);
+    client_send_mask(client);
+
+    // Like the state callback of a context, this is only called from the main loop.
+    client->state_id = g_idle_add(client_connected, client);
+
+    return 0;
+}
+
+
+int client_disconnect(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+    client_close(client);
+    return 0;
+}
+
+
+int client_get_state(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+
+    if (client->fd < 0) {
+        lua_pushinteger(L, PA_CONTEXT_UNCONNECTED);
+        return 1;
+    }
+
+    lua_settop(L, 1);
+    lua_pushstring(L, "get_state");
+    lua_pushcclosure(L, client_forward, 1);
+    lua_insert(L, 1);
+    lua_call(L, 1, 1);
+    return 1;
+}
+
+
+int client_subscribe(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_State* thread_L = client->data->L;
+
+    size_t pos = lua_rawlen(thread_L, 1) + 1;
+    lua_pushvalue(L, 2);
+    lua_xmove(L, thread_L, 1);
+    lua_rawseti(thread_L, 1, pos);
+
+    if (pos == 1) {
+        client_send_mask(client);
+    }
+
+    lua_pushinteger(L, pos);
+    return 1;
+}
+
+
+int client_unsubscribe(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+    lua_State* thread_L = client->data->L;
+    size_t len = lua_rawlen(thread_L, 1);
+    size_t pos = 0;
+
+    switch (lua_type(L, 2)) {
+    case LUA_TNUMBER: {
+        pos = lua_tointeger(L, 2);
+        break;
+    }
+    case LUA_TFUNCTION: {
+        lua_pushvalue(L, 2);
+        lua_xmove(L, thread_L, 1);
+        for (size_t i = 1; i <= len && pos == 0; ++i) {
+            lua_rawgeti(thread_L, 1, i);
+            if (lua_rawequal(thread_L, -1, -2)) {
+                pos = i;
+            }
+            lua_pop(thread_L, 1);
+        }
+        lua_pop(thread_L, 1);
+        break;
+    }
+    default: {
+        return luaL_argerror(L, 2, "expected number or function");
+    }
+    }
+
+    if (pos == 0 || pos > len) {
+        return 0;
+    }
+
+    for (; pos < len; ++pos) {
+        lua_rawgeti(thread_L, 1, pos + 1);
+        lua_rawseti(thread_L, 1, pos);
+    }
+    lua_pushnil(thread_L);
+    lua_rawseti(thread_L, 1, len);
+
+    if (len == 1) {
+        client_send_mask(client);
+    }
+
+    return 0;
+}
+
+
+int client_set_subscription_mask(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+    lua_Integer mask = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (mask & ~PA_SUBSCRIPTION_MASK_ALL) == 0, 2, "invalid subscription mask");
+
+    client->subscription_mask = (pa_subscription_mask_t) mask;
+    client_send_mask(client);
+
+    return 0;
+}
+
+
+// Resolves methods. Local ones come from the table in the upvalue, all other `Context` methods are
+// forwarded. Forwarding closures are cached in the same table.
+int client__index(lua_State* L) {
+    const char* name = luaL_checkstring(L, 2);
+
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    if (!lua_isnil(L, -1)) {
+        return 1;
+    }
+    lua_pop(L, 1);
+
+    for (int i = 0; context_f[i].name != NULL; ++i) {
+        if (strcmp(name, context_f[i].name) == 0) {
+            lua_pushvalue(L, 2);
+            lua_pushvalue(L, 2);
+            lua_pushcclosure(L, client_forward, 1);
+            lua_rawset(L, lua_upvalueindex(1));
+
+            lua_pushvalue(L, 2);
+            lua_rawget(L, lua_upvalueindex(1));
+            return 1;
+        }
+    }
+
+    lua_pushnil(L);
+    return 1;
+}
+
+
+int client__gc(lua_State* L) {
+    lua_pa_client* client = client_check(L);
+
+    client_close(client);
+    g_byte_array_free(client->in, TRUE);
+    free_lua_callback(client->data);
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+/** A context that uses another process' connection.
+ *
+ * Connects to a server started with @{Context:serve}. A @{Client} has the same methods as a @{Context}, which
+ * are forwarded to the serving process and use its connection. Methods that take a callback are asynchronous,
+ * all other methods block until the serving process has replied.
+ *
+ *    local client = require("lua_libpulse_glib.client")
+ *    local ctx = client.new("my-applet")
+ *    ctx:connect(nil, function(err, state) end)
+ *    ctx:get_sinks(function(err, sinks) end)
+ *
+ * @module lua_libpulse_glib.client
+ */
+#pragma once
+
+#include "callback.h"
+
+#include <glib.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <pulse/subscribe.h>
+#include <stdint.h>
+
+#define LUA_PA_CLIENT "pulseaudio.client"
+
+
+typedef struct lua_pa_client {
+    int fd;
+    guint read_id;
+    // Reports the connection state from the main loop, after `Client:connect`.
+    guint state_id;
+    // Handles frames that arrived while waiting for the reply to a blocking call.
+    guint pending_id;
+    GByteArray* in;
+    uint32_t next_id;
+    pa_subscription_mask_t subscription_mask;
+    // A thread with the subscription callbacks at index 1, a weak table holding the client at index 2,
+    // the callbacks of requests in flight by request ID at index 3 and the state callback at index 4.
+    simple_callback_data* data;
+} lua_pa_client;
+
+
+/** Creates a new client.
+ *
+ * @function new
+ * @tparam string name The application name. Only used for error messages, as the serving process' connection
+ *  has its own name.
+ * @treturn Client
+ */
+int client_new(lua_State*);
+
+
+/// Client
+/// @type Client
+
+
+/** Connects to the serving process.
+ *
+ * Once connected, the callback receives the state of the serving process' connection. When the serving process
+ * goes away, it receives `PA_CONTEXT_TERMINATED`.
+ *
+ * @function Client:connect
+ * @async
+ * @tparam[opt=nil] string path The socket path. Defaults to the same path as @{Context:serve}.
+ * @tparam function cb The connection state callback.
+ * @treturn[opt] string The error message
+ * @treturn string The state
+ */
+int client_connect(lua_State*);
+
+/** Disconnects from the serving process.
+ *
+ * @function Client:disconnect
+ */
+int client_disconnect(lua_State*);
+
+/** Returns the state of the serving process' connection.
+ *
+ * @function Client:get_state
+ * @treturn number
+ */
+int client_get_state(lua_State*);
+
+/** Registers a callback function as event handler.
+ *
+ * Works like @{Context:subscribe}. Events are received once by the serving process and broadcast to all
+ * clients that are interested in them.
+ *
+ * @function Client:subscribe
+ * @tparam function cb
+ * @treturn number The subscription ID.
+ */
+int client_subscribe(lua_State*);
+
+/** Removes an event handler subscription.
+ *
+ * @function Client:unsubscribe
+ * @tparam number|function handler The handler to remove.
+ */
+int client_unsubscribe(lua_State*);
+
+/** Sets which events are passed to the event callbacks.
+ *
+ * @function Client:set_subscription_mask
+ * @tparam number mask
+ */
+int client_set_subscription_mask(lua_State*);
+
+int client__index(lua_State*);
+int client__gc(lua_State*);
+
+
+static const struct luaL_Reg client_f[] = {
+    {"connect",                client_connect              },
+    { "disconnect",            client_disconnect           },
+    { "get_state",             client_get_state            },
+    { "subscribe",             client_subscribe            },
+    { "unsubscribe",           client_unsubscribe          },
+    { "set_subscription_mask", client_set_subscription_mask},
+    { NULL,                    NULL                        }
+};
+
+
+static const struct luaL_Reg client_mt[] = {
+    {"__index", client__index},
+    { "__gc",   client__gc   },
+    { NULL,     NULL         }
+};
+
+
+static const struct luaL_Reg client_lib[] = {
+    {"new", client_new},
+    { NULL, NULL      }
+};
@@ -1,17 +1,61 @@
 #include "context.h"
 
-#include "pulseaudio.h"
+#include "adjust.h"
 #include "lua_util.h"
+#include "meter.h"
+#include "mirror.h"
+#include "operation.h"
+#include "pulseaudio.h"
+#include "snapshot.h"
 
 #include <pulse/context.h>
 #include <pulse/error.h>
 #include <pulse/subscribe.h>
 
 
+static void context_schedule_reconnect(lua_pa_context*);
+
+
 /* Calls the user-provided callback with the updated state info.
  */
 void context_state_callback(pa_context* c, void* userdata) {
-    simple_callback_data* data = (simple_callback_data*) userdata;
+    lua_pa_context* ctx = (lua_pa_context*) userdata;
+    simple_callback_data* data = ctx->state_callback_data;
+
+    pa_context_state_t state = pa_context_get_state(c);
+    if (state == PA_CONTEXT_READY) {
+        ctx->reconnect_attempt = 0;
+
+        // Subscriptions don't survive a reconnect, so they have to be sent every time.
+        ctx->applied_mask = PA_SUBSCRIPTION_MASK_NULL;
+        context_apply_subscription(ctx);
+
+        // A graph that was tracked before the connection was lost needs to catch up.
+        if (ctx->mirror != NULL && ctx->mirror->tracking && ctx->mirror->stale) {
+            graph_resync(ctx);
+        }
+
+        for (guint i = 0; ctx->meters != NULL && i < ctx->meters->len; ++i) {
+            meter_handle_state(g_ptr_array_index(ctx->meters, i), state);
+        }
+    } else if (state == PA_CONTEXT_FAILED || state == PA_CONTEXT_TERMINATED) {
+        // Queries that are still in flight won't be answered anymore.
+        if (ctx->sync != NULL) {
+            graph_sync_abort(ctx->sync, "connection lost");
+        }
+
+        if (ctx->mirror != NULL) {
+            ctx->mirror->stale = true;
+        }
+
+        volume_adjust_abort_all(ctx, "connection lost");
+        operation_engine_cancel_all(ctx->operations, "connection lost");
+
+        for (guint i = 0; ctx->meters != NULL && i < ctx->meters->len; ++i) {
+            meter_handle_state(g_ptr_array_index(ctx->meters, i), state);
+        }
+    }
+
     luaL_checktype(data->L, 1, LUA_TFUNCTION);
     // `lua_call` will pop the function and arguments from the stack, but this callback will likely be called
     // multiple times.
@@ -19,37 +63,168 @@ void context_state_callback(pa_context* c, void* userdata) {
     lua_pushvalue(data->L, 1);
     // This can't really fail, but for consistency, we keep the error value.
     lua_pushnil(data->L);
-
-    pa_context_state_t state = pa_context_get_state(c);
     lua_pushinteger(data->L, state);
 
     lua_call(data->L, 2, 0);
+
+    if ((state == PA_CONTEXT_FAILED || state == PA_CONTEXT_TERMINATED) && ctx->reconnect.enabled
+        && !ctx->disconnecting) {
+        context_schedule_reconnect(ctx);
+    }
 }
 
 
-/* Calls the user-prodivded event callbacks.
+/* Calls the user-provided event callbacks.
+ *
+ * This is called by the context's dispatcher, which may defer it to a later main loop iteration.
+ */
+void context_dispatch_event(void* userdata, uint32_t event_type, uint32_t index) {
+    lua_pa_context* ctx = (lua_pa_context*) userdata;
+    lua_State* L = ctx->event_callback_data->L;
+
+    // Events may have been subscribed to for internal use only.
+    uint32_t facility = event_type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    if ((ctx->subscription_mask & (1U << facility)) == 0) {
+        return;
+    }
+
+    // The context userdata itself, kept in a weak table. It stays on the thread's stack until all callbacks ran:
+    // a callback may drop the last reference to it, and collecting it would free the thread and the callbacks
+    // while we're still iterating them.
+    lua_rawgeti(L, 2, 1);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return;
+    }
+    int ctx_index = lua_gettop(L);
+
+    // The list of callbacks may change while we're calling them, so we need to check the length every time.
+    for (size_t i = 1; i <= lua_rawlen(L, 1); ++i) {
+        lua_rawgeti(L, 1, i);
+        if (!lua_isfunction(L, -1)) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        lua_pushvalue(L, ctx_index);
+        lua_pushinteger(L, event_type);
+        lua_pushinteger(L, index);
+
+        lua_call(L, 3, 0);
+    }
+
+    lua_pop(L, 1);
+}
+
+
+/* Receives events from libpulse and queues them for the user-provided event callbacks.
  */
 void context_event_callback(pa_context* c, pa_subscription_event_type_t event_type, uint32_t index, void* userdata) {
-    simple_callback_data* data = (simple_callback_data*) userdata;
-    lua_State* L = data->L;
+    lua_pa_context* ctx = (lua_pa_context*) userdata;
 
-    luaL_checktype(L, 1, LUA_TFUNCTION);
-    luaL_checkudata(L, 2, LUA_PA_CONTEXT);
+    if (ctx->mirror != NULL && ctx->mirror->tracking) {
+        mirror_handle_event(ctx->mirror, c, event_type, index);
+    }
 
-    // `lua_call` will pop the function and arguments from the stack, but this callback will likely be called
-    // multiple times.
-    // To preseve the values for future calls, we need to duplicate them.
-    lua_pushvalue(L, 1);
-    lua_pushvalue(L, 2);
-    lua_pushinteger(L, event_type);
-    lua_pushinteger(L, index);
+    for (guint i = 0; ctx->meters != NULL && i < ctx->meters->len; ++i) {
+        meter_handle_event(g_ptr_array_index(ctx->meters, i), event_type, index);
+    }
 
-    lua_call(L, 3, 0);
+    dispatcher_push(ctx->dispatcher, context_dispatch_event, ctx, event_type, index);
 }
 
 
-int context_new(lua_State* L, pa_mainloop_api* pa_api) {
-    const char* name = luaL_checkstring(L, -1);
+void context_apply_subscription(lua_pa_context* ctx) {
+    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
+        return;
+    }
+
+    pa_subscription_mask_t mask = PA_SUBSCRIPTION_MASK_NULL;
+
+    if (lua_rawlen(ctx->event_callback_data->L, 1) > 0) {
+        mask |= ctx->subscription_mask;
+    }
+
+    if (ctx->mirror != NULL && ctx->mirror->tracking) {
+        mask |= MIRROR_SUBSCRIPTION_MASK;
+    }
+
+    for (guint i = 0; ctx->meters != NULL && i < ctx->meters->len; ++i) {
+        if (((meter*) g_ptr_array_index(ctx->meters, i))->automatic) {
+            mask |= PA_SUBSCRIPTION_MASK_SINK_INPUT;
+        }
+    }
+
+    if (mask == ctx->applied_mask) {
+        return;
+    }
+
+    pa_operation* op = pa_context_subscribe(ctx->context, mask, NULL, NULL);
+    if (op != NULL) {
+        pa_operation_unref(op);
+        ctx->applied_mask = mask;
+    }
+}
+
+
+// Replaces a failed or terminated `pa_context` with a new one. The old one can't be connected again.
+static bool context_replace(lua_pa_context* ctx) {
+    pa_context* c = pa_context_new(ctx->api, ctx->name);
+    if (c == NULL) {
+        return false;
+    }
+
+    pa_context_set_state_callback(ctx->context, NULL, NULL);
+    pa_context_set_subscribe_callback(ctx->context, NULL, NULL);
+    pa_context_unref(ctx->context);
+
+    ctx->context = c;
+    ctx->connected = false;
+    ctx->applied_mask = PA_SUBSCRIPTION_MASK_NULL;
+    pa_context_set_state_callback(c, context_state_callback, ctx);
+    pa_context_set_subscribe_callback(c, context_event_callback, ctx);
+
+    return true;
+}
+
+
+static gboolean context_reconnect(gpointer userdata) {
+    lua_pa_context* ctx = (lua_pa_context*) userdata;
+    ctx->reconnect_id = 0;
+    ctx->reconnect_attempt++;
+
+    // This is done here, rather than in the state callback, as libpulse doesn't expect the context
+    // to be freed from within its own callback.
+    if (!context_replace(ctx) || pa_context_connect(ctx->context, ctx->server, ctx->flags, NULL) < 0) {
+        context_schedule_reconnect(ctx);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+
+static void context_schedule_reconnect(lua_pa_context* ctx) {
+    if (ctx->reconnect_id != 0) {
+        return;
+    }
+
+    const reconnect_config* config = &ctx->reconnect;
+    double delay = config->min_delay;
+    for (uint32_t i = 0; i < ctx->reconnect_attempt && delay < config->max_delay; ++i) {
+        delay *= config->multiplier;
+    }
+
+    if (delay > config->max_delay) {
+        delay = config->max_delay;
+    }
+
+    delay *= 1.0 + g_random_double_range(-config->jitter, config->jitter);
+    ctx->reconnect_id = g_timeout_add(delay > 0 ? (guint) delay : 0, context_reconnect, ctx);
+}
+
+
+int context_new(lua_State* L, pa_mainloop_api* pa_api, const dispatch_config* config) {
+    const char* name = luaL_checkstring(L, 2);
     // TODO: libpulse recommends using `new_with_proplist` instead. But I need to figure out that `proplist` first.
     pa_context* ctx = pa_context_new(pa_api, name);
     if (ctx == NULL) {
@@ -60,13 +235,45 @@ int context_new(lua_State* L, pa_mainloop_api* pa_api) {
     if (lgi_ctx == NULL) {
         return luaL_error(L, "failed to create context userdata");
     }
+    int ctx_index = lua_gettop(L);
+
     lgi_ctx->context = ctx;
     lgi_ctx->connected = FALSE;
     lgi_ctx->state_callback_data = prepare_lua_callback(L, 0);
     lgi_ctx->event_callback_data = prepare_lua_callback(L, 0);
+    lgi_ctx->dispatcher = dispatcher_new(config);
+    lgi_ctx->subscription_mask = PA_SUBSCRIPTION_MASK_ALL;
+    lgi_ctx->applied_mask = PA_SUBSCRIPTION_MASK_NULL;
+    lgi_ctx->mirror = NULL;
+    lgi_ctx->sync = NULL;
+    lgi_ctx->publisher = NULL;
+    lgi_ctx->meters = NULL;
+    lgi_ctx->api = pa_api;
+    lgi_ctx->name = g_strdup(name);
+    lgi_ctx->server = NULL;
+    lgi_ctx->flags = PA_CONTEXT_NOAUTOSPAWN;
+    lgi_ctx->reconnect.enabled = false;
+    lgi_ctx->reconnect_id = 0;
+    lgi_ctx->reconnect_attempt = 0;
+    lgi_ctx->disconnecting = false;
+    lgi_ctx->adjustments = NULL;
+    lgi_ctx->operations = operation_engine_new(lgi_ctx);
+
+    lua_State* event_L = lgi_ctx->event_callback_data->L;
 
     // Create the table used to store the subscription callbacks.
-    lua_newtable(lgi_ctx->event_callback_data->L);
+    lua_newtable(event_L);
+
+    // The event callbacks receive the context as parameter. To not keep the context alive forever through
+    // the thread's registry reference, it is stored in a table with weak values.
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, ctx_index);
+    lua_rawseti(L, -2, 1);
+    lua_xmove(L, event_L, 1);
 
     luaL_getmetatable(L, LUA_PA_CONTEXT);
     lua_setmetatable(L, -2);
@@ -78,9 +285,16 @@ int context_new(lua_State* L, pa_mainloop_api* pa_api) {
 int context__gc(lua_State* L) {
     lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
 
-    if (ctx->connected == TRUE) {
-        pa_context_disconnect(ctx->context);
-        ctx->connected = 0;
+    // Make sure libpulse doesn't call into any of the data we're about to free.
+    // Disconnecting also cancels all pending operations.
+    pa_context_set_state_callback(ctx->context, NULL, NULL);
+    pa_context_set_subscribe_callback(ctx->context, NULL, NULL);
+    pa_context_disconnect(ctx->context);
+    ctx->connected = false;
+
+    if (ctx->reconnect_id != 0) {
+        g_source_remove(ctx->reconnect_id);
+        ctx->reconnect_id = 0;
     }
 
     if (ctx->state_callback_data != NULL) {
@@ -91,7 +305,51 @@ int context__gc(lua_State* L) {
         free_lua_callback(ctx->event_callback_data);
     }
 
+    if (ctx->dispatcher != NULL) {
+        dispatcher_free(ctx->dispatcher);
+        ctx->dispatcher = NULL;
+    }
+
+    if (ctx->sync != NULL) {
+        graph_sync_free(ctx->sync);
+        ctx->sync = NULL;
+    }
+
+    if (ctx->meters != NULL) {
+        // Queries in flight were cancelled by the disconnect.
+        while (ctx->meters->len > 0) {
+            meter* m = g_ptr_array_index(ctx->meters, 0);
+            meter_handle_state(m, PA_CONTEXT_TERMINATED);
+            meter_close(m);
+        }
+        g_ptr_array_free(ctx->meters, TRUE);
+        ctx->meters = NULL;
+    }
+
+    if (ctx->adjustments != NULL) {
+        volume_adjust_abort_all(ctx, "context closed");
+        g_hash_table_destroy(ctx->adjustments);
+        ctx->adjustments = NULL;
+    }
+
+    if (ctx->operations != NULL) {
+        operation_engine_free(ctx->operations);
+        ctx->operations = NULL;
+    }
+
+    if (ctx->publisher != NULL) {
+        snapshot_publisher_free(ctx->publisher);
+        ctx->publisher = NULL;
+    }
+
+    if (ctx->mirror != NULL) {
+        mirror_free(ctx->mirror);
+        ctx->mirror = NULL;
+    }
+
     pa_context_unref(ctx->context);
+    g_free(ctx->name);
+    g_free(ctx->server);
     return 0;
 }
 
@@ -127,8 +385,25 @@ int context_connect(lua_State* L) {
     lua_pushvalue(L, 3);
     lua_xmove(L, ctx->state_callback_data->L, 1);
 
-    pa_context_set_state_callback(ctx->context, context_state_callback, ctx->state_callback_data);
-    pa_context_set_subscribe_callback(ctx->context, context_event_callback, ctx->event_callback_data);
+    // Keep the parameters around for reconnects.
+    g_free(ctx->server);
+    ctx->server = g_strdup(server);
+    ctx->flags = flags;
+    ctx->disconnecting = false;
+
+    if (ctx->reconnect_id != 0) {
+        g_source_remove(ctx->reconnect_id);
+        ctx->reconnect_id = 0;
+    }
+
+    // A context that has failed or was disconnected can't be connected again.
+    pa_context_state_t state = pa_context_get_state(ctx->context);
+    if ((state == PA_CONTEXT_FAILED || state == PA_CONTEXT_TERMINATED) && !context_replace(ctx)) {
+        return luaL_error(L, "failed to create pulseaudio context");
+    }
+
+    pa_context_set_state_callback(ctx->context, context_state_callback, ctx);
+    pa_context_set_subscribe_callback(ctx->context, context_event_callback, ctx);
 
     // TODO: Check if I need to create bindings for `pa_spawn_api`.
     int ret = pa_context_connect(ctx->context, server, flags, NULL);
@@ -142,54 +417,80 @@ int context_connect(lua_State* L) {
 
 int context_disconnect(lua_State* L) {
     lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+
+    ctx->disconnecting = true;
+    if (ctx->reconnect_id != 0) {
+        g_source_remove(ctx->reconnect_id);
+        ctx->reconnect_id = 0;
+    }
+
     pa_context_disconnect(ctx->context);
     return 0;
 }
 
 
-int context_get_state(lua_State* L) {
+int context_set_reconnect(lua_State* L) {
     lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    pa_context_state_t state = pa_context_get_state(ctx->context);
-    lua_pushinteger(L, state);
-    return 1;
-}
-
+    reconnect_config config = {
+        .enabled = true,
+        .min_delay = 100,
+        .max_delay = 30000,
+        .multiplier = 2.0,
+        .jitter = 0.2,
+    };
 
-int context_set_default_sink(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
+    switch (lua_type(L, 2)) {
+    case LUA_TBOOLEAN: {
+        config.enabled = lua_toboolean(L, 2);
+        break;
+    }
+    case LUA_TTABLE: {
+        lua_getfield(L, 2, "min_delay");
+        config.min_delay = (uint32_t) luaL_optinteger(L, -1, config.min_delay);
+        lua_getfield(L, 2, "max_delay");
+        config.max_delay = (uint32_t) luaL_optinteger(L, -1, config.max_delay);
+        lua_getfield(L, 2, "multiplier");
+        config.multiplier = luaL_optnumber(L, -1, config.multiplier);
+        lua_getfield(L, 2, "jitter");
+        config.jitter = luaL_optnumber(L, -1, config.jitter);
+        lua_pop(L, 4);
+
+        luaL_argcheck(L, config.min_delay <= config.max_delay, 2, "min_delay must not be larger than max_delay");
+        luaL_argcheck(L, config.multiplier >= 1.0, 2, "multiplier must be at least 1");
+        luaL_argcheck(L, config.jitter >= 0.0 && config.jitter < 1.0, 2, "jitter must be in [0, 1)");
+        break;
+    }
+    default: {
+        return luaL_argerror(L, 2, "expected table or boolean");
+    }
+    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 3);
+    ctx->reconnect = config;
 
-    pa_operation* op = pa_context_set_default_sink(ctx->context, name, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set default sink: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
+    if (!config.enabled && ctx->reconnect_id != 0) {
+        g_source_remove(ctx->reconnect_id);
+        ctx->reconnect_id = 0;
     }
 
     return 0;
 }
 
 
-int context_set_default_source(lua_State* L) {
+int context_get_state(lua_State* L) {
     lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
+    pa_context_state_t state = pa_context_get_state(ctx->context);
+    lua_pushinteger(L, state);
+    return 1;
+}
 
-    simple_callback_data* data = prepare_lua_callback(L, 3);
 
-    pa_operation* op = pa_context_set_default_source(ctx->context, name, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set default source: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
+int context_set_default_sink(lua_State* L) {
+    return operation_run(L, OPERATION_SET_DEFAULT_SINK);
+}
 
-    return 0;
+
+int context_set_default_source(lua_State* L) {
+    return operation_run(L, OPERATION_SET_DEFAULT_SOURCE);
 }
 
 
@@ -203,6 +504,8 @@ int context_subscribe(lua_State* L) {
     lua_xmove(L, ctx->event_callback_data->L, 1);
     lua_rawseti(ctx->event_callback_data->L, 1, pos);
 
+    context_apply_subscription(ctx);
+
     lua_pushinteger(L, pos);
     return 1;
 }
@@ -225,19 +528,17 @@ int context_unsubscribe(lua_State* L) {
     }
     case LUA_TFUNCTION: {
         bool found = false;
-        size_t i = 0;
 
         // Duplicate the function value, so we can move it other to the other thread for comparing
-        lua_pushvalue(L, -1);
+        lua_pushvalue(L, 2);
         lua_xmove(L, thread_L, 1);
         int fn_index = lua_gettop(thread_L);
 
-        lua_pushnil(L);
+        lua_pushnil(thread_L);
         while (lua_next(thread_L, 1) != 0) {
-            ++i;
-
             if (lua_equal(thread_L, -1, fn_index) == 1) {
-                pos = i;
+                pos = lua_tointeger(thread_L, -2);
+                found = true;
                 lua_pop(thread_L, 2);
                 break;
             }
@@ -246,6 +547,9 @@ int context_unsubscribe(lua_State* L) {
             lua_pop(thread_L, 1);
         }
 
+        // Remove the duplicated function
+        lua_pop(thread_L, 1);
+
         if (!found) {
             return luaL_error(L, "couldn't find this function in the list of subscriptions");
         }
@@ -264,5 +568,64 @@ int context_unsubscribe(lua_State* L) {
     lua_pushnil(thread_L);
     lua_rawseti(thread_L, 1, len);
 
+    context_apply_subscription(ctx);
+
+    return 0;
+}
+
+
+int context_set_subscription_mask(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    lua_Integer mask = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, (mask & ~PA_SUBSCRIPTION_MASK_ALL) == 0, 2, "invalid subscription mask");
+
+    ctx->subscription_mask = (pa_subscription_mask_t) mask;
+    context_apply_subscription(ctx);
+
+    return 0;
+}
+
+
+int context_get_dispatch_stats(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    dispatch_stats_to_lua(L, ctx->dispatcher);
+    return 1;
+}
+
+
+int context_set_dispatch_options(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    dispatch_config config = ctx->dispatcher->config;
+    dispatch_config_from_lua(L, 2, &config);
+    dispatcher_set_config(ctx->dispatcher, &config);
+
+    return 0;
+}
+
+
+int context_get_operation_stats(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    operation_stats_to_lua(L, ctx->operations);
+    return 1;
+}
+
+
+int context_set_operation_options(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    operation_config config = ctx->operations->config;
+    operation_config_from_lua(L, 2, &config);
+    operation_engine_set_config(ctx->operations, &config);
+
+    return 0;
+}
+
+
+int context_cancel_operations(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    operation_engine_cancel_all(ctx->operations, "cancelled");
     return 0;
 }
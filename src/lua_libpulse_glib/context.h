@@ -11,25 +11,86 @@
 #pragma once
 
 #include "callback.h"
+#include "dispatch.h"
 
 #include <lauxlib.h>
 #include <lua.h>
 #include <pulse/context.h>
 #include <pulse/mainloop-api.h>
+#include <pulse/subscribe.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define LUA_PA_CONTEXT "pulseaudio.context"
 
 
+// Settings for automatic reconnects. Delays are in milliseconds.
+typedef struct reconnect_config {
+    bool enabled;
+    uint32_t min_delay;
+    uint32_t max_delay;
+    double multiplier;
+    // The fraction by which each delay is randomly varied, so that many clients don't reconnect
+    // at the same time.
+    double jitter;
+} reconnect_config;
+
+
 typedef struct lua_pa_context {
     pa_context* context;
     bool connected;
     simple_callback_data* state_callback_data;
     simple_callback_data* event_callback_data;
+    // Schedules calls to the subscription callbacks on the main loop.
+    dispatcher* dispatcher;
+    // The events the user-provided callbacks are interested in.
+    pa_subscription_mask_t subscription_mask;
+    // The mask that was last sent to the server.
+    pa_subscription_mask_t applied_mask;
+    // The C-side copy of the server's audio graph. `NULL` until it is loaded or synced.
+    struct mirror* mirror;
+    // A running `Context:sync_graph` operation.
+    struct graph_sync* sync;
+    // Publishes the mirror to shared memory, while enabled with `Context:publish_graph`.
+    struct snapshot_publisher* publisher;
+    // The peak meters created with `Context:new_meter`, as `struct meter*`. `NULL` until the first one.
+    GPtrArray* meters;
+
+    // The parameters the context was created and connected with, to create a new one when reconnecting.
+    pa_mainloop_api* api;
+    char* name;
+    char* server;
+    pa_context_flags_t flags;
+    reconnect_config reconnect;
+    // The ID of the timeout for the next reconnect attempt, if any.
+    guint reconnect_id;
+    uint32_t reconnect_attempt;
+    // Set by `Context:disconnect`, so that a deliberate disconnect doesn't trigger a reconnect.
+    bool disconnecting;
+    // The running `Context:adjust_*_volume` changes, as `struct volume_adjust*` by object. `NULL` until the first.
+    GHashTable* adjustments;
+    // Sends and tracks the introspection requests, such as `Context:get_sinks`.
+    struct operation_engine* operations;
 } lua_pa_context;
 
 
-int context_new(lua_State*, pa_mainloop_api*);
+int context_new(lua_State*, pa_mainloop_api*, const dispatch_config*);
+
+// Sends the subscription mask to the server, combining the user's mask with the events
+// needed internally. Does nothing when the connection is not ready.
+void context_apply_subscription(lua_pa_context*);
+
+// Calls the subscription callbacks for an event. Used by the dispatcher.
+void context_dispatch_event(void*, uint32_t, uint32_t);
+
+void graph_sync_free(struct graph_sync*);
+
+// Fails a running `Context:sync_graph`, e.g. when the connection is lost and its queries won't be answered.
+void graph_sync_abort(struct graph_sync*, const char*);
+
+// Reconciles the mirror with the server after a reconnect. Instead of a list of changes, the differences
+// are reported to the subscription callbacks as regular events.
+void graph_resync(lua_pa_context*);
 int context__gc(lua_State*);
 
 /// Callback Functions
@@ -76,11 +137,33 @@ int context__gc(lua_State*);
 int context_connect(lua_State*);
 
 /** Disconnects from the server.
+ *
+ * This also stops any automatic reconnects.
  *
  * @function Context:disconnect
  */
 int context_disconnect(lua_State*);
 
+/** Enables or disables automatic reconnects.
+ *
+ * When the connection fails, e.g. because the server restarted, a new connection is attempted after a delay.
+ * The delay starts at `min_delay` and grows by `multiplier` after every failed attempt, up to `max_delay`.
+ * Each delay is varied randomly by up to `jitter` (a fraction of the delay).
+ *
+ * Once connected again, the subscription mask is sent again and all event callbacks stay registered.
+ * If the audio graph is tracked (see @{Context:sync_graph}), it is reconciled with a single round trip, and
+ * the differences are delivered to the event callbacks as regular `new`, `change` and `remove` events.
+ *
+ * The state callback passed to @{Context:connect} sees every state change, including the failure and the
+ * new connection.
+ *
+ * @function Context:set_reconnect
+ * @tparam table|boolean opts `false` to disable, `true` for the defaults, or a table with the fields
+ *  `min_delay` (milliseconds, default `100`), `max_delay` (milliseconds, default `30000`),
+ *  `multiplier` (default `2`) and `jitter` (default `0.2`).
+ */
+int context_set_reconnect(lua_State*);
+
 /** Returns the current connection state.
  *
  * @function Context:get_state
@@ -95,6 +178,9 @@ int context_get_state(lua_State*);
  * Any number of callbacks may be registered at the same time, and can be unscubscribed with
  * @{Context:unsubscribe}, using the returned subscription ID.
  *
+ * Which events are received can be configured with @{Context:set_subscription_mask}. By default, all events
+ * are subscribed to.
+ *
  * @function Context:subscribe
  * @tparam function cb
  * @treturn number The subscription ID.
@@ -110,6 +196,263 @@ int context_subscribe(lua_State*);
  */
 int context_unsubscribe(lua_State*);
 
+/** Sets which events are passed to the event callbacks.
+ *
+ * The mask is a combination of the `PA_SUBSCRIPTION_MASK_*` flags from libpulse. It is sent to the server
+ * once the connection is ready, and again after every reconnect.
+ *
+ * @function Context:set_subscription_mask
+ * @tparam number mask
+ */
+int context_set_subscription_mask(lua_State*);
+
+/** Returns statistics about how event callbacks have been dispatched.
+ *
+ * Latencies are measured in microseconds, from the moment an event was received from the server until its
+ * callbacks were called. This can be used to tune the budget set with @{Context:set_dispatch_options}.
+ *
+ * @function Context:get_dispatch_stats
+ * @treturn table A table with the fields `dispatched`, `deferred`, `pending`, `priority`, `latency_last`,
+ *  `latency_min`, `latency_max` and `latency_avg`.
+ */
+int context_get_dispatch_stats(lua_State*);
+
+/** Changes the dispatch options for event callbacks.
+ *
+ * Accepts the same options as @{lua_libpulse_glib.new}. Options that are not present in the table keep their
+ * current value.
+ *
+ * @function Context:set_dispatch_options
+ * @tparam table opts
+ */
+int context_set_dispatch_options(lua_State*);
+
+/** Returns statistics about the introspection requests, such as @{Context:get_sinks} or
+ * @{Context:set_sink_mute}.
+ *
+ * The `operations` field holds a table for every method that has been called, with the fields `started`,
+ * `completed`, `failed`, `cancelled`, `latency_avg` and `latency_max`. Latencies are measured in microseconds,
+ * from sending the request until the server's reply.
+ *
+ * @function Context:get_operation_stats
+ * @treturn table A table with the fields `in_flight`, `queued`, `pooled`, `max_in_flight`, `pool_size` and
+ *  `operations`.
+ */
+int context_get_operation_stats(lua_State*);
+
+/** Changes how introspection requests are sent.
+ *
+ * - `max_in_flight`: The number of requests that may wait for the server at the same time. Further requests are
+ *   queued and sent in order as replies arrive. `0`, the default, means unlimited.
+ * - `pool_size`: The number of finished requests whose Lua thread is kept for reuse. Defaults to `8`.
+ *
+ * Options that are not present in the table keep their current value.
+ *
+ * @function Context:set_operation_options
+ * @tparam table opts
+ */
+int context_set_operation_options(lua_State*);
+
+/** Cancels all introspection requests that are queued or waiting for the server.
+ *
+ * Their callbacks are called with the error `"cancelled"`. The server may still apply changes it has already
+ * received.
+ *
+ * @function Context:cancel_operations
+ */
+int context_cancel_operations(lua_State*);
+
+
+/// Audio Graph Cache
+/// @section graph
+
+/** Loads a previously saved audio graph from a file.
+ *
+ * This makes the last known state of sinks, sources, streams and default devices available immediately,
+ * without a connection to the server. The loaded graph is marked as `stale` until it has been reconciled
+ * with @{Context:sync_graph}.
+ *
+ * @function Context:load_graph
+ * @tparam[opt] string path The cache file. Defaults to a file in `$XDG_RUNTIME_DIR`.
+ * @treturn[opt] table The graph, as returned by @{Context:get_graph}.
+ * @treturn[opt] string The error message.
+ */
+int context_load_graph(lua_State*);
+
+/** Writes the current audio graph to a file.
+ *
+ * @function Context:save_graph
+ * @tparam[opt] string path The cache file. Defaults to a file in `$XDG_RUNTIME_DIR`.
+ * @treturn[opt] boolean
+ * @treturn[opt] string The error message.
+ */
+int context_save_graph(lua_State*);
+
+/** Returns the current audio graph.
+ *
+ * The table has the fields `stale`, `default_sink_name`, `default_source_name`, `sinks`, `sources`,
+ * `sink_inputs` and `source_outputs`. Each entry has the fields `index`, `name`, `description`, `volume`
+ * and `mute`. Streams also have a `parent` field with the index of their sink or source.
+ *
+ * @function Context:get_graph
+ * @treturn table|nil The graph, or `nil` if it has neither been loaded nor synced.
+ */
+int context_get_graph(lua_State*);
+
+/** Reconciles the audio graph with the server.
+ *
+ * All list queries are sent at once. When they have all returned, the callback receives a list of the
+ * differences to the previous graph, e.g. a loaded cache file. Each change is a table with the fields
+ * `kind` (`"sink"`, `"source"`, `"sink_input"`, `"source_output"` or `"server"`), `change`
+ * (`"new"`, `"change"` or `"remove"`) and `entry`.
+ *
+ * Afterwards, the graph is kept up to date with server events, until the context is disconnected.
+ *
+ * @function Context:sync_graph
+ * @async
+ * @tparam function cb
+ * @treturn[opt] string The error message.
+ * @treturn table The list of changes.
+ */
+int context_sync_graph(lua_State*);
+
+/** Publishes the audio graph to shared memory.
+ *
+ * The graph is written to a memory-mapped file and updated whenever it changes, at most once per main loop
+ * iteration. Other processes can read it with @{lua_libpulse_glib.snapshot}, without a connection of their own.
+ *
+ * Publishing starts with the current graph, so this is usually combined with @{Context:sync_graph}.
+ *
+ * @function Context:publish_graph
+ * @tparam[opt] string path The shared file. Defaults to a file in `$XDG_RUNTIME_DIR`.
+ * @treturn[opt] boolean
+ * @treturn[opt] string The error message.
+ */
+int context_publish_graph(lua_State*);
+
+/** Stops publishing the audio graph.
+ *
+ * The shared file is kept and marked as inactive, so that readers can continue to use it once a new
+ * publisher takes over.
+ *
+ * @function Context:unpublish_graph
+ */
+int context_unpublish_graph(lua_State*);
+
+
+/** Shares this context with other processes.
+ *
+ * Listens on a Unix socket for clients created with @{lua_libpulse_glib.client}. Their method calls are
+ * forwarded to this context, and events are broadcast to them, so that any number of processes can use
+ * a single connection to the server.
+ *
+ * Only queries, such as @{Context:get_sinks}, and commands that change the server's state, such as
+ * @{Context:set_sink_volume}, are forwarded. Methods that manage the connection, create streams or read and
+ * write local files are not available to clients.
+ *
+ * The returned @{lua_libpulse_glib.proxy.Server} keeps the context alive until it is closed.
+ *
+ * @function Context:serve
+ * @tparam[opt] string path The socket path. Defaults to a file in `$XDG_RUNTIME_DIR`.
+ * @treturn[opt] Server
+ * @treturn[opt] string The error message.
+ */
+int context_serve(lua_State*);
+
+
+/** Creates a peak meter for sink inputs.
+ *
+ * The meter opens a record stream for each sink input it monitors, on the monitor source of the input's
+ * sink. The server does the peak detection and sends `rate` values per second. Instead of one callback
+ * per stream and value, the highest peak of each stream is collected and all of them are passed to the
+ * callback once every `interval`.
+ *
+ * The callback receives a flat list of pairs, `{ index1, level1, index2, level2, ... }`, where each
+ * level is a number between `0` and `1`. The same table is reused for every call, so it should not be
+ * kept around.
+ *
+ * With `automatic` set, sink inputs are added and removed as they appear on the server, and streams
+ * follow inputs that move to a different sink.
+ *
+ * @function Context:new_meter
+ * @tparam[opt] table opts
+ * @tparam[opt=25] number opts.rate The number of peak values per second the server sends for each stream.
+ * @tparam[opt=40] number opts.interval The time between callback calls, in milliseconds.
+ * @tparam[opt=true] boolean opts.automatic Whether to monitor all sink inputs.
+ * @tparam function cb
+ * @treturn Meter
+ */
+int context_new_meter(lua_State*);
+
+
+/** Creates a new stream.
+ *
+ * @function Context:new_stream
+ * @tparam string name The stream's name, as shown in volume controls.
+ * @tparam table spec The sample spec.
+ * @tparam string|number spec.format A format name like `"s16le"` or `"float32ne"`, or a `PA_SAMPLE_*` value.
+ * @tparam number spec.rate The sample rate.
+ * @tparam number spec.channels The number of channels.
+ * @tparam[opt] Proplist proplist Additional stream properties, like `media.role`.
+ * @treturn Stream
+ */
+int context_new_stream(lua_State*);
+
+
+/** Records from a source straight into a file.
+ *
+ * The data never passes through Lua. It is written as raw PCM or WAV, in batches, using asynchronous GIO
+ * writes. When `max_bytes` or `max_seconds` is set, a new file is started whenever the current one reaches
+ * that size. WAV files are always rotated before they reach 4 GiB.
+ *
+ * The callback receives progress reports after every batch written, and a final report with `finished` set
+ * once a file has been closed. On errors, it receives the error message instead, and recording stops.
+ *
+ * @function Context:record_to_file
+ * @tparam string path The file to write. May contain `%d` for the file number, when rotating.
+ * @tparam table opts
+ * @tparam[opt] string opts.device The source's name. Defaults to the default source.
+ * @tparam[opt] table opts.spec The sample spec, as for @{Context:new_stream}. Defaults to 44.1 kHz stereo `s16le`.
+ * @tparam[opt] string opts.container Either `"raw"` or `"wav"`. Defaults to `"wav"` for paths ending in `.wav`.
+ * @tparam[opt] number opts.max_bytes The maximum number of audio bytes per file.
+ * @tparam[opt] number opts.max_seconds The maximum duration per file.
+ * @tparam[opt=65536] number opts.batch_size The number of bytes collected before a write.
+ * @tparam[opt=1000] number opts.flush_interval How often partial batches are written, in milliseconds.
+ * @tparam[opt] number opts.latency The fragment latency in milliseconds.
+ * @tparam function cb
+ * @treturn[opt] Recorder
+ * @treturn[opt] string The error message.
+ */
+int context_record_to_file(lua_State*);
+
+
+/** Plays a WAV or raw PCM file.
+ *
+ * The file is memory-mapped and fed to a playback stream from C, in copies of the stream's `minreq`.
+ * Lua is not involved while the file plays. Raw files need a sample spec, WAV files use the one from
+ * their header.
+ *
+ * The @{Player} stays alive until playback has finished or is stopped, so the return value may be ignored.
+ *
+ * @function Context:play_file
+ * @tparam string path
+ * @tparam[opt] table opts
+ * @tparam[opt] string opts.device The sink's name. Defaults to the default sink.
+ * @tparam[opt] table opts.spec The sample spec of a raw file, as for @{Context:new_stream}.
+ * @tparam[opt=0] number opts.offset The position to start at, in seconds.
+ * @tparam[opt=false] boolean|number opts.loop `true` to loop forever, or the number of times to play the file.
+ *  Loops start at the beginning of the file, not at `offset`.
+ * @tparam[opt] number opts.latency The target latency in milliseconds.
+ * @tparam[opt] number opts.tlength
+ * @tparam[opt] number opts.minreq
+ * @tparam[opt] number opts.prebuf
+ * @tparam[opt] number opts.flags A combination of `PA_STREAM_*` flags.
+ * @tparam[opt] function cb Called once playback has finished, or failed.
+ * @treturn[opt] Player
+ * @treturn[opt] string The error message.
+ */
+int context_play_file(lua_State*);
+
 
 /** Sets the default sink.
  *
@@ -141,6 +484,7 @@ int context_set_default_source(lua_State*);
  *
  * @function Context:get_server_info
  * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @return[opt] string The error
  * @return table The server info.
@@ -161,6 +505,7 @@ int context_get_server_info(lua_State*);
  * @function Context:get_sink_info
  * @async
  * @tparam number|string sink The index or name of the sink to query.
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
@@ -177,29 +522,53 @@ int context_get_sink_info(lua_State*);
  *
  * @function Context:get_sinks
  * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
  */
 int context_get_sink_info_list(lua_State*);
-int context_get_sink_info_by_name(lua_State*);
-int context_get_sink_info_by_index(lua_State*);
 
 /** Sets the sink's volume to the given value.
  *
  * The sink may be indicated by either its name or its index.
  *
+ * The volume may be a @{lua_libpulse_glib.volume.Volume}, a list of channel volumes, or a single number. A
+ * number is applied to all channels. While the graph mirror is tracked (see @{Context:sync_graph}), the number
+ * is sent for as many channels as the object has, otherwise as a single channel. A list may have at most 32
+ * entries.
+ *
  * @function Context:set_sink_volume
  * @async
  * @tparam number|string sink The sink to update.
- * @tparam Volume volume
- * @tparam function cb
+ * @tparam number|table|Volume volume
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_sink_volume(lua_State*);
-int context_set_sink_volume_by_name(lua_State*);
-int context_set_sink_volume_by_index(lua_State*);
+
+/** Changes the sink's volume relative to its current one.
+ *
+ * The delta is either a number in percent of normal volume, or a string like `"+5%"` or `"-3dB"`. Percent
+ * steps are added to the loudest channel with `pa_cvolume_inc_clamp` and `pa_cvolume_dec`, dB steps scale it.
+ * Either way, the balance between the channels is kept. A muted sink can only be raised with percent steps.
+ *
+ * The current volume is taken from the graph mirror while it's tracked (see @{Context:sync_graph}), so the
+ * change takes a single round trip. Otherwise it's queried first. Only one write per sink is in flight at a
+ * time, and changes made in the meantime are combined into the next one, so rapid key presses don't race each
+ * other.
+ *
+ * @function Context:adjust_sink_volume
+ * @async
+ * @tparam number|string sink The sink to update, by index or name.
+ * @tparam number|string delta
+ * @tparam[opt] function cb Called once the write that includes this change has completed.
+ * @tparam[opt=PA_VOLUME_NORM] number limit Increases stop at this volume.
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int context_adjust_sink_volume(lua_State*);
 
 /** Sets the sink's mute state.
  *
@@ -209,13 +578,11 @@ int context_set_sink_volume_by_index(lua_State*);
  * @async
  * @tparam number|string sink The sink to update.
  * @tparam boolean mute
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_sink_mute(lua_State*);
-int context_set_sink_mute_by_name(lua_State*);
-int context_set_sink_mute_by_index(lua_State*);
 
 /** Sets the sink's suspended state.
  *
@@ -225,13 +592,11 @@ int context_set_sink_mute_by_index(lua_State*);
  * @async
  * @tparam number|string sink The sink to update.
  * @tparam boolean suspended
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_sink_suspended(lua_State*);
-int context_set_sink_suspended_by_name(lua_State*);
-int context_set_sink_suspended_by_index(lua_State*);
 
 
 // Sink Inputs
@@ -246,6 +611,7 @@ int context_set_sink_suspended_by_index(lua_State*);
  * @function Context:get_sink_input_info
  * @async
  * @tparam number|string sink input The index or name of the sink input to query.
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
@@ -262,6 +628,7 @@ int context_get_sink_input_info(lua_State*);
  *
  * @function Context:get_sink_inputs
  * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
@@ -273,37 +640,48 @@ int context_get_sink_input_info_list(lua_State*);
  *
  * The target sink may be indicated by either its name or its index.
  *
- * @function Context:set_sink_suspended
+ * @function Context:move_sink_input
  * @async
- * @tparam number The sink input to move.
+ * @tparam number sink_input The sink input to move.
  * @tparam number|string sink The sink to update.
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_move_sink_input(lua_State*);
-int context_move_sink_input_by_name(lua_State*);
-int context_move_sink_input_by_index(lua_State*);
 
 /** Sets the sink input's volume to the given value.
  *
  * @function Context:set_sink_input_volume
  * @async
  * @tparam number sink_input The sink input to update.
- * @tparam Volume volume
- * @tparam function cb
+ * @tparam number|table|Volume volume See @{Context:set_sink_volume}.
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_sink_input_volume(lua_State*);
 
+/** Changes the sink input's volume relative to its current one, like @{Context:adjust_sink_volume}.
+ *
+ * @function Context:adjust_sink_input_volume
+ * @async
+ * @tparam number sink_input The sink input to update.
+ * @tparam number|string delta
+ * @tparam[opt] function cb
+ * @tparam[opt=PA_VOLUME_NORM] number limit
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int context_adjust_sink_input_volume(lua_State*);
+
 /** Sets the sink input's mute state.
  *
  * @function Context:set_sink_input_mute
  * @async
  * @tparam number sink_input The sink input to update.
  * @tparam boolean mute
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
@@ -314,7 +692,7 @@ int context_set_sink_input_mute(lua_State*);
  * @function Context:kill_sink_input
  * @async
  * @tparam number sink_input The sink input to kill.
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
@@ -333,6 +711,7 @@ int context_kill_sink_input(lua_State*);
  * @function Context:get_source_info
  * @async
  * @tparam number|string source The index or name of the source to query.
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
@@ -349,13 +728,12 @@ int context_get_source_info(lua_State*);
  *
  * @function Context:get_sources
  * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
  */
 int context_get_source_info_list(lua_State*);
-int context_get_source_info_by_name(lua_State*);
-int context_get_source_info_by_index(lua_State*);
 
 /** Sets the source's volume to the given value.
  *
@@ -364,14 +742,25 @@ int context_get_source_info_by_index(lua_State*);
  * @function Context:set_source_volume
  * @async
  * @tparam number|string source The source to update.
- * @tparam Volume volume
- * @tparam function cb
+ * @tparam number|table|Volume volume See @{Context:set_sink_volume}.
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_source_volume(lua_State*);
-int context_set_source_volume_by_name(lua_State*);
-int context_set_source_volume_by_index(lua_State*);
+
+/** Changes the source's volume relative to its current one, like @{Context:adjust_sink_volume}.
+ *
+ * @function Context:adjust_source_volume
+ * @async
+ * @tparam number|string source The source to update, by index or name.
+ * @tparam number|string delta
+ * @tparam[opt] function cb
+ * @tparam[opt=PA_VOLUME_NORM] number limit
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int context_adjust_source_volume(lua_State*);
 
 /** Sets the source's mute state.
  *
@@ -381,13 +770,11 @@ int context_set_source_volume_by_index(lua_State*);
  * @async
  * @tparam number|string source The source to update.
  * @tparam boolean mute
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_source_mute(lua_State*);
-int context_set_source_mute_by_name(lua_State*);
-int context_set_source_mute_by_index(lua_State*);
 
 /** Sets the source's suspended state.
  *
@@ -397,13 +784,11 @@ int context_set_source_mute_by_index(lua_State*);
  * @async
  * @tparam number|string source The source to update.
  * @tparam boolean suspended
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_source_suspended(lua_State*);
-int context_set_source_suspended_by_name(lua_State*);
-int context_set_source_suspended_by_index(lua_State*);
 
 
 // Source Outputs
@@ -416,6 +801,7 @@ int context_set_source_suspended_by_index(lua_State*);
  * @function Context:get_source_output_info
  * @async
  * @tparam number source_output The index of the source output to query.
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
@@ -432,6 +818,7 @@ int context_get_source_output_info(lua_State*);
  *
  * @function Context:get_source_outputs
  * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
  * @tparam function cb
  * @treturn[opt] string
  * @treturn table
@@ -442,17 +829,15 @@ int context_get_source_output_info_list(lua_State*);
  *
  * The target source may be indicated by either its name or its index.
  *
- * @function Context:set_source_suspended
+ * @function Context:move_source_output
  * @async
- * @tparam number The source output to move.
+ * @tparam number source_output The source output to move.
  * @tparam number|string source The source to update.
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_move_source_output(lua_State*);
-int context_move_source_output_by_name(lua_State*);
-int context_move_source_output_by_index(lua_State*);
 
 
 /** Sets the source output's volume to the given value.
@@ -460,20 +845,33 @@ int context_move_source_output_by_index(lua_State*);
  * @function Context:set_source_output_volume
  * @async
  * @tparam number source_output The source output to update.
- * @tparam Volume volume
- * @tparam function cb
+ * @tparam number|table|Volume volume See @{Context:set_sink_volume}.
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_set_source_output_volume(lua_State*);
 
+/** Changes the source output's volume relative to its current one, like @{Context:adjust_sink_volume}.
+ *
+ * @function Context:adjust_source_output_volume
+ * @async
+ * @tparam number source_output The source output to update.
+ * @tparam number|string delta
+ * @tparam[opt] function cb
+ * @tparam[opt=PA_VOLUME_NORM] number limit
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int context_adjust_source_output_volume(lua_State*);
+
 /** Sets the source output's mute state.
  *
  * @function Context:set_source_output_mute
  * @async
  * @tparam number source_output The source output to update.
  * @tparam boolean mute
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
@@ -484,13 +882,151 @@ int context_set_source_output_mute(lua_State*);
  * @function Context:kill_source_output
  * @async
  * @tparam number source_output The source output to kill.
- * @tparam function cb
+ * @tparam[opt] function cb
  * @treturn[opt] string
  * @treturn boolean
  */
 int context_kill_source_output(lua_State*);
 
 
+// Clients
+
+/** Gets information about the given client.
+ *
+ * See [pa_client_info](https://freedesktop.org/software/pulseaudio/doxygen/structpa__client__info.html)
+ * for documentation on the return type.
+ *
+ * @function Context:get_client_info
+ * @async
+ * @tparam number client The index of the client to query.
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn table
+ */
+int context_get_client_info(lua_State*);
+
+/** Gets information about all clients connected to the server.
+ *
+ * @function Context:get_clients
+ * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn table
+ */
+int context_get_client_info_list(lua_State*);
+
+
+// Modules
+
+/** Gets information about the given module.
+ *
+ * See [pa_module_info](https://freedesktop.org/software/pulseaudio/doxygen/structpa__module__info.html)
+ * for documentation on the return type.
+ *
+ * @function Context:get_module_info
+ * @async
+ * @tparam number module The index of the module to query.
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn table
+ */
+int context_get_module_info(lua_State*);
+
+/** Gets information about all modules loaded by the server.
+ *
+ * @function Context:get_modules
+ * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn table
+ */
+int context_get_module_info_list(lua_State*);
+
+
+// Samples
+
+/** Gets information about the given sample in the server's sample cache.
+ *
+ * See [pa_sample_info](https://freedesktop.org/software/pulseaudio/doxygen/structpa__sample__info.html)
+ * for documentation on the return type.
+ *
+ * @function Context:get_sample_info
+ * @async
+ * @tparam string name The name of the sample to query.
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn table
+ */
+int context_get_sample_info(lua_State*);
+
+/** Gets information about all samples in the server's sample cache.
+ *
+ * See [pa_sample_info](https://freedesktop.org/software/pulseaudio/doxygen/structpa__sample__info.html)
+ * for documentation on the return type.
+ *
+ * @function Context:get_samples
+ * @async
+ * @tparam[opt] table fields The names of the fields to return. All fields by default.
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn table
+ */
+int context_get_sample_info_list(lua_State*);
+
+/** Uploads audio data to the server's sample cache.
+ *
+ * Once uploaded, the sample can be played with @{Context:play_sample} as often as needed, without setting up
+ * a new stream each time. This is the preferred way to play short, frequent sounds, such as notification
+ * chimes. A sample with the same name is replaced.
+ *
+ * The data must be a whole number of frames in the given sample spec.
+ *
+ * @function Context:upload_sample
+ * @async
+ * @tparam string name
+ * @tparam string|lua_libpulse_glib.buffer.Buffer data
+ * @tparam[opt] table spec The sample spec, as for @{Context:new_stream}.
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int context_upload_sample(lua_State*);
+
+/** Plays a sample from the server's sample cache.
+ *
+ * The options table may contain `device`, the name of the sink to play on, `volume`, either a raw volume
+ * or a @{lua_libpulse_glib.volume.Volume} whose loudest channel is used, and `proplist`, a
+ * @{lua_libpulse_glib.proplist.Proplist} for the new sink input.
+ *
+ * The callback is optional. Without one, the request is sent without waiting for a reply.
+ *
+ * @function Context:play_sample
+ * @async
+ * @tparam string name
+ * @tparam[opt] table opts
+ * @tparam[opt] function cb
+ * @treturn[opt] string
+ * @treturn number The index of the sink input that plays the sample.
+ */
+int context_play_sample(lua_State*);
+
+/** Removes a sample from the server's sample cache.
+ *
+ * @function Context:remove_sample
+ * @async
+ * @tparam string name
+ * @tparam[opt] function cb
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int context_remove_sample(lua_State*);
+
+
 static const struct luaL_Reg context_mt[] = {
     {"__gc", context__gc},
     { NULL,  NULL       }
@@ -498,35 +1034,66 @@ static const struct luaL_Reg context_mt[] = {
 
 
 static const struct luaL_Reg context_f[] = {
-    {"connect",                   context_connect                    },
-    { "disconnect",               context_disconnect                 },
-    { "subscribe",                context_subscribe                  },
-    { "unsubscribe",              context_unsubscribe                },
-    { "get_state",                context_get_state                  },
-    { "set_default_sink",         context_set_default_sink           },
-    { "set_default_source",       context_set_default_source         },
-    { "get_server_info",          context_get_server_info            },
-    { "get_sinks",                context_get_sink_info_list         },
-    { "get_sink_info",            context_get_sink_info              },
-    { "set_sink_volume",          context_set_sink_volume            },
-    { "set_sink_mute",            context_set_sink_mute              },
-    { "set_sink_suspended",       context_set_sink_suspended         },
-    { "get_sink_inputs",          context_get_sink_input_info_list   },
-    { "get_sink_input_info",      context_get_sink_input_info        },
-    { "set_sink_input_volume",    context_set_sink_input_volume      },
-    { "set_sink_input_mute",      context_set_sink_input_mute        },
-    { "move_sink_input",          context_move_sink_input            },
-    { "kill_sink_input",          context_kill_sink_input            },
-    { "set_source_volume",        context_set_source_volume          },
-    { "set_source_mute",          context_set_source_mute            },
-    { "set_source_suspended",     context_set_source_suspended       },
-    { "get_sources",              context_get_source_info_list       },
-    { "get_source_info",          context_get_source_info            },
-    { "get_source_outputs",       context_get_source_output_info_list},
-    { "get_source_output_info",   context_get_source_output_info     },
-    { "set_source_output_volume", context_set_source_output_volume   },
-    { "set_source_output_mute",   context_set_source_output_mute     },
-    { "move_source_output",       context_move_source_output         },
-    { "kill_source_output",       context_kill_source_output         },
-    { NULL,                       NULL                               }
+    {"connect",                      context_connect                    },
+    { "disconnect",                  context_disconnect                 },
+    { "set_reconnect",               context_set_reconnect              },
+    { "subscribe",                   context_subscribe                  },
+    { "unsubscribe",                 context_unsubscribe                },
+    { "get_dispatch_stats",          context_get_dispatch_stats         },
+    { "set_dispatch_options",        context_set_dispatch_options       },
+    { "get_operation_stats",         context_get_operation_stats        },
+    { "set_operation_options",       context_set_operation_options      },
+    { "cancel_operations",           context_cancel_operations          },
+    { "set_subscription_mask",       context_set_subscription_mask      },
+    { "load_graph",                  context_load_graph                 },
+    { "save_graph",                  context_save_graph                 },
+    { "get_graph",                   context_get_graph                  },
+    { "sync_graph",                  context_sync_graph                 },
+    { "publish_graph",               context_publish_graph              },
+    { "unpublish_graph",             context_unpublish_graph            },
+    { "serve",                       context_serve                      },
+    { "new_meter",                   context_new_meter                  },
+    { "new_stream",                  context_new_stream                 },
+    { "record_to_file",              context_record_to_file             },
+    { "play_file",                   context_play_file                  },
+    { "get_state",                   context_get_state                  },
+    { "set_default_sink",            context_set_default_sink           },
+    { "set_default_source",          context_set_default_source         },
+    { "get_server_info",             context_get_server_info            },
+    { "get_sinks",                   context_get_sink_info_list         },
+    { "get_sink_info",               context_get_sink_info              },
+    { "set_sink_volume",             context_set_sink_volume            },
+    { "adjust_sink_volume",          context_adjust_sink_volume         },
+    { "set_sink_mute",               context_set_sink_mute              },
+    { "set_sink_suspended",          context_set_sink_suspended         },
+    { "get_sink_inputs",             context_get_sink_input_info_list   },
+    { "get_sink_input_info",         context_get_sink_input_info        },
+    { "set_sink_input_volume",       context_set_sink_input_volume      },
+    { "adjust_sink_input_volume",    context_adjust_sink_input_volume   },
+    { "set_sink_input_mute",         context_set_sink_input_mute        },
+    { "move_sink_input",             context_move_sink_input            },
+    { "kill_sink_input",             context_kill_sink_input            },
+    { "set_source_volume",           context_set_source_volume          },
+    { "adjust_source_volume",        context_adjust_source_volume       },
+    { "set_source_mute",             context_set_source_mute            },
+    { "set_source_suspended",        context_set_source_suspended       },
+    { "get_sources",                 context_get_source_info_list       },
+    { "get_source_info",             context_get_source_info            },
+    { "get_source_outputs",          context_get_source_output_info_list},
+    { "get_source_output_info",      context_get_source_output_info     },
+    { "set_source_output_volume",    context_set_source_output_volume   },
+    { "adjust_source_output_volume", context_adjust_source_output_volume},
+    { "set_source_output_mute",      context_set_source_output_mute     },
+    { "move_source_output",          context_move_source_output         },
+    { "kill_source_output",          context_kill_source_output         },
+    { "get_clients",                 context_get_client_info_list       },
+    { "get_client_info",             context_get_client_info            },
+    { "get_modules",                 context_get_module_info_list       },
+    { "get_module_info",             context_get_module_info            },
+    { "get_samples",                 context_get_sample_info_list       },
+    { "get_sample_info",             context_get_sample_info            },
+    { "upload_sample",               context_upload_sample              },
+    { "play_sample",                 context_play_sample                },
+    { "remove_sample",               context_remove_sample              },
+    { NULL,                          NULL                               }
 };
@@ -1,10 +1,5 @@
 #include "convert.h"
 
-#include "proplist.h"
-#include "volume.h"
-
-#include <pulse/xmalloc.h>
-
 
 void channel_map_to_lua(lua_State* L, const pa_channel_map* spec) {
     lua_createtable(L, spec->channels, 0);
@@ -36,497 +31,189 @@ void sample_spec_to_lua(lua_State* L, const pa_sample_spec* spec) {
 }
 
 
-void sink_port_info_to_lua(lua_State* L, const pa_sink_port_info* info) {
-    lua_createtable(L, 0, 6);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "name");
-    lua_pushstring(L, info->name);
-    lua_settable(L, table_index);
+// Schemas
+
+
+#define PORT_INFO_FIELDS(T)                                                                                            \
+    SCHEMA_FIELD(T, name, STRING),                                                                                     \
+    SCHEMA_FIELD(T, description, STRING),                                                                              \
+    SCHEMA_FIELD(T, priority, UINT32),                                                                                 \
+    SCHEMA_FIELD(T, available, INT),                                                                                   \
+    SCHEMA_FIELD(T, availability_group, STRING),                                                                       \
+    SCHEMA_FIELD(T, type, UINT32)
+
+DEFINE_SCHEMA(sink_port_info_schema, pa_sink_port_info, PORT_INFO_FIELDS);
+DEFINE_SCHEMA(source_port_info_schema, pa_source_port_info, PORT_INFO_FIELDS);
+
+
+#define FORMAT_INFO_FIELDS(T)                                                                                          \
+    SCHEMA_FIELD(T, encoding, INT),                                                                                    \
+    SCHEMA_FIELD(T, plist, PROPLIST)
+
+DEFINE_SCHEMA(format_info_schema, pa_format_info, FORMAT_INFO_FIELDS);
+
+
+// Sinks and sources only differ in the names of their monitor fields.
+#define DEVICE_INFO_FIELDS(T, ports_schema, MONITOR_FIELDS)                                                            \
+    SCHEMA_FIELD(T, name, STRING),                                                                                     \
+    SCHEMA_FIELD(T, index, INDEX),                                                                                     \
+    SCHEMA_FIELD(T, description, STRING),                                                                              \
+    SCHEMA_FIELD(T, sample_spec, SAMPLE_SPEC),                                                                         \
+    SCHEMA_FIELD(T, channel_map, CHANNEL_MAP),                                                                         \
+    SCHEMA_FIELD(T, owner_module, UINT32),                                                                             \
+    SCHEMA_FIELD(T, volume, CVOLUME),                                                                                  \
+    SCHEMA_FIELD(T, mute, INT),                                                                                        \
+    MONITOR_FIELDS(T),                                                                                                 \
+    SCHEMA_FIELD(T, latency, USEC),                                                                                    \
+    SCHEMA_FIELD(T, driver, STRING),                                                                                   \
+    SCHEMA_FIELD(T, flags, INT),                                                                                       \
+    SCHEMA_FIELD(T, proplist, PROPLIST),                                                                               \
+    SCHEMA_FIELD(T, configured_latency, USEC),                                                                         \
+    SCHEMA_FIELD(T, base_volume, UINT32),                                                                              \
+    SCHEMA_FIELD(T, state, INT),                                                                                       \
+    SCHEMA_FIELD(T, n_volume_steps, UINT32),                                                                           \
+    SCHEMA_FIELD(T, card, UINT32),                                                                                     \
+    SCHEMA_LIST_FIELD_ACTIVE(T, ports, ports_schema, n_ports, active_port),                                            \
+    SCHEMA_LIST_FIELD(T, formats, format_info_schema, n_formats)
+
+#define SINK_MONITOR_FIELDS(T)                                                                                         \
+    SCHEMA_FIELD(T, monitor_source, UINT32), SCHEMA_FIELD(T, monitor_source_name, STRING)
+#define SINK_INFO_FIELDS(T) DEVICE_INFO_FIELDS(T, sink_port_info_schema, SINK_MONITOR_FIELDS)
+
+#define SOURCE_MONITOR_FIELDS(T)                                                                                       \
+    SCHEMA_FIELD(T, monitor_of_sink, UINT32), SCHEMA_FIELD(T, monitor_of_sink_name, STRING)
+#define SOURCE_INFO_FIELDS(T) DEVICE_INFO_FIELDS(T, source_port_info_schema, SOURCE_MONITOR_FIELDS)
+
+DEFINE_SCHEMA(sink_info_schema, pa_sink_info, SINK_INFO_FIELDS);
+DEFINE_SCHEMA(source_info_schema, pa_source_info, SOURCE_INFO_FIELDS);
+
+
+#define SERVER_INFO_FIELDS(T)                                                                                          \
+    SCHEMA_FIELD(T, user_name, STRING),                                                                                \
+    SCHEMA_FIELD(T, host_name, STRING),                                                                                \
+    SCHEMA_FIELD(T, server_version, STRING),                                                                           \
+    SCHEMA_FIELD(T, server_name, STRING),                                                                              \
+    SCHEMA_FIELD(T, default_sink_name, STRING),                                                                        \
+    SCHEMA_FIELD(T, default_source_name, STRING),                                                                      \
+    SCHEMA_FIELD(T, cookie, UINT32),                                                                                   \
+    SCHEMA_FIELD(T, sample_spec, SAMPLE_SPEC),                                                                         \
+    SCHEMA_FIELD(T, channel_map, CHANNEL_MAP)
+
+DEFINE_SCHEMA(server_info_schema, pa_server_info, SERVER_INFO_FIELDS);
+
+
+// Sink inputs and source outputs only differ in the names of their device fields.
+#define STREAM_INFO_FIELDS(T, device, device_usec)                                                                     \
+    SCHEMA_FIELD(T, index, INDEX),                                                                                     \
+    SCHEMA_FIELD(T, name, STRING),                                                                                     \
+    SCHEMA_FIELD(T, owner_module, UINT32),                                                                             \
+    SCHEMA_FIELD(T, client, UINT32),                                                                                   \
+    SCHEMA_FIELD(T, device, UINT32),                                                                                   \
+    SCHEMA_FIELD(T, sample_spec, SAMPLE_SPEC),                                                                         \
+    SCHEMA_FIELD(T, channel_map, CHANNEL_MAP),                                                                         \
+    SCHEMA_FIELD(T, has_volume, BOOLEAN),                                                                              \
+    SCHEMA_FIELD(T, volume_writable, BOOLEAN),                                                                         \
+    SCHEMA_FIELD_IF(T, volume, CVOLUME, has_volume),                                                                   \
+    SCHEMA_FIELD(T, buffer_usec, USEC),                                                                                \
+    SCHEMA_FIELD(T, device_usec, USEC),                                                                                \
+    SCHEMA_FIELD(T, resample_method, STRING),                                                                          \
+    SCHEMA_FIELD(T, driver, STRING),                                                                                   \
+    SCHEMA_FIELD(T, mute, BOOLEAN),                                                                                    \
+    SCHEMA_OBJECT_FIELD(T, format, format_info_schema),                                                                \
+    SCHEMA_FIELD(T, proplist, PROPLIST)
+
+#define SINK_INPUT_INFO_FIELDS(T)    STREAM_INFO_FIELDS(T, sink, sink_usec)
+#define SOURCE_OUTPUT_INFO_FIELDS(T) STREAM_INFO_FIELDS(T, source, source_usec)
+
+DEFINE_SCHEMA(sink_input_info_schema, pa_sink_input_info, SINK_INPUT_INFO_FIELDS);
+DEFINE_SCHEMA(source_output_info_schema, pa_source_output_info, SOURCE_OUTPUT_INFO_FIELDS);
+
+
+#define SAMPLE_INFO_FIELDS(T)                                                                                          \
+    SCHEMA_FIELD(T, index, INDEX),                                                                                     \
+    SCHEMA_FIELD(T, name, STRING),                                                                                     \
+    SCHEMA_FIELD(T, volume, CVOLUME),                                                                                  \
+    SCHEMA_FIELD(T, sample_spec, SAMPLE_SPEC),                                                                         \
+    SCHEMA_FIELD(T, channel_map, CHANNEL_MAP),                                                                         \
+    SCHEMA_FIELD(T, duration, USEC),                                                                                   \
+    SCHEMA_FIELD(T, bytes, UINT32),                                                                                    \
+    SCHEMA_FIELD(T, lazy, BOOLEAN),                                                                                    \
+    SCHEMA_FIELD(T, filename, STRING),                                                                                 \
+    SCHEMA_FIELD(T, proplist, PROPLIST)
+
+DEFINE_SCHEMA(sample_info_schema, pa_sample_info, SAMPLE_INFO_FIELDS);
+
+
+#define CLIENT_INFO_FIELDS(T)                                                                                          \
+    SCHEMA_FIELD(T, index, INDEX),                                                                                     \
+    SCHEMA_FIELD(T, name, STRING),                                                                                     \
+    SCHEMA_FIELD(T, owner_module, UINT32),                                                                             \
+    SCHEMA_FIELD(T, driver, STRING),                                                                                   \
+    SCHEMA_FIELD(T, proplist, PROPLIST)
+
+DEFINE_SCHEMA(client_info_schema, pa_client_info, CLIENT_INFO_FIELDS);
+
+
+#define MODULE_INFO_FIELDS(T)                                                                                          \
+    SCHEMA_FIELD(T, index, INDEX),                                                                                     \
+    SCHEMA_FIELD(T, name, STRING),                                                                                     \
+    SCHEMA_FIELD(T, argument, STRING),                                                                                 \
+    SCHEMA_FIELD(T, n_used, UINT32),                                                                                   \
+    SCHEMA_FIELD(T, proplist, PROPLIST)
+
+DEFINE_SCHEMA(module_info_schema, pa_module_info, MODULE_INFO_FIELDS);
 
-    lua_pushstring(L, "description");
-    lua_pushstring(L, info->description);
-    lua_settable(L, table_index);
 
-    lua_pushstring(L, "priority");
-    lua_pushinteger(L, info->priority);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "available");
-    lua_pushinteger(L, info->available);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "availability_group");
-    lua_pushstring(L, info->availability_group);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "type");
-    lua_pushinteger(L, info->type);
-    lua_settable(L, table_index);
+void sink_port_info_to_lua(lua_State* L, const pa_sink_port_info* info) {
+    schema_to_lua(L, &sink_port_info_schema, info);
 }
 
 
 void source_port_info_to_lua(lua_State* L, const pa_source_port_info* info) {
-    lua_createtable(L, 0, 6);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "name");
-    lua_pushstring(L, info->name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "description");
-    lua_pushstring(L, info->description);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "priority");
-    lua_pushinteger(L, info->priority);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "available");
-    lua_pushinteger(L, info->available);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "availability_group");
-    lua_pushstring(L, info->availability_group);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "type");
-    lua_pushinteger(L, info->type);
-    lua_settable(L, table_index);
+    schema_to_lua(L, &source_port_info_schema, info);
 }
 
 
 void format_info_to_lua(lua_State* L, const pa_format_info* info) {
-    lua_createtable(L, 0, 2);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "encoding");
-    lua_pushinteger(L, info->encoding);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "plist");
-    proplist_to_lua(L, pa_proplist_copy(info->plist));
-    lua_settable(L, table_index);
-}
-
-
-void sink_ports_to_lua(lua_State* L, pa_sink_port_info** list, int n_ports, pa_sink_port_info* active) {
-    lua_createtable(L, n_ports, 1);
-    int table_index = lua_gettop(L);
-
-    for (int i = 0; i < n_ports; ++i) {
-        lua_pushinteger(L, i + 1);
-        sink_port_info_to_lua(L, list[i]);
-
-        if (list[i] == active) {
-            lua_pushstring(L, "active");
-            lua_pushvalue(L, -2);
-            lua_settable(L, table_index);
-        }
-
-        lua_settable(L, table_index);
-    }
-}
-
-
-void source_ports_to_lua(lua_State* L, pa_source_port_info** list, int n_ports, pa_source_port_info* active) {
-    lua_createtable(L, n_ports, 1);
-    int table_index = lua_gettop(L);
-
-    for (int i = 0; i < n_ports; ++i) {
-        lua_pushinteger(L, i + 1);
-        source_port_info_to_lua(L, list[i]);
-
-        if (list[i] == active) {
-            lua_pushstring(L, "active");
-            lua_pushvalue(L, -2);
-            lua_settable(L, table_index);
-        }
-
-        lua_settable(L, table_index);
-    }
-}
-
-
-void formats_to_lua(lua_State* L, pa_format_info** list, int n_formats) {
-    lua_createtable(L, n_formats, 0);
-    int table_index = lua_gettop(L);
-
-    for (int i = 0; i < n_formats; ++i) {
-        lua_pushinteger(L, i + 1);
-        format_info_to_lua(L, list[i]);
-        lua_settable(L, table_index);
-    }
+    schema_to_lua(L, &format_info_schema, info);
 }
 
 
 void sink_info_to_lua(lua_State* L, const pa_sink_info* info) {
-    lua_createtable(L, 0, 24);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "name");
-    lua_pushstring(L, info->name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "index");
-    // Convert C's 0-based index to Lua's 1-base
-    lua_pushinteger(L, info->index + 1);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "description");
-    lua_pushstring(L, info->description);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "sample_spec");
-    sample_spec_to_lua(L, &info->sample_spec);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "channel_map");
-    channel_map_to_lua(L, &info->channel_map);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "owner_module");
-    lua_pushinteger(L, info->owner_module);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "volume");
-    volume_to_lua(L, &info->volume);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "mute");
-    lua_pushinteger(L, info->mute);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "monitor_source");
-    lua_pushinteger(L, info->monitor_source);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "monitor_source_name");
-    lua_pushstring(L, info->monitor_source_name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "latency");
-    lua_pushinteger(L, info->latency);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "driver");
-    lua_pushstring(L, info->driver);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "flags");
-    lua_pushinteger(L, info->flags);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "proplist");
-    proplist_to_lua(L, pa_proplist_copy(info->proplist));
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "base_volume");
-    lua_pushinteger(L, info->base_volume);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "state");
-    lua_pushinteger(L, info->state);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "n_volume_steps");
-    lua_pushinteger(L, info->n_volume_steps);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "card");
-    lua_pushinteger(L, info->card);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "ports");
-    sink_ports_to_lua(L, info->ports, info->n_ports, info->active_port);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "formats");
-    formats_to_lua(L, info->formats, info->n_formats);
-    lua_settable(L, table_index);
+    schema_to_lua(L, &sink_info_schema, info);
 }
 
 
 void source_info_to_lua(lua_State* L, const pa_source_info* info) {
-    lua_createtable(L, 0, 24);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "name");
-    lua_pushstring(L, info->name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "index");
-    // Convert C's 0-based index to Lua's 1-base
-    lua_pushinteger(L, info->index + 1);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "description");
-    lua_pushstring(L, info->description);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "sample_spec");
-    sample_spec_to_lua(L, &info->sample_spec);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "channel_map");
-    channel_map_to_lua(L, &info->channel_map);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "owner_module");
-    lua_pushinteger(L, info->owner_module);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "volume");
-    volume_to_lua(L, &info->volume);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "mute");
-    lua_pushinteger(L, info->mute);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "monitor_of_sink");
-    lua_pushinteger(L, info->monitor_of_sink);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "monitor_of_sink_name");
-    lua_pushstring(L, info->monitor_of_sink_name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "latency");
-    lua_pushinteger(L, info->latency);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "driver");
-    lua_pushstring(L, info->driver);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "flags");
-    lua_pushinteger(L, info->flags);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "proplist");
-    proplist_to_lua(L, pa_proplist_copy(info->proplist));
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "configured_latency");
-    lua_pushinteger(L, info->configured_latency);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "base_volume");
-    lua_pushinteger(L, info->base_volume);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "state");
-    lua_pushinteger(L, info->state);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "n_volume_steps");
-    lua_pushinteger(L, info->n_volume_steps);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "card");
-    lua_pushinteger(L, info->card);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "ports");
-    source_ports_to_lua(L, info->ports, info->n_ports, info->active_port);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "formats");
-    formats_to_lua(L, info->formats, info->n_formats);
-    lua_settable(L, table_index);
+    schema_to_lua(L, &source_info_schema, info);
 }
 
 
 void server_info_to_lua(lua_State* L, const pa_server_info* info) {
-    lua_createtable(L, 0, 9);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "user_name");
-    lua_pushstring(L, info->user_name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "host_name");
-    lua_pushstring(L, info->host_name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "server_version");
-    lua_pushstring(L, info->server_version);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "server_name");
-    lua_pushstring(L, info->server_name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "default_sink_name");
-    lua_pushstring(L, info->default_sink_name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "default_source_name");
-    lua_pushstring(L, info->default_source_name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "cookie");
-    lua_pushinteger(L, info->cookie);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "sample_spec");
-    sample_spec_to_lua(L, &info->sample_spec);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "channel_map");
-    channel_map_to_lua(L, &info->channel_map);
-    lua_settable(L, table_index);
+    schema_to_lua(L, &server_info_schema, info);
 }
 
 
 void sink_input_info_to_lua(lua_State* L, const pa_sink_input_info* info) {
-    lua_createtable(L, 0, 15);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "index");
-    lua_pushinteger(L, info->index + 1);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "name");
-    lua_pushstring(L, info->name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "owner_module");
-    lua_pushinteger(L, info->owner_module);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "client");
-    lua_pushinteger(L, info->client);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "sink");
-    lua_pushinteger(L, info->sink);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "sample_spec");
-    sample_spec_to_lua(L, &info->sample_spec);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "channel_map");
-    channel_map_to_lua(L, &info->channel_map);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "has_volume");
-    lua_pushboolean(L, info->has_volume);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "volume_writable");
-    lua_pushboolean(L, info->volume_writable);
-    lua_settable(L, table_index);
-
-    if (info->has_volume) {
-        lua_pushstring(L, "volume");
-        volume_to_lua(L, &info->volume);
-        lua_settable(L, table_index);
-    }
-
-    lua_pushstring(L, "buffer_usec");
-    lua_pushinteger(L, info->buffer_usec);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "sink_usec");
-    lua_pushinteger(L, info->sink_usec);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "resample_method");
-    lua_pushstring(L, info->resample_method);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "driver");
-    lua_pushstring(L, info->driver);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "mute");
-    lua_pushboolean(L, info->mute);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "format");
-    format_info_to_lua(L, info->format);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "proplist");
-    proplist_to_lua(L, pa_proplist_copy(info->proplist));
-    lua_settable(L, table_index);
+    schema_to_lua(L, &sink_input_info_schema, info);
 }
 
 
 void source_output_info_to_lua(lua_State* L, const pa_source_output_info* info) {
-    lua_createtable(L, 0, 15);
-    int table_index = lua_gettop(L);
-
-    lua_pushstring(L, "index");
-    lua_pushinteger(L, info->index + 1);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "name");
-    lua_pushstring(L, info->name);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "owner_module");
-    lua_pushinteger(L, info->owner_module);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "client");
-    lua_pushinteger(L, info->client);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "source");
-    lua_pushinteger(L, info->source);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "sample_spec");
-    sample_spec_to_lua(L, &info->sample_spec);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "channel_map");
-    channel_map_to_lua(L, &info->channel_map);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "has_volume");
-    lua_pushboolean(L, info->has_volume);
-    lua_settable(L, table_index);
-
-    lua_pushstring(L, "volume_writable");
-    lua_pushboolean(L, info->volume_writable);
-    lua_settable(L, table_index);
-
-    if (info->has_volume) {
-        lua_pushstring(L, "volume");
-        volume_to_lua(L, &info->volume);
-        lua_settable(L, table_index);
-    }
-
-    lua_pushstring(L, "buffer_usec");
-    lua_pushinteger(L, info->buffer_usec);
-    lua_settable(L, table_index);
+    schema_to_lua(L, &source_output_info_schema, info);
+}
 
-    lua_pushstring(L, "source_usec");
-    lua_pushinteger(L, info->source_usec);
-    lua_settable(L, table_index);
 
-    lua_pushstring(L, "resample_method");
-    lua_pushstring(L, info->resample_method);
-    lua_settable(L, table_index);
+void sample_info_to_lua(lua_State* L, const pa_sample_info* info) {
+    schema_to_lua(L, &sample_info_schema, info);
+}
 
-    lua_pushstring(L, "driver");
-    lua_pushstring(L, info->driver);
-    lua_settable(L, table_index);
 
-    lua_pushstring(L, "mute");
-    lua_pushboolean(L, info->mute);
-    lua_settable(L, table_index);
+void client_info_to_lua(lua_State* L, const pa_client_info* info) {
+    schema_to_lua(L, &client_info_schema, info);
+}
 
-    lua_pushstring(L, "format");
-    format_info_to_lua(L, info->format);
-    lua_settable(L, table_index);
 
-    lua_pushstring(L, "proplist");
-    proplist_to_lua(L, pa_proplist_copy(info->proplist));
-    lua_settable(L, table_index);
+void module_info_to_lua(lua_State* L, const pa_module_info* info) {
+    schema_to_lua(L, &module_info_schema, info);
 }
@@ -0,0 +1,235 @@
+#include "curve.h"
+
+#include "lua_util.h"
+#include "volume.h"
+
+#include <glib.h>
+#include <math.h>
+
+
+#define CURVE_DEFAULT_SIZE  1024
+#define CURVE_DEFAULT_RANGE 60.0
+
+
+typedef enum curve_kind {
+    CURVE_CUBIC,
+    CURVE_LINEAR,
+    CURVE_LOG,
+    CURVE_POINTS,
+    CURVE_FUNCTION,
+} curve_kind;
+
+
+// What `volume.curve` was asked for, evaluated exactly while compiling.
+typedef struct curve_source {
+    lua_State* L;
+    curve_kind kind;
+    double max;
+    // For `CURVE_LOG`, the volume factor at position `0`, before offsetting it to `0`.
+    double low;
+    // For `CURVE_POINTS`, `count` pairs of position and volume, sorted by position.
+    const double* points;
+    size_t count;
+} curve_source;
+
+
+static double curve_source_eval(double position, void* userdata) {
+    curve_source* source = userdata;
+
+    switch (source->kind) {
+    case CURVE_CUBIC:
+        // Volumes are already cubic in amplitude.
+        return position * source->max;
+    case CURVE_LINEAR:
+        return cbrt(position) * source->max;
+    case CURVE_LOG:
+        // Equal steps in dB, offset and rescaled so that the ends map to `0` and `max` exactly.
+        return (pow(source->low, 1.0 - position) - source->low) / (1.0 - source->low) * source->max;
+    case CURVE_POINTS: {
+        const double* points = source->points;
+        if (position <= points[0]) {
+            return points[1];
+        }
+        for (size_t i = 1; i < source->count; i++) {
+            if (position <= points[2 * i]) {
+                double t = (position - points[2 * i - 2]) / (points[2 * i] - points[2 * i - 2]);
+                return points[2 * i - 1] + t * (points[2 * i + 1] - points[2 * i - 1]);
+            }
+        }
+        return points[2 * source->count - 1];
+    }
+    case CURVE_FUNCTION: {
+        lua_State* L = source->L;
+        lua_pushvalue(L, 1);
+        lua_pushnumber(L, position);
+        lua_call(L, 1, 1);
+        if (!lua_isnumber(L, -1)) {
+            return luaL_error(L, "curve function must return a number");
+        }
+        double value = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        return value;
+    }
+    }
+
+    return 0;
+}
+
+
+// Reads the breakpoints from the table at index 1 into a userdata on top of the stack, which keeps them alive
+// until the curve is compiled.
+static void read_points(lua_State* L, curve_source* source) {
+    size_t count = lua_rawlen(L, 1);
+    luaL_argcheck(L, count >= 2, 1, "expected at least two breakpoints");
+
+    double* points = lua_newuserdata(L, 2 * count * sizeof(double));
+    for (size_t i = 0; i < count; i++) {
+        lua_rawgeti(L, 1, (int) i + 1);
+        luaL_argcheck(L, lua_istable(L, -1), 1, "breakpoints must be pairs of position and volume");
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        points[2 * i] = luaL_checknumber(L, -2);
+        points[2 * i + 1] = luaL_checknumber(L, -1);
+        lua_pop(L, 3);
+
+        luaL_argcheck(L, i == 0 || points[2 * i] > points[2 * i - 2], 1, "breakpoint positions must increase");
+    }
+
+    source->points = points;
+    source->count = count;
+}
+
+
+int curve_new(lua_State* L) {
+    curve_source source = { 0 };
+    source.L = L;
+    source.max = PA_VOLUME_NORM;
+    lua_Integer size = CURVE_DEFAULT_SIZE;
+    double range = CURVE_DEFAULT_RANGE;
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "size");
+        size = luaL_optinteger(L, -1, size);
+        luaL_argcheck(L, size >= 1 && size <= (1 << 20), 2, "size out of bounds");
+        lua_pop(L, 1);
+
+        lua_getfield(L, 2, "max");
+        lua_Integer max = luaL_optinteger(L, -1, PA_VOLUME_NORM);
+        luaL_argcheck(L, max >= 0 && PA_VOLUME_IS_VALID(max), 2, "max volume out of bounds");
+        source.max = (double) max;
+        lua_pop(L, 1);
+
+        lua_getfield(L, 2, "range");
+        range = luaL_optnumber(L, -1, range);
+        luaL_argcheck(L, range > 0, 2, "range must be positive");
+        lua_pop(L, 1);
+    }
+
+    switch (lua_type(L, 1)) {
+    case LUA_TSTRING: {
+        static const char* const kinds[] = { "cubic", "linear", "log", NULL };
+        source.kind = (curve_kind) luaL_checkoption(L, 1, NULL, kinds);
+        // A drop of `range` dB in amplitude is a factor of `10^(-range / 60)` in volume.
+        source.low = pow(10.0, -range / 60.0);
+        break;
+    }
+    case LUA_TTABLE:
+        source.kind = CURVE_POINTS;
+        read_points(L, &source);
+        break;
+    case LUA_TFUNCTION:
+        source.kind = CURVE_FUNCTION;
+        break;
+    default:
+        return luaL_argerror(L, 1, "expected string, table or function");
+    }
+
+    curve_t* curve = lua_newuserdata(L, sizeof(curve_t));
+    curve->inner = (lut_curve) { 0 };
+    luaL_getmetatable(L, LUA_PA_CURVE);
+    lua_setmetatable(L, -2);
+
+    // Should the function raise an error, the table is freed along with the userdata.
+    if (!lut_curve_compile(&curve->inner, (size_t) size, curve_source_eval, &source)) {
+        return luaL_error(L, "curve must not decrease");
+    }
+
+    return 1;
+}
+
+
+static curve_t* curve_check(lua_State* L, int index) {
+    return luaL_checkudata(L, index, LUA_PA_CURVE);
+}
+
+
+int curve_to_volume(lua_State* L) {
+    curve_t* curve = curve_check(L, 1);
+
+    if (lua_type(L, 2) != LUA_TTABLE) {
+        lua_pushinteger(L, lut_curve_to_volume(&curve->inner, luaL_checknumber(L, 2)));
+        return 1;
+    }
+
+    int count = (int) lua_rawlen(L, 2);
+    lua_createtable(L, count, 0);
+    for (int i = 1; i <= count; i++) {
+        lua_rawgeti(L, 2, i);
+        pa_volume_t volume = lut_curve_to_volume(&curve->inner, luaL_checknumber(L, -1));
+        lua_pop(L, 1);
+        lua_pushinteger(L, volume);
+        lua_rawseti(L, -2, i);
+    }
+
+    return 1;
+}
+
+
+int curve_to_position(lua_State* L) {
+    curve_t* curve = curve_check(L, 1);
+
+    switch (lua_type(L, 2)) {
+    case LUA_TUSERDATA: {
+        volume_t* volume = luaL_checkudata(L, 2, LUA_PA_VOLUME);
+        lua_createtable(L, volume->channels, 0);
+        for (int i = 0; i < volume->channels; i++) {
+            lua_pushnumber(L, lut_curve_to_position(&curve->inner, volume->values[i]));
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+    case LUA_TTABLE: {
+        int count = (int) lua_rawlen(L, 2);
+        lua_createtable(L, count, 0);
+        for (int i = 1; i <= count; i++) {
+            lua_rawgeti(L, 2, i);
+            pa_volume_t volume = PA_CLAMP_VOLUME((pa_volume_t) luaL_checkinteger(L, -1));
+            lua_pop(L, 1);
+            lua_pushnumber(L, lut_curve_to_position(&curve->inner, volume));
+            lua_rawseti(L, -2, i);
+        }
+        return 1;
+    }
+    default: {
+        pa_volume_t volume = PA_CLAMP_VOLUME((pa_volume_t) luaL_checkinteger(L, 2));
+        lua_pushnumber(L, lut_curve_to_position(&curve->inner, volume));
+        return 1;
+    }
+    }
+}
+
+
+int curve_error(lua_State* L) {
+    curve_t* curve = curve_check(L, 1);
+    lua_pushnumber(L, curve->inner.error);
+    return 1;
+}
+
+
+int curve__gc(lua_State* L) {
+    curve_t* curve = curve_check(L, 1);
+    lut_curve_clear(&curve->inner);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/** Slider curves.
+ *
+ * A @{Curve} maps slider positions between `0` and `1` to volumes and back. The curve is sampled into a lookup
+ * table once, when it is created with @{lua_libpulse_glib.volume.curve}, so converting a position afterwards
+ * costs an interpolation instead of calls to `pow` or `cbrt`, or into Lua.
+ *
+ *    local volume = require("lua_libpulse_glib.volume")
+ *    local curve = volume.curve("log", { range = 50 })
+ *    vol:scale(curve:to_volume(slider.value))
+ *    slider.value = curve:to_position(vol:max())
+ *
+ * @module lua_libpulse_glib.curve
+ */
+#pragma once
+
+#include "lut.h"
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#define LUA_PA_CURVE "lua_libpulse_glib.curve"
+
+
+typedef struct curve_t {
+    lut_curve inner;
+} curve_t;
+
+
+/// Curve
+/// @type Curve
+
+
+/** Converts slider positions to volumes.
+ *
+ * Positions are clamped to `[0, 1]`.
+ *
+ * @function Curve:to_volume
+ * @tparam number|table position A position, or a list of them.
+ * @treturn number|table The volume, or a list of them.
+ */
+int curve_to_volume(lua_State*);
+
+/** Converts volumes to slider positions.
+ *
+ * Where the curve is flat, the lowest position that reaches the volume is returned.
+ *
+ * @function Curve:to_position
+ * @tparam number|table|Volume volume A volume, a list of them, or the channels of a
+ *  @{lua_libpulse_glib.volume.Volume}.
+ * @treturn number|table The position, or a list of them.
+ */
+int curve_to_position(lua_State*);
+
+/** Returns the largest difference between the lookup table and the exact curve.
+ *
+ * This is measured when the curve is created, by comparing both at several points within each segment of the
+ * table. It's given in volume units. A larger `size` reduces it.
+ *
+ * @function Curve:error
+ * @treturn number
+ */
+int curve_error(lua_State*);
+
+int curve__gc(lua_State*);
+
+
+static const struct luaL_Reg curve_f[] = {
+    {"to_volume",    curve_to_volume  },
+    { "to_position", curve_to_position},
+    { "error",       curve_error      },
+    { NULL,          NULL             }
+};
+
+
+static const struct luaL_Reg curve_mt[] = {
+    {"__gc", curve__gc},
+    { NULL,  NULL     }
+};
@@ -0,0 +1,249 @@
+#include "dispatch.h"
+
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DISPATCH_INITIAL_CAPACITY 16
+
+
+static gboolean dispatcher_run(gpointer);
+
+
+void dispatch_config_init(dispatch_config* config) {
+    config->priority = G_PRIORITY_DEFAULT;
+    config->has_priority = false;
+    config->budget_callbacks = 0;
+    config->budget_usec = 0;
+}
+
+
+void dispatch_config_from_lua(lua_State* L, int index, dispatch_config* config) {
+    if (lua_isnoneornil(L, index)) {
+        return;
+    }
+
+    luaL_checktype(L, index, LUA_TTABLE);
+
+    lua_getfield(L, index, "priority");
+    if (!lua_isnil(L, -1)) {
+        config->priority = (int) luaL_checkinteger(L, -1);
+        config->has_priority = true;
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, index, "budget_callbacks");
+    if (!lua_isnil(L, -1)) {
+        lua_Integer value = luaL_checkinteger(L, -1);
+        luaL_argcheck(L, value >= 0, index, "budget_callbacks must not be negative");
+        config->budget_callbacks = (uint32_t) value;
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, index, "budget_usec");
+    if (!lua_isnil(L, -1)) {
+        lua_Integer value = luaL_checkinteger(L, -1);
+        luaL_argcheck(L, value >= 0, index, "budget_usec must not be negative");
+        config->budget_usec = (uint64_t) value;
+    }
+    lua_pop(L, 1);
+}
+
+
+// Whether items need to go through the queue at all, or can be called right away.
+static bool dispatch_config_is_immediate(const dispatch_config* config) {
+    return !config->has_priority && config->budget_callbacks == 0 && config->budget_usec == 0;
+}
+
+
+dispatcher* dispatcher_new(const dispatch_config* config) {
+    dispatcher* d = calloc(1, sizeof(dispatcher));
+    d->config = *config;
+    d->stats.latency_min = UINT64_MAX;
+    return d;
+}
+
+
+void dispatcher_free(dispatcher* d) {
+    if (d->running) {
+        // We're being called from within one of the items. `dispatcher_run` will
+        // free the memory once the item returns.
+        d->freed = true;
+        return;
+    }
+
+    if (d->source_id != 0) {
+        g_source_remove(d->source_id);
+    }
+
+    free(d->items);
+    free(d);
+}
+
+
+void dispatcher_set_config(dispatcher* d, const dispatch_config* config) {
+    d->config = *config;
+}
+
+
+static void dispatcher_schedule(dispatcher* d, bool idle) {
+    if (d->source_id != 0 || d->running) {
+        return;
+    }
+
+    int priority = d->config.priority;
+    // When the budget for this iteration is used up, continue with a priority below regular event processing
+    // and redraws, so that other sources get a chance to run first.
+    if (idle && priority < G_PRIORITY_DEFAULT_IDLE) {
+        priority = G_PRIORITY_DEFAULT_IDLE;
+    }
+
+    d->source_id = g_idle_add_full(priority, dispatcher_run, d, NULL);
+}
+
+
+static void dispatcher_record(dispatcher* d, gint64 queued_at, gint64 now) {
+    uint64_t latency = now > queued_at ? (uint64_t) (now - queued_at) : 0;
+
+    d->stats.dispatched++;
+    d->stats.latency_total += latency;
+    d->stats.latency_last = latency;
+
+    if (latency > d->stats.latency_max) {
+        d->stats.latency_max = latency;
+    }
+
+    if (latency < d->stats.latency_min) {
+        d->stats.latency_min = latency;
+    }
+}
+
+
+static void dispatcher_grow(dispatcher* d) {
+    size_t capacity = d->capacity == 0 ? DISPATCH_INITIAL_CAPACITY : d->capacity * 2;
+    dispatch_item* items = malloc(capacity * sizeof(dispatch_item));
+
+    // Unwrap the ring buffer, so that the oldest item ends up at the start.
+    for (size_t i = 0; i < d->length; ++i) {
+        items[i] = d->items[(d->head + i) % d->capacity];
+    }
+
+    free(d->items);
+    d->items = items;
+    d->capacity = capacity;
+    d->head = 0;
+}
+
+
+void dispatcher_push(dispatcher* d, dispatch_fn fn, void* userdata, uint32_t a, uint32_t b) {
+    gint64 now = g_get_monotonic_time();
+
+    // Keep the order of events intact: only skip the queue when it is empty.
+    if (dispatch_config_is_immediate(&d->config) && d->length == 0) {
+        dispatcher_record(d, now, now);
+        fn(userdata, a, b);
+        return;
+    }
+
+    if (d->length == d->capacity) {
+        dispatcher_grow(d);
+    }
+
+    dispatch_item* item = &d->items[(d->head + d->length) % d->capacity];
+    item->fn = fn;
+    item->userdata = userdata;
+    item->a = a;
+    item->b = b;
+    item->queued_at = now;
+    d->length++;
+
+    dispatcher_schedule(d, false);
+}
+
+
+static gboolean dispatcher_run(gpointer userdata) {
+    dispatcher* d = (dispatcher*) userdata;
+    gint64 start = g_get_monotonic_time();
+    gint64 now = start;
+    uint32_t count = 0;
+
+    d->source_id = 0;
+    d->running = true;
+
+    while (d->length > 0 && !d->freed) {
+        if (d->config.budget_callbacks != 0 && count >= d->config.budget_callbacks) {
+            break;
+        }
+
+        if (d->config.budget_usec != 0 && (uint64_t) (now - start) >= d->config.budget_usec) {
+            break;
+        }
+
+        dispatch_item item = d->items[d->head];
+        d->head = (d->head + 1) % d->capacity;
+        d->length--;
+
+        dispatcher_record(d, item.queued_at, now);
+        item.fn(item.userdata, item.a, item.b);
+
+        ++count;
+        now = g_get_monotonic_time();
+    }
+
+    d->running = false;
+
+    if (d->freed) {
+        d->freed = false;
+        dispatcher_free(d);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (d->length > 0) {
+        d->stats.deferred++;
+        dispatcher_schedule(d, true);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+
+void dispatch_stats_to_lua(lua_State* L, const dispatcher* d) {
+    lua_createtable(L, 0, 8);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "dispatched");
+    lua_pushinteger(L, (lua_Integer) d->stats.dispatched);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "deferred");
+    lua_pushinteger(L, (lua_Integer) d->stats.deferred);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "pending");
+    lua_pushinteger(L, (lua_Integer) d->length);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "latency_last");
+    lua_pushinteger(L, (lua_Integer) d->stats.latency_last);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "latency_max");
+    lua_pushinteger(L, (lua_Integer) d->stats.latency_max);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "latency_min");
+    lua_pushinteger(L, d->stats.dispatched > 0 ? (lua_Integer) d->stats.latency_min : 0);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "latency_avg");
+    if (d->stats.dispatched > 0) {
+        lua_pushnumber(L, (lua_Number) d->stats.latency_total / (lua_Number) d->stats.dispatched);
+    } else {
+        lua_pushnumber(L, 0);
+    }
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "priority");
+    lua_pushinteger(L, d->config.priority);
+    lua_settable(L, table_index);
+}
@@ -0,0 +1,88 @@
+#ifndef dispatch_h_INCLUDED
+#define dispatch_h_INCLUDED
+
+#include <glib.h>
+#include <lua.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// A function that performs the deferred work for a queued item.
+// This is where Lua callbacks are actually called.
+typedef void (*dispatch_fn)(void* userdata, uint32_t a, uint32_t b);
+
+
+// Settings that control how queued Lua callbacks are scheduled on the GLib Main Loop.
+//
+// A budget value of `0` means "unlimited". When neither a budget nor a custom priority is
+// configured, callbacks are called immediately, as they are received from libpulse.
+typedef struct dispatch_config {
+    int priority;
+    bool has_priority;
+    // Maximum number of callbacks per main loop iteration.
+    uint32_t budget_callbacks;
+    // Maximum time in microseconds to spend on callbacks per main loop iteration.
+    uint64_t budget_usec;
+} dispatch_config;
+
+
+typedef struct dispatch_item {
+    dispatch_fn fn;
+    void* userdata;
+    uint32_t a;
+    uint32_t b;
+    gint64 queued_at;
+} dispatch_item;
+
+
+typedef struct dispatch_stats {
+    uint64_t dispatched;
+    // Number of main loop iterations that ran out of budget and had to defer items to an idle source.
+    uint64_t deferred;
+    uint64_t latency_total;
+    uint64_t latency_max;
+    uint64_t latency_min;
+    uint64_t latency_last;
+} dispatch_stats;
+
+
+typedef struct dispatcher {
+    dispatch_config config;
+    dispatch_stats stats;
+
+    // Ring buffer of pending items
+    dispatch_item* items;
+    size_t capacity;
+    size_t head;
+    size_t length;
+
+    // The ID of the currently scheduled GSource, if any.
+    guint source_id;
+    // Set while items are being dispatched, to guard against re-entrant scheduling
+    // and against the dispatcher being freed by one of its own items.
+    bool running;
+    bool freed;
+} dispatcher;
+
+
+// Initializes the config with the default values, i.e. immediate dispatch.
+void dispatch_config_init(dispatch_config*);
+
+// Reads `priority`, `budget_callbacks` and `budget_usec` from the table at the given index
+// into the config. Fields that are not present keep their current value.
+void dispatch_config_from_lua(lua_State*, int, dispatch_config*);
+
+dispatcher* dispatcher_new(const dispatch_config*);
+
+// Removes any scheduled sources and frees the dispatcher. Pending items are dropped.
+void dispatcher_free(dispatcher*);
+
+void dispatcher_set_config(dispatcher*, const dispatch_config*);
+
+// Queues an item. Depending on the configuration, the function may be called immediately.
+void dispatcher_push(dispatcher*, dispatch_fn, void*, uint32_t, uint32_t);
+
+// Pushes a table with the dispatcher's statistics onto the stack.
+void dispatch_stats_to_lua(lua_State*, const dispatcher*);
+
+#endif // dispatch_h_INCLUDED
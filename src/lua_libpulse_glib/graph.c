@@ -0,0 +1,415 @@
+#include "callback.h"
+#include "context.h"
+#include "lua_util.h"
+#include "mirror.h"
+#include "snapshot.h"
+
+#include <glib.h>
+#include <pulse/error.h>
+#include <pulse/introspect.h>
+#include <stdbool.h>
+
+
+// The number of queries `context_sync_graph` sends to the server.
+#define GRAPH_SYNC_QUERIES 5
+
+
+typedef struct graph_sync {
+    lua_pa_context* ctx;
+    mirror* fresh;
+    simple_callback_data* data;
+    int outstanding;
+    int error;
+} graph_sync;
+
+
+void graph_sync_free(graph_sync* sync) {
+    mirror_free(sync->fresh);
+    if (sync->data != NULL) {
+        free_lua_callback(sync->data);
+    }
+    g_free(sync);
+}
+
+
+void graph_sync_abort(graph_sync* sync, const char* reason) {
+    sync->ctx->sync = NULL;
+
+    if (sync->data != NULL) {
+        lua_State* L = sync->data->L;
+        lua_pushfstring(L, "failed to sync graph: %s", reason);
+        lua_call(L, 1, 0);
+    }
+
+    graph_sync_free(sync);
+}
+
+
+// Maps a mirror change to the subscription event the server would have sent for it.
+static pa_subscription_event_type_t graph_change_to_event(mirror_kind kind, mirror_change change) {
+    static const pa_subscription_event_type_t facilities[] = {
+        [MIRROR_SINK] = PA_SUBSCRIPTION_EVENT_SINK,
+        [MIRROR_SOURCE] = PA_SUBSCRIPTION_EVENT_SOURCE,
+        [MIRROR_SINK_INPUT] = PA_SUBSCRIPTION_EVENT_SINK_INPUT,
+        [MIRROR_SOURCE_OUTPUT] = PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT,
+        [MIRROR_KIND_MAX] = PA_SUBSCRIPTION_EVENT_SERVER,
+    };
+
+    static const pa_subscription_event_type_t types[] = {
+        [MIRROR_CHANGE_NEW] = PA_SUBSCRIPTION_EVENT_NEW,
+        [MIRROR_CHANGE_CHANGE] = PA_SUBSCRIPTION_EVENT_CHANGE,
+        [MIRROR_CHANGE_REMOVE] = PA_SUBSCRIPTION_EVENT_REMOVE,
+    };
+
+    return facilities[kind] | types[change];
+}
+
+
+// Queues a change as event for the subscription callbacks.
+static void graph_emit_change(mirror_kind kind, mirror_change change, const mirror_entry* entry, void* userdata) {
+    lua_pa_context* ctx = (lua_pa_context*) userdata;
+    uint32_t index = entry != NULL ? entry->index : PA_INVALID_INDEX;
+    dispatcher_push(ctx->dispatcher, context_dispatch_event, ctx, graph_change_to_event(kind, change), index);
+}
+
+
+// Appends a change to the list at index 2 of the callback thread's stack.
+static void graph_push_change(mirror_kind kind, mirror_change change, const mirror_entry* entry, void* userdata) {
+    lua_State* L = (lua_State*) userdata;
+
+    lua_createtable(L, 0, 3);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "kind");
+    lua_pushstring(L, mirror_kind_to_string(kind));
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "change");
+    lua_pushstring(L, mirror_change_to_string(change));
+    lua_settable(L, table_index);
+
+    if (entry != NULL) {
+        lua_pushstring(L, "entry");
+        mirror_entry_to_lua(L, entry);
+        lua_settable(L, table_index);
+    }
+
+    lua_rawseti(L, 2, lua_rawlen(L, 2) + 1);
+}
+
+
+// Finishes a resync after a reconnect, which reports differences as events rather than to a callback.
+static void graph_resync_finish(graph_sync* sync) {
+    lua_pa_context* ctx = sync->ctx;
+    ctx->sync = NULL;
+
+    if (sync->error != 0) {
+        // The mirror stays stale. The next reconnect will try again.
+        graph_sync_free(sync);
+        return;
+    }
+
+    mirror* current = ctx->mirror;
+    mirror_diff(current, sync->fresh, graph_emit_change, ctx);
+
+    if (g_strcmp0(current->default_sink, sync->fresh->default_sink) != 0
+        || g_strcmp0(current->default_source, sync->fresh->default_source) != 0) {
+        graph_emit_change(MIRROR_KIND_MAX, MIRROR_CHANGE_CHANGE, NULL, ctx);
+    }
+
+    sync->fresh->stale = false;
+    mirror_replace(current, sync->fresh);
+    graph_sync_free(sync);
+}
+
+
+static void graph_sync_finish(graph_sync* sync) {
+    if (sync->data == NULL) {
+        graph_resync_finish(sync);
+        return;
+    }
+
+    lua_pa_context* ctx = sync->ctx;
+    lua_State* L = sync->data->L;
+    ctx->sync = NULL;
+
+    if (sync->error != 0) {
+        lua_pushfstring(L, "failed to sync graph: %s", pa_strerror(sync->error));
+        lua_call(L, 1, 0);
+        graph_sync_free(sync);
+        return;
+    }
+
+    // The list of changes
+    lua_newtable(L);
+
+    mirror* current = ctx->mirror;
+    mirror_diff(current, sync->fresh, graph_push_change, L);
+
+    if (g_strcmp0(current->default_sink, sync->fresh->default_sink) != 0
+        || g_strcmp0(current->default_source, sync->fresh->default_source) != 0) {
+        graph_push_change(MIRROR_KIND_MAX, MIRROR_CHANGE_CHANGE, NULL, L);
+    }
+
+    sync->fresh->stale = false;
+    mirror_replace(current, sync->fresh);
+    current->tracking = true;
+    context_apply_subscription(ctx);
+
+    lua_pushnil(L);
+    lua_insert(L, -2);
+    lua_call(L, 2, 0);
+
+    graph_sync_free(sync);
+}
+
+
+static void graph_sync_done(graph_sync* sync, int eol) {
+    if (eol < 0 && sync->error == 0) {
+        sync->error = pa_context_errno(sync->ctx->context);
+    }
+
+    if (--sync->outstanding == 0) {
+        graph_sync_finish(sync);
+    }
+}
+
+
+static void graph_server_info_callback(pa_context* c, const pa_server_info* info, void* userdata) {
+    graph_sync* sync = (graph_sync*) userdata;
+    if (info != NULL) {
+        mirror_set_defaults(sync->fresh, info->default_sink_name, info->default_source_name);
+    }
+    graph_sync_done(sync, info != NULL ? 1 : -1);
+}
+
+
+static void graph_sink_info_callback(pa_context* c, const pa_sink_info* info, int eol, void* userdata) {
+    graph_sync* sync = (graph_sync*) userdata;
+    if (eol == 0) {
+        mirror_update_sink(sync->fresh, info);
+    } else {
+        graph_sync_done(sync, eol);
+    }
+}
+
+
+static void graph_source_info_callback(pa_context* c, const pa_source_info* info, int eol, void* userdata) {
+    graph_sync* sync = (graph_sync*) userdata;
+    if (eol == 0) {
+        mirror_update_source(sync->fresh, info);
+    } else {
+        graph_sync_done(sync, eol);
+    }
+}
+
+
+static void graph_sink_input_info_callback(pa_context* c, const pa_sink_input_info* info, int eol, void* userdata) {
+    graph_sync* sync = (graph_sync*) userdata;
+    if (eol == 0) {
+        mirror_update_sink_input(sync->fresh, info);
+    } else {
+        graph_sync_done(sync, eol);
+    }
+}
+
+
+static void graph_source_output_info_callback(pa_context* c,
+                                              const pa_source_output_info* info,
+                                              int eol,
+                                              void* userdata) {
+    graph_sync* sync = (graph_sync*) userdata;
+    if (eol == 0) {
+        mirror_update_source_output(sync->fresh, info);
+    } else {
+        graph_sync_done(sync, eol);
+    }
+}
+
+
+int context_load_graph(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* path = luaL_optstring(L, 2, NULL);
+    char* default_path = NULL;
+    char* error = NULL;
+
+    if (path == NULL) {
+        default_path = mirror_default_path();
+        path = default_path;
+    }
+
+    if (ctx->mirror == NULL) {
+        ctx->mirror = mirror_new();
+    }
+
+    bool ok = mirror_load(ctx->mirror, path, &error);
+    g_free(default_path);
+
+    if (!ok) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to load graph: %s", error);
+        g_free(error);
+        return 2;
+    }
+
+    mirror_to_lua(L, ctx->mirror);
+    return 1;
+}
+
+
+int context_save_graph(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* path = luaL_optstring(L, 2, NULL);
+    char* default_path = NULL;
+    char* error = NULL;
+
+    if (ctx->mirror == NULL) {
+        lua_pushnil(L);
+        lua_pushstring(L, "no graph to save");
+        return 2;
+    }
+
+    if (path == NULL) {
+        default_path = mirror_default_path();
+        path = default_path;
+    }
+
+    bool ok = mirror_save(ctx->mirror, path, &error);
+    g_free(default_path);
+
+    if (!ok) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to save graph: %s", error);
+        g_free(error);
+        return 2;
+    }
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+
+int context_get_graph(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+
+    if (ctx->mirror == NULL) {
+        lua_pushnil(L);
+    } else {
+        mirror_to_lua(L, ctx->mirror);
+    }
+
+    return 1;
+}
+
+
+// Sends all queries for a sync. With `NULL` callback data, the result is reported as events.
+static void graph_sync_start(lua_pa_context* ctx, simple_callback_data* data) {
+    graph_sync* sync = g_new0(graph_sync, 1);
+    sync->ctx = ctx;
+    sync->fresh = mirror_new();
+    sync->data = data;
+    sync->outstanding = GRAPH_SYNC_QUERIES;
+    ctx->sync = sync;
+
+    // All queries are sent right away, so that they are answered in a single round trip.
+    pa_operation* ops[GRAPH_SYNC_QUERIES] = {
+        pa_context_get_server_info(ctx->context, graph_server_info_callback, sync),
+        pa_context_get_sink_info_list(ctx->context, graph_sink_info_callback, sync),
+        pa_context_get_source_info_list(ctx->context, graph_source_info_callback, sync),
+        pa_context_get_sink_input_info_list(ctx->context, graph_sink_input_info_callback, sync),
+        pa_context_get_source_output_info_list(ctx->context, graph_source_output_info_callback, sync),
+    };
+
+    for (int i = 0; i < GRAPH_SYNC_QUERIES; ++i) {
+        if (ops[i] != NULL) {
+            pa_operation_unref(ops[i]);
+        } else {
+            // The callback won't be called for this query.
+            graph_sync_done(sync, -1);
+        }
+    }
+}
+
+
+int context_sync_graph(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
+        lua_pushvalue(L, 2);
+        lua_pushstring(L, "connection not ready");
+        lua_call(L, 1, 0);
+        return 0;
+    }
+
+    if (ctx->sync != NULL) {
+        lua_pushvalue(L, 2);
+        lua_pushstring(L, "graph sync already in progress");
+        lua_call(L, 1, 0);
+        return 0;
+    }
+
+    if (ctx->mirror == NULL) {
+        ctx->mirror = mirror_new();
+    }
+
+    graph_sync_start(ctx, prepare_lua_callback(L, 2));
+    return 0;
+}
+
+
+void graph_resync(lua_pa_context* ctx) {
+    if (ctx->sync != NULL) {
+        // A sync from the user is already on its way, and will bring the mirror up to date.
+        return;
+    }
+
+    graph_sync_start(ctx, NULL);
+}
+
+
+int context_publish_graph(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* path = luaL_optstring(L, 2, NULL);
+    char* default_path = NULL;
+    char* error = NULL;
+
+    if (ctx->publisher != NULL) {
+        snapshot_publisher_free(ctx->publisher);
+        ctx->publisher = NULL;
+    }
+
+    if (ctx->mirror == NULL) {
+        ctx->mirror = mirror_new();
+    }
+
+    if (path == NULL) {
+        default_path = snapshot_default_path();
+        path = default_path;
+    }
+
+    ctx->publisher = snapshot_publisher_new(ctx->mirror, path, &error);
+    g_free(default_path);
+
+    if (ctx->publisher == NULL) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to publish graph: %s", error);
+        g_free(error);
+        return 2;
+    }
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+
+int context_unpublish_graph(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+
+    if (ctx->publisher != NULL) {
+        snapshot_publisher_free(ctx->publisher);
+        ctx->publisher = NULL;
+    }
+
+    return 0;
+}
@@ -1,1368 +1,638 @@
-#include "callback.h"
 #include "context.h"
 #include "convert.h"
-#include "proplist.h"
-#include "pulseaudio.h"
-#include "volume.h"
+#include "operation.h"
 
-#include <pulse/error.h>
 #include <pulse/introspect.h>
-#include <pulse/xmalloc.h>
-#include <stdbool.h>
-#include <stdlib.h>
+#include <pulse/scache.h>
 
 
-void server_info_callback(pa_context* c, const pa_server_info* info, void* userdata) {
-    simple_callback_data* data = (simple_callback_data*) userdata;
-    lua_State* L = data->L;
+DEFINE_OPERATION_INFO_CALLBACK(sink_info, pa_sink_info)
+DEFINE_OPERATION_INFO_CALLBACK(source_info, pa_source_info)
+DEFINE_OPERATION_INFO_CALLBACK(sink_input_info, pa_sink_input_info)
+DEFINE_OPERATION_INFO_CALLBACK(source_output_info, pa_source_output_info)
+DEFINE_OPERATION_INFO_CALLBACK(client_info, pa_client_info)
+DEFINE_OPERATION_INFO_CALLBACK(module_info, pa_module_info)
+DEFINE_OPERATION_INFO_CALLBACK(sample_info, pa_sample_info)
 
-    lua_pushnil(L);
-    server_info_to_lua(L, info);
-    lua_call(L, 2, 0);
 
-    free_lua_callback(data);
-}
-
-
-int context_get_server_info(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 2);
+// Unlike the other info callbacks, this one is called exactly once, with `NULL` on errors.
+static void server_info_callback(pa_context* c, const pa_server_info* info, void* userdata) {
+    operation* op = (operation*) userdata;
 
-    pa_operation* op = pa_context_get_server_info(ctx->context, server_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get server info: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
+    if (info != NULL) {
+        schema_project(op->data->L, &server_info_schema, info, op->fields);
+        operation_add_result(op);
     }
 
-    return 0;
+    operation_complete(op, info != NULL ? 1 : -1);
 }
 
 
-void sink_info_callback(pa_context* c, const pa_sink_info* info, int eol, void* userdata) {
-    simple_callback_data* data = (simple_callback_data*) userdata;
-    lua_State* L = data->L;
-
-    if (data->is_list) {
-        if (!eol) {
-            int i = lua_rawlen(L, 2);
-            lua_pushinteger(L, i + 1);
-            sink_info_to_lua(L, info);
-            lua_settable(L, 2);
-        } else {
-            // Insert the error argument
-            lua_pushnil(L);
-            lua_insert(L, -2);
-
-            lua_call(L, 2, 0);
-
-            free_lua_callback(data);
-        }
-    } else {
-        if (!eol) {
-            lua_pushfstring(L, "only one sink info expected, but got multiple");
-            lua_call(L, 1, 0);
-        } else {
-            lua_pushnil(L);
-            sink_info_to_lua(L, info);
+// Adapters that pass the decoded arguments to the libpulse functions.
 
-            lua_call(L, 2, 0);
 
-            free_lua_callback(data);
-        }
-    }
+static pa_operation* start_get_server_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_server_info(c, server_info_callback, userdata);
 }
 
 
-int context_get_sink_info_list(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 2);
-    data->is_list = true;
-    // Create the list to store infos in
-    lua_newtable(data->L);
-
-    pa_operation* op = pa_context_get_sink_info_list(ctx->context, sink_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get sink info list: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+static pa_operation* start_set_default_sink(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_default_sink(c, args->name, operation_success_callback, userdata);
 }
 
 
-int context_get_sink_info_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 2);
-
-    pa_operation* op = pa_context_get_sink_info_by_name(ctx->context, name, sink_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get sink info by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+static pa_operation* start_set_default_source(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_default_source(c, args->name, operation_success_callback, userdata);
 }
 
 
-int context_get_sink_info_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink index out of bounds. Got %d", index);
-    }
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 3);
-
-    pa_operation* op = pa_context_get_sink_info_by_index(ctx->context, (uint32_t) index - 1, sink_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get sink info by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+static pa_operation* start_get_sinks(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_sink_info_list(c, sink_info_callback, userdata);
 }
 
 
-int context_get_sink_info(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_get_sink_info_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_get_sink_info_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+static pa_operation* start_get_sink_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_sink_info_by_index(c, args->index, sink_info_callback, userdata);
 }
 
 
-int context_set_sink_volume_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-    const char* name = luaL_checkstring(L, 2);
-
-    if (lua_istable(L, 3)) {
-        pa_cvolume* volume = volume_from_lua(L, 3);
-        volume_to_lua(L, volume);
-        pa_xfree((void*) volume);
-    } else {
-        lua_pushvalue(L, 3);
-    }
-
-    volume_t* vol = luaL_checkudata(L, -1, LUA_PA_VOLUME);
-
-    // Move the volume userdata to the callback's thread. It needs to be kept alive
-    // until the callback has run.
-    lua_xmove(L, data->L, 1);
-
-    pa_operation* op = pa_context_set_sink_volume_by_name(ctx->context, name, &vol->inner, success_callback, data);
-
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set sink volume by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-    }
-
-    return 0;
+static pa_operation* start_get_sink_info_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_sink_info_by_name(c, args->name, sink_info_callback, userdata);
 }
 
 
-int context_set_sink_volume_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink index out of bounds. Got %d", index);
-    }
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    if (lua_istable(L, 3)) {
-        pa_cvolume* volume = volume_from_lua(L, 3);
-        volume_to_lua(L, volume);
-        pa_xfree((void*) volume);
-    } else {
-        lua_pushvalue(L, 3);
-    }
-
-    volume_t* vol = luaL_checkudata(L, -1, LUA_PA_VOLUME);
-
-    // Move the volume userdata to the callback's thread. It needs to be kept alive
-    // until the callback has run.
-    lua_xmove(L, data->L, 1);
-
-    pa_operation* op =
-        pa_context_set_sink_volume_by_index(ctx->context, (uint32_t) index - 1, &vol->inner, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set sink volume by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-    }
-
-    return 0;
+static pa_operation* start_set_sink_volume(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_sink_volume_by_index(c, args->index, &args->volume, operation_success_callback, userdata);
 }
 
 
-int context_set_sink_volume(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_set_sink_volume_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_set_sink_volume_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+static pa_operation* start_set_sink_volume_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_sink_volume_by_name(c, args->name, &args->volume, operation_success_callback, userdata);
 }
 
 
-int context_set_sink_mute_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
-    int mute = lua_toboolean(L, 3);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    pa_operation* op = pa_context_set_sink_mute_by_name(ctx->context, name, mute, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set sink mute by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+static pa_operation* start_set_sink_mute(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_sink_mute_by_index(c, args->index, args->flag, operation_success_callback, userdata);
 }
 
 
-int context_set_sink_mute_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink index out of bounds. Got %d", index);
-    }
-    int mute = lua_toboolean(L, 3);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
+static pa_operation* start_set_sink_mute_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_sink_mute_by_name(c, args->name, args->flag, operation_success_callback, userdata);
+}
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
 
-    pa_operation* op =
-        pa_context_set_sink_mute_by_index(ctx->context, (uint32_t) index - 1, mute, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set sink mute by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+static pa_operation* start_set_sink_suspended(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_suspend_sink_by_index(c, args->index, args->flag, operation_success_callback, userdata);
 }
 
 
-int context_set_sink_mute(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_set_sink_mute_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_set_sink_mute_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+static pa_operation* start_set_sink_suspended_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_suspend_sink_by_name(c, args->name, args->flag, operation_success_callback, userdata);
 }
 
 
-int context_set_sink_suspended_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
-    int suspended = lua_toboolean(L, 3);
+static pa_operation* start_get_sources(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_source_info_list(c, source_info_callback, userdata);
+}
 
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
+static pa_operation* start_get_source_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_source_info_by_index(c, args->index, source_info_callback, userdata);
+}
 
-    pa_operation* op = pa_context_suspend_sink_by_name(ctx->context, name, suspended, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set sink suspended by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+static pa_operation* start_get_source_info_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_source_info_by_name(c, args->name, source_info_callback, userdata);
 }
 
 
-int context_set_sink_suspended_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink index out of bounds. Got %d", index);
-    }
-    int suspended = lua_toboolean(L, 3);
+static pa_operation* start_set_source_volume(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_source_volume_by_index(c, args->index, &args->volume, operation_success_callback, userdata);
+}
 
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
+static pa_operation* start_set_source_volume_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_source_volume_by_name(c, args->name, &args->volume, operation_success_callback, userdata);
+}
 
-    pa_operation* op =
-        pa_context_suspend_sink_by_index(ctx->context, (uint32_t) index - 1, suspended, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set sink suspended by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+static pa_operation* start_set_source_mute(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_source_mute_by_index(c, args->index, args->flag, operation_success_callback, userdata);
 }
 
 
-int context_set_sink_suspended(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_set_sink_suspended_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_set_sink_suspended_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+static pa_operation* start_set_source_mute_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_source_mute_by_name(c, args->name, args->flag, operation_success_callback, userdata);
 }
 
 
-// Can be used both functions that produce a single value or the `_list` versions.
-// The `is_list` value on the userdata needs to be set accordingly.
-// For lists, the callback will be called multiple times, once for each entry.
-// The function that sets up the callback must make sure to push a table on the stack, where the
-// values can be collected.
-//
-// @tparam pa_source_info* info Pointer to the data.
-// @tparam boolean eol Indicates whether the last item of the list was reached.
-// @tparam simple_callback_data* userdata Expected to be an instance of `simple_callback_data`.
-void source_info_callback(pa_context* c, const pa_source_info* info, int eol, void* userdata) {
-    simple_callback_data* data = (simple_callback_data*) userdata;
-    lua_State* L = data->L;
-
-    if (data->is_list) {
-        if (!eol) {
-            int i = lua_rawlen(L, 2);
-            lua_pushinteger(L, i + 1);
-            source_info_to_lua(L, info);
-            lua_settable(L, 2);
-        } else {
-            // Insert the error argument
-            lua_pushnil(L);
-            lua_insert(L, -2);
-
-            lua_call(L, 2, 0);
-
-            free_lua_callback(data);
-        }
-    } else {
-        if (!eol) {
-            lua_pushfstring(L, "only one source info expected, but got multiple");
-            lua_call(L, 1, 0);
-        } else {
-            lua_pushnil(L);
-            source_info_to_lua(L, info);
-
-            lua_call(L, 2, 0);
-
-            free_lua_callback(data);
-        }
-    }
+static pa_operation* start_set_source_suspended(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_suspend_source_by_index(c, args->index, args->flag, operation_success_callback, userdata);
 }
 
 
-int context_get_source_info_list(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
+static pa_operation* start_set_source_suspended_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_suspend_source_by_name(c, args->name, args->flag, operation_success_callback, userdata);
+}
 
-    simple_callback_data* data = prepare_lua_callback(L, 2);
-    data->is_list = true;
-    // Create the list to store infos in
-    lua_newtable(data->L);
-
-    pa_operation* op = pa_context_get_source_info_list(ctx->context, source_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get source info list: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+static pa_operation* start_get_sink_inputs(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_sink_input_info_list(c, sink_input_info_callback, userdata);
 }
 
 
-int context_get_source_info_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
+static pa_operation* start_get_sink_input_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_sink_input_info(c, args->index, sink_input_info_callback, userdata);
+}
 
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 3);
+static pa_operation* start_move_sink_input(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_move_sink_input_by_index(
+        c, args->index, args->target_index, operation_success_callback, userdata);
+}
 
-    pa_operation* op = pa_context_get_source_info_by_name(ctx->context, name, source_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get source info by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+static pa_operation* start_move_sink_input_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_move_sink_input_by_name(c, args->index, args->target_name, operation_success_callback, userdata);
 }
 
 
-int context_get_source_info_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source index out of bounds. Got %d", index);
-    }
+static pa_operation* start_set_sink_input_volume(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_sink_input_volume(c, args->index, &args->volume, operation_success_callback, userdata);
+}
 
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 3);
+static pa_operation* start_set_sink_input_mute(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_sink_input_mute(c, args->index, args->flag, operation_success_callback, userdata);
+}
 
-    pa_operation* op =
-        pa_context_get_source_info_by_index(ctx->context, (uint32_t) index - 1, source_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get source info by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+static pa_operation* start_kill_sink_input(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_kill_sink_input(c, args->index, operation_success_callback, userdata);
 }
 
 
-int context_get_source_info(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_get_source_info_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_get_source_info_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+static pa_operation* start_get_source_outputs(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_source_output_info_list(c, source_output_info_callback, userdata);
 }
 
 
-int context_set_source_volume_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
+static pa_operation* start_get_source_output_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_source_output_info(c, args->index, source_output_info_callback, userdata);
+}
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-    const char* name = luaL_checkstring(L, 2);
 
-    if (lua_istable(L, 3)) {
-        pa_cvolume* volume = volume_from_lua(L, 3);
-        volume_to_lua(L, volume);
-        pa_xfree((void*) volume);
-    } else {
-        lua_pushvalue(L, 3);
-    }
+static pa_operation* start_move_source_output(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_move_source_output_by_index(
+        c, args->index, args->target_index, operation_success_callback, userdata);
+}
 
-    volume_t* vol = luaL_checkudata(L, -1, LUA_PA_VOLUME);
 
-    // Move the volume userdata to the callback's thread. It needs to be kept alive
-    // until the callback has run.
-    lua_xmove(L, data->L, 1);
+static pa_operation* start_move_source_output_by_name(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_move_source_output_by_name(
+        c, args->index, args->target_name, operation_success_callback, userdata);
+}
 
-    pa_operation* op = pa_context_set_source_volume_by_name(ctx->context, name, &vol->inner, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set source volume by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-    }
 
-    return 0;
+static pa_operation* start_set_source_output_volume(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_source_output_volume(c, args->index, &args->volume, operation_success_callback, userdata);
 }
 
 
-int context_set_source_volume_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source index out of bounds. Got %d", index);
-    }
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
+static pa_operation* start_set_source_output_mute(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_set_source_output_mute(c, args->index, args->flag, operation_success_callback, userdata);
+}
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
 
-    if (lua_istable(L, 3)) {
-        pa_cvolume* volume = volume_from_lua(L, 3);
-        volume_to_lua(L, volume);
-        pa_xfree((void*) volume);
-    } else {
-        lua_pushvalue(L, 3);
-    }
+static pa_operation* start_kill_source_output(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_kill_source_output(c, args->index, operation_success_callback, userdata);
+}
 
-    volume_t* vol = luaL_checkudata(L, -1, LUA_PA_VOLUME);
 
-    // Move the volume userdata to the callback's thread. It needs to be kept alive
-    // until the callback has run.
-    lua_xmove(L, data->L, 1);
+static pa_operation* start_get_clients(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_client_info_list(c, client_info_callback, userdata);
+}
 
-    pa_operation* op =
-        pa_context_set_source_volume_by_index(ctx->context, (uint32_t) index - 1, &vol->inner, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set source volume by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-    }
 
-    return 0;
+static pa_operation* start_get_client_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_client_info(c, args->index, client_info_callback, userdata);
 }
 
 
-int context_set_source_volume(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_set_source_volume_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_set_source_volume_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+static pa_operation* start_get_modules(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_module_info_list(c, module_info_callback, userdata);
 }
 
 
-int context_set_source_mute_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
-    int mute = lua_toboolean(L, 3);
+static pa_operation* start_get_module_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_module_info(c, args->index, module_info_callback, userdata);
+}
 
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
+static pa_operation* start_get_samples(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_sample_info_list(c, sample_info_callback, userdata);
+}
 
-    pa_operation* op = pa_context_set_source_mute_by_name(ctx->context, name, mute, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set source mute by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+static pa_operation* start_get_sample_info(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_get_sample_info_by_name(c, args->name, sample_info_callback, userdata);
 }
 
 
-int context_set_source_mute_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source index out of bounds. Got %d", index);
-    }
-    int mute = lua_toboolean(L, 3);
+static pa_operation* start_remove_sample(pa_context* c, const operation_args* args, void* userdata) {
+    return pa_context_remove_sample(c, args->name, operation_success_callback, userdata);
+}
 
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
+const operation_kind operation_kinds[OPERATION_ID_MAX] = {
+    [OPERATION_GET_SERVER_INFO] = {
+        .name = "get_server_info",
+        .description = "get server info",
+        .result = OPERATION_RESULT_INFO,
+        .schema = &server_info_schema,
+        .start = start_get_server_info,
+    },
+    [OPERATION_SET_DEFAULT_SINK] = {
+        .name = "set_default_sink",
+        .description = "set default sink",
+        .args = { OPERATION_ARG_NAME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_default_sink,
+    },
+    [OPERATION_SET_DEFAULT_SOURCE] = {
+        .name = "set_default_source",
+        .description = "set default source",
+        .args = { OPERATION_ARG_NAME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_default_source,
+    },
+    [OPERATION_GET_SINKS] = {
+        .name = "get_sinks",
+        .description = "get sink info list",
+        .result = OPERATION_RESULT_LIST,
+        .schema = &sink_info_schema,
+        .start = start_get_sinks,
+    },
+    [OPERATION_GET_SINK_INFO] = {
+        .name = "get_sink_info",
+        .description = "get sink info",
+        .args = { OPERATION_ARG_INDEX_OR_NAME },
+        .result = OPERATION_RESULT_INFO,
+        .schema = &sink_info_schema,
+        .start = start_get_sink_info,
+        .start_by_name = start_get_sink_info_by_name,
+    },
+    [OPERATION_SET_SINK_VOLUME] = {
+        .name = "set_sink_volume",
+        .description = "set sink volume",
+        .args = { OPERATION_ARG_INDEX_OR_NAME, OPERATION_ARG_VOLUME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .mirror = MIRROR_SINK,
+        .start = start_set_sink_volume,
+        .start_by_name = start_set_sink_volume_by_name,
+    },
+    [OPERATION_SET_SINK_MUTE] = {
+        .name = "set_sink_mute",
+        .description = "set sink mute",
+        .args = { OPERATION_ARG_INDEX_OR_NAME, OPERATION_ARG_BOOLEAN },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_sink_mute,
+        .start_by_name = start_set_sink_mute_by_name,
+    },
+    [OPERATION_SET_SINK_SUSPENDED] = {
+        .name = "set_sink_suspended",
+        .description = "set sink suspended",
+        .args = { OPERATION_ARG_INDEX_OR_NAME, OPERATION_ARG_BOOLEAN },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_sink_suspended,
+        .start_by_name = start_set_sink_suspended_by_name,
+    },
+    [OPERATION_GET_SOURCES] = {
+        .name = "get_sources",
+        .description = "get source info list",
+        .result = OPERATION_RESULT_LIST,
+        .schema = &source_info_schema,
+        .start = start_get_sources,
+    },
+    [OPERATION_GET_SOURCE_INFO] = {
+        .name = "get_source_info",
+        .description = "get source info",
+        .args = { OPERATION_ARG_INDEX_OR_NAME },
+        .result = OPERATION_RESULT_INFO,
+        .schema = &source_info_schema,
+        .start = start_get_source_info,
+        .start_by_name = start_get_source_info_by_name,
+    },
+    [OPERATION_SET_SOURCE_VOLUME] = {
+        .name = "set_source_volume",
+        .description = "set source volume",
+        .args = { OPERATION_ARG_INDEX_OR_NAME, OPERATION_ARG_VOLUME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .mirror = MIRROR_SOURCE,
+        .start = start_set_source_volume,
+        .start_by_name = start_set_source_volume_by_name,
+    },
+    [OPERATION_SET_SOURCE_MUTE] = {
+        .name = "set_source_mute",
+        .description = "set source mute",
+        .args = { OPERATION_ARG_INDEX_OR_NAME, OPERATION_ARG_BOOLEAN },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_source_mute,
+        .start_by_name = start_set_source_mute_by_name,
+    },
+    [OPERATION_SET_SOURCE_SUSPENDED] = {
+        .name = "set_source_suspended",
+        .description = "set source suspended",
+        .args = { OPERATION_ARG_INDEX_OR_NAME, OPERATION_ARG_BOOLEAN },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_source_suspended,
+        .start_by_name = start_set_source_suspended_by_name,
+    },
+    [OPERATION_GET_SINK_INPUTS] = {
+        .name = "get_sink_inputs",
+        .description = "get sink input info list",
+        .result = OPERATION_RESULT_LIST,
+        .schema = &sink_input_info_schema,
+        .start = start_get_sink_inputs,
+    },
+    [OPERATION_GET_SINK_INPUT_INFO] = {
+        .name = "get_sink_input_info",
+        .description = "get sink input info",
+        .args = { OPERATION_ARG_INDEX },
+        .result = OPERATION_RESULT_INFO,
+        .schema = &sink_input_info_schema,
+        .start = start_get_sink_input_info,
+    },
+    [OPERATION_MOVE_SINK_INPUT] = {
+        .name = "move_sink_input",
+        .description = "move sink input",
+        .args = { OPERATION_ARG_INDEX, OPERATION_ARG_INDEX_OR_NAME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_move_sink_input,
+        .start_by_name = start_move_sink_input_by_name,
+    },
+    [OPERATION_SET_SINK_INPUT_VOLUME] = {
+        .name = "set_sink_input_volume",
+        .description = "set sink input volume",
+        .args = { OPERATION_ARG_INDEX, OPERATION_ARG_VOLUME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .mirror = MIRROR_SINK_INPUT,
+        .start = start_set_sink_input_volume,
+    },
+    [OPERATION_SET_SINK_INPUT_MUTE] = {
+        .name = "set_sink_input_mute",
+        .description = "set sink input mute",
+        .args = { OPERATION_ARG_INDEX, OPERATION_ARG_BOOLEAN },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_sink_input_mute,
+    },
+    [OPERATION_KILL_SINK_INPUT] = {
+        .name = "kill_sink_input",
+        .description = "kill sink input",
+        .args = { OPERATION_ARG_INDEX },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_kill_sink_input,
+    },
+    [OPERATION_GET_SOURCE_OUTPUTS] = {
+        .name = "get_source_outputs",
+        .description = "get source output info list",
+        .result = OPERATION_RESULT_LIST,
+        .schema = &source_output_info_schema,
+        .start = start_get_source_outputs,
+    },
+    [OPERATION_GET_SOURCE_OUTPUT_INFO] = {
+        .name = "get_source_output_info",
+        .description = "get source output info",
+        .args = { OPERATION_ARG_INDEX },
+        .result = OPERATION_RESULT_INFO,
+        .schema = &source_output_info_schema,
+        .start = start_get_source_output_info,
+    },
+    [OPERATION_MOVE_SOURCE_OUTPUT] = {
+        .name = "move_source_output",
+        .description = "move source output",
+        .args = { OPERATION_ARG_INDEX, OPERATION_ARG_INDEX_OR_NAME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_move_source_output,
+        .start_by_name = start_move_source_output_by_name,
+    },
+    [OPERATION_SET_SOURCE_OUTPUT_VOLUME] = {
+        .name = "set_source_output_volume",
+        .description = "set source output volume",
+        .args = { OPERATION_ARG_INDEX, OPERATION_ARG_VOLUME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .mirror = MIRROR_SOURCE_OUTPUT,
+        .start = start_set_source_output_volume,
+    },
+    [OPERATION_SET_SOURCE_OUTPUT_MUTE] = {
+        .name = "set_source_output_mute",
+        .description = "set source output mute",
+        .args = { OPERATION_ARG_INDEX, OPERATION_ARG_BOOLEAN },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_set_source_output_mute,
+    },
+    [OPERATION_KILL_SOURCE_OUTPUT] = {
+        .name = "kill_source_output",
+        .description = "kill source output",
+        .args = { OPERATION_ARG_INDEX },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_kill_source_output,
+    },
+    [OPERATION_GET_CLIENTS] = {
+        .name = "get_clients",
+        .description = "get client info list",
+        .result = OPERATION_RESULT_LIST,
+        .schema = &client_info_schema,
+        .start = start_get_clients,
+    },
+    [OPERATION_GET_CLIENT_INFO] = {
+        .name = "get_client_info",
+        .description = "get client info",
+        .args = { OPERATION_ARG_INDEX },
+        .result = OPERATION_RESULT_INFO,
+        .schema = &client_info_schema,
+        .start = start_get_client_info,
+    },
+    [OPERATION_GET_MODULES] = {
+        .name = "get_modules",
+        .description = "get module info list",
+        .result = OPERATION_RESULT_LIST,
+        .schema = &module_info_schema,
+        .start = start_get_modules,
+    },
+    [OPERATION_GET_MODULE_INFO] = {
+        .name = "get_module_info",
+        .description = "get module info",
+        .args = { OPERATION_ARG_INDEX },
+        .result = OPERATION_RESULT_INFO,
+        .schema = &module_info_schema,
+        .start = start_get_module_info,
+    },
+    [OPERATION_GET_SAMPLES] = {
+        .name = "get_samples",
+        .description = "get sample info list",
+        .result = OPERATION_RESULT_LIST,
+        .schema = &sample_info_schema,
+        .start = start_get_samples,
+    },
+    [OPERATION_GET_SAMPLE_INFO] = {
+        .name = "get_sample_info",
+        .description = "get sample info",
+        .args = { OPERATION_ARG_NAME },
+        .result = OPERATION_RESULT_INFO,
+        .schema = &sample_info_schema,
+        .start = start_get_sample_info,
+    },
+    [OPERATION_REMOVE_SAMPLE] = {
+        .name = "remove_sample",
+        .description = "remove sample",
+        .args = { OPERATION_ARG_NAME },
+        .result = OPERATION_RESULT_SUCCESS,
+        .start = start_remove_sample,
+    },
+};
 
-    pa_operation* op =
-        pa_context_set_source_mute_by_index(ctx->context, (uint32_t) index - 1, mute, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set source mute by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+int context_get_server_info(lua_State* L) {
+    return operation_run(L, OPERATION_GET_SERVER_INFO);
 }
 
 
-int context_set_source_mute(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_set_source_mute_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_set_source_mute_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+int context_get_sink_info_list(lua_State* L) {
+    return operation_run(L, OPERATION_GET_SINKS);
 }
 
 
-int context_set_source_suspended_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    const char* name = luaL_checkstring(L, 2);
-    int suspended = lua_toboolean(L, 3);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
+int context_get_sink_info(lua_State* L) {
+    return operation_run(L, OPERATION_GET_SINK_INFO);
+}
 
-    pa_operation* op = pa_context_suspend_source_by_name(ctx->context, name, suspended, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set source suspended by name: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+int context_set_sink_volume(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SINK_VOLUME);
 }
 
 
-int context_set_source_suspended_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source index out of bounds. Got %d", index);
-    }
-    int suspended = lua_toboolean(L, 3);
+int context_set_sink_mute(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SINK_MUTE);
+}
 
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    simple_callback_data* data = prepare_lua_callback(L, 4);
+int context_set_sink_suspended(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SINK_SUSPENDED);
+}
 
-    pa_operation* op =
-        pa_context_suspend_source_by_index(ctx->context, (uint32_t) index - 1, suspended, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set source suspended by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+int context_get_source_info_list(lua_State* L) {
+    return operation_run(L, OPERATION_GET_SOURCES);
 }
 
 
-int context_set_source_suspended(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_set_source_suspended_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_set_source_suspended_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+int context_get_source_info(lua_State* L) {
+    return operation_run(L, OPERATION_GET_SOURCE_INFO);
 }
 
 
-void sink_input_info_callback(pa_context* c, const pa_sink_input_info* info, int eol, void* userdata) {
-    simple_callback_data* data = (simple_callback_data*) userdata;
-    lua_State* L = data->L;
-
-    if (data->is_list) {
-        if (!eol) {
-            int i = lua_rawlen(L, 2);
-            lua_pushinteger(L, i + 1);
-            sink_input_info_to_lua(L, info);
-            lua_settable(L, 2);
-        } else {
-            // Insert the error argument
-            lua_pushnil(L);
-            lua_insert(L, -2);
+int context_set_source_volume(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SOURCE_VOLUME);
+}
 
-            lua_call(L, 2, 0);
 
-            free_lua_callback(data);
-        }
-    } else {
-        if (!eol) {
-            lua_pushfstring(L, "only one sink input info expected, but got multiple");
-            lua_call(L, 1, 0);
-        } else {
-            lua_pushnil(L);
-            sink_input_info_to_lua(L, info);
+int context_set_source_mute(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SOURCE_MUTE);
+}
 
-            lua_call(L, 2, 0);
 
-            free_lua_callback(data);
-        }
-    }
+int context_set_source_suspended(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SOURCE_SUSPENDED);
 }
 
 
 int context_get_sink_input_info_list(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 2);
-    data->is_list = true;
-    // Create the list to store infos in
-    lua_newtable(data->L);
-
-    pa_operation* op = pa_context_get_sink_input_info_list(ctx->context, sink_input_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get source info list: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+    return operation_run(L, OPERATION_GET_SINK_INPUTS);
 }
 
 
 int context_get_sink_input_info(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink input index out of bounds. Got %d", index);
-    }
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 3);
-
-    pa_operation* op =
-        pa_context_get_sink_input_info(ctx->context, (uint32_t) index - 1, sink_input_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get sink input info by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+    return operation_run(L, OPERATION_GET_SINK_INPUT_INFO);
 }
 
 
 int context_move_sink_input(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_move_sink_input_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_move_sink_input_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
-}
-
-
-int context_move_sink_input_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer sink_input_index = luaL_checkinteger(L, 2);
-    if (sink_input_index < 1) {
-        return luaL_error(L, "Sink input index out of bounds. Got %d", sink_input_index);
-    }
-
-    lua_Integer sink_index = luaL_checkinteger(L, 3);
-    if (sink_index < 1) {
-        return luaL_error(L, "Sink index out of bounds. Got %d", sink_index);
-    }
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    pa_operation* op = pa_context_move_sink_input_by_index(ctx->context,
-                                                           (uint32_t) sink_input_index - 1,
-                                                           (uint32_t) sink_index - 1,
-                                                           success_callback,
-                                                           data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L,
-                        "failed to move sink input %d to sink %d: %s",
-                        sink_input_index,
-                        sink_index,
-                        pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
-}
-
-
-int context_move_sink_input_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer sink_input_index = luaL_checkinteger(L, 2);
-    if (sink_input_index < 1) {
-        return luaL_error(L, "Sink input index out of bounds. Got %d", sink_input_index);
-    }
-
-    const char* sink_name = luaL_checkstring(L, 3);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    pa_operation* op = pa_context_move_sink_input_by_name(ctx->context,
-                                                          (uint32_t) sink_input_index - 1,
-                                                          sink_name,
-                                                          success_callback,
-                                                          data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L,
-                        "failed to move sink input %d to sink %s: %s",
-                        sink_input_index,
-                        sink_name,
-                        pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+    return operation_run(L, OPERATION_MOVE_SINK_INPUT);
 }
 
 
 int context_set_sink_input_volume(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink input index out of bounds. Got %d", index);
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    if (lua_istable(L, 3)) {
-        pa_cvolume* volume = volume_from_lua(L, 3);
-        volume_to_lua(L, volume);
-        pa_xfree((void*) volume);
-    } else {
-        lua_pushvalue(L, 3);
-    }
-
-    volume_t* vol = luaL_checkudata(L, -1, LUA_PA_VOLUME);
-
-    // Move the volume userdata to the callback's thread. It needs to be kept alive
-    // until the callback has run.
-    lua_xmove(L, data->L, 1);
-
-    pa_operation* op =
-        pa_context_set_sink_input_volume(ctx->context, (uint32_t) index - 1, &vol->inner, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set volume for sink input %d: %s", index, pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+    return operation_run(L, OPERATION_SET_SINK_INPUT_VOLUME);
 }
 
 
 int context_set_sink_input_mute(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink input index out of bounds. Got %d", index);
-    }
-    bool mute = lua_toboolean(L, 3);
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    pa_operation* op = pa_context_set_sink_input_mute(ctx->context, (uint32_t) index - 1, mute, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set mute for sink input %d: %s", index, pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+    return operation_run(L, OPERATION_SET_SINK_INPUT_MUTE);
 }
 
 
 int context_kill_sink_input(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Sink input index out of bounds. Got %d", index);
-    }
-
-
-    simple_callback_data* data = prepare_lua_callback(L, 3);
-
-    pa_operation* op = pa_context_kill_sink_input(ctx->context, (uint32_t) index - 1, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to kill sink input %d: %s", index, pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
-}
-
-
-void source_output_info_callback(pa_context* c, const pa_source_output_info* info, int eol, void* userdata) {
-    simple_callback_data* data = (simple_callback_data*) userdata;
-    lua_State* L = data->L;
-
-    if (data->is_list) {
-        if (!eol) {
-            int i = lua_rawlen(L, 2);
-            lua_pushinteger(L, i + 1);
-            source_output_info_to_lua(L, info);
-            lua_settable(L, 2);
-        } else {
-            // Insert the error argument
-            lua_pushnil(L);
-            lua_insert(L, -2);
-
-            lua_call(L, 2, 0);
-
-            free_lua_callback(data);
-        }
-    } else {
-        if (!eol) {
-            lua_pushfstring(L, "only one source output info expected, but got multiple");
-            lua_call(L, 1, 0);
-        } else {
-            lua_pushnil(L);
-            source_output_info_to_lua(L, info);
-
-            lua_call(L, 2, 0);
-
-            free_lua_callback(data);
-        }
-    }
+    return operation_run(L, OPERATION_KILL_SINK_INPUT);
 }
 
 
 int context_get_source_output_info_list(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 2);
-    data->is_list = true;
-    // Create the list to store infos in
-    lua_newtable(data->L);
-
-    pa_operation* op = pa_context_get_source_output_info_list(ctx->context, source_output_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get source info list: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+    return operation_run(L, OPERATION_GET_SOURCE_OUTPUTS);
 }
 
 
 int context_get_source_output_info(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source output index out of bounds. Got %d", index);
-    }
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 3);
-
-    pa_operation* op =
-        pa_context_get_source_output_info(ctx->context, (uint32_t) index - 1, source_output_info_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to get source output info by index: %s", pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+    return operation_run(L, OPERATION_GET_SOURCE_OUTPUT_INFO);
 }
 
 
 int context_move_source_output(lua_State* L) {
-    switch (lua_type(L, 2)) {
-    case LUA_TSTRING: {
-        return context_move_source_output_by_name(L);
-    }
-    case LUA_TNUMBER: {
-        return context_move_source_output_by_index(L);
-    }
-    default: {
-        lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, 2));
-        return luaL_argerror(L, 2, lua_tostring(L, -1));
-    }
-    }
+    return operation_run(L, OPERATION_MOVE_SOURCE_OUTPUT);
 }
 
 
-int context_move_source_output_by_index(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer source_output_index = luaL_checkinteger(L, 2);
-    if (source_output_index < 1) {
-        return luaL_error(L, "Source output index out of bounds. Got %d", source_output_index);
-    }
-
-    lua_Integer source_index = luaL_checkinteger(L, 3);
-    if (source_index < 1) {
-        return luaL_error(L, "Source index out of bounds. Got %d", source_index);
-    }
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    pa_operation* op = pa_context_move_source_output_by_index(ctx->context,
-                                                              (uint32_t) source_output_index - 1,
-                                                              (uint32_t) source_index - 1,
-                                                              success_callback,
-                                                              data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L,
-                        "failed to move source output %d to source %d: %s",
-                        source_output_index,
-                        source_index,
-                        pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+int context_set_source_output_volume(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SOURCE_OUTPUT_VOLUME);
 }
 
 
-int context_move_source_output_by_name(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer source_output_index = luaL_checkinteger(L, 2);
-    if (source_output_index < 1) {
-        return luaL_error(L, "Source output index out of bounds. Got %d", source_output_index);
-    }
-
-    const char* source_name = luaL_checkstring(L, 3);
-
-    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
-        lua_pushvalue(L, 2);
-        lua_pushstring(L, "connection not ready");
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    pa_operation* op = pa_context_move_source_output_by_name(ctx->context,
-                                                             (uint32_t) source_output_index - 1,
-                                                             source_name,
-                                                             success_callback,
-                                                             data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L,
-                        "failed to move source output %d to source %s: %s",
-                        source_output_index,
-                        source_name,
-                        pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+int context_set_source_output_mute(lua_State* L) {
+    return operation_run(L, OPERATION_SET_SOURCE_OUTPUT_MUTE);
 }
 
 
-int context_set_source_output_volume(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source output index out of bounds. Got %d", index);
-    }
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    if (lua_istable(L, 3)) {
-        pa_cvolume* volume = volume_from_lua(L, 3);
-        volume_to_lua(L, volume);
-        pa_xfree((void*) volume);
-    } else {
-        lua_pushvalue(L, 3);
-    }
+int context_kill_source_output(lua_State* L) {
+    return operation_run(L, OPERATION_KILL_SOURCE_OUTPUT);
+}
 
-    volume_t* vol = luaL_checkudata(L, -1, LUA_PA_VOLUME);
 
-    // Move the volume userdata to the callback's thread. It needs to be kept alive
-    // until the callback has run.
-    lua_xmove(L, data->L, 1);
+int context_get_client_info_list(lua_State* L) {
+    return operation_run(L, OPERATION_GET_CLIENTS);
+}
 
-    pa_operation* op =
-        pa_context_set_source_output_volume(ctx->context, (uint32_t) index - 1, &vol->inner, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set volume for source output %d: %s", index, pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+int context_get_client_info(lua_State* L) {
+    return operation_run(L, OPERATION_GET_CLIENT_INFO);
 }
 
 
-int context_set_source_output_mute(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source output index out of bounds. Got %d", index);
-    }
-    bool mute = lua_toboolean(L, 3);
-
-    simple_callback_data* data = prepare_lua_callback(L, 4);
-
-    pa_operation* op =
-        pa_context_set_source_output_mute(ctx->context, (uint32_t) index - 1, mute, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to set mute for source output %d: %s", index, pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
-
-    return 0;
+int context_get_module_info_list(lua_State* L) {
+    return operation_run(L, OPERATION_GET_MODULES);
 }
 
 
-int context_kill_source_output(lua_State* L) {
-    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
-    lua_Integer index = luaL_checkinteger(L, 2);
-    if (index < 1) {
-        return luaL_error(L, "Source output index out of bounds. Got %d", index);
-    }
+int context_get_module_info(lua_State* L) {
+    return operation_run(L, OPERATION_GET_MODULE_INFO);
+}
 
 
-    simple_callback_data* data = prepare_lua_callback(L, 3);
+int context_get_sample_info_list(lua_State* L) {
+    return operation_run(L, OPERATION_GET_SAMPLES);
+}
 
-    pa_operation* op = pa_context_kill_source_output(ctx->context, (uint32_t) index - 1, success_callback, data);
-    if (op == NULL) {
-        int error = pa_context_errno(ctx->context);
-        lua_pushvalue(L, 2);
-        lua_pushfstring(L, "failed to kill source output %d: %s", index, pa_strerror(error));
-        lua_call(L, 1, 0);
-        return 0;
-    }
 
-    return 0;
+int context_get_sample_info(lua_State* L) {
+    return operation_run(L, OPERATION_GET_SAMPLE_INFO);
 }
@@ -14,6 +14,21 @@
 #define lua_equal(L, i1, i2) lua_compare(L, i1, i2, LUA_OPEQ)
 #endif
 
+// Like `luaL_testudata`, which doesn't exist in Lua 5.1.
+static inline void* luaU_testudata(lua_State* L, int index, const char* name) {
+    void* p = lua_touserdata(L, index);
+    if (p == NULL || !lua_getmetatable(L, index)) {
+        return NULL;
+    }
+
+    luaL_getmetatable(L, name);
+    if (!lua_rawequal(L, -1, -2)) {
+        p = NULL;
+    }
+    lua_pop(L, 2);
+    return p;
+}
+
 typedef struct luaU_enumfield {
     const char* name;
     const char* value;
@@ -0,0 +1,234 @@
+#include "lut.h"
+
+#include <float.h>
+#include <glib.h>
+#include <math.h>
+
+
+// `log2(1 + i / LUT_SEGMENTS)` and `2^(i / LUT_SEGMENTS)`.
+static double log2_table[LUT_SEGMENTS + 1];
+static double exp2_table[LUT_SEGMENTS + 1];
+static bool initialized = false;
+static lut_error error;
+
+// `log2(PA_VOLUME_NORM)`, as volumes are `PA_VOLUME_NORM * linear^(1/3)`.
+static double norm_exponent;
+// `60 * log10(2)`, which converts the base 2 exponent of a volume to dB.
+static double dB_per_exponent;
+
+
+void lut_init(void) {
+    if (initialized) {
+        return;
+    }
+
+    for (size_t i = 0; i <= LUT_SEGMENTS; i++) {
+        double x = (double) i / LUT_SEGMENTS;
+        log2_table[i] = log2(1.0 + x);
+        exp2_table[i] = exp2(x);
+    }
+
+    // Linear interpolation is furthest off where the curve's slope equals the chord's. Both functions have a
+    // closed form inverse for their derivative, so that point can be computed exactly for every segment.
+    double log2_error = 0;
+    double exp2_error = 0;
+    double h = 1.0 / LUT_SEGMENTS;
+    for (size_t i = 0; i < LUT_SEGMENTS; i++) {
+        double a = (double) i * h;
+        double slope = (log2_table[i + 1] - log2_table[i]) / h;
+        double x = 1.0 / (slope * M_LN2) - 1.0;
+        log2_error = MAX(log2_error, fabs(log2(1.0 + x) - (log2_table[i] + slope * (x - a))));
+
+        slope = (exp2_table[i + 1] - exp2_table[i]) / h;
+        x = log2(slope / M_LN2);
+        exp2_error = MAX(exp2_error, fabs(exp2_table[i] + slope * (x - a) - exp2(x)) / exp2_table[i]);
+    }
+
+    // Leave room for the rounding of the table entries and the arithmetic around them.
+    log2_error += 8 * DBL_EPSILON;
+    exp2_error += 8 * DBL_EPSILON;
+
+    norm_exponent = log2((double) PA_VOLUME_NORM);
+    dB_per_exponent = 60.0 * log10(2.0);
+
+    error.to_dB = dB_per_exponent * log2_error;
+    error.from_dB = exp2_error;
+    error.from_linear = (1.0 + exp2_error) * exp2(log2_error / 3.0) - 1.0;
+
+    initialized = true;
+}
+
+
+const lut_error* lut_get_error(void) {
+    return &error;
+}
+
+
+static inline double interpolate(const double* table, double x) {
+    double t = x * LUT_SEGMENTS;
+    size_t i = MIN((size_t) t, LUT_SEGMENTS - 1);
+    return table[i] + (t - (double) i) * (table[i + 1] - table[i]);
+}
+
+
+// `log2(value)`, for finite values greater than `0`.
+static inline double fast_log2(double value) {
+    int exponent;
+    double mantissa = frexp(value, &exponent);
+    return (double) (exponent - 1) + interpolate(log2_table, mantissa * 2.0 - 1.0);
+}
+
+
+// Converts a base 2 exponent relative to `PA_VOLUME_NORM` to a volume, rounding like `pa_sw_volume_from_linear`.
+static inline pa_volume_t volume_from_exponent(double exponent) {
+    double y = exponent + norm_exponent;
+    // Below this, the result rounds to `0`. Above, it's beyond `PA_VOLUME_MAX`.
+    if (y < -2.0) {
+        return PA_VOLUME_MUTED;
+    }
+    if (!(y < 32.0)) {
+        return PA_VOLUME_MAX;
+    }
+
+    double whole = floor(y);
+    double value = ldexp(interpolate(exp2_table, y - whole), (int) whole);
+    return (pa_volume_t) PA_CLAMP_VOLUME((uint64_t) lround(value));
+}
+
+
+double lut_volume_to_dB(pa_volume_t volume) {
+    if (volume <= PA_VOLUME_MUTED) {
+        return PA_DECIBEL_MININFTY;
+    }
+    if (volume == PA_VOLUME_NORM) {
+        return 0.0;
+    }
+
+    return dB_per_exponent * (fast_log2((double) volume) - norm_exponent);
+}
+
+
+pa_volume_t lut_volume_from_dB(double dB) {
+    // Also catches `NaN`.
+    if (!(dB > PA_DECIBEL_MININFTY)) {
+        return PA_VOLUME_MUTED;
+    }
+    // `pa_sw_volume_from_dB` goes through `pa_sw_volume_from_linear`, and snaps to normal volume with it. The
+    // window is a little less than 0.01 dB wide either way, so the exact factor is only needed close to it.
+    if (fabs(dB) < 0.01) {
+        double value = pow(10.0, dB / 20.0);
+        if (value > 0.999 && value < 1.001) {
+            return PA_VOLUME_NORM;
+        }
+    }
+
+    return volume_from_exponent(dB / dB_per_exponent);
+}
+
+
+double lut_volume_to_linear(pa_volume_t volume) {
+    // This is a plain cube, which is cheap enough already.
+    return pa_sw_volume_to_linear(volume);
+}
+
+
+pa_volume_t lut_volume_from_linear(double value) {
+    if (!(value > 0.0)) {
+        return PA_VOLUME_MUTED;
+    }
+    if (isinf(value)) {
+        return PA_VOLUME_MAX;
+    }
+    // Like `pa_sw_volume_from_linear`, factors close to `1.0` snap to normal volume.
+    if (value > 0.999 && value < 1.001) {
+        return PA_VOLUME_NORM;
+    }
+
+    return volume_from_exponent(fast_log2(value) / 3.0);
+}
+
+
+// The number of points within each segment that the compiled curve is compared at.
+#define CURVE_PROBES 7
+
+
+static double clamp_volume(double value) {
+    // Also catches `NaN`.
+    if (!(value > PA_VOLUME_MUTED)) {
+        return PA_VOLUME_MUTED;
+    }
+    return MIN(value, (double) PA_VOLUME_MAX);
+}
+
+
+bool lut_curve_compile(lut_curve* curve, size_t size, lut_curve_fn fn, void* userdata) {
+    lut_curve_clear(curve);
+    curve->size = MAX(size, 1);
+    curve->volumes = g_new0(double, curve->size + 1);
+
+    for (size_t i = 0; i <= curve->size; i++) {
+        curve->volumes[i] = clamp_volume(fn((double) i / (double) curve->size, userdata));
+        if (i > 0 && curve->volumes[i] < curve->volumes[i - 1]) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < curve->size; i++) {
+        for (size_t p = 1; p <= CURVE_PROBES; p++) {
+            double t = (double) p / (CURVE_PROBES + 1);
+            double exact = clamp_volume(fn(((double) i + t) / (double) curve->size, userdata));
+            double approximation = curve->volumes[i] + t * (curve->volumes[i + 1] - curve->volumes[i]);
+            curve->error = MAX(curve->error, fabs(exact - approximation));
+        }
+    }
+
+    return true;
+}
+
+
+void lut_curve_clear(lut_curve* curve) {
+    g_free(curve->volumes);
+    curve->volumes = NULL;
+    curve->size = 0;
+    curve->error = 0;
+}
+
+
+pa_volume_t lut_curve_to_volume(const lut_curve* curve, double position) {
+    // Also catches `NaN`.
+    if (!(position > 0.0)) {
+        position = 0.0;
+    }
+
+    double t = MIN(position, 1.0) * (double) curve->size;
+    size_t i = MIN((size_t) t, curve->size - 1);
+    double value = curve->volumes[i] + (t - (double) i) * (curve->volumes[i + 1] - curve->volumes[i]);
+    return (pa_volume_t) PA_CLAMP_VOLUME((uint64_t) lround(value));
+}
+
+
+double lut_curve_to_position(const lut_curve* curve, pa_volume_t volume) {
+    double value = (double) volume;
+    if (value <= curve->volumes[0]) {
+        return 0.0;
+    }
+    if (value > curve->volumes[curve->size]) {
+        return 1.0;
+    }
+
+    // Find the first sample that reaches the volume. Flat stretches resolve to their lowest position.
+    size_t low = 1;
+    size_t high = curve->size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (curve->volumes[mid] >= value) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    double a = curve->volumes[low - 1];
+    double b = curve->volumes[low];
+    return ((double) (low - 1) + (value - a) / (b - a)) / (double) curve->size;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <pulse/volume.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The number of linear segments in the conversion tables. Must be a power of two.
+#define LUT_SEGMENTS 1024
+
+
+// The worst-case errors of the table based conversions. These are computed when the tables are built, from the
+// exact maximum of each segment's interpolation error, so they are guaranteed rather than sampled.
+typedef struct lut_error {
+    // In dB.
+    double to_dB;
+    // Relative to the exact result, before rounding to an integer volume.
+    double from_dB;
+    double from_linear;
+} lut_error;
+
+
+// Builds the tables, if that hasn't happened yet.
+void lut_init(void);
+
+const lut_error* lut_get_error(void);
+
+// Drop-in replacements for `pa_sw_volume_to_dB`, `pa_sw_volume_from_dB`, `pa_sw_volume_to_linear` and
+// `pa_sw_volume_from_linear`, that avoid `log`, `pow` and `cbrt`. `lut_init` must have been called.
+double lut_volume_to_dB(pa_volume_t);
+pa_volume_t lut_volume_from_dB(double);
+double lut_volume_to_linear(pa_volume_t);
+pa_volume_t lut_volume_from_linear(double);
+
+
+// A slider curve, mapping positions in `[0, 1]` to volumes, sampled at `size + 1` evenly spaced positions.
+typedef struct lut_curve {
+    size_t size;
+    double* volumes;
+    // The largest difference to the exact curve that was found when compiling, in volume units.
+    double error;
+} lut_curve;
+
+// Evaluates the exact curve at a position.
+typedef double (*lut_curve_fn)(double position, void* userdata);
+
+// Samples `fn`, and measures the error at several points within each segment. Returns `false` when the curve
+// isn't non-decreasing, as it couldn't be inverted.
+bool lut_curve_compile(lut_curve*, size_t size, lut_curve_fn fn, void* userdata);
+void lut_curve_clear(lut_curve*);
+
+pa_volume_t lut_curve_to_volume(const lut_curve*, double position);
+double lut_curve_to_position(const lut_curve*, pa_volume_t);
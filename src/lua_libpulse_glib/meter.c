@@ -0,0 +1,543 @@
+#include "meter.h"
+
+#include "lua_util.h"
+
+#include <math.h>
+#include <pulse/introspect.h>
+#include <pulse/subscribe.h>
+#include <stdio.h>
+
+
+#define METER_DEFAULT_RATE     25
+#define METER_DEFAULT_INTERVAL 40
+
+
+static void meter_stream_connect(meter_stream*, uint32_t);
+static void meter_stream_query(meter_stream*);
+
+
+static void meter_stream_disconnect(meter_stream* ms) {
+    if (ms->stream == NULL) {
+        return;
+    }
+
+    pa_stream_set_read_callback(ms->stream, NULL, NULL);
+    pa_stream_set_state_callback(ms->stream, NULL, NULL);
+    pa_stream_disconnect(ms->stream);
+    pa_stream_unref(ms->stream);
+    ms->stream = NULL;
+    ms->peak = 0.0f;
+}
+
+
+static void meter_free(meter* m) {
+    for (guint i = 0; i < m->streams->len; ++i) {
+        meter_stream* ms = g_ptr_array_index(m->streams, i);
+        meter_stream_disconnect(ms);
+        g_free(ms);
+    }
+
+    g_ptr_array_free(m->streams, TRUE);
+    g_free(m);
+}
+
+
+// Frees the meter once it is closed, its userdata has been collected and no queries are left.
+static void meter_maybe_free(meter* m) {
+    if (m->closed && m->pending == 0 && m->data == NULL) {
+        meter_free(m);
+    }
+}
+
+
+static meter_stream* meter_find(meter* m, uint32_t index) {
+    for (guint i = 0; i < m->streams->len; ++i) {
+        meter_stream* ms = g_ptr_array_index(m->streams, i);
+        if (ms->index == index && !ms->removed) {
+            return ms;
+        }
+    }
+    return NULL;
+}
+
+
+static meter_stream* meter_stream_new(meter* m, uint32_t index) {
+    meter_stream* ms = g_new0(meter_stream, 1);
+    ms->meter = m;
+    ms->index = index;
+    ms->sink = PA_INVALID_INDEX;
+    g_ptr_array_add(m->streams, ms);
+    return ms;
+}
+
+
+static void meter_stream_remove(meter_stream* ms) {
+    meter* m = ms->meter;
+    meter_stream_disconnect(ms);
+
+    if (ms->pending > 0) {
+        // Queries are still in flight. The stream is freed when the last one returns.
+        ms->removed = true;
+        return;
+    }
+
+    g_ptr_array_remove(m->streams, ms);
+    g_free(ms);
+}
+
+
+// Called when a query for the stream has returned.
+static void meter_stream_release(meter_stream* ms) {
+    meter* m = ms->meter;
+    ms->pending--;
+    m->pending--;
+
+    if (ms->removed && ms->pending == 0) {
+        g_ptr_array_remove(m->streams, ms);
+        g_free(ms);
+    }
+
+    meter_maybe_free(m);
+}
+
+
+static void meter_stream_read_callback(pa_stream* s, size_t length, void* userdata) {
+    meter_stream* ms = (meter_stream*) userdata;
+    const void* data;
+
+    while (pa_stream_readable_size(s) > 0) {
+        if (pa_stream_peek(s, &data, &length) < 0 || length == 0) {
+            return;
+        }
+
+        // `NULL` data with a length is a hole in the stream.
+        if (data != NULL) {
+            const float* samples = (const float*) data;
+            size_t count = length / sizeof(float);
+            for (size_t i = 0; i < count; ++i) {
+                float value = fabsf(samples[i]);
+                if (value > ms->peak) {
+                    ms->peak = value;
+                }
+            }
+        }
+
+        pa_stream_drop(s);
+    }
+}
+
+
+static void meter_stream_state_callback(pa_stream* s, void* userdata) {
+    meter_stream* ms = (meter_stream*) userdata;
+
+    switch (pa_stream_get_state(s)) {
+    case PA_STREAM_FAILED:
+    case PA_STREAM_TERMINATED: {
+        // The sink input went away or was moved. A `change` or `remove` event will follow.
+        meter_stream_disconnect(ms);
+        break;
+    }
+    default: {
+        break;
+    }
+    }
+}
+
+
+static void meter_stream_connect(meter_stream* ms, uint32_t monitor_source) {
+    meter* m = ms->meter;
+    pa_context* c = m->ctx->context;
+
+    meter_stream_disconnect(ms);
+
+    // Peak detection makes the server send one value per fragment, at the given rate.
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_FLOAT32NE,
+        .rate = m->rate,
+        .channels = 1,
+    };
+
+    pa_buffer_attr attr = {
+        .maxlength = (uint32_t) -1,
+        .tlength = (uint32_t) -1,
+        .prebuf = (uint32_t) -1,
+        .minreq = (uint32_t) -1,
+        .fragsize = sizeof(float),
+    };
+
+    pa_stream* s = pa_stream_new(c, "Peak detect", &ss, NULL);
+    if (s == NULL) {
+        return;
+    }
+
+    if (pa_stream_set_monitor_stream(s, ms->index) < 0) {
+        pa_stream_unref(s);
+        return;
+    }
+
+    pa_stream_set_read_callback(s, meter_stream_read_callback, ms);
+    pa_stream_set_state_callback(s, meter_stream_state_callback, ms);
+
+    char device[16];
+    snprintf(device, sizeof(device), "%u", monitor_source);
+
+    pa_stream_flags_t flags = PA_STREAM_DONT_MOVE | PA_STREAM_PEAK_DETECT | PA_STREAM_ADJUST_LATENCY
+                            | PA_STREAM_DONT_INHIBIT_AUTO_SUSPEND;
+    if (pa_stream_connect_record(s, device, &attr, flags) < 0) {
+        pa_stream_unref(s);
+        return;
+    }
+
+    ms->stream = s;
+}
+
+
+static void meter_sink_info_callback(pa_context* c, const pa_sink_info* info, int eol, void* userdata) {
+    meter_stream* ms = (meter_stream*) userdata;
+
+    if (eol != 0) {
+        meter_stream_release(ms);
+        return;
+    }
+
+    if (!ms->removed && !ms->meter->closed && info->index == ms->sink) {
+        meter_stream_connect(ms, info->monitor_source);
+    }
+}
+
+
+// Looks up the sink's monitor source and connects the stream.
+static void meter_stream_query_sink(meter_stream* ms, uint32_t sink) {
+    meter* m = ms->meter;
+
+    // Nothing to do, if the input is still on the same sink.
+    if (ms->stream != NULL && ms->sink == sink) {
+        return;
+    }
+    ms->sink = sink;
+
+    pa_operation* op = pa_context_get_sink_info_by_index(m->ctx->context, sink, meter_sink_info_callback, ms);
+    if (op != NULL) {
+        ms->pending++;
+        m->pending++;
+        pa_operation_unref(op);
+    }
+}
+
+
+static void meter_sink_input_info_callback(pa_context* c, const pa_sink_input_info* info, int eol, void* userdata) {
+    meter_stream* ms = (meter_stream*) userdata;
+
+    if (eol != 0) {
+        meter_stream_release(ms);
+        return;
+    }
+
+    if (!ms->removed && !ms->meter->closed) {
+        meter_stream_query_sink(ms, info->sink);
+    }
+}
+
+
+// Looks up the sink input's sink, and (re)connects the stream if needed.
+static void meter_stream_query(meter_stream* ms) {
+    meter* m = ms->meter;
+    pa_operation* op = pa_context_get_sink_input_info(m->ctx->context, ms->index, meter_sink_input_info_callback, ms);
+    if (op != NULL) {
+        ms->pending++;
+        m->pending++;
+        pa_operation_unref(op);
+    }
+}
+
+
+static void meter_populate_callback(pa_context* c, const pa_sink_input_info* info, int eol, void* userdata) {
+    meter* m = (meter*) userdata;
+
+    if (eol != 0) {
+        m->pending--;
+        meter_maybe_free(m);
+        return;
+    }
+
+    if (m->closed || meter_find(m, info->index) != NULL) {
+        return;
+    }
+
+    meter_stream_query_sink(meter_stream_new(m, info->index), info->sink);
+}
+
+
+// Creates streams for all current sink inputs.
+static void meter_populate(meter* m) {
+    pa_operation* op = pa_context_get_sink_input_info_list(m->ctx->context, meter_populate_callback, m);
+    if (op != NULL) {
+        m->pending++;
+        pa_operation_unref(op);
+    }
+}
+
+
+void meter_handle_event(meter* m, pa_subscription_event_type_t event_type, uint32_t index) {
+    if (!m->automatic || (event_type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) != PA_SUBSCRIPTION_EVENT_SINK_INPUT) {
+        return;
+    }
+
+    meter_stream* ms = meter_find(m, index);
+
+    switch (event_type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) {
+    case PA_SUBSCRIPTION_EVENT_NEW: {
+        if (ms == NULL) {
+            meter_stream_query(meter_stream_new(m, index));
+        }
+        break;
+    }
+    case PA_SUBSCRIPTION_EVENT_CHANGE: {
+        // The input may have moved to a different sink.
+        if (ms != NULL) {
+            meter_stream_query(ms);
+        }
+        break;
+    }
+    case PA_SUBSCRIPTION_EVENT_REMOVE: {
+        if (ms != NULL) {
+            meter_stream_remove(ms);
+        }
+        break;
+    }
+    }
+}
+
+
+void meter_handle_state(meter* m, pa_context_state_t state) {
+    switch (state) {
+    case PA_CONTEXT_READY: {
+        if (m->automatic) {
+            meter_populate(m);
+        } else {
+            for (guint i = 0; i < m->streams->len; ++i) {
+                meter_stream_query(g_ptr_array_index(m->streams, i));
+            }
+        }
+        break;
+    }
+    case PA_CONTEXT_FAILED:
+    case PA_CONTEXT_TERMINATED: {
+        // Queries in flight are dropped by libpulse without calling their callbacks, so the counters
+        // can be reset.
+        for (guint i = m->streams->len; i > 0; --i) {
+            meter_stream* ms = g_ptr_array_index(m->streams, i - 1);
+            meter_stream_disconnect(ms);
+            m->pending -= ms->pending;
+            ms->pending = 0;
+
+            if (ms->removed || m->automatic) {
+                g_ptr_array_remove_index(m->streams, i - 1);
+                g_free(ms);
+            }
+        }
+        m->pending = 0;
+        break;
+    }
+    default: {
+        break;
+    }
+    }
+}
+
+
+static gboolean meter_tick(gpointer userdata) {
+    meter* m = (meter*) userdata;
+    lua_State* L = m->data->L;
+
+    if (m->streams->len == 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    // The list is reused on every tick, to not create garbage at the meter's rate.
+    size_t old_len = lua_rawlen(L, 2);
+    size_t pos = 0;
+
+    for (guint i = 0; i < m->streams->len; ++i) {
+        meter_stream* ms = g_ptr_array_index(m->streams, i);
+        if (ms->removed) {
+            continue;
+        }
+
+        lua_pushinteger(L, ms->index + 1);
+        lua_rawseti(L, 2, ++pos);
+        lua_pushnumber(L, ms->peak);
+        lua_rawseti(L, 2, ++pos);
+
+        ms->peak = 0.0f;
+    }
+
+    for (size_t i = old_len; i > pos; --i) {
+        lua_pushnil(L);
+        lua_rawseti(L, 2, i);
+    }
+
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_call(L, 1, 0);
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+void meter_close(meter* m) {
+    if (m->closed) {
+        return;
+    }
+    m->closed = true;
+
+    if (m->timer_id != 0) {
+        g_source_remove(m->timer_id);
+        m->timer_id = 0;
+    }
+
+    for (guint i = m->streams->len; i > 0; --i) {
+        meter_stream* ms = g_ptr_array_index(m->streams, i - 1);
+        if (!ms->removed) {
+            meter_stream_remove(ms);
+        }
+    }
+
+    g_ptr_array_remove(m->ctx->meters, m);
+    context_apply_subscription(m->ctx);
+}
+
+
+int context_new_meter(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    uint32_t rate = METER_DEFAULT_RATE;
+    uint32_t interval = METER_DEFAULT_INTERVAL;
+    bool automatic = true;
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "rate");
+        rate = (uint32_t) luaL_optinteger(L, -1, rate);
+        lua_getfield(L, 2, "interval");
+        interval = (uint32_t) luaL_optinteger(L, -1, interval);
+        lua_getfield(L, 2, "automatic");
+        if (!lua_isnil(L, -1)) {
+            automatic = lua_toboolean(L, -1);
+        }
+        lua_pop(L, 3);
+
+        luaL_argcheck(L, rate > 0, 2, "rate must be positive");
+        luaL_argcheck(L, interval > 0, 2, "interval must be positive");
+    }
+
+    meter* m = g_new0(meter, 1);
+    m->ctx = ctx;
+    m->streams = g_ptr_array_new();
+    m->rate = rate;
+    m->interval = interval;
+    m->automatic = automatic;
+    m->data = prepare_lua_callback(L, 3);
+
+    lua_State* thread_L = m->data->L;
+    lua_newtable(thread_L);
+    lua_pushvalue(L, 1);
+    lua_xmove(L, thread_L, 1);
+
+    if (ctx->meters == NULL) {
+        ctx->meters = g_ptr_array_new();
+    }
+    g_ptr_array_add(ctx->meters, m);
+
+    m->timer_id = g_timeout_add(interval, meter_tick, m);
+
+    if (pa_context_get_state(ctx->context) == PA_CONTEXT_READY) {
+        context_apply_subscription(ctx);
+        if (automatic) {
+            meter_populate(m);
+        }
+    }
+
+    lua_pa_meter* userdata = lua_newuserdata(L, sizeof(lua_pa_meter));
+    userdata->meter = m;
+    luaL_getmetatable(L, LUA_PA_METER);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+
+static meter* meter_check(lua_State* L) {
+    lua_pa_meter* userdata = luaL_checkudata(L, 1, LUA_PA_METER);
+    if (userdata->meter->closed) {
+        luaL_error(L, "meter is closed");
+    }
+    return userdata->meter;
+}
+
+
+int meter_add(lua_State* L) {
+    meter* m = meter_check(L);
+    uint32_t index = (uint32_t) luaL_checkinteger(L, 2) - 1;
+
+    if (meter_find(m, index) == NULL) {
+        meter_stream* ms = meter_stream_new(m, index);
+        if (pa_context_get_state(m->ctx->context) == PA_CONTEXT_READY) {
+            meter_stream_query(ms);
+        }
+    }
+
+    return 0;
+}
+
+
+int meter_remove(lua_State* L) {
+    meter* m = meter_check(L);
+    uint32_t index = (uint32_t) luaL_checkinteger(L, 2) - 1;
+
+    meter_stream* ms = meter_find(m, index);
+    if (ms != NULL) {
+        meter_stream_remove(ms);
+    }
+
+    return 0;
+}
+
+
+int meter_get_indices(lua_State* L) {
+    meter* m = meter_check(L);
+    int pos = 0;
+
+    lua_createtable(L, m->streams->len, 0);
+    for (guint i = 0; i < m->streams->len; ++i) {
+        meter_stream* ms = g_ptr_array_index(m->streams, i);
+        if (!ms->removed) {
+            lua_pushinteger(L, ms->index + 1);
+            lua_rawseti(L, -2, ++pos);
+        }
+    }
+
+    return 1;
+}
+
+
+int meter_close_lua(lua_State* L) {
+    lua_pa_meter* userdata = luaL_checkudata(L, 1, LUA_PA_METER);
+    meter_close(userdata->meter);
+    return 0;
+}
+
+
+int meter__gc(lua_State* L) {
+    lua_pa_meter* userdata = luaL_checkudata(L, 1, LUA_PA_METER);
+    meter* m = userdata->meter;
+
+    meter_close(m);
+    free_lua_callback(m->data);
+    m->data = NULL;
+    meter_maybe_free(m);
+
+    return 0;
+}
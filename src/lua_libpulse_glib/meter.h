@@ -0,0 +1,128 @@
+/** Peak level meters for sink inputs.
+ *
+ * A @{Meter} opens one small record stream per sink input, using the sink's monitor source and
+ * `pa_stream_set_monitor_stream`, with peak detection done by the server. Levels are collected in C and
+ * delivered together on a single timer, as one flat list per tick.
+ *
+ * @module lua_libpulse_glib.meter
+ */
+#pragma once
+
+#include "callback.h"
+#include "context.h"
+
+#include <glib.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <pulse/stream.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LUA_PA_METER "pulseaudio.meter"
+
+
+struct meter;
+
+
+typedef struct meter_stream {
+    struct meter* meter;
+    // The sink input this stream monitors.
+    uint32_t index;
+    // The sink the input was connected to when the stream was created.
+    uint32_t sink;
+    pa_stream* stream;
+    // The highest peak since the last tick.
+    float peak;
+    // Number of introspection queries in flight for this stream.
+    int pending;
+    // Set when the sink input went away while queries were in flight.
+    bool removed;
+} meter_stream;
+
+
+typedef struct meter {
+    lua_pa_context* ctx;
+    // List of `meter_stream*`
+    GPtrArray* streams;
+    // The rate at which the server sends peak values, in Hz.
+    uint32_t rate;
+    // The tick interval, in milliseconds.
+    uint32_t interval;
+    guint timer_id;
+    // Whether streams follow the server's sink inputs, rather than being added manually.
+    bool automatic;
+    // A thread with the tick callback at index 1, the reused list of levels at index 2 and the
+    // context at index 3, to keep it alive.
+    simple_callback_data* data;
+    // Number of queries in flight across all streams, including removed ones.
+    int pending;
+    bool closed;
+} meter;
+
+
+typedef struct lua_pa_meter {
+    meter* meter;
+} lua_pa_meter;
+
+
+// Applies a subscription event to all meters of a context.
+void meter_handle_event(meter*, pa_subscription_event_type_t, uint32_t);
+
+// Reacts to connection state changes: streams are dropped when the connection is lost, and
+// re-created when it is ready again.
+void meter_handle_state(meter*, pa_context_state_t);
+
+// Closes all streams and detaches the meter from its context.
+void meter_close(meter*);
+
+
+/// Meter
+/// @type Meter
+
+
+/** Starts monitoring a sink input.
+ *
+ * Only needed for meters created with `automatic = false`.
+ *
+ * @function Meter:add
+ * @tparam number index The sink input's index, as returned by @{Context:get_sink_inputs}.
+ */
+int meter_add(lua_State*);
+
+/** Stops monitoring a sink input.
+ *
+ * @function Meter:remove
+ * @tparam number index The sink input's index.
+ */
+int meter_remove(lua_State*);
+
+/** Returns the indices of all monitored sink inputs.
+ *
+ * @function Meter:get_indices
+ * @treturn table
+ */
+int meter_get_indices(lua_State*);
+
+/** Closes all streams and stops the timer.
+ *
+ * This is also done when the meter is garbage collected.
+ *
+ * @function Meter:close
+ */
+int meter_close_lua(lua_State*);
+int meter__gc(lua_State*);
+
+
+static const struct luaL_Reg meter_f[] = {
+    {"add",          meter_add        },
+    { "remove",      meter_remove     },
+    { "get_indices", meter_get_indices},
+    { "close",       meter_close_lua  },
+    { NULL,          NULL             }
+};
+
+
+static const struct luaL_Reg meter_mt[] = {
+    {"__gc", meter__gc},
+    { NULL,  NULL     }
+};
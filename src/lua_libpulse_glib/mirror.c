@@ -0,0 +1,662 @@
+#include "mirror.h"
+
+#include "volume.h"
+
+#include <lauxlib.h>
+#include <pulse/proplist.h>
+#include <string.h>
+
+// The file header is written in native byte order. A cache file from a machine with a different
+// byte order is rejected, rather than converted.
+#define MIRROR_FILE_BOM 0x0102
+
+
+#define MIRROR_ENTRY_FIELDS(T)                                                                                         \
+    SCHEMA_FIELD(T, index, INDEX),                                                                                     \
+    SCHEMA_FIELD(T, parent, INDEX),                                                                                    \
+    SCHEMA_FIELD(T, name, STRING),                                                                                     \
+    SCHEMA_FIELD(T, description, STRING),                                                                              \
+    SCHEMA_FIELD_IF(T, volume, CVOLUME, has_volume),                                                                   \
+    SCHEMA_FIELD(T, has_volume, BOOLEAN),                                                                              \
+    SCHEMA_FIELD(T, mute, BOOLEAN)
+
+DEFINE_SCHEMA(mirror_entry_schema, mirror_entry, MIRROR_ENTRY_FIELDS);
+
+
+// Of the mirror itself, only the default devices are written to cache files.
+#define MIRROR_DEFAULTS_FIELDS(T)                                                                                      \
+    SCHEMA_FIELD(T, default_sink, STRING),                                                                             \
+    SCHEMA_FIELD(T, default_source, STRING)
+
+DEFINE_SCHEMA(mirror_defaults_schema, mirror, MIRROR_DEFAULTS_FIELDS);
+
+
+static void mirror_entry_clear(mirror_entry* entry) {
+    schema_clear(&mirror_entry_schema, entry);
+}
+
+
+// Marks the mirror as changed and notifies the listener, if any.
+static void mirror_touch(mirror* m) {
+    m->generation++;
+    if (m->changed_cb != NULL) {
+        m->changed_cb(m, m->changed_data);
+    }
+}
+
+
+mirror* mirror_new(void) {
+    mirror* m = g_new0(mirror, 1);
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        m->entries[kind] = g_array_new(FALSE, TRUE, sizeof(mirror_entry));
+    }
+    return m;
+}
+
+
+void mirror_clear(mirror* m) {
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        GArray* entries = m->entries[kind];
+        for (guint i = 0; i < entries->len; ++i) {
+            mirror_entry_clear(&g_array_index(entries, mirror_entry, i));
+        }
+        g_array_set_size(entries, 0);
+    }
+
+    g_free(m->default_sink);
+    g_free(m->default_source);
+    m->default_sink = NULL;
+    m->default_source = NULL;
+    mirror_touch(m);
+}
+
+
+void mirror_free(mirror* m) {
+    mirror_clear(m);
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        g_array_free(m->entries[kind], TRUE);
+    }
+    g_free(m);
+}
+
+
+void mirror_replace(mirror* m, mirror* other) {
+    mirror_clear(m);
+
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        GArray* tmp = m->entries[kind];
+        m->entries[kind] = other->entries[kind];
+        other->entries[kind] = tmp;
+    }
+
+    m->default_sink = other->default_sink;
+    m->default_source = other->default_source;
+    other->default_sink = NULL;
+    other->default_source = NULL;
+
+    m->stale = other->stale;
+    mirror_touch(m);
+}
+
+
+static guint mirror_find_position(mirror* m, mirror_kind kind, uint32_t index) {
+    GArray* entries = m->entries[kind];
+    for (guint i = 0; i < entries->len; ++i) {
+        if (g_array_index(entries, mirror_entry, i).index == index) {
+            return i;
+        }
+    }
+    return entries->len;
+}
+
+
+mirror_entry* mirror_find(mirror* m, mirror_kind kind, uint32_t index) {
+    guint pos = mirror_find_position(m, kind, index);
+    if (pos == m->entries[kind]->len) {
+        return NULL;
+    }
+    return &g_array_index(m->entries[kind], mirror_entry, pos);
+}
+
+
+mirror_entry* mirror_find_name(mirror* m, mirror_kind kind, const char* name) {
+    GArray* entries = m->entries[kind];
+    for (guint i = 0; i < entries->len; i++) {
+        mirror_entry* entry = &g_array_index(entries, mirror_entry, i);
+        if (g_strcmp0(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+
+void mirror_remove(mirror* m, mirror_kind kind, uint32_t index) {
+    guint pos = mirror_find_position(m, kind, index);
+    if (pos == m->entries[kind]->len) {
+        return;
+    }
+
+    mirror_entry_clear(&g_array_index(m->entries[kind], mirror_entry, pos));
+    g_array_remove_index(m->entries[kind], pos);
+    mirror_touch(m);
+}
+
+
+static bool mirror_entry_equal(const mirror_entry* a, const mirror_entry* b) {
+    return schema_diff(&mirror_entry_schema, a, b, SCHEMA_MASK_ALL) == 0;
+}
+
+
+static void mirror_set(mirror* m,
+                       mirror_kind kind,
+                       uint32_t index,
+                       uint32_t parent,
+                       const char* name,
+                       const char* description,
+                       const pa_cvolume* volume,
+                       bool has_volume,
+                       bool mute) {
+    mirror_entry* entry = mirror_find(m, kind, index);
+    if (entry == NULL) {
+        mirror_entry empty = { 0 };
+        empty.index = index;
+        g_array_append_val(m->entries[kind], empty);
+        entry = &g_array_index(m->entries[kind], mirror_entry, m->entries[kind]->len - 1);
+    } else {
+        mirror_entry update = { 0 };
+        update.index = index;
+        update.parent = parent;
+        update.name = (char*) name;
+        update.description = (char*) description;
+        update.has_volume = has_volume;
+        update.mute = mute;
+        if (has_volume) {
+            update.volume = *volume;
+        }
+
+        if (mirror_entry_equal(entry, &update)) {
+            return;
+        }
+
+        mirror_entry_clear(entry);
+    }
+
+    entry->parent = parent;
+    entry->name = g_strdup(name);
+    entry->description = g_strdup(description);
+    entry->has_volume = has_volume;
+    entry->mute = mute;
+    if (has_volume) {
+        entry->volume = *volume;
+    } else {
+        pa_cvolume_init(&entry->volume);
+    }
+
+    mirror_touch(m);
+}
+
+
+void mirror_set_defaults(mirror* m, const char* sink, const char* source) {
+    if (g_strcmp0(m->default_sink, sink) == 0 && g_strcmp0(m->default_source, source) == 0) {
+        return;
+    }
+
+    g_free(m->default_sink);
+    g_free(m->default_source);
+    m->default_sink = g_strdup(sink);
+    m->default_source = g_strdup(source);
+    mirror_touch(m);
+}
+
+
+void mirror_update_sink(mirror* m, const pa_sink_info* info) {
+    mirror_set(m,
+               MIRROR_SINK,
+               info->index,
+               PA_INVALID_INDEX,
+               info->name,
+               info->description,
+               &info->volume,
+               true,
+               info->mute);
+}
+
+
+void mirror_update_source(mirror* m, const pa_source_info* info) {
+    mirror_set(m,
+               MIRROR_SOURCE,
+               info->index,
+               PA_INVALID_INDEX,
+               info->name,
+               info->description,
+               &info->volume,
+               true,
+               info->mute);
+}
+
+
+void mirror_update_sink_input(mirror* m, const pa_sink_input_info* info) {
+    mirror_set(m,
+               MIRROR_SINK_INPUT,
+               info->index,
+               info->sink,
+               info->name,
+               pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_NAME),
+               &info->volume,
+               info->has_volume,
+               info->mute);
+}
+
+
+void mirror_update_source_output(mirror* m, const pa_source_output_info* info) {
+    mirror_set(m,
+               MIRROR_SOURCE_OUTPUT,
+               info->index,
+               info->source,
+               info->name,
+               pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_NAME),
+               &info->volume,
+               info->has_volume,
+               info->mute);
+}
+
+
+// Finds the counterpart of `entry` in another mirror. Devices keep their name across server restarts, while
+// their index may change, so they're matched by name. Streams, and devices without a name, by index.
+static mirror_entry* mirror_match(const mirror* m, mirror_kind kind, const mirror_entry* entry) {
+    if ((kind == MIRROR_SINK || kind == MIRROR_SOURCE) && entry->name != NULL) {
+        return mirror_find_name((mirror*) m, kind, entry->name);
+    }
+    return mirror_find((mirror*) m, kind, entry->index);
+}
+
+
+size_t mirror_diff(const mirror* old, const mirror* new, mirror_diff_cb cb, void* userdata) {
+    size_t count = 0;
+
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        GArray* old_entries = old->entries[kind];
+        GArray* new_entries = new->entries[kind];
+
+        for (guint i = 0; i < old_entries->len; ++i) {
+            const mirror_entry* entry = &g_array_index(old_entries, mirror_entry, i);
+            const mirror_entry* other = mirror_match(new, kind, entry);
+
+            if (other == NULL) {
+                cb(kind, MIRROR_CHANGE_REMOVE, entry, userdata);
+                ++count;
+            } else if (!mirror_entry_equal(entry, other)) {
+                cb(kind, MIRROR_CHANGE_CHANGE, other, userdata);
+                ++count;
+            }
+        }
+
+        for (guint i = 0; i < new_entries->len; ++i) {
+            const mirror_entry* entry = &g_array_index(new_entries, mirror_entry, i);
+            if (mirror_match(old, kind, entry) == NULL) {
+                cb(kind, MIRROR_CHANGE_NEW, entry, userdata);
+                ++count;
+            }
+        }
+    }
+
+    return count;
+}
+
+
+// Event handling
+
+
+static void mirror_server_info_callback(pa_context* c, const pa_server_info* info, void* userdata) {
+    mirror* m = (mirror*) userdata;
+    if (info != NULL) {
+        mirror_set_defaults(m, info->default_sink_name, info->default_source_name);
+    }
+}
+
+
+static void mirror_sink_info_callback(pa_context* c, const pa_sink_info* info, int eol, void* userdata) {
+    if (eol == 0 && info != NULL) {
+        mirror_update_sink((mirror*) userdata, info);
+    }
+}
+
+
+static void mirror_source_info_callback(pa_context* c, const pa_source_info* info, int eol, void* userdata) {
+    if (eol == 0 && info != NULL) {
+        mirror_update_source((mirror*) userdata, info);
+    }
+}
+
+
+static void mirror_sink_input_info_callback(pa_context* c, const pa_sink_input_info* info, int eol, void* userdata) {
+    if (eol == 0 && info != NULL) {
+        mirror_update_sink_input((mirror*) userdata, info);
+    }
+}
+
+
+static void mirror_source_output_info_callback(pa_context* c,
+                                               const pa_source_output_info* info,
+                                               int eol,
+                                               void* userdata) {
+    if (eol == 0 && info != NULL) {
+        mirror_update_source_output((mirror*) userdata, info);
+    }
+}
+
+
+void mirror_handle_event(mirror* m, pa_context* c, pa_subscription_event_type_t event_type, uint32_t index) {
+    pa_subscription_event_type_t facility = event_type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    pa_subscription_event_type_t type = event_type & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+    pa_operation* op = NULL;
+    mirror_kind kind;
+
+    switch (facility) {
+    case PA_SUBSCRIPTION_EVENT_SERVER: {
+        op = pa_context_get_server_info(c, mirror_server_info_callback, m);
+        if (op != NULL) {
+            pa_operation_unref(op);
+        }
+        return;
+    }
+    case PA_SUBSCRIPTION_EVENT_SINK:
+        kind = MIRROR_SINK;
+        break;
+    case PA_SUBSCRIPTION_EVENT_SOURCE:
+        kind = MIRROR_SOURCE;
+        break;
+    case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+        kind = MIRROR_SINK_INPUT;
+        break;
+    case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+        kind = MIRROR_SOURCE_OUTPUT;
+        break;
+    default:
+        return;
+    }
+
+    if (type == PA_SUBSCRIPTION_EVENT_REMOVE) {
+        mirror_remove(m, kind, index);
+        return;
+    }
+
+    switch (kind) {
+    case MIRROR_SINK:
+        op = pa_context_get_sink_info_by_index(c, index, mirror_sink_info_callback, m);
+        break;
+    case MIRROR_SOURCE:
+        op = pa_context_get_source_info_by_index(c, index, mirror_source_info_callback, m);
+        break;
+    case MIRROR_SINK_INPUT:
+        op = pa_context_get_sink_input_info(c, index, mirror_sink_input_info_callback, m);
+        break;
+    case MIRROR_SOURCE_OUTPUT:
+        op = pa_context_get_source_output_info(c, index, mirror_source_output_info_callback, m);
+        break;
+    default:
+        break;
+    }
+
+    if (op != NULL) {
+        pa_operation_unref(op);
+    }
+}
+
+
+// Serialization
+
+
+static void put_u16(GByteArray* buf, uint16_t value) {
+    g_byte_array_append(buf, (const guint8*) &value, sizeof(value));
+}
+
+
+static void put_u32(GByteArray* buf, uint32_t value) {
+    g_byte_array_append(buf, (const guint8*) &value, sizeof(value));
+}
+
+
+typedef struct reader {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    bool failed;
+} reader;
+
+
+static bool get_bytes(reader* r, void* out, size_t n) {
+    if (r->failed || r->len - r->pos < n) {
+        r->failed = true;
+        return false;
+    }
+
+    memcpy(out, r->data + r->pos, n);
+    r->pos += n;
+    return true;
+}
+
+
+static uint16_t get_u16(reader* r) {
+    uint16_t value = 0;
+    get_bytes(r, &value, sizeof(value));
+    return value;
+}
+
+
+static uint32_t get_u32(reader* r) {
+    uint32_t value = 0;
+    get_bytes(r, &value, sizeof(value));
+    return value;
+}
+
+
+// Reads a struct written by `schema_encode`.
+static void get_schema(reader* r, const schema* s, void* base) {
+    if (r->failed) {
+        return;
+    }
+
+    size_t read = schema_decode(s, base, r->data + r->pos, r->len - r->pos);
+    if (read == 0) {
+        r->failed = true;
+        return;
+    }
+    r->pos += read;
+}
+
+
+char* mirror_default_path(void) {
+    return g_build_filename(g_get_user_runtime_dir(), "lua_libpulse_glib", "graph.cache", NULL);
+}
+
+
+bool mirror_save(const mirror* m, const char* path, char** error) {
+    GByteArray* buf = g_byte_array_new();
+
+    put_u32(buf, MIRROR_FILE_MAGIC);
+    put_u16(buf, MIRROR_FILE_VERSION);
+    put_u16(buf, MIRROR_FILE_BOM);
+    schema_encode(buf, &mirror_defaults_schema, m, SCHEMA_MASK_ALL);
+
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        GArray* entries = m->entries[kind];
+        put_u32(buf, entries->len);
+
+        for (guint i = 0; i < entries->len; ++i) {
+            schema_encode(buf, &mirror_entry_schema, &g_array_index(entries, mirror_entry, i), SCHEMA_MASK_ALL);
+        }
+    }
+
+    char* dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    GError* err = NULL;
+    bool ok = g_file_set_contents(path, (const gchar*) buf->data, buf->len, &err);
+    g_byte_array_free(buf, TRUE);
+
+    if (!ok) {
+        *error = g_strdup(err->message);
+        g_error_free(err);
+    }
+
+    return ok;
+}
+
+
+bool mirror_load(mirror* m, const char* path, char** error) {
+    gchar* contents = NULL;
+    gsize len = 0;
+    GError* err = NULL;
+
+    if (!g_file_get_contents(path, &contents, &len, &err)) {
+        *error = g_strdup(err->message);
+        g_error_free(err);
+        return false;
+    }
+
+    reader r = { (const uint8_t*) contents, len, 0, false };
+    mirror* loaded = mirror_new();
+
+    if (get_u32(&r) != MIRROR_FILE_MAGIC || get_u16(&r) != MIRROR_FILE_VERSION || get_u16(&r) != MIRROR_FILE_BOM) {
+        *error = g_strdup("not a compatible cache file");
+        goto fail;
+    }
+
+    get_schema(&r, &mirror_defaults_schema, loaded);
+
+    for (int kind = 0; kind < MIRROR_KIND_MAX && !r.failed; ++kind) {
+        uint32_t count = get_u32(&r);
+
+        for (uint32_t i = 0; i < count && !r.failed; ++i) {
+            mirror_entry entry = { 0 };
+            get_schema(&r, &mirror_entry_schema, &entry);
+            if (!r.failed) {
+                g_array_append_val(loaded->entries[kind], entry);
+            }
+        }
+    }
+
+    if (r.failed) {
+        *error = g_strdup("cache file is truncated or corrupt");
+        goto fail;
+    }
+
+    g_free(contents);
+    loaded->stale = true;
+    mirror_replace(m, loaded);
+    mirror_free(loaded);
+    return true;
+
+fail:
+    g_free(contents);
+    mirror_free(loaded);
+    return false;
+}
+
+
+// Lua conversion
+
+
+const char* mirror_kind_to_string(mirror_kind kind) {
+    switch (kind) {
+    case MIRROR_SINK:
+        return "sink";
+    case MIRROR_SOURCE:
+        return "source";
+    case MIRROR_SINK_INPUT:
+        return "sink_input";
+    case MIRROR_SOURCE_OUTPUT:
+        return "source_output";
+    default:
+        return "server";
+    }
+}
+
+
+const char* mirror_change_to_string(mirror_change change) {
+    switch (change) {
+    case MIRROR_CHANGE_NEW:
+        return "new";
+    case MIRROR_CHANGE_CHANGE:
+        return "change";
+    default:
+        return "remove";
+    }
+}
+
+
+void mirror_entry_to_lua(lua_State* L, const mirror_entry* entry) {
+    lua_createtable(L, 0, 6);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "index");
+    // Convert C's 0-based index to Lua's 1-base
+    lua_pushinteger(L, entry->index + 1);
+    lua_settable(L, table_index);
+
+    if (entry->parent != PA_INVALID_INDEX) {
+        lua_pushstring(L, "parent");
+        lua_pushinteger(L, entry->parent + 1);
+        lua_settable(L, table_index);
+    }
+
+    lua_pushstring(L, "name");
+    lua_pushstring(L, entry->name);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "description");
+    lua_pushstring(L, entry->description);
+    lua_settable(L, table_index);
+
+    if (entry->has_volume) {
+        lua_pushstring(L, "volume");
+        volume_to_lua(L, &entry->volume);
+        lua_settable(L, table_index);
+    }
+
+    lua_pushstring(L, "mute");
+    lua_pushboolean(L, entry->mute);
+    lua_settable(L, table_index);
+}
+
+
+static const char* const mirror_list_names[MIRROR_KIND_MAX] = {
+    "sinks",
+    "sources",
+    "sink_inputs",
+    "source_outputs",
+};
+
+
+void mirror_to_lua(lua_State* L, const mirror* m) {
+    lua_createtable(L, 0, 7);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "stale");
+    lua_pushboolean(L, m->stale);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "default_sink_name");
+    lua_pushstring(L, m->default_sink);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "default_source_name");
+    lua_pushstring(L, m->default_source);
+    lua_settable(L, table_index);
+
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        GArray* entries = m->entries[kind];
+
+        lua_pushstring(L, mirror_list_names[kind]);
+        lua_createtable(L, entries->len, 0);
+        for (guint i = 0; i < entries->len; ++i) {
+            lua_pushinteger(L, i + 1);
+            mirror_entry_to_lua(L, &g_array_index(entries, mirror_entry, i));
+            lua_settable(L, -3);
+        }
+        lua_settable(L, table_index);
+    }
+}
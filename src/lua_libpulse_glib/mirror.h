@@ -0,0 +1,128 @@
+/* A C-side mirror of the server's audio graph.
+ *
+ * The mirror keeps the last known state of sinks, sources, sink inputs and source outputs, as well as the
+ * default devices. It can be written to and restored from a compact binary file, so that a new process has
+ * data to show before the connection is ready.
+ */
+#ifndef mirror_h_INCLUDED
+#define mirror_h_INCLUDED
+
+#include "schema.h"
+
+#include <glib.h>
+#include <lua.h>
+#include <pulse/context.h>
+#include <pulse/introspect.h>
+#include <pulse/subscribe.h>
+#include <pulse/volume.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MIRROR_FILE_MAGIC   0x5347504cU // "LPGS"
+#define MIRROR_FILE_VERSION 2
+
+// The subscription mask needed to keep the mirror up to date.
+#define MIRROR_SUBSCRIPTION_MASK                                                                           \
+    (PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SOURCE | PA_SUBSCRIPTION_MASK_SINK_INPUT             \
+     | PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT | PA_SUBSCRIPTION_MASK_SERVER)
+
+
+typedef enum mirror_kind {
+    MIRROR_SINK = 0,
+    MIRROR_SOURCE,
+    MIRROR_SINK_INPUT,
+    MIRROR_SOURCE_OUTPUT,
+    MIRROR_KIND_MAX,
+} mirror_kind;
+
+
+typedef struct mirror_entry {
+    uint32_t index;
+    // The sink or source a stream is connected to. `PA_INVALID_INDEX` for devices.
+    uint32_t parent;
+    char* name;
+    char* description;
+    pa_cvolume volume;
+    // `int` rather than `bool`, as the schema's flags and booleans are.
+    int has_volume;
+    int mute;
+} mirror_entry;
+
+
+// Describes `mirror_entry`, to compare entries and to write them to cache files.
+extern const schema mirror_entry_schema;
+
+
+typedef struct mirror {
+    // One `GArray` of `mirror_entry` per `mirror_kind`.
+    GArray* entries[MIRROR_KIND_MAX];
+    char* default_sink;
+    char* default_source;
+    // `true` while the data comes from a cache file and hasn't been reconciled with the server yet.
+    bool stale;
+    // Whether server events are applied to the mirror.
+    bool tracking;
+    // Incremented whenever the mirror's content changes.
+    uint64_t generation;
+    // Called after every change.
+    void (*changed_cb)(struct mirror*, void*);
+    void* changed_data;
+} mirror;
+
+
+// The kind of change reported by `mirror_diff`.
+typedef enum mirror_change {
+    MIRROR_CHANGE_NEW = 0,
+    MIRROR_CHANGE_CHANGE,
+    MIRROR_CHANGE_REMOVE,
+} mirror_change;
+
+
+// Called by `mirror_diff` for every difference.
+// For removed entries, the entry is the old one, otherwise it's the new one.
+typedef void (*mirror_diff_cb)(mirror_kind, mirror_change, const mirror_entry*, void*);
+
+
+mirror* mirror_new(void);
+void mirror_free(mirror*);
+void mirror_clear(mirror*);
+
+// Moves the content of the second mirror into the first one. The second mirror is left empty.
+void mirror_replace(mirror*, mirror*);
+
+mirror_entry* mirror_find(mirror*, mirror_kind, uint32_t);
+// Looks up a device by name. Streams don't have unique names, so this is only meaningful for sinks and sources.
+mirror_entry* mirror_find_name(mirror*, mirror_kind, const char*);
+void mirror_remove(mirror*, mirror_kind, uint32_t);
+
+void mirror_set_defaults(mirror*, const char*, const char*);
+void mirror_update_sink(mirror*, const pa_sink_info*);
+void mirror_update_source(mirror*, const pa_source_info*);
+void mirror_update_sink_input(mirror*, const pa_sink_input_info*);
+void mirror_update_source_output(mirror*, const pa_source_output_info*);
+
+// Compares two mirrors and calls the callback for every entry that was added, changed or removed. Sinks and
+// sources are matched by name, so one that was recreated with a new index is reported as changed.
+// Returns the number of differences.
+size_t mirror_diff(const mirror*, const mirror*, mirror_diff_cb, void*);
+
+// Applies a server event to the mirror, querying the server for new data where needed.
+void mirror_handle_event(mirror*, pa_context*, pa_subscription_event_type_t, uint32_t);
+
+// Returns a newly allocated path to the default cache file. Free with `g_free`.
+char* mirror_default_path(void);
+
+// Writes the mirror to a file. On failure, returns `false` and sets the error message, which must be
+// freed with `g_free`.
+bool mirror_save(const mirror*, const char*, char**);
+
+// Reads a mirror from a file, replacing the current content. The mirror is marked as stale.
+bool mirror_load(mirror*, const char*, char**);
+
+const char* mirror_kind_to_string(mirror_kind);
+const char* mirror_change_to_string(mirror_change);
+
+void mirror_entry_to_lua(lua_State*, const mirror_entry*);
+void mirror_to_lua(lua_State*, const mirror*);
+
+#endif // mirror_h_INCLUDED
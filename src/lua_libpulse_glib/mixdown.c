@@ -0,0 +1,40 @@
+#include "mixdown.h"
+
+#include <stdint.h>
+#include <string.h>
+
+
+bool mixdown_supports_format(pa_sample_format_t format) {
+    return format == PA_SAMPLE_FLOAT32NE || format == PA_SAMPLE_S16NE;
+}
+
+
+void mixdown(const pa_sample_spec* spec, const void* data, size_t first, size_t count, float* out) {
+    size_t channels = spec->channels;
+    float scale = 1.0f / (float) channels;
+
+    if (data == NULL) {
+        memset(out, 0, count * sizeof(float));
+        return;
+    }
+
+    if (spec->format == PA_SAMPLE_FLOAT32NE) {
+        const float* frame = (const float*) data + first * channels;
+        for (size_t f = 0; f < count; f++, frame += channels) {
+            float sample = 0;
+            for (size_t c = 0; c < channels; c++) {
+                sample += frame[c];
+            }
+            out[f] = sample * scale;
+        }
+    } else {
+        const int16_t* frame = (const int16_t*) data + first * channels;
+        for (size_t f = 0; f < count; f++, frame += channels) {
+            float sample = 0;
+            for (size_t c = 0; c < channels; c++) {
+                sample += frame[c] * (1.0f / 32768.0f);
+            }
+            out[f] = sample * scale;
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <pulse/sample.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The number of frames `mixdown` callers convert at a time, on the stack.
+#define MIXDOWN_CHUNK_FRAMES 256
+
+
+// Returns whether `mixdown` can read samples of the given format.
+bool mixdown_supports_format(pa_sample_format_t);
+
+// Mixes `count` interleaved frames, starting at frame `first`, down to mono floats between -1 and 1.
+// When `data` is `NULL`, silence is written instead.
+void mixdown(const pa_sample_spec*, const void* data, size_t first, size_t count, float* out);
@@ -0,0 +1,540 @@
+#include "operation.h"
+
+#include "context.h"
+#include "lua_util.h"
+#include "volume.h"
+
+#include <lauxlib.h>
+#include <pulse/error.h>
+
+
+#define OPERATION_DEFAULT_POOL_SIZE 8
+
+
+operation_engine* operation_engine_new(lua_pa_context* ctx) {
+    operation_engine* engine = g_new0(operation_engine, 1);
+    engine->ctx = ctx;
+    engine->config.max_in_flight = 0;
+    engine->config.pool_size = OPERATION_DEFAULT_POOL_SIZE;
+    engine->in_flight = g_ptr_array_new();
+    g_queue_init(&engine->queued);
+    engine->pool = g_ptr_array_new();
+    return engine;
+}
+
+
+static void operation_free(operation* op) {
+    if (op->op != NULL) {
+        pa_operation_cancel(op->op);
+        pa_operation_unref(op->op);
+    }
+    free_lua_callback(op->data);
+    g_free(op);
+}
+
+
+void operation_engine_free(operation_engine* engine) {
+    for (guint i = 0; i < engine->in_flight->len; ++i) {
+        operation_free(g_ptr_array_index(engine->in_flight, i));
+    }
+    g_ptr_array_free(engine->in_flight, TRUE);
+    engine->in_flight = NULL;
+
+    operation* op;
+    while ((op = g_queue_pop_head(&engine->queued)) != NULL) {
+        operation_free(op);
+    }
+
+    for (guint i = 0; i < engine->pool->len; ++i) {
+        operation_free(g_ptr_array_index(engine->pool, i));
+    }
+    g_ptr_array_free(engine->pool, TRUE);
+    engine->pool = NULL;
+
+    // A callback that is running right now still returns into `operation_finish`, which frees the rest.
+    if (engine->calling > 0) {
+        engine->freed = true;
+    } else {
+        g_free(engine);
+    }
+}
+
+
+// Takes a request from the pool, or creates one.
+static operation* operation_acquire(operation_engine* engine, lua_State* L, operation_id id) {
+    operation* op;
+    if (engine->pool->len > 0) {
+        op = g_ptr_array_remove_index_fast(engine->pool, engine->pool->len - 1);
+    } else {
+        op = g_new0(operation, 1);
+        op->engine = engine;
+        op->data = prepare_lua_callback(L, 0);
+    }
+
+    op->id = id;
+    op->has_result = false;
+    op->op = NULL;
+    return op;
+}
+
+
+// Returns a finished request to the pool, or frees it when the pool is full.
+static void operation_release(operation* op) {
+    operation_engine* engine = op->engine;
+
+    if (engine->freed || engine->pool->len >= engine->config.pool_size) {
+        operation_free(op);
+        return;
+    }
+
+    lua_settop(op->data->L, 0);
+    g_ptr_array_add(engine->pool, op);
+}
+
+
+static void operation_send(operation*);
+
+
+// Sends queued requests while there are free slots.
+static void operation_send_queued(operation_engine* engine) {
+    while (!g_queue_is_empty(&engine->queued)
+           && (engine->config.max_in_flight == 0 || engine->in_flight->len < engine->config.max_in_flight)) {
+        operation_send(g_queue_pop_head(&engine->queued));
+    }
+}
+
+
+// Ends the request and calls the Lua callback. If `failed` is set, the error message is on top of the thread's
+// stack. Otherwise the result is at index 2.
+static void operation_finish(operation* op, bool failed) {
+    operation_engine* engine = op->engine;
+    lua_State* L = op->data->L;
+
+    if (op->op != NULL) {
+        if (!engine->freed) {
+            g_ptr_array_remove_fast(engine->in_flight, op);
+        }
+        pa_operation_unref(op->op);
+        op->op = NULL;
+    }
+
+    if (op->has_callback) {
+        engine->calling++;
+        lua_pushvalue(L, 1);
+        if (failed) {
+            lua_insert(L, -2);
+            lua_call(L, 1, 0);
+        } else {
+            lua_pushnil(L);
+            lua_pushvalue(L, 2);
+            lua_call(L, 2, 0);
+        }
+        engine->calling--;
+    }
+
+    // Queued requests are only sent once the callback has returned, as one that fails right away calls its own
+    // callback, which must not run before this one. Errors raised by the callback aren't caught here, the same
+    // as in every other callback that runs on a thread.
+    if (!engine->freed) {
+        operation_send_queued(engine);
+    }
+
+    if (engine->freed) {
+        operation_free(op);
+        if (engine->calling == 0) {
+            g_free(engine);
+        }
+        return;
+    }
+
+    operation_release(op);
+}
+
+
+// Fails the request with libpulse's error for the context.
+static void operation_fail(operation* op, int error) {
+    op->engine->stats[op->id].failed++;
+    lua_pushfstring(
+        op->data->L, "failed to %s: %s", operation_kinds[op->id].description, pa_strerror(error));
+    operation_finish(op, true);
+}
+
+
+static void operation_send(operation* op) {
+    operation_engine* engine = op->engine;
+    const operation_kind* kind = &operation_kinds[op->id];
+    operation_start_fn start = op->by_name ? kind->start_by_name : kind->start;
+
+    engine->stats[op->id].started++;
+    op->started_at = g_get_monotonic_time();
+    op->op = start(engine->ctx->context, &op->args, op);
+    if (op->op == NULL) {
+        engine->stats[op->id].unsent++;
+        operation_fail(op, pa_context_errno(engine->ctx->context));
+        return;
+    }
+
+    g_ptr_array_add(engine->in_flight, op);
+}
+
+
+void operation_add_result(operation* op) {
+    lua_State* L = op->data->L;
+
+    if (operation_kinds[op->id].result == OPERATION_RESULT_LIST) {
+        lua_rawseti(L, 2, (int) lua_rawlen(L, 2) + 1);
+    } else {
+        lua_replace(L, 2);
+    }
+
+    op->has_result = true;
+}
+
+
+void operation_complete(operation* op, int eol) {
+    operation_stats* stats = &op->engine->stats[op->id];
+    uint64_t latency = (uint64_t) (g_get_monotonic_time() - op->started_at);
+    stats->latency_total += latency;
+    if (latency > stats->latency_max) {
+        stats->latency_max = latency;
+    }
+
+    if (eol < 0) {
+        operation_fail(op, pa_context_errno(op->engine->ctx->context));
+        return;
+    }
+
+    // Lists may well be empty, but a single info has to be there.
+    if (!op->has_result && operation_kinds[op->id].result == OPERATION_RESULT_INFO) {
+        operation_fail(op, PA_ERR_NOENTITY);
+        return;
+    }
+
+    stats->completed++;
+    operation_finish(op, false);
+}
+
+
+void operation_success_callback(pa_context* c, int success, void* userdata) {
+    operation* op = (operation*) userdata;
+
+    if (success) {
+        lua_pushboolean(op->data->L, true);
+        operation_add_result(op);
+    }
+
+    operation_complete(op, success ? 1 : -1);
+}
+
+
+void operation_engine_cancel_all(operation_engine* engine, const char* reason) {
+    // Callbacks may send new requests, which are not part of this.
+    GQueue queued = engine->queued;
+    g_queue_init(&engine->queued);
+    GPtrArray* in_flight = engine->in_flight;
+    engine->in_flight = g_ptr_array_new();
+
+    // One of the callbacks may free the engine, which must then not happen until the loop is done.
+    engine->calling++;
+
+    operation* op;
+    while ((op = g_queue_pop_head(&queued)) != NULL) {
+        if (engine->freed) {
+            operation_free(op);
+            continue;
+        }
+        engine->stats[op->id].cancelled++;
+        lua_pushstring(op->data->L, reason);
+        operation_finish(op, true);
+    }
+
+    for (guint i = 0; i < in_flight->len; ++i) {
+        op = g_ptr_array_index(in_flight, i);
+        if (engine->freed) {
+            operation_free(op);
+            continue;
+        }
+        pa_operation_cancel(op->op);
+        engine->stats[op->id].cancelled++;
+        lua_pushstring(op->data->L, reason);
+        operation_finish(op, true);
+    }
+
+    g_ptr_array_free(in_flight, TRUE);
+
+    engine->calling--;
+    if (engine->freed && engine->calling == 0) {
+        g_free(engine);
+    }
+}
+
+
+void operation_config_from_lua(lua_State* L, int index, operation_config* config) {
+    if (lua_isnoneornil(L, index)) {
+        return;
+    }
+
+    luaL_checktype(L, index, LUA_TTABLE);
+
+    lua_getfield(L, index, "max_in_flight");
+    if (!lua_isnil(L, -1)) {
+        lua_Integer value = luaL_checkinteger(L, -1);
+        luaL_argcheck(L, value >= 0, index, "max_in_flight must not be negative");
+        config->max_in_flight = (uint32_t) value;
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, index, "pool_size");
+    if (!lua_isnil(L, -1)) {
+        lua_Integer value = luaL_checkinteger(L, -1);
+        luaL_argcheck(L, value >= 0, index, "pool_size must not be negative");
+        config->pool_size = (uint32_t) value;
+    }
+    lua_pop(L, 1);
+}
+
+
+void operation_engine_set_config(operation_engine* engine, const operation_config* config) {
+    engine->config = *config;
+
+    while (engine->pool->len > engine->config.pool_size) {
+        operation_free(g_ptr_array_remove_index_fast(engine->pool, engine->pool->len - 1));
+    }
+
+    operation_send_queued(engine);
+}
+
+
+void operation_stats_to_lua(lua_State* L, const operation_engine* engine) {
+    lua_createtable(L, 0, 6);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "in_flight");
+    lua_pushinteger(L, (lua_Integer) engine->in_flight->len);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "queued");
+    lua_pushinteger(L, (lua_Integer) g_queue_get_length((GQueue*) &engine->queued));
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "pooled");
+    lua_pushinteger(L, (lua_Integer) engine->pool->len);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "max_in_flight");
+    lua_pushinteger(L, engine->config.max_in_flight);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "pool_size");
+    lua_pushinteger(L, engine->config.pool_size);
+    lua_settable(L, table_index);
+
+    // Only operations that were used at least once are listed.
+    lua_pushstring(L, "operations");
+    lua_newtable(L);
+    for (int id = 0; id < OPERATION_ID_MAX; ++id) {
+        const operation_stats* stats = &engine->stats[id];
+        if (stats->started == 0) {
+            continue;
+        }
+
+        lua_createtable(L, 0, 6);
+        int stats_index = lua_gettop(L);
+
+        lua_pushstring(L, "started");
+        lua_pushinteger(L, (lua_Integer) stats->started);
+        lua_settable(L, stats_index);
+
+        lua_pushstring(L, "completed");
+        lua_pushinteger(L, (lua_Integer) stats->completed);
+        lua_settable(L, stats_index);
+
+        lua_pushstring(L, "failed");
+        lua_pushinteger(L, (lua_Integer) stats->failed);
+        lua_settable(L, stats_index);
+
+        lua_pushstring(L, "cancelled");
+        lua_pushinteger(L, (lua_Integer) stats->cancelled);
+        lua_settable(L, stats_index);
+
+        lua_pushstring(L, "latency_max");
+        lua_pushinteger(L, (lua_Integer) stats->latency_max);
+        lua_settable(L, stats_index);
+
+        // Only requests the server answered have a latency.
+        uint64_t answered = stats->completed + stats->failed - stats->unsent;
+        lua_pushstring(L, "latency_avg");
+        lua_pushnumber(L, answered > 0 ? (lua_Number) stats->latency_total / (lua_Number) answered : 0);
+        lua_settable(L, stats_index);
+
+        lua_setfield(L, -2, operation_kinds[id].name);
+    }
+    lua_settable(L, table_index);
+}
+
+
+// Reads the volume argument of the volume setters into `volume`, without allocating anything. libpulse
+// serializes the volume before the request returns, so it can live on the caller's stack.
+//
+// A number is applied to all channels. When the mirror knows the object, it is sent for as many channels as the
+// object has. Otherwise a single channel is sent, which the server applies to all of them.
+static void check_volume_arg(lua_State* L, int arg, lua_pa_context* ctx, mirror_kind kind, uint32_t index,
+                             const char* name, pa_cvolume* volume) {
+    switch (lua_type(L, arg)) {
+    case LUA_TNUMBER: {
+        lua_Integer value = luaL_checkinteger(L, arg);
+        luaL_argcheck(L, value >= 0 && PA_VOLUME_IS_VALID(value), arg, "volume out of bounds");
+
+        if (ctx->mirror != NULL) {
+            mirror_entry* entry =
+                name != NULL ? mirror_find_name(ctx->mirror, kind, name) : mirror_find(ctx->mirror, kind, index);
+            if (entry != NULL && entry->has_volume && pa_cvolume_valid(&entry->volume)) {
+                pa_cvolume_set(volume, entry->volume.channels, (pa_volume_t) value);
+                return;
+            }
+        }
+
+        pa_cvolume_set(volume, 1, (pa_volume_t) value);
+        return;
+    }
+    case LUA_TTABLE: {
+        size_t channels = lua_rawlen(L, arg);
+        luaL_argcheck(L, channels > 0, arg, "expected at least one channel");
+        luaL_argcheck(L, channels <= PA_CHANNELS_MAX, arg, "too many channels");
+        volume->channels = (uint8_t) channels;
+        for (int i = 0; i < volume->channels; i++) {
+            lua_rawgeti(L, arg, i + 1);
+            pa_volume_t value = (pa_volume_t) luaL_checkinteger(L, -1);
+            volume->values[i] = PA_CLAMP_VOLUME(value);
+            lua_pop(L, 1);
+        }
+        return;
+    }
+    default: {
+        volume_load(luaL_checkudata(L, arg, LUA_PA_VOLUME), volume);
+        return;
+    }
+    }
+}
+
+
+static uint32_t check_index_arg(lua_State* L, int arg) {
+    lua_Integer index = luaL_checkinteger(L, arg);
+    luaL_argcheck(L, index >= 1 && (uint64_t) index < PA_INVALID_INDEX, arg, "index out of bounds");
+    return (uint32_t) index - 1;
+}
+
+
+int operation_run(lua_State* L, operation_id id) {
+    const operation_kind* kind = &operation_kinds[id];
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+
+    operation_args args = { 0 };
+    args.index = PA_INVALID_INDEX;
+    args.target_index = PA_INVALID_INDEX;
+    bool by_name = false;
+    int volume_arg = 0;
+    // Object arguments fill `index` and `name` first, then `target_index` and `target_name`.
+    int objects = 0;
+
+    int arg = 2;
+    for (int i = 0; i < OPERATION_MAX_ARGS && kind->args[i] != OPERATION_ARG_NONE; ++i, ++arg) {
+        uint32_t* index = objects == 0 ? &args.index : &args.target_index;
+        const char** name = objects == 0 ? &args.name : &args.target_name;
+
+        switch (kind->args[i]) {
+        case OPERATION_ARG_INDEX:
+            *index = check_index_arg(L, arg);
+            objects++;
+            break;
+        case OPERATION_ARG_NAME:
+            *name = luaL_checkstring(L, arg);
+            objects++;
+            break;
+        case OPERATION_ARG_INDEX_OR_NAME:
+            if (lua_type(L, arg) == LUA_TSTRING) {
+                *name = lua_tostring(L, arg);
+                by_name = true;
+            } else if (lua_type(L, arg) == LUA_TNUMBER) {
+                *index = check_index_arg(L, arg);
+            } else {
+                lua_pushfstring(L, "expected number or string, got %s", luaL_typename(L, arg));
+                return luaL_argerror(L, arg, lua_tostring(L, -1));
+            }
+            objects++;
+            break;
+        case OPERATION_ARG_BOOLEAN:
+            args.flag = lua_toboolean(L, arg);
+            break;
+        case OPERATION_ARG_VOLUME:
+            volume_arg = arg;
+            break;
+        case OPERATION_ARG_NONE:
+            break;
+        }
+    }
+
+    if (volume_arg != 0) {
+        check_volume_arg(L, volume_arg, ctx, kind->mirror, args.index, args.name, &args.volume);
+    }
+
+    schema_mask fields = SCHEMA_MASK_ALL;
+    if (kind->schema != NULL && lua_type(L, arg) == LUA_TTABLE) {
+        fields = schema_check_mask(L, arg, kind->schema);
+        arg++;
+    }
+
+    // Without a callback, there is nothing to tell about a request that only reports success.
+    int callback = arg;
+    bool has_callback = !lua_isnoneornil(L, callback);
+    if (has_callback || kind->result != OPERATION_RESULT_SUCCESS) {
+        luaL_checktype(L, callback, LUA_TFUNCTION);
+    }
+
+    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
+        if (has_callback) {
+            lua_pushvalue(L, callback);
+            lua_pushstring(L, "connection not ready");
+            lua_call(L, 1, 0);
+        }
+        return 0;
+    }
+
+    operation_engine* engine = ctx->operations;
+    operation* op = operation_acquire(engine, L, id);
+    op->args = args;
+    op->by_name = by_name;
+    op->has_callback = has_callback;
+    op->fields = fields;
+
+    lua_State* thread = op->data->L;
+    if (has_callback) {
+        lua_pushvalue(L, callback);
+    } else {
+        lua_pushnil(L);
+    }
+    if (kind->result == OPERATION_RESULT_LIST) {
+        lua_newtable(L);
+    } else {
+        lua_pushnil(L);
+    }
+    lua_xmove(L, thread, 2);
+
+    // Keep the strings the names point into alive for as long as the request may be queued.
+    for (int i = 2; i < callback; ++i) {
+        if (lua_type(L, i) == LUA_TSTRING) {
+            lua_pushvalue(L, i);
+            lua_xmove(L, thread, 1);
+        }
+    }
+
+    // Requests run from a callback must not overtake the queued ones, which are only sent after it.
+    if (!g_queue_is_empty(&engine->queued)
+        || (engine->config.max_in_flight > 0 && engine->in_flight->len >= engine->config.max_in_flight)) {
+        g_queue_push_tail(&engine->queued, op);
+        return 0;
+    }
+
+    operation_send(op);
+    return 0;
+}
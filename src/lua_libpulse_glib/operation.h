@@ -0,0 +1,228 @@
+/* Runs the introspection requests of a context, such as `Context:get_sinks` or `Context:set_sink_mute`.
+ *
+ * Every request is described by an `operation_kind`: which arguments it takes from Lua, which libpulse function
+ * sends it, and what kind of result it produces. `operation_run` does everything else the same way for all of
+ * them: checking the arguments and connection state, holding the callback, formatting errors, releasing the
+ * `pa_operation`, and keeping statistics. Requests beyond the configured limit are queued, and finished
+ * requests return their Lua thread to a pool for the next one.
+ */
+#pragma once
+
+#include "callback.h"
+#include "mirror.h"
+#include "schema.h"
+
+#include <glib.h>
+#include <lua.h>
+#include <pulse/context.h>
+#include <pulse/introspect.h>
+#include <pulse/operation.h>
+#include <pulse/volume.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct lua_pa_context;
+
+
+// The number of Lua arguments between the context and the callback an operation can take.
+#define OPERATION_MAX_ARGS 2
+
+
+typedef enum operation_arg {
+    OPERATION_ARG_NONE = 0,
+    // A 1-based index.
+    OPERATION_ARG_INDEX,
+    OPERATION_ARG_NAME,
+    // Either of the two. Names are sent with `start_by_name`.
+    OPERATION_ARG_INDEX_OR_NAME,
+    OPERATION_ARG_BOOLEAN,
+    // Anything `Context:set_sink_volume` accepts.
+    OPERATION_ARG_VOLUME,
+} operation_arg;
+
+
+typedef enum operation_result {
+    // A `pa_context_success_cb_t`. The callback gets `true`, or an error.
+    OPERATION_RESULT_SUCCESS = 0,
+    // An info callback that is called once before the end of the list. The callback gets the info table.
+    OPERATION_RESULT_INFO,
+    // An info callback that is called for every entry. The callback gets a list of info tables.
+    OPERATION_RESULT_LIST,
+} operation_result;
+
+
+// The decoded arguments of a request. Names point into strings that the request's thread keeps alive.
+typedef struct operation_args {
+    // The first object argument.
+    uint32_t index;
+    const char* name;
+    // The second object argument, e.g. the sink to move a sink input to.
+    uint32_t target_index;
+    const char* target_name;
+    bool flag;
+    pa_cvolume volume;
+} operation_args;
+
+
+// Sends a request. `userdata` has to be passed on to `operation_success_callback` or an info callback that was
+// defined with `DEFINE_OPERATION_INFO_CALLBACK`.
+typedef pa_operation* (*operation_start_fn)(pa_context*, const operation_args*, void* userdata);
+
+
+typedef enum operation_id {
+    OPERATION_GET_SERVER_INFO = 0,
+    OPERATION_SET_DEFAULT_SINK,
+    OPERATION_SET_DEFAULT_SOURCE,
+    OPERATION_GET_SINKS,
+    OPERATION_GET_SINK_INFO,
+    OPERATION_SET_SINK_VOLUME,
+    OPERATION_SET_SINK_MUTE,
+    OPERATION_SET_SINK_SUSPENDED,
+    OPERATION_GET_SOURCES,
+    OPERATION_GET_SOURCE_INFO,
+    OPERATION_SET_SOURCE_VOLUME,
+    OPERATION_SET_SOURCE_MUTE,
+    OPERATION_SET_SOURCE_SUSPENDED,
+    OPERATION_GET_SINK_INPUTS,
+    OPERATION_GET_SINK_INPUT_INFO,
+    OPERATION_MOVE_SINK_INPUT,
+    OPERATION_SET_SINK_INPUT_VOLUME,
+    OPERATION_SET_SINK_INPUT_MUTE,
+    OPERATION_KILL_SINK_INPUT,
+    OPERATION_GET_SOURCE_OUTPUTS,
+    OPERATION_GET_SOURCE_OUTPUT_INFO,
+    OPERATION_MOVE_SOURCE_OUTPUT,
+    OPERATION_SET_SOURCE_OUTPUT_VOLUME,
+    OPERATION_SET_SOURCE_OUTPUT_MUTE,
+    OPERATION_KILL_SOURCE_OUTPUT,
+    OPERATION_GET_CLIENTS,
+    OPERATION_GET_CLIENT_INFO,
+    OPERATION_GET_MODULES,
+    OPERATION_GET_MODULE_INFO,
+    OPERATION_GET_SAMPLES,
+    OPERATION_GET_SAMPLE_INFO,
+    OPERATION_REMOVE_SAMPLE,
+    OPERATION_ID_MAX,
+} operation_id;
+
+
+typedef struct operation_kind {
+    // The method name, used as key in `Context:get_operation_stats`.
+    const char* name;
+    // Completes "failed to ..." in error messages.
+    const char* description;
+    operation_arg args[OPERATION_MAX_ARGS];
+    operation_result result;
+    // Describes the info struct of queries, which take an optional list of the fields to return before the
+    // callback.
+    const schema* schema;
+    // Where the channel count is looked up to apply a plain number volume to.
+    mirror_kind mirror;
+    operation_start_fn start;
+    // Used instead of `start` when the `OPERATION_ARG_INDEX_OR_NAME` argument is a name.
+    operation_start_fn start_by_name;
+} operation_kind;
+
+
+// Defined in `introspection.c`, indexed by `operation_id`.
+extern const operation_kind operation_kinds[OPERATION_ID_MAX];
+
+
+typedef struct operation_stats {
+    uint64_t started;
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t cancelled;
+    // Failed requests that couldn't be sent at all, which are included in `failed`.
+    uint64_t unsent;
+    // Time from sending the request to its result, in microseconds.
+    uint64_t latency_total;
+    uint64_t latency_max;
+} operation_stats;
+
+
+typedef struct operation_config {
+    // The number of requests that may wait for the server at the same time. `0` means unlimited.
+    uint32_t max_in_flight;
+    // The number of finished requests whose Lua thread is kept for reuse.
+    uint32_t pool_size;
+} operation_config;
+
+
+typedef struct operation {
+    struct operation_engine* engine;
+    operation_id id;
+    operation_args args;
+    // A thread with the callback, or `nil`, at index 1, and the result at index 2. Names from the arguments are
+    // kept above that.
+    simple_callback_data* data;
+    bool has_callback;
+    bool by_name;
+    bool has_result;
+    // The info fields to return.
+    schema_mask fields;
+    // `NULL` while queued.
+    pa_operation* op;
+    gint64 started_at;
+} operation;
+
+
+typedef struct operation_engine {
+    struct lua_pa_context* ctx;
+    operation_config config;
+    operation_stats stats[OPERATION_ID_MAX];
+    // Requests that were sent, as `operation*`.
+    GPtrArray* in_flight;
+    // Requests that wait for a free slot, oldest first.
+    GQueue queued;
+    // Finished requests, with their threads cleared.
+    GPtrArray* pool;
+    // The number of Lua callbacks currently running, which the engine must outlive.
+    int calling;
+    bool freed;
+} operation_engine;
+
+
+operation_engine* operation_engine_new(struct lua_pa_context*);
+
+// Reads `max_in_flight` and `pool_size` from the table at the given index into the config. Fields that are not
+// present keep their current value.
+void operation_config_from_lua(lua_State*, int, operation_config*);
+
+// Applies the config, sending queued requests if the limit was raised.
+void operation_engine_set_config(operation_engine*, const operation_config*);
+
+// Pushes a table with the engine's statistics onto the stack.
+void operation_stats_to_lua(lua_State*, const operation_engine*);
+
+// Fails all requests of the engine with the given error, e.g. when the connection is lost.
+void operation_engine_cancel_all(operation_engine*, const char* reason);
+
+// Cancels all requests without calling their callbacks, and frees the engine.
+void operation_engine_free(operation_engine*);
+
+// The implementation of every Lua method that is described by an `operation_kind`.
+int operation_run(lua_State*, operation_id);
+
+// Stores the value on top of the operation's thread as result, or appends it for lists.
+void operation_add_result(operation*);
+
+// Ends the request and calls the Lua callback. `eol` is the value libpulse passed, where a negative one
+// signals an error.
+void operation_complete(operation*, int eol);
+
+void operation_success_callback(pa_context*, int success, void* userdata);
+
+
+// Defines `<name>_callback`, which converts the requested fields of each info and passes them to
+// `operation_add_result`.
+#define DEFINE_OPERATION_INFO_CALLBACK(name, type)                                                                     \
+    static void name##_callback(pa_context* c, const type* info, int eol, void* userdata) {                            \
+        operation* op = (operation*) userdata;                                                                         \
+        if (eol == 0) {                                                                                                \
+            schema_project(op->data->L, operation_kinds[op->id].schema, info, op->fields);                             \
+            operation_add_result(op);                                                                                  \
+        } else {                                                                                                       \
+            operation_complete(op, eol);                                                                               \
+        }                                                                                                              \
+    }
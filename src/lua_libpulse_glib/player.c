@@ -0,0 +1,444 @@
+#include "player.h"
+
+#include "lua_util.h"
+#include "stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <pulse/error.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define WAV_FORMAT_PCM        0x0001
+#define WAV_FORMAT_FLOAT      0x0003
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+
+static uint16_t get_u16(const unsigned char* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+
+// Finds the format and audio data of a WAV file. Returns an error message, or `NULL` on success.
+static const char* player_parse_wav(lua_pa_player* player) {
+    const unsigned char* p = player->map;
+    size_t size = player->map_size;
+
+    if (size < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+        return "not a WAV file";
+    }
+
+    bool has_format = false;
+    size_t offset = 12;
+
+    while (offset + 8 <= size) {
+        const unsigned char* chunk = p + offset;
+        size_t chunk_size = get_u32(chunk + 4);
+        size_t available = size - offset - 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_size < 16 || chunk_size > available) {
+                return "invalid WAV format chunk";
+            }
+
+            uint16_t tag = get_u16(chunk + 8);
+            uint16_t channels = get_u16(chunk + 10);
+            uint32_t rate = get_u32(chunk + 12);
+            uint16_t bits = get_u16(chunk + 22);
+
+            // The actual format of an extensible file is the first two bytes of its sub-format GUID.
+            if (tag == WAV_FORMAT_EXTENSIBLE && chunk_size >= 26) {
+                tag = get_u16(chunk + 8 + 24);
+            }
+
+            switch (bits) {
+            case 8:
+                player->spec.format = tag == WAV_FORMAT_PCM ? PA_SAMPLE_U8 : PA_SAMPLE_INVALID;
+                break;
+            case 16:
+                player->spec.format = tag == WAV_FORMAT_PCM ? PA_SAMPLE_S16LE : PA_SAMPLE_INVALID;
+                break;
+            case 24:
+                player->spec.format = tag == WAV_FORMAT_PCM ? PA_SAMPLE_S24LE : PA_SAMPLE_INVALID;
+                break;
+            case 32:
+                player->spec.format = tag == WAV_FORMAT_FLOAT ? PA_SAMPLE_FLOAT32LE
+                                    : tag == WAV_FORMAT_PCM   ? PA_SAMPLE_S32LE
+                                                              : PA_SAMPLE_INVALID;
+                break;
+            default:
+                player->spec.format = PA_SAMPLE_INVALID;
+                break;
+            }
+
+            player->spec.channels = (uint8_t) channels;
+            player->spec.rate = rate;
+            has_format = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!has_format) {
+                return "WAV data before format chunk";
+            }
+
+            // Streamed files may not have the final size set, so the data is clamped to the file.
+            player->audio = chunk + 8;
+            player->audio_size = MIN(chunk_size, available);
+            return NULL;
+        }
+
+        // Chunks are padded to an even size.
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    return "WAV file has no data";
+}
+
+
+static void player_close(lua_pa_player* player) {
+    if (player->drain != NULL) {
+        pa_operation_cancel(player->drain);
+        pa_operation_unref(player->drain);
+        player->drain = NULL;
+    }
+
+    if (player->stream != NULL) {
+        pa_stream_set_state_callback(player->stream, NULL, NULL);
+        pa_stream_set_write_callback(player->stream, NULL, NULL);
+        if (pa_stream_get_state(player->stream) != PA_STREAM_UNCONNECTED) {
+            pa_stream_disconnect(player->stream);
+        }
+        pa_stream_unref(player->stream);
+        player->stream = NULL;
+    }
+
+    if (player->map != NULL) {
+        munmap(player->map, player->map_size);
+        player->map = NULL;
+        player->audio = NULL;
+    }
+
+    // Once this is gone, the player may be collected, so it has to be the last thing to touch it.
+    if (player->self_ref != LUA_NOREF) {
+        luaL_unref(player->data->L, LUA_REGISTRYINDEX, player->self_ref);
+        player->self_ref = LUA_NOREF;
+    }
+}
+
+
+// Calls the Lua callback once playback has ended, either with an error message or `true`.
+static void player_report(lua_pa_player* player, const char* err) {
+    lua_State* L = player->data->L;
+
+    if (!lua_isfunction(L, 1)) {
+        return;
+    }
+
+    lua_pushvalue(L, 1);
+    if (err != NULL) {
+        lua_pushstring(L, err);
+        lua_call(L, 1, 0);
+    } else {
+        lua_pushnil(L);
+        lua_pushboolean(L, true);
+        lua_call(L, 2, 0);
+    }
+}
+
+
+static void player_drain_callback(pa_stream* s, int success, void* userdata) {
+    lua_pa_player* player = (lua_pa_player*) userdata;
+
+    pa_operation_unref(player->drain);
+    player->drain = NULL;
+
+    // The reference keeps the player alive while the callback runs.
+    player_report(player, NULL);
+    player_close(player);
+}
+
+
+static void player_state_callback(pa_stream* s, void* userdata) {
+    lua_pa_player* player = (lua_pa_player*) userdata;
+
+    switch (pa_stream_get_state(s)) {
+    case PA_STREAM_READY: {
+        const pa_buffer_attr* attr = pa_stream_get_buffer_attr(s);
+        if (attr != NULL && attr->minreq > 0) {
+            player->chunk_size = attr->minreq;
+        }
+        break;
+    }
+    case PA_STREAM_FAILED: {
+        const char* err = pa_strerror(pa_context_errno(pa_stream_get_context(s)));
+        player_report(player, err);
+        player_close(player);
+        break;
+    }
+    default: {
+        break;
+    }
+    }
+}
+
+
+// Copies audio from the mapping into the stream, until the request is served or the file ends.
+static void player_write_callback(pa_stream* s, size_t nbytes, void* userdata) {
+    lua_pa_player* player = (lua_pa_player*) userdata;
+
+    while (nbytes > 0 && !player->finished) {
+        if (player->position >= player->audio_size) {
+            if (player->remaining_loops == 0) {
+                player->finished = true;
+                break;
+            }
+            if (player->remaining_loops > 0) {
+                player->remaining_loops--;
+            }
+            player->position = 0;
+        }
+
+        size_t chunk = MIN(nbytes, player->audio_size - player->position);
+        chunk = MIN(chunk, player->chunk_size);
+
+        void* dest;
+        if (pa_stream_begin_write(s, &dest, &chunk) < 0 || dest == NULL) {
+            return;
+        }
+
+        // libpulse may hand out less memory than requested, but only whole frames may be written.
+        chunk = MIN(chunk, player->audio_size - player->position);
+        chunk -= chunk % pa_frame_size(&player->spec);
+        if (chunk == 0) {
+            pa_stream_cancel_write(s);
+            return;
+        }
+
+        memcpy(dest, player->audio + player->position, chunk);
+        if (pa_stream_write(s, dest, chunk, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+            return;
+        }
+
+        player->position += chunk;
+        nbytes -= chunk;
+    }
+
+    if (player->finished && player->drain == NULL) {
+        pa_stream_set_write_callback(s, NULL, NULL);
+        player->drain = pa_stream_drain(s, player_drain_callback, player);
+    }
+}
+
+
+int context_play_file(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* path = luaL_checkstring(L, 2);
+    bool has_opts = !lua_isnoneornil(L, 3);
+    if (has_opts) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+    }
+    if (!lua_isnoneornil(L, 4)) {
+        luaL_checktype(L, 4, LUA_TFUNCTION);
+    }
+
+    lua_pa_player* player = lua_newuserdata(L, sizeof(lua_pa_player));
+    memset(player, 0, sizeof(lua_pa_player));
+    player->self_ref = LUA_NOREF;
+    int player_index = lua_gettop(L);
+
+    player->data = prepare_lua_callback(L, 0);
+    lua_State* thread_L = player->data->L;
+    if (!lua_isnoneornil(L, 4)) {
+        lua_pushvalue(L, 4);
+    } else {
+        lua_pushnil(L);
+    }
+    lua_pushvalue(L, 1);
+    lua_xmove(L, thread_L, 2);
+
+    luaL_getmetatable(L, LUA_PA_PLAYER);
+    lua_setmetatable(L, player_index);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        int err = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to open %s: %s", path, strerror(err));
+        return 2;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        lua_pushnil(L);
+        lua_pushfstring(L, "file is empty: %s", path);
+        return 2;
+    }
+
+    void* map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int map_err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to map %s: %s", path, strerror(map_err));
+        return 2;
+    }
+
+    player->map = map;
+    player->map_size = (size_t) st.st_size;
+    madvise(map, player->map_size, MADV_SEQUENTIAL);
+
+    if (player->map_size >= 4 && memcmp(map, "RIFF", 4) == 0) {
+        const char* err = player_parse_wav(player);
+        if (err != NULL) {
+            player_close(player);
+            lua_pushnil(L);
+            lua_pushstring(L, err);
+            return 2;
+        }
+    } else {
+        // Raw files need to be described by the caller.
+        if (has_opts) {
+            lua_getfield(L, 3, "spec");
+        }
+        if (!has_opts || lua_isnil(L, -1)) {
+            player_close(player);
+            return luaL_argerror(L, 3, "raw files need a sample spec");
+        }
+        sample_spec_from_lua(L, lua_gettop(L), &player->spec);
+        lua_pop(L, 1);
+
+        player->audio = map;
+        player->audio_size = player->map_size;
+    }
+
+    if (!pa_sample_spec_valid(&player->spec)) {
+        player_close(player);
+        lua_pushnil(L);
+        lua_pushstring(L, "unsupported sample format");
+        return 2;
+    }
+
+    size_t frame_size = pa_frame_size(&player->spec);
+    player->audio_size -= player->audio_size % frame_size;
+    player->chunk_size = pa_usec_to_bytes(10 * PA_USEC_PER_MSEC, &player->spec);
+
+    pa_buffer_attr attr;
+    buffer_attr_from_lua(L, 3, &player->spec, &attr);
+
+    const char* device = NULL;
+    pa_stream_flags_t flags = PA_STREAM_NOFLAGS;
+
+    if (has_opts) {
+        lua_getfield(L, 3, "device");
+        device = luaL_optstring(L, -1, NULL);
+
+        lua_getfield(L, 3, "offset");
+        lua_Number offset = luaL_optnumber(L, -1, 0);
+        size_t start = pa_usec_to_bytes((pa_usec_t) (offset * PA_USEC_PER_SEC), &player->spec);
+        if (offset < 0 || start >= player->audio_size) {
+            player_close(player);
+            return luaL_argerror(L, 3, "offset is beyond the end of the file");
+        }
+        player->position = start;
+
+        lua_getfield(L, 3, "loop");
+        if (lua_isboolean(L, -1)) {
+            player->remaining_loops = lua_toboolean(L, -1) ? -1 : 0;
+        } else if (!lua_isnil(L, -1)) {
+            lua_Integer count = luaL_checkinteger(L, -1);
+            player->remaining_loops = count > 0 ? (int) count - 1 : -1;
+        }
+
+        lua_getfield(L, 3, "flags");
+        flags = (pa_stream_flags_t) luaL_optinteger(L, -1, flags);
+
+        lua_pop(L, 4);
+    }
+
+    if (attr.tlength != (uint32_t) -1 || attr.minreq != (uint32_t) -1) {
+        flags |= PA_STREAM_ADJUST_LATENCY;
+    }
+
+    char* name = g_path_get_basename(path);
+    player->stream = pa_stream_new(ctx->context, name, &player->spec, NULL);
+    g_free(name);
+
+    if (player->stream != NULL) {
+        pa_stream_set_state_callback(player->stream, player_state_callback, player);
+        pa_stream_set_write_callback(player->stream, player_write_callback, player);
+    }
+
+    if (player->stream == NULL || pa_stream_connect_playback(player->stream, device, &attr, flags, NULL, NULL) < 0) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to connect stream: %s", pa_strerror(pa_context_errno(ctx->context)));
+        player_close(player);
+        return 2;
+    }
+
+    lua_pushvalue(L, player_index);
+    player->self_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_pushvalue(L, player_index);
+    return 1;
+}
+
+
+int player_stop(lua_State* L) {
+    lua_pa_player* player = luaL_checkudata(L, 1, LUA_PA_PLAYER);
+    player_close(player);
+    return 0;
+}
+
+
+int player_pause(lua_State* L) {
+    lua_pa_player* player = luaL_checkudata(L, 1, LUA_PA_PLAYER);
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+
+    if (player->stream != NULL) {
+        pa_operation* op = pa_stream_cork(player->stream, lua_toboolean(L, 2), NULL, NULL);
+        if (op != NULL) {
+            pa_operation_unref(op);
+        }
+    }
+
+    return 0;
+}
+
+
+int player_get_position(lua_State* L) {
+    lua_pa_player* player = luaL_checkudata(L, 1, LUA_PA_PLAYER);
+    lua_pushnumber(L, (lua_Number) pa_bytes_to_usec(player->position, &player->spec) / PA_USEC_PER_SEC);
+    return 1;
+}
+
+
+int player_get_duration(lua_State* L) {
+    lua_pa_player* player = luaL_checkudata(L, 1, LUA_PA_PLAYER);
+    lua_pushnumber(L, (lua_Number) pa_bytes_to_usec(player->audio_size, &player->spec) / PA_USEC_PER_SEC);
+    return 1;
+}
+
+
+int player__gc(lua_State* L) {
+    lua_pa_player* player = luaL_checkudata(L, 1, LUA_PA_PLAYER);
+
+    player_close(player);
+
+    if (player->data != NULL) {
+        free_lua_callback(player->data);
+        player->data = NULL;
+    }
+
+    return 0;
+}
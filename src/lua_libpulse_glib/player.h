@@ -0,0 +1,100 @@
+/** File playback.
+ *
+ * A @{Player} plays a WAV or raw PCM file without reading it into Lua. The file is memory-mapped, and the
+ * stream's write requests are served directly from the mapping in C.
+ *
+ *    local player = ctx:play_file("/usr/share/sounds/alert.wav", { loop = 2 }, function(err)
+ *        print(err or "done")
+ *    end)
+ *
+ * @module lua_libpulse_glib.player
+ */
+#pragma once
+
+#include "callback.h"
+#include "context.h"
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <pulse/stream.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LUA_PA_PLAYER "pulseaudio.player"
+
+
+typedef struct lua_pa_player {
+    pa_stream* stream;
+    pa_sample_spec spec;
+    // The whole file, as mapped into memory.
+    void* map;
+    size_t map_size;
+    // The audio data inside the mapping.
+    const unsigned char* audio;
+    size_t audio_size;
+    // The read position, relative to `audio`.
+    size_t position;
+    // How many more times the file is played after the current pass. Negative to loop forever.
+    int remaining_loops;
+    // The size of each copy, taken from the stream's `minreq` once it is ready.
+    size_t chunk_size;
+    pa_operation* drain;
+    bool finished;
+    // A thread with the callback at index 1 and the context at index 2, to keep it alive.
+    simple_callback_data* data;
+    // A registry reference to the player itself while it is playing, so that playback finishes and the callback
+    // is called even if the caller doesn't keep the player. `LUA_NOREF` otherwise.
+    int self_ref;
+} lua_pa_player;
+
+
+/// Player
+/// @type Player
+
+
+/** Stops playback. The callback is not called.
+ *
+ * @function Player:stop
+ */
+int player_stop(lua_State*);
+
+/** Pauses or resumes playback.
+ *
+ * @function Player:pause
+ * @tparam boolean pause
+ */
+int player_pause(lua_State*);
+
+/** Returns the current read position in seconds.
+ *
+ * As data is buffered by the server, this is ahead of what can be heard by up to the stream's latency.
+ *
+ * @function Player:get_position
+ * @treturn number
+ */
+int player_get_position(lua_State*);
+
+/** Returns the length of the file's audio in seconds.
+ *
+ * @function Player:get_duration
+ * @treturn number
+ */
+int player_get_duration(lua_State*);
+
+int player__gc(lua_State*);
+
+
+static const struct luaL_Reg player_f[] = {
+    {"stop",          player_stop        },
+    { "pause",        player_pause       },
+    { "get_position", player_get_position},
+    { "get_duration", player_get_duration},
+    { NULL,           NULL               }
+};
+
+
+static const struct luaL_Reg player_mt[] = {
+    {"__gc", player__gc},
+    { NULL,  NULL      }
+};
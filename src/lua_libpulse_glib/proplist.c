@@ -1,6 +1,7 @@
 #include "proplist.h"
 
 #include <pulse/xmalloc.h>
+#include <string.h>
 
 // Creates a Lua userdatum from/for a PulseAudio proplist.
 //
@@ -18,11 +19,46 @@ int proplist_to_lua(lua_State* L, pa_proplist* pa_plist) {
     lua_setmetatable(L, -2);
 
     plist->plist = pa_proplist_copy(pa_plist);
+    plist->hash_valid = false;
 
     return 1;
 }
 
 
+// Creates a Lua userdatum that takes ownership of the given proplist.
+static proplist* proplist_push(lua_State* L, pa_proplist* pa_plist) {
+    proplist* plist = lua_newuserdata(L, sizeof(proplist));
+    plist->plist = pa_plist;
+    plist->hash_valid = false;
+    luaL_getmetatable(L, LUA_PA_PROPLIST);
+    lua_setmetatable(L, -2);
+    return plist;
+}
+
+
+// Sets the keys and values of the table at `index` in `plist`.
+//
+// Raises an error for anything but strings, as `__newindex` does. Binary values have to go through `set_binary`.
+static void set_from_table(lua_State* L, int index, pa_proplist* plist) {
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        if (lua_type(L, -2) != LUA_TSTRING) {
+            luaL_error(L, "proplist keys must be strings");
+        }
+        const char* key = lua_tostring(L, -2);
+        if (lua_type(L, -1) != LUA_TSTRING) {
+            luaL_error(L, "value for key %s must be a string", key);
+        }
+
+        if (pa_proplist_sets(plist, key, lua_tostring(L, -1)) < 0) {
+            luaL_error(L, "failed to set value for key %s", key);
+        }
+
+        lua_pop(L, 1);
+    }
+}
+
+
 int proplist_new(lua_State* L) {
     pa_proplist* pa_plist = pa_proplist_new();
     if (pa_plist == NULL) {
@@ -30,15 +66,27 @@ int proplist_new(lua_State* L) {
         return lua_error(L);
     }
 
-    return proplist_to_lua(L, pa_plist);
+    // Owned by the userdatum right away, so that errors from reading the table don't leak it.
+    proplist* plist = proplist_push(L, pa_plist);
+
+    if (!lua_isnoneornil(L, 1)) {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        set_from_table(L, 1, plist->plist);
+    }
+
+    return 1;
 }
 
 
 int proplist_from_string(lua_State* L) {
     const char* str = luaL_checkstring(L, 1);
     pa_proplist* pa_plist = pa_proplist_from_string(str);
+    if (pa_plist == NULL) {
+        return luaL_error(L, "failed to parse proplist");
+    }
 
-    return proplist_to_lua(L, pa_plist);
+    proplist_push(L, pa_plist);
+    return 1;
 }
 
 
@@ -70,6 +118,7 @@ int proplist_tostring_sep(lua_State* L) {
 
 int proplist_clear(lua_State* L) {
     proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    plist->hash_valid = false;
     pa_proplist_clear(plist->plist);
     return 0;
 }
@@ -95,9 +144,188 @@ int proplist_contains(lua_State* L) {
 
 int proplist_copy(lua_State* L) {
     proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
-    pa_proplist* other = pa_proplist_copy(plist->plist);
+    proplist_push(L, pa_proplist_copy(plist->plist));
+    return 1;
+}
+
+
+int proplist_update(lua_State* L) {
+    static const char* const modes[] = { "set", "merge", "replace", NULL };
+    static const pa_update_mode_t mode_values[] = { PA_UPDATE_SET, PA_UPDATE_MERGE, PA_UPDATE_REPLACE };
+
+    proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    pa_update_mode_t mode = mode_values[luaL_checkoption(L, 3, "replace", modes)];
+
+    proplist* other = luaU_testudata(L, 2, LUA_PA_PROPLIST);
+    if (other != NULL) {
+        plist->hash_valid = false;
+        pa_proplist_update(plist->plist, mode, other->plist);
+        return 0;
+    }
+
+    luaL_checktype(L, 2, LUA_TTABLE);
+    // The table is read into a separate proplist first, so that an invalid value leaves `plist` untouched.
+    proplist* source = proplist_push(L, pa_proplist_new());
+    set_from_table(L, 2, source->plist);
+    plist->hash_valid = false;
+    pa_proplist_update(plist->plist, mode, source->plist);
+    return 0;
+}
+
+
+int proplist_get_binary(lua_State* L) {
+    proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    const char* key = luaL_checkstring(L, 2);
+    if (!pa_proplist_key_valid(key)) {
+        return luaL_error(L, "invalid key for proplist");
+    }
+
+    const void* data = NULL;
+    size_t size = 0;
+    if (pa_proplist_get(plist->plist, key, &data, &size) < 0) {
+        lua_pushnil(L);
+    } else {
+        lua_pushlstring(L, data, size);
+    }
+
+    return 1;
+}
+
+
+int proplist_set_binary(lua_State* L) {
+    proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    const char* key = luaL_checkstring(L, 2);
+    size_t size = 0;
+    const char* data = luaL_checklstring(L, 3, &size);
 
-    return proplist_to_lua(L, other);
+    plist->hash_valid = false;
+    if (pa_proplist_set(plist->plist, key, data, size) < 0) {
+        return luaL_error(L, "failed to set value for key %s", key);
+    }
+
+    return 0;
+}
+
+
+// 64-bit FNV-1a, continuing from `hash`.
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+
+// The finalizer of SplitMix64, which spreads FNV's weak high bits before the entries are summed up.
+static uint64_t mix(uint64_t hash) {
+    hash = (hash ^ (hash >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    hash = (hash ^ (hash >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return hash ^ (hash >> 31);
+}
+
+
+// Hashes every entry on its own and adds them up, which doesn't depend on the order `pa_proplist_iterate` visits
+// them in.
+static uint64_t compute_hash(pa_proplist* plist) {
+    uint64_t hash = mix(pa_proplist_size(plist));
+
+    void* state = NULL;
+    const char* key;
+    while ((key = pa_proplist_iterate(plist, &state)) != NULL) {
+        const void* data = NULL;
+        size_t size = 0;
+        pa_proplist_get(plist, key, &data, &size);
+
+        // Including the key's `NUL` keeps `"a" = "bc"` and `"ab" = "c"` apart.
+        uint64_t entry = fnv1a(UINT64_C(0xcbf29ce484222325), key, strlen(key) + 1);
+        entry = fnv1a(entry, data, size);
+        hash += mix(entry);
+    }
+
+    return hash;
+}
+
+
+static uint64_t proplist_get_hash(proplist* plist) {
+    if (!plist->hash_valid) {
+        plist->hash = compute_hash(plist->plist);
+        plist->hash_valid = true;
+    }
+    return plist->hash;
+}
+
+
+int proplist_hash(lua_State* L) {
+    proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    uint64_t hash = proplist_get_hash(plist);
+#if LUA_VERSION_NUM >= 503
+    lua_pushinteger(L, (lua_Integer) hash);
+#else
+    lua_pushnumber(L, (lua_Number) (hash >> 11));
+#endif
+    return 1;
+}
+
+
+// Pushes a table with all keys that have string values.
+static void push_table(lua_State* L, pa_proplist* plist) {
+    lua_createtable(L, 0, (int) pa_proplist_size(plist));
+
+    void* state = NULL;
+    const char* key;
+    while ((key = pa_proplist_iterate(plist, &state)) != NULL) {
+        const char* value = pa_proplist_gets(plist, key);
+        if (value != NULL) {
+            lua_pushstring(L, value);
+            lua_setfield(L, -2, key);
+        }
+    }
+}
+
+
+int proplist_to_table(lua_State* L) {
+    proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    push_table(L, plist->plist);
+    return 1;
+}
+
+
+int proplist_iterate(lua_State* L) {
+    proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    // Iterating a snapshot keeps `pa_proplist_iterate`'s state out of Lua's hands, where changing the proplist
+    // within the loop would leave it dangling. `createlib_proplist` passes `next` as second upvalue.
+    lua_pushvalue(L, lua_upvalueindex(2));
+    push_table(L, plist->plist);
+    lua_pushnil(L);
+    return 3;
+}
+
+
+int proplist_get_many(lua_State* L) {
+    proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    int count = (int) lua_rawlen(L, 2);
+    luaL_checkstack(L, count, "too many keys");
+    for (int i = 1; i <= count; ++i) {
+        lua_rawgeti(L, 2, i);
+        const char* key = luaL_checkstring(L, -1);
+        if (!pa_proplist_key_valid(key)) {
+            return luaL_error(L, "invalid key for proplist: %s", key);
+        }
+
+        const char* value = pa_proplist_gets(plist->plist, key);
+        lua_pop(L, 1);
+        if (value == NULL) {
+            lua_pushnil(L);
+        } else {
+            lua_pushstring(L, value);
+        }
+    }
+
+    return count;
 }
 
 
@@ -108,25 +336,32 @@ int proplist_copy(lua_State* L) {
 //
 // This functions very similar to a regular hash table.
 //
-// Numeric indices/keys are not supported.
+// Numeric indices/keys are not supported. Methods take precedence over keys of the same name, which PulseAudio's
+// dotted keys don't collide with.
 //
 // Will return `nil` if there is no value or if it is not valid UTF-8.
 // Arbitrary data from `pa_proplist_get()` is currently not supported.
 //
+// The method table is passed as upvalue by `createlib_proplist`.
+//
 // @param[type=string] key The index to access.
 // @return[type=string|nil] The data at the given index.
 int proplist__index(lua_State* L) {
     proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
     const char* key = luaL_checkstring(L, 2);
-    if (!pa_proplist_key_valid(key)) {
-        return luaL_error(L, "invalid key for proplist");
-    }
 
-    if (!pa_proplist_contains(plist->plist, key)) {
-        lua_pushnil(L);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    if (!lua_isnil(L, -1)) {
         return 1;
     }
+    lua_pop(L, 1);
 
+    if (!pa_proplist_key_valid(key)) {
+        return luaL_error(L, "invalid key for proplist");
+    }
+
+    // Missing keys return `NULL` as well, so there's no need to check with `pa_proplist_contains` first.
     const char* value = pa_proplist_gets(plist->plist, key);
     if (value == NULL) {
         lua_pushnil(L);
@@ -151,6 +386,7 @@ int proplist__newindex(lua_State* L) {
     proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
     const char* key = luaL_checkstring(L, 2);
 
+    plist->hash_valid = false;
     if (lua_isnil(L, 3)) {
         if (pa_proplist_unset(plist->plist, key) < 0) {
             // TODO: Get last error. Need to get access to the current context for
@@ -189,11 +425,19 @@ int proplist__len(lua_State* L) {
 //
 // Proplists are equal if they contain the same keys with the same values.
 //
+// Differing fingerprints settle this without comparing the contents. Matching ones are confirmed with
+// `pa_proplist_equal`, as they could be a collision.
+//
 // @param[type=PropList] other The proplist to compare against.
 // @return[type=boolean]
 int proplist__eq(lua_State* L) {
     proplist* plist = luaL_checkudata(L, 1, LUA_PA_PROPLIST);
     proplist* other = luaL_checkudata(L, 2, LUA_PA_PROPLIST);
+    if (proplist_get_hash(plist) != proplist_get_hash(other)) {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
     int equal = pa_proplist_equal(plist->plist, other->plist);
     lua_pushboolean(L, equal);
     return 1;
@@ -212,3 +456,12 @@ int proplist__tostring(lua_State* L) {
     pa_xfree((void*) str);
     return 1;
 }
+
+
+// Iterates over all keys with string values.
+//
+// Only used by Lua 5.2+, and by LuaJIT when built with `LUAJIT_ENABLE_LUA52COMPAT`. Otherwise `pairs` ignores
+// this metamethod.
+int proplist__pairs(lua_State* L) {
+    return proplist_iterate(L);
+}
@@ -6,7 +6,9 @@
  * - set a value: `plist[key] = value`
  * - get the size: `#plist`
  * - get default string presentation: `tostring(plist)`
- * - equality: `plist == other`
+ * - equality: `plist == other`, which compares @{hash}es first
+ * - iterate over all string values: `for key, value in pairs(plist) do ... end` (Lua 5.2+, or LuaJIT built
+ *   with `LUAJIT_ENABLE_LUA52COMPAT`)
  *
  * Additional operations are exposed as methods, as documented below.
  *
@@ -20,12 +22,17 @@
 #include <lua.h>
 #include <pulse/proplist.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define LUA_PA_PROPLIST "lua_libpulse_glib.proplist"
 
 
 typedef struct proplist {
     pa_proplist* plist;
+    // Fingerprint of the contents, see `proplist_hash`. Only valid while `hash_valid` is set, which every change
+    // to `plist` has to clear.
+    uint64_t hash;
+    bool hash_valid;
 } proplist;
 
 
@@ -125,9 +132,17 @@ typedef struct proplist {
 /// @section constructors
 
 
-/** Creates a new, empty property list.
+/** Creates a new property list.
+ *
+ * Given a table, its keys and values are set in a single call:
+ *
+ *     local plist = proplist.new({
+ *         [proplist.APPLICATION_NAME] = "My Player",
+ *         [proplist.MEDIA_ROLE] = "music",
+ *     })
  *
  * @function new
+ * @param[type=table,opt] values String keys and values to set.
  * @return[type=PropList]
  */
 int proplist_new(lua_State*);
@@ -163,6 +178,7 @@ int proplist__gc(lua_State*);
 int proplist__len(lua_State*);
 int proplist__eq(lua_State*);
 int proplist__tostring(lua_State*);
+int proplist__pairs(lua_State*);
 
 
 /// Methods
@@ -204,13 +220,113 @@ int proplist_contains(lua_State*);
  */
 int proplist_copy(lua_State*);
 
+/** Sets many keys at once.
+ *
+ * The mode decides what happens to keys that are already set, like `pa_proplist_update` does:
+ *
+ * - `"set"`: Removes all keys, then sets the new ones.
+ * - `"merge"`: Only sets keys that aren't set yet.
+ * - `"replace"`: Sets all keys, overwriting existing values.
+ *
+ * Values from a table must be valid UTF-8 strings. If any of them isn't, the proplist is left unchanged.
+ *
+ * @function update
+ * @param[type=table|PropList] values String keys and values, or another proplist.
+ * @param[type=string,opt="replace"] mode One of `"set"`, `"merge"` or `"replace"`.
+ */
+int proplist_update(lua_State*);
+
+/** Gets the raw data at the given key.
+ *
+ * Unlike indexing, this also returns binary data, exactly as stored. Note that values set as strings include
+ * their terminating `NUL` byte.
+ *
+ * @function get_binary
+ * @param[type=string] key The key to read.
+ * @return[type=string|nil] The data, or `nil` if the key isn't set.
+ */
+int proplist_get_binary(lua_State*);
+
+/** Sets the given key to arbitrary data.
+ *
+ * The Lua string is stored as it is, without checking for or adding any encoding.
+ *
+ * @function set_binary
+ * @param[type=string] key The key to write to.
+ * @param[type=string] data The data to store.
+ */
+int proplist_set_binary(lua_State*);
+
+/** Returns a fingerprint of the contents.
+ *
+ * Proplists with the same keys and values have the same fingerprint, regardless of the order the keys were set
+ * in. It's computed on the first call and cached until the proplist changes, so checking whether a snapshot
+ * from an info callback differs from the previous one takes a single comparison:
+ *
+ *     if info.proplist:hash() ~= last_hash then ... end
+ *
+ * Different contents yield the same fingerprint only by rare coincidence, so `==` still compares the contents
+ * when fingerprints match.
+ *
+ * With Lua 5.3+ this is a 64-bit integer. Older versions, whose numbers are doubles, get the upper 53 bits.
+ *
+ * @function hash
+ * @return[type=number]
+ */
+int proplist_hash(lua_State*);
+
+/** Copies all keys with string values into a table.
+ *
+ * This reads the whole proplist in a single call, which is much cheaper than indexing it once per key.
+ * Keys with binary values are skipped.
+ *
+ * @function to_table
+ * @return[type=table]
+ */
+int proplist_to_table(lua_State*);
+
+/** Returns an iterator over all keys with string values, for use with a generic `for`.
+ *
+ * This is what `pairs(plist)` calls. The loop runs over a snapshot taken by @{to_table}, so the proplist may be
+ * changed within it.
+ *
+ *     for key, value in plist:iterate() do
+ *         print(key, value)
+ *     end
+ *
+ * @function iterate
+ * @return[type=function]
+ * @return[type=table]
+ */
+int proplist_iterate(lua_State*);
+
+/** Reads several keys at once.
+ *
+ * Meant for reading a few well-known keys from many proplists, such as those of all sink inputs. Each key is
+ * looked up once, without a round trip through `__index`.
+ *
+ *     local name, role = plist:get_many({ proplist.APPLICATION_NAME, proplist.MEDIA_ROLE })
+ *
+ * @function get_many
+ * @param[type=table] keys A list of keys.
+ * @return[type=string|nil] ... The value for each key, or `nil` where it's not set.
+ */
+int proplist_get_many(lua_State*);
+
 
 static const struct luaL_Reg proplist_f[] = {
     {"clear",         proplist_clear       },
     { "contains",     proplist_contains    },
     { "copy",         proplist_copy        },
+    { "get_binary",   proplist_get_binary  },
+    { "get_many",     proplist_get_many    },
+    { "hash",         proplist_hash        },
     { "is_empty",     proplist_isempty     },
+    { "iterate",      proplist_iterate     },
+    { "set_binary",   proplist_set_binary  },
+    { "to_table",     proplist_to_table    },
     { "tostring_sep", proplist_tostring_sep},
+    { "update",       proplist_update      },
     { NULL,           NULL                 }
 };
 
@@ -222,6 +338,7 @@ static const struct luaL_Reg proplist_mt[] = {
     { "__eq",       proplist__eq      },
     { "__index",    proplist__index   },
     { "__newindex", proplist__newindex},
+    { "__pairs",    proplist__pairs   },
     { NULL,         NULL              }
 };
 
@@ -0,0 +1,1033 @@
+// For `accept4`
+#define _GNU_SOURCE
+
+#include "proxy.h"
+
+#include "context.h"
+#include "lua_util.h"
+#include "proplist.h"
+#include "volume.h"
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <pulse/subscribe.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Nested tables deeper than this are sent as `nil`, which also guards against cycles.
+#define PROXY_MAX_DEPTH 32
+#define PROXY_READ_SIZE 4096
+
+
+// The methods clients may call: queries and commands that change the server's state. Anything else, such as
+// methods that manage the connection or touch local files, is not forwarded, including methods added later.
+static const char* proxy_allowed_methods[] = {
+    "get_state",
+    "get_server_info",
+    "get_graph",
+    "set_default_sink",
+    "set_default_source",
+    "get_sinks",
+    "get_sink_info",
+    "set_sink_volume",
+    "adjust_sink_volume",
+    "set_sink_mute",
+    "set_sink_suspended",
+    "get_sources",
+    "get_source_info",
+    "set_source_volume",
+    "adjust_source_volume",
+    "set_source_mute",
+    "set_source_suspended",
+    "get_sink_inputs",
+    "get_sink_input_info",
+    "set_sink_input_volume",
+    "adjust_sink_input_volume",
+    "set_sink_input_mute",
+    "move_sink_input",
+    "kill_sink_input",
+    "get_source_outputs",
+    "get_source_output_info",
+    "set_source_output_volume",
+    "adjust_source_output_volume",
+    "set_source_output_mute",
+    "move_source_output",
+    "kill_source_output",
+    "get_clients",
+    "get_client_info",
+    "get_modules",
+    "get_module_info",
+    "get_samples",
+    "get_sample_info",
+    "play_sample",
+    "remove_sample",
+    NULL,
+};
+
+
+typedef struct proxy_client {
+    uint32_t id;
+    int fd;
+    guint read_id;
+    guint write_id;
+    GByteArray* in;
+    GByteArray* out;
+    // The client's subscription mask. Events are only sent for these facilities.
+    pa_subscription_mask_t mask;
+    proxy_server* server;
+} proxy_client;
+
+
+typedef struct proxy_waiter {
+    uint32_t client_id;
+    uint32_t request_id;
+} proxy_waiter;
+
+
+// A request that has been forwarded to the context and waits for its callback.
+typedef struct proxy_inflight {
+    uint32_t id;
+    // The encoded request, for reads that other clients can share. `NULL` otherwise.
+    GBytes* key;
+    GArray* waiters;
+} proxy_inflight;
+
+
+struct proxy_server {
+    char* path;
+    int fd;
+    guint accept_id;
+
+    // Client ID to `proxy_client*`
+    GHashTable* clients;
+    // In-flight ID to `proxy_inflight*`
+    GHashTable* inflight;
+    // Encoded request to `proxy_inflight*`, for deduplicated reads
+    GHashTable* reads;
+    uint32_t next_client_id;
+    uint32_t next_inflight_id;
+
+    // Thread with the context userdata at index 1, the context's method table at index 2 and the
+    // event callback at index 3.
+    simple_callback_data* data;
+    lua_pa_context* ctx;
+
+    uint64_t requests;
+    uint64_t deduplicated;
+    uint64_t events;
+
+    // Set when the server userdata has been closed. The memory is kept until all in-flight callbacks
+    // have returned.
+    bool closed;
+};
+
+
+size_t proxy_frame_begin(GByteArray* buf, proxy_frame_type type, uint32_t id) {
+    size_t start = buf->len;
+    uint8_t type_byte = (uint8_t) type;
+
+    // The length is filled in by `proxy_frame_end`.
+    proxy_write_u32(buf, 0);
+    g_byte_array_append(buf, &type_byte, 1);
+    proxy_write_u32(buf, id);
+
+    return start;
+}
+
+
+void proxy_frame_end(GByteArray* buf, size_t start) {
+    uint32_t length = (uint32_t) (buf->len - start - sizeof(uint32_t));
+    memcpy(buf->data + start, &length, sizeof(uint32_t));
+}
+
+
+ssize_t proxy_frame_parse(const GByteArray* buf, proxy_frame* frame) {
+    if (buf->len < PROXY_FRAME_HEADER) {
+        return 0;
+    }
+
+    uint32_t length;
+    memcpy(&length, buf->data, sizeof(uint32_t));
+    if (length < PROXY_FRAME_HEADER - sizeof(uint32_t) || length > PROXY_FRAME_MAX) {
+        return -1;
+    }
+
+    if (buf->len - sizeof(uint32_t) < length) {
+        return 0;
+    }
+
+    frame->type = (proxy_frame_type) buf->data[4];
+    memcpy(&frame->id, buf->data + 5, sizeof(uint32_t));
+    frame->payload = buf->data + PROXY_FRAME_HEADER;
+    frame->length = length - (PROXY_FRAME_HEADER - sizeof(uint32_t));
+
+    return (ssize_t) (length + sizeof(uint32_t));
+}
+
+
+void proxy_write_u32(GByteArray* buf, uint32_t value) {
+    g_byte_array_append(buf, (const guint8*) &value, sizeof(uint32_t));
+}
+
+
+void proxy_write_u8(GByteArray* buf, uint8_t value) {
+    g_byte_array_append(buf, &value, 1);
+}
+
+
+void proxy_write_string(GByteArray* buf, const char* str, size_t len) {
+    proxy_write_u32(buf, (uint32_t) len);
+    g_byte_array_append(buf, (const guint8*) str, (guint) len);
+}
+
+
+static const uint8_t* proxy_read_bytes(proxy_reader* r, size_t len) {
+    if (r->error || r->length - r->pos < len) {
+        r->error = true;
+        return NULL;
+    }
+
+    const uint8_t* data = r->data + r->pos;
+    r->pos += len;
+    return data;
+}
+
+
+uint32_t proxy_read_u32(proxy_reader* r) {
+    uint32_t value = 0;
+    const uint8_t* data = proxy_read_bytes(r, sizeof(uint32_t));
+    if (data != NULL) {
+        memcpy(&value, data, sizeof(uint32_t));
+    }
+    return value;
+}
+
+
+uint8_t proxy_read_u8(proxy_reader* r) {
+    const uint8_t* data = proxy_read_bytes(r, 1);
+    return data != NULL ? *data : 0;
+}
+
+
+static void proxy_encode_value_depth(lua_State* L, int index, GByteArray* buf, int depth) {
+    switch (lua_type(L, index)) {
+    case LUA_TBOOLEAN: {
+        proxy_write_u8(buf, lua_toboolean(L, index) ? PROXY_VALUE_TRUE : PROXY_VALUE_FALSE);
+        break;
+    }
+    case LUA_TNUMBER: {
+        lua_Number number = lua_tonumber(L, index);
+        int64_t integer = (int64_t) number;
+
+        if ((lua_Number) integer == number) {
+            proxy_write_u8(buf, PROXY_VALUE_INTEGER);
+            g_byte_array_append(buf, (const guint8*) &integer, sizeof(int64_t));
+        } else {
+            double value = (double) number;
+            proxy_write_u8(buf, PROXY_VALUE_NUMBER);
+            g_byte_array_append(buf, (const guint8*) &value, sizeof(double));
+        }
+        break;
+    }
+    case LUA_TSTRING: {
+        size_t len = 0;
+        const char* str = lua_tolstring(L, index, &len);
+        proxy_write_u8(buf, PROXY_VALUE_STRING);
+        proxy_write_string(buf, str, len);
+        break;
+    }
+    case LUA_TTABLE: {
+        if (depth >= PROXY_MAX_DEPTH) {
+            proxy_write_u8(buf, PROXY_VALUE_NIL);
+            break;
+        }
+
+        if (index < 0) {
+            index = lua_gettop(L) + index + 1;
+        }
+
+        proxy_write_u8(buf, PROXY_VALUE_TABLE);
+        // The number of pairs isn't known up front, so it is patched in afterwards.
+        size_t count_pos = buf->len;
+        uint32_t count = 0;
+        proxy_write_u32(buf, 0);
+
+        lua_pushnil(L);
+        while (lua_next(L, index) != 0) {
+            proxy_encode_value_depth(L, -2, buf, depth + 1);
+            proxy_encode_value_depth(L, -1, buf, depth + 1);
+            lua_pop(L, 1);
+            ++count;
+        }
+
+        memcpy(buf->data + count_pos, &count, sizeof(uint32_t));
+        break;
+    }
+    case LUA_TFUNCTION: {
+        proxy_write_u8(buf, PROXY_VALUE_FUNCTION);
+        break;
+    }
+    case LUA_TUSERDATA: {
+        if (luaU_testudata(L, index, LUA_PA_VOLUME)) {
+            const volume_t* volume = lua_touserdata(L, index);
+            proxy_write_u8(buf, PROXY_VALUE_VOLUME);
+            proxy_write_u8(buf, volume->channels);
+            for (uint8_t i = 0; i < volume->channels; ++i) {
+                proxy_write_u32(buf, volume->values[i]);
+            }
+            break;
+        }
+
+        if (luaU_testudata(L, index, LUA_PA_PROPLIST)) {
+            const proplist* plist = lua_touserdata(L, index);
+            proxy_write_u8(buf, PROXY_VALUE_PROPLIST);
+            proxy_write_u32(buf, pa_proplist_size(plist->plist));
+
+            void* state = NULL;
+            const char* key;
+            while ((key = pa_proplist_iterate(plist->plist, &state)) != NULL) {
+                const void* data = NULL;
+                size_t size = 0;
+                pa_proplist_get(plist->plist, key, &data, &size);
+                proxy_write_string(buf, key, strlen(key));
+                proxy_write_string(buf, data, size);
+            }
+            break;
+        }
+
+        proxy_write_u8(buf, PROXY_VALUE_NIL);
+        break;
+    }
+    default: {
+        proxy_write_u8(buf, PROXY_VALUE_NIL);
+        break;
+    }
+    }
+}
+
+
+void proxy_encode_value(lua_State* L, int index, GByteArray* buf) {
+    proxy_encode_value_depth(L, index, buf, 0);
+}
+
+
+static bool proxy_decode_value_depth(lua_State* L, proxy_reader* r, int depth) {
+    if (depth > PROXY_MAX_DEPTH) {
+        return false;
+    }
+
+    switch (proxy_read_u8(r)) {
+    case PROXY_VALUE_NIL:
+    case PROXY_VALUE_FUNCTION: {
+        if (r->error) {
+            return false;
+        }
+        lua_pushnil(L);
+        return true;
+    }
+    case PROXY_VALUE_FALSE: {
+        lua_pushboolean(L, false);
+        return true;
+    }
+    case PROXY_VALUE_TRUE: {
+        lua_pushboolean(L, true);
+        return true;
+    }
+    case PROXY_VALUE_INTEGER: {
+        int64_t value;
+        const uint8_t* data = proxy_read_bytes(r, sizeof(int64_t));
+        if (data == NULL) {
+            return false;
+        }
+        memcpy(&value, data, sizeof(int64_t));
+        lua_pushinteger(L, (lua_Integer) value);
+        return true;
+    }
+    case PROXY_VALUE_NUMBER: {
+        double value;
+        const uint8_t* data = proxy_read_bytes(r, sizeof(double));
+        if (data == NULL) {
+            return false;
+        }
+        memcpy(&value, data, sizeof(double));
+        lua_pushnumber(L, (lua_Number) value);
+        return true;
+    }
+    case PROXY_VALUE_STRING: {
+        uint32_t len = proxy_read_u32(r);
+        const uint8_t* data = proxy_read_bytes(r, len);
+        if (data == NULL) {
+            return false;
+        }
+        lua_pushlstring(L, (const char*) data, len);
+        return true;
+    }
+    case PROXY_VALUE_TABLE: {
+        uint32_t count = proxy_read_u32(r);
+        if (r->error) {
+            return false;
+        }
+
+        lua_newtable(L);
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!proxy_decode_value_depth(L, r, depth + 1)) {
+                lua_pop(L, 1);
+                return false;
+            }
+
+            if (!proxy_decode_value_depth(L, r, depth + 1)) {
+                lua_pop(L, 2);
+                return false;
+            }
+
+            // A `nil` key can't be stored, and would only come from a value that couldn't be encoded.
+            if (lua_isnil(L, -2)) {
+                lua_pop(L, 2);
+            } else {
+                lua_rawset(L, -3);
+            }
+        }
+        return true;
+    }
+    case PROXY_VALUE_VOLUME: {
+        pa_cvolume volume;
+        pa_cvolume_init(&volume);
+
+        uint8_t channels = proxy_read_u8(r);
+        if (channels > PA_CHANNELS_MAX) {
+            return false;
+        }
+
+        volume.channels = channels;
+        for (uint8_t i = 0; i < channels; ++i) {
+            volume.values[i] = proxy_read_u32(r);
+        }
+
+        if (r->error) {
+            return false;
+        }
+
+        volume_to_lua(L, &volume);
+        return true;
+    }
+    case PROXY_VALUE_PROPLIST: {
+        uint32_t count = proxy_read_u32(r);
+        pa_proplist* plist = pa_proplist_new();
+
+        for (uint32_t i = 0; i < count && !r->error; ++i) {
+            uint32_t key_len = proxy_read_u32(r);
+            const uint8_t* key = proxy_read_bytes(r, key_len);
+            uint32_t value_len = proxy_read_u32(r);
+            const uint8_t* value = proxy_read_bytes(r, value_len);
+
+            if (key != NULL && value != NULL) {
+                char* key_str = g_strndup((const char*) key, key_len);
+                pa_proplist_set(plist, key_str, value, value_len);
+                g_free(key_str);
+            }
+        }
+
+        if (r->error) {
+            pa_proplist_free(plist);
+            return false;
+        }
+
+        proplist_to_lua(L, plist);
+        pa_proplist_free(plist);
+        return true;
+    }
+    default: {
+        return false;
+    }
+    }
+}
+
+
+bool proxy_decode_value(lua_State* L, proxy_reader* r) {
+    return proxy_decode_value_depth(L, r, 0);
+}
+
+
+char* proxy_default_path(void) {
+    return g_build_filename(g_get_user_runtime_dir(), "lua_libpulse_glib", "proxy.sock", NULL);
+}
+
+
+static void proxy_server_free(proxy_server* server) {
+    g_hash_table_destroy(server->reads);
+    g_hash_table_destroy(server->inflight);
+    g_hash_table_destroy(server->clients);
+    g_free(server->path);
+    g_free(server);
+}
+
+
+static void proxy_inflight_free(gpointer userdata) {
+    proxy_inflight* inflight = (proxy_inflight*) userdata;
+    if (inflight->key != NULL) {
+        g_bytes_unref(inflight->key);
+    }
+    g_array_free(inflight->waiters, TRUE);
+    g_free(inflight);
+}
+
+
+static void proxy_client_free(gpointer userdata) {
+    proxy_client* client = (proxy_client*) userdata;
+
+    if (client->read_id != 0) {
+        g_source_remove(client->read_id);
+    }
+
+    if (client->write_id != 0) {
+        g_source_remove(client->write_id);
+    }
+
+    close(client->fd);
+    g_byte_array_free(client->in, TRUE);
+    g_byte_array_free(client->out, TRUE);
+    g_free(client);
+}
+
+
+static void proxy_client_drop(proxy_client* client) {
+    g_hash_table_remove(client->server->clients, GUINT_TO_POINTER(client->id));
+}
+
+
+// Writes as much of the output buffer as the socket accepts. Returns `false` if the client was dropped.
+static bool proxy_client_flush(proxy_client* client) {
+    while (client->out->len > 0) {
+        ssize_t written = send(client->fd, client->out->data, client->out->len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            proxy_client_drop(client);
+            return false;
+        }
+
+        g_byte_array_remove_range(client->out, 0, (guint) written);
+    }
+
+    return true;
+}
+
+
+static gboolean proxy_client_writable(gint fd, GIOCondition condition, gpointer userdata) {
+    proxy_client* client = (proxy_client*) userdata;
+
+    if (!proxy_client_flush(client)) {
+        // The source was removed with the client.
+        return G_SOURCE_REMOVE;
+    }
+
+    if (client->out->len > 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    client->write_id = 0;
+    return G_SOURCE_REMOVE;
+}
+
+
+static void proxy_client_send(proxy_client* client, const GByteArray* frame) {
+    g_byte_array_append(client->out, frame->data, frame->len);
+
+    if (client->write_id != 0) {
+        // Already waiting for the socket to become writable.
+        return;
+    }
+
+    if (proxy_client_flush(client) && client->out->len > 0) {
+        client->write_id = g_unix_fd_add(client->fd, G_IO_OUT, proxy_client_writable, client);
+    }
+}
+
+
+static void proxy_send_error(proxy_client* client, uint32_t request_id, const char* message) {
+    GByteArray* frame = g_byte_array_new();
+    size_t start = proxy_frame_begin(frame, PROXY_FRAME_ERROR, request_id);
+    proxy_write_string(frame, message, strlen(message));
+    proxy_frame_end(frame, start);
+
+    proxy_client_send(client, frame);
+    g_byte_array_free(frame, TRUE);
+}
+
+
+// Sends the frame's payload to every waiter of the in-flight request, and removes it.
+static void proxy_inflight_finish(proxy_server* server,
+                                  proxy_inflight* inflight,
+                                  proxy_frame_type type,
+                                  const GByteArray* payload) {
+    GByteArray* frame = g_byte_array_new();
+
+    for (guint i = 0; i < inflight->waiters->len; ++i) {
+        proxy_waiter* waiter = &g_array_index(inflight->waiters, proxy_waiter, i);
+        proxy_client* client = g_hash_table_lookup(server->clients, GUINT_TO_POINTER(waiter->client_id));
+        if (client == NULL) {
+            // The client disconnected in the meantime.
+            continue;
+        }
+
+        g_byte_array_set_size(frame, 0);
+        size_t start = proxy_frame_begin(frame, type, waiter->request_id);
+        g_byte_array_append(frame, payload->data, payload->len);
+        proxy_frame_end(frame, start);
+
+        proxy_client_send(client, frame);
+    }
+
+    g_byte_array_free(frame, TRUE);
+
+    if (inflight->key != NULL) {
+        g_hash_table_remove(server->reads, inflight->key);
+    }
+    g_hash_table_remove(server->inflight, GUINT_TO_POINTER(inflight->id));
+}
+
+
+// The callback that is passed to the context methods in place of the client's function.
+// Upvalues are the server and the in-flight ID.
+static int proxy_server_reply(lua_State* L) {
+    proxy_server* server = lua_touserdata(L, lua_upvalueindex(1));
+    uint32_t id = (uint32_t) lua_tointeger(L, lua_upvalueindex(2));
+
+    proxy_inflight* inflight = g_hash_table_lookup(server->inflight, GUINT_TO_POINTER(id));
+    if (inflight == NULL) {
+        return 0;
+    }
+
+    int nargs = lua_gettop(L);
+    GByteArray* payload = g_byte_array_new();
+    proxy_write_u8(payload, (uint8_t) nargs);
+    for (int i = 1; i <= nargs; ++i) {
+        proxy_encode_value(L, i, payload);
+    }
+
+    proxy_inflight_finish(server, inflight, PROXY_FRAME_REPLY, payload);
+    g_byte_array_free(payload, TRUE);
+
+    if (server->closed && g_hash_table_size(server->inflight) == 0) {
+        proxy_server_free(server);
+    }
+
+    return 0;
+}
+
+
+static bool proxy_method_allowed(const char* name) {
+    for (int i = 0; proxy_allowed_methods[i] != NULL; ++i) {
+        if (strcmp(name, proxy_allowed_methods[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void proxy_server_handle_request(proxy_server* server, proxy_client* client, const proxy_frame* frame) {
+    lua_State* L = server->data->L;
+    int base = lua_gettop(L);
+    proxy_reader r = { frame->payload, frame->length, 0, false };
+
+    server->requests++;
+
+    size_t name_len = proxy_read_u32(&r);
+    const uint8_t* name_data = proxy_read_bytes(&r, name_len);
+    uint8_t nargs = proxy_read_u8(&r);
+    if (r.error) {
+        proxy_send_error(client, frame->id, "malformed request");
+        return;
+    }
+
+    // The name stays on the stack, below the method, so that the string remains valid.
+    lua_pushlstring(L, (const char*) name_data, name_len);
+    const char* name = lua_tostring(L, -1);
+    lua_pushvalue(L, -1);
+    lua_gettable(L, 2);
+
+    if (!proxy_method_allowed(name) || !lua_isfunction(L, -1)) {
+        lua_settop(L, base);
+        proxy_send_error(client, frame->id, "unknown or unsupported method");
+        return;
+    }
+
+    // The context is the method's `self`.
+    lua_pushvalue(L, 1);
+
+    proxy_inflight* inflight = NULL;
+    int callback_arg = 0;
+
+    for (uint8_t i = 0; i < nargs; ++i) {
+        bool is_function = r.pos < r.length && r.data[r.pos] == PROXY_VALUE_FUNCTION;
+        if (!proxy_decode_value(L, &r)) {
+            lua_settop(L, base);
+            proxy_send_error(client, frame->id, "malformed request");
+            return;
+        }
+
+        if (is_function) {
+            callback_arg = lua_gettop(L);
+        }
+    }
+
+    if (callback_arg != 0) {
+        proxy_waiter waiter = { client->id, frame->id };
+
+        // Reads that are already in flight are answered with the same result.
+        bool dedupe = strncmp(name, "get_", 4) == 0;
+        GBytes* key = dedupe ? g_bytes_new(frame->payload, frame->length) : NULL;
+
+        if (key != NULL && (inflight = g_hash_table_lookup(server->reads, key)) != NULL) {
+            g_array_append_val(inflight->waiters, waiter);
+            server->deduplicated++;
+            g_bytes_unref(key);
+            lua_settop(L, base);
+            return;
+        }
+
+        inflight = g_new0(proxy_inflight, 1);
+        inflight->id = ++server->next_inflight_id;
+        inflight->key = key;
+        inflight->waiters = g_array_new(FALSE, FALSE, sizeof(proxy_waiter));
+        g_array_append_val(inflight->waiters, waiter);
+
+        g_hash_table_insert(server->inflight, GUINT_TO_POINTER(inflight->id), inflight);
+        if (key != NULL) {
+            g_hash_table_insert(server->reads, key, inflight);
+        }
+
+        lua_pushlightuserdata(L, server);
+        lua_pushinteger(L, inflight->id);
+        lua_pushcclosure(L, proxy_server_reply, 2);
+        lua_replace(L, callback_arg);
+    }
+
+    int method_index = base + 2;
+    uint32_t inflight_id = inflight != NULL ? inflight->id : 0;
+
+    if (lua_pcall(L, lua_gettop(L) - method_index, LUA_MULTRET, 0) != 0) {
+        GByteArray* payload = g_byte_array_new();
+        size_t len = 0;
+        const char* message = lua_tolstring(L, -1, &len);
+        proxy_write_string(payload, message != NULL ? message : "error", message != NULL ? len : 5);
+
+        // The method may have failed before or after scheduling the callback. Either way, it won't be called.
+        inflight = inflight_id != 0 ? g_hash_table_lookup(server->inflight, GUINT_TO_POINTER(inflight_id)) : NULL;
+        if (inflight != NULL) {
+            proxy_inflight_finish(server, inflight, PROXY_FRAME_ERROR, payload);
+        } else if (inflight_id == 0) {
+            GByteArray* frame_buf = g_byte_array_new();
+            size_t start = proxy_frame_begin(frame_buf, PROXY_FRAME_ERROR, frame->id);
+            g_byte_array_append(frame_buf, payload->data, payload->len);
+            proxy_frame_end(frame_buf, start);
+            proxy_client_send(client, frame_buf);
+            g_byte_array_free(frame_buf, TRUE);
+        }
+
+        g_byte_array_free(payload, TRUE);
+        lua_settop(L, base);
+        return;
+    }
+
+    if (inflight_id == 0) {
+        // A synchronous method: its return values are the reply.
+        int nresults = lua_gettop(L) - method_index + 1;
+        GByteArray* reply = g_byte_array_new();
+        size_t start = proxy_frame_begin(reply, PROXY_FRAME_REPLY, frame->id);
+        proxy_write_u8(reply, (uint8_t) nresults);
+        for (int i = method_index; i <= lua_gettop(L); ++i) {
+            proxy_encode_value(L, i, reply);
+        }
+        proxy_frame_end(reply, start);
+
+        proxy_client_send(client, reply);
+        g_byte_array_free(reply, TRUE);
+    }
+
+    lua_settop(L, base);
+}
+
+
+// Handles all complete frames in the client's input buffer. Returns `false` if the client was dropped.
+static bool proxy_server_handle_input(proxy_server* server, proxy_client* client) {
+    uint32_t client_id = client->id;
+    proxy_frame frame;
+    ssize_t consumed;
+
+    while ((consumed = proxy_frame_parse(client->in, &frame)) > 0) {
+        switch (frame.type) {
+        case PROXY_FRAME_REQUEST: {
+            proxy_server_handle_request(server, client, &frame);
+            break;
+        }
+        case PROXY_FRAME_SUBSCRIBE: {
+            proxy_reader r = { frame.payload, frame.length, 0, false };
+            client->mask = (pa_subscription_mask_t) proxy_read_u32(&r);
+            break;
+        }
+        default: {
+            proxy_client_drop(client);
+            return false;
+        }
+        }
+
+        // Sending a reply may have failed and dropped the client.
+        if (g_hash_table_lookup(server->clients, GUINT_TO_POINTER(client_id)) == NULL) {
+            return false;
+        }
+
+        g_byte_array_remove_range(client->in, 0, (guint) consumed);
+    }
+
+    if (consumed < 0) {
+        proxy_client_drop(client);
+        return false;
+    }
+
+    return true;
+}
+
+
+static gboolean proxy_client_readable(gint fd, GIOCondition condition, gpointer userdata) {
+    proxy_client* client = (proxy_client*) userdata;
+    proxy_server* server = client->server;
+    guint8 buffer[PROXY_READ_SIZE];
+
+    for (;;) {
+        ssize_t len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (len > 0) {
+            g_byte_array_append(client->in, buffer, (guint) len);
+            continue;
+        }
+
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        // End of file or error
+        client->read_id = 0;
+        proxy_client_drop(client);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (!proxy_server_handle_input(server, client)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+static gboolean proxy_server_accept(gint fd, GIOCondition condition, gpointer userdata) {
+    proxy_server* server = (proxy_server*) userdata;
+
+    int client_fd;
+    while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        proxy_client* client = g_new0(proxy_client, 1);
+        client->id = ++server->next_client_id;
+        client->fd = client_fd;
+        client->in = g_byte_array_new();
+        client->out = g_byte_array_new();
+        client->mask = PA_SUBSCRIPTION_MASK_NULL;
+        client->server = server;
+        client->read_id = g_unix_fd_add(client_fd, G_IO_IN | G_IO_HUP | G_IO_ERR, proxy_client_readable, client);
+
+        g_hash_table_insert(server->clients, GUINT_TO_POINTER(client->id), client);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+// Subscribed to the context, to fan events out to the clients.
+// The upvalue is the server.
+static int proxy_server_event(lua_State* L) {
+    proxy_server* server = lua_touserdata(L, lua_upvalueindex(1));
+    uint32_t event_type = (uint32_t) luaL_checkinteger(L, 2);
+    uint32_t index = (uint32_t) luaL_checkinteger(L, 3);
+    uint32_t facility = event_type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+
+    GByteArray* frame = g_byte_array_new();
+    size_t start = proxy_frame_begin(frame, PROXY_FRAME_EVENT, 0);
+    proxy_write_u32(frame, event_type);
+    proxy_write_u32(frame, index);
+    proxy_frame_end(frame, start);
+
+    server->events++;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, server->clients);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        proxy_client* client = (proxy_client*) value;
+        if ((client->mask & (1U << facility)) == 0) {
+            continue;
+        }
+
+        // Clients are only dropped on the next read, so iterating stays valid.
+        g_byte_array_append(client->out, frame->data, frame->len);
+        if (client->write_id == 0) {
+            client->write_id = g_unix_fd_add(client->fd, G_IO_OUT, proxy_client_writable, client);
+        }
+    }
+
+    g_byte_array_free(frame, TRUE);
+    return 0;
+}
+
+
+int context_serve(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* path = luaL_optstring(L, 2, NULL);
+    char* default_path = NULL;
+
+    if (path == NULL) {
+        default_path = proxy_default_path();
+        path = default_path;
+    }
+
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        g_free(default_path);
+        lua_pushnil(L);
+        lua_pushstring(L, "failed to serve: socket path too long");
+        return 2;
+    }
+    g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    char* dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    // A stale socket from a previous process would make `bind` fail.
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        g_free(default_path);
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to serve: %s", strerror(error));
+        return 2;
+    }
+
+    proxy_server* server = g_new0(proxy_server, 1);
+    server->path = g_strdup(path);
+    server->fd = fd;
+    server->ctx = ctx;
+    server->clients = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, proxy_client_free);
+    server->inflight = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, proxy_inflight_free);
+    server->reads = g_hash_table_new_full(g_bytes_hash, g_bytes_equal, NULL, NULL);
+    g_free(default_path);
+
+    // The thread keeps the context alive for as long as the server is open.
+    server->data = prepare_lua_callback(L, 0);
+    lua_State* thread_L = server->data->L;
+
+    lua_pushvalue(L, 1);
+    lua_getmetatable(L, 1);
+    lua_getfield(L, -1, "__index");
+    lua_remove(L, -2);
+    lua_pushlightuserdata(L, server);
+    lua_pushcclosure(L, proxy_server_event, 1);
+    lua_xmove(L, thread_L, 3);
+
+    lua_pushcfunction(thread_L, context_subscribe);
+    lua_pushvalue(thread_L, 1);
+    lua_pushvalue(thread_L, 3);
+    lua_call(thread_L, 2, 0);
+
+    server->accept_id = g_unix_fd_add(fd, G_IO_IN, proxy_server_accept, server);
+
+    lua_pa_proxy_server* userdata = lua_newuserdata(L, sizeof(lua_pa_proxy_server));
+    userdata->server = server;
+    luaL_getmetatable(L, LUA_PA_PROXY_SERVER);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+
+int proxy_server_get_stats(lua_State* L) {
+    lua_pa_proxy_server* userdata = luaL_checkudata(L, 1, LUA_PA_PROXY_SERVER);
+    proxy_server* server = userdata->server;
+
+    lua_createtable(L, 0, 5);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "clients");
+    lua_pushinteger(L, server != NULL ? g_hash_table_size(server->clients) : 0);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "requests");
+    lua_pushinteger(L, server != NULL ? (lua_Integer) server->requests : 0);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "deduplicated");
+    lua_pushinteger(L, server != NULL ? (lua_Integer) server->deduplicated : 0);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "in_flight");
+    lua_pushinteger(L, server != NULL ? g_hash_table_size(server->inflight) : 0);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "events");
+    lua_pushinteger(L, server != NULL ? (lua_Integer) server->events : 0);
+    lua_settable(L, table_index);
+
+    return 1;
+}
+
+
+int proxy_server_close(lua_State* L) {
+    lua_pa_proxy_server* userdata = luaL_checkudata(L, 1, LUA_PA_PROXY_SERVER);
+    proxy_server* server = userdata->server;
+    if (server == NULL) {
+        return 0;
+    }
+    userdata->server = NULL;
+
+    g_source_remove(server->accept_id);
+    close(server->fd);
+    unlink(server->path);
+
+    // Remove the event callback from the context.
+    lua_State* thread_L = server->data->L;
+    lua_pushcfunction(thread_L, context_unsubscribe);
+    lua_pushvalue(thread_L, 1);
+    lua_pushvalue(thread_L, 3);
+    lua_call(thread_L, 2, 0);
+
+    g_hash_table_remove_all(server->clients);
+    free_lua_callback(server->data);
+    server->data = NULL;
+    server->closed = true;
+
+    // In-flight callbacks still refer to the server. The last one frees it.
+    if (g_hash_table_size(server->inflight) == 0) {
+        proxy_server_free(server);
+    }
+
+    return 0;
+}
+
+
+int proxy_server__gc(lua_State* L) {
+    return proxy_server_close(L);
+}
@@ -0,0 +1,144 @@
+/** A server that shares one connection context with other local processes.
+ *
+ * @{Context:serve} listens on a Unix socket. Clients connect to it with @{lua_libpulse_glib.client}, and
+ * their queries and commands are forwarded to the same @{Context} methods that are available locally.
+ * Identical `get_*` queries that are in flight at the same time are sent to the server only once, and
+ * subscription events are received once and broadcast to all clients.
+ *
+ * @module lua_libpulse_glib.proxy
+ */
+#pragma once
+
+#include "callback.h"
+
+#include <glib.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LUA_PA_PROXY_SERVER "pulseaudio.proxy_server"
+
+// Frames larger than this are considered a protocol error.
+#define PROXY_FRAME_MAX (16 * 1024 * 1024)
+// Length, type and request ID
+#define PROXY_FRAME_HEADER 9
+
+
+// A frame is made up of a `uint32_t` length, which counts the bytes after it, a `uint8_t` type,
+// a `uint32_t` request ID and the payload. All values are in native byte order, as both ends are on the
+// same machine.
+typedef enum proxy_frame_type {
+    // Client to server: method name, argument count and arguments
+    PROXY_FRAME_REQUEST = 1,
+    // Server to client: value count and values
+    PROXY_FRAME_REPLY,
+    // Server to client: error message
+    PROXY_FRAME_ERROR,
+    // Server to client: event type and index
+    PROXY_FRAME_EVENT,
+    // Client to server: subscription mask
+    PROXY_FRAME_SUBSCRIBE,
+} proxy_frame_type;
+
+
+// Type tags for encoded Lua values.
+typedef enum proxy_value_type {
+    PROXY_VALUE_NIL = 0,
+    PROXY_VALUE_FALSE,
+    PROXY_VALUE_TRUE,
+    PROXY_VALUE_INTEGER,
+    PROXY_VALUE_NUMBER,
+    PROXY_VALUE_STRING,
+    PROXY_VALUE_TABLE,
+    PROXY_VALUE_VOLUME,
+    PROXY_VALUE_PROPLIST,
+    // Marks the position of a callback argument.
+    PROXY_VALUE_FUNCTION,
+} proxy_value_type;
+
+
+typedef struct proxy_frame {
+    proxy_frame_type type;
+    uint32_t id;
+    const uint8_t* payload;
+    size_t length;
+} proxy_frame;
+
+
+// Reads values from a frame's payload. Reads past the end fail, rather than overflow.
+typedef struct proxy_reader {
+    const uint8_t* data;
+    size_t length;
+    size_t pos;
+    bool error;
+} proxy_reader;
+
+
+// Starts a frame in the buffer. Finish it with `proxy_frame_end` after the payload has been appended.
+size_t proxy_frame_begin(GByteArray*, proxy_frame_type, uint32_t);
+void proxy_frame_end(GByteArray*, size_t);
+
+// Parses the first complete frame from the buffer. Returns the number of bytes it spans, `0` if the buffer
+// doesn't contain a complete frame yet, or `-1` if the data is invalid.
+ssize_t proxy_frame_parse(const GByteArray*, proxy_frame*);
+
+void proxy_write_u8(GByteArray*, uint8_t);
+void proxy_write_u32(GByteArray*, uint32_t);
+// Writes a `uint32_t` length, followed by the bytes.
+void proxy_write_string(GByteArray*, const char*, size_t);
+uint32_t proxy_read_u32(proxy_reader*);
+uint8_t proxy_read_u8(proxy_reader*);
+
+// Appends the Lua value at the given index. Functions are encoded as `PROXY_VALUE_FUNCTION`, other
+// values that can't be sent, such as threads or foreign userdata, as `nil`.
+void proxy_encode_value(lua_State*, int, GByteArray*);
+
+// Pushes the next value. Function markers are pushed as `nil`; it's up to the caller to handle those.
+// Returns `false` and pushes nothing on malformed data.
+bool proxy_decode_value(lua_State*, proxy_reader*);
+
+// Returns a newly allocated path to the default socket. Free with `g_free`.
+char* proxy_default_path(void);
+
+
+typedef struct proxy_server proxy_server;
+
+typedef struct lua_pa_proxy_server {
+    proxy_server* server;
+} lua_pa_proxy_server;
+
+
+/// Server
+/// @type Server
+
+
+/** Returns statistics about the server.
+ *
+ * @function Server:get_stats
+ * @treturn table A table with the fields `clients`, `requests`, `deduplicated`, `in_flight` and `events`.
+ */
+int proxy_server_get_stats(lua_State*);
+
+/** Stops listening and disconnects all clients.
+ *
+ * This is also done when the server object is garbage collected.
+ *
+ * @function Server:close
+ */
+int proxy_server_close(lua_State*);
+int proxy_server__gc(lua_State*);
+
+
+static const struct luaL_Reg proxy_server_f[] = {
+    {"get_stats", proxy_server_get_stats},
+    { "close",    proxy_server_close    },
+    { NULL,       NULL                  }
+};
+
+
+static const struct luaL_Reg proxy_server_mt[] = {
+    {"__gc", proxy_server__gc},
+    { NULL,  NULL            }
+};
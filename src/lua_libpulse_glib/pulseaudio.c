@@ -1,9 +1,20 @@
 #include "pulseaudio.h"
 
+#include "buffer.h"
+#include "client.h"
 #include "context.h"
+#include "curve.h"
 #include "lua_util.h"
+#include "lut.h"
+#include "meter.h"
+#include "player.h"
 #include "proplist.h"
+#include "proxy.h"
+#include "recorder.h"
+#include "snapshot.h"
+#include "stream.h"
 #include "volume.h"
+#include "volume_array.h"
 
 #include <lauxlib.h>
 #include <lua.h>
@@ -43,6 +54,10 @@ int pulseaudio_new(lua_State* L) {
         return 0;
     }
 
+    dispatch_config config;
+    dispatch_config_init(&config);
+    dispatch_config_from_lua(L, 1, &config);
+
     pulseaudio* pa = lua_newuserdata(L, sizeof(pulseaudio));
     if (!pa) {
         return luaL_error(L, "failed to create pulseaudio userdata");
@@ -50,6 +65,7 @@ int pulseaudio_new(lua_State* L) {
     luaL_getmetatable(L, LUA_PULSEAUDIO);
     lua_setmetatable(L, -2);
 
+    pa->dispatch = config;
     pa->mainloop = pa_glib_mainloop_new(ctx);
 
     return 1;
@@ -79,11 +95,31 @@ int pulseaudio__gc(lua_State* L) {
 
 int pulseaudio_new_context(lua_State* L) {
     pulseaudio* pa = luaL_checkudata(L, 1, LUA_PULSEAUDIO);
-    return context_new(L, pa_glib_mainloop_get_api(pa->mainloop));
+
+    dispatch_config config = pa->dispatch;
+    dispatch_config_from_lua(L, 3, &config);
+
+    return context_new(L, pa_glib_mainloop_get_api(pa->mainloop), &config);
+}
+
+
+void createlib_curve(lua_State* L) {
+    lut_init();
+
+    luaL_newmetatable(L, LUA_PA_CURVE);
+
+    lua_createtable(L, 0, sizeof curve_f / sizeof curve_f[0]);
+    luaL_setfuncs(L, curve_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, curve_mt, 0);
+    lua_pop(L, 1);
 }
 
 
 void createlib_volume(lua_State* L) {
+    createlib_curve(L);
+
     luaL_newmetatable(L, LUA_PA_VOLUME);
 
     lua_createtable(L, 0, sizeof volume_f / sizeof volume_f[0]);
@@ -104,11 +140,14 @@ void createlib_volume(lua_State* L) {
 void createlib_proplist(lua_State* L) {
     luaL_newmetatable(L, LUA_PA_PROPLIST);
 
+    // `__index` is a function, to look up keys, so the method table is passed to it as upvalue instead.
+    // The iterators get `next` as second upvalue, so that they don't depend on the global being left alone.
     lua_createtable(L, 0, sizeof proplist_f / sizeof proplist_f[0]);
-    luaL_setfuncs(L, proplist_f, 0);
-    lua_setfield(L, -2, "__index");
-
-    luaL_setfuncs(L, proplist_mt, 0);
+    lua_pushvalue(L, -1);
+    lua_getglobal(L, "next");
+    luaL_setfuncs(L, proplist_f, 2);
+    lua_getglobal(L, "next");
+    luaL_setfuncs(L, proplist_mt, 2);
 
 #if LUA_VERSION_NUM <= 501
     luaL_register(L, LUA_PA_PROPLIST, proplist_lib);
@@ -141,6 +180,72 @@ void createlib_context(lua_State* L) {
 }
 
 
+void createlib_proxy_server(lua_State* L) {
+    luaL_newmetatable(L, LUA_PA_PROXY_SERVER);
+
+    lua_createtable(L, 0, sizeof proxy_server_f / sizeof proxy_server_f[0]);
+    luaL_setfuncs(L, proxy_server_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, proxy_server_mt, 0);
+}
+
+
+void createlib_meter(lua_State* L) {
+    luaL_newmetatable(L, LUA_PA_METER);
+
+    lua_createtable(L, 0, sizeof meter_f / sizeof meter_f[0]);
+    luaL_setfuncs(L, meter_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, meter_mt, 0);
+}
+
+
+void createlib_stream(lua_State* L) {
+    luaL_newmetatable(L, LUA_PA_STREAM);
+
+    lua_createtable(L, 0, sizeof stream_f / sizeof stream_f[0]);
+    luaL_setfuncs(L, stream_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, stream_mt, 0);
+}
+
+
+void createlib_recorder(lua_State* L) {
+    luaL_newmetatable(L, LUA_PA_RECORDER);
+
+    lua_createtable(L, 0, sizeof recorder_f / sizeof recorder_f[0]);
+    luaL_setfuncs(L, recorder_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, recorder_mt, 0);
+}
+
+
+void createlib_player(lua_State* L) {
+    luaL_newmetatable(L, LUA_PA_PLAYER);
+
+    lua_createtable(L, 0, sizeof player_f / sizeof player_f[0]);
+    luaL_setfuncs(L, player_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, player_mt, 0);
+}
+
+
+void createlib_buffer(lua_State* L) {
+    luaL_newmetatable(L, LUA_PA_BUFFER);
+
+    lua_createtable(L, 0, sizeof buffer_f / sizeof buffer_f[0]);
+    luaL_setfuncs(L, buffer_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, buffer_mt, 0);
+}
+
+
 void createlib_pulseaudio(lua_State* L) {
     luaL_newmetatable(L, LUA_PULSEAUDIO);
 
@@ -158,16 +263,38 @@ void createlib_pulseaudio(lua_State* L) {
 }
 
 
-LUA_MOD_EXPORT int luaopen_lua_libpulse_glib(lua_State* L) {
-    // Create a table to store callback refs in, stored in the Lua registry
+/*
+ * Creates the table to store callback refs in, stored in the Lua registry.
+ * Modules that can be loaded on their own share the table with the main module.
+ */
+void createlib_registry(lua_State* L) {
+    lua_pushstring(L, LUA_PULSEAUDIO);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    bool exists = lua_istable(L, -1);
+    lua_pop(L, 1);
+
+    if (exists) {
+        return;
+    }
+
     lua_pushstring(L, LUA_PULSEAUDIO);
     lua_newtable(L);
     lua_pushstring(L, LUA_PA_REGISTRY);
     lua_newtable(L);
     lua_settable(L, -3);
     lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
 
+LUA_MOD_EXPORT int luaopen_lua_libpulse_glib(lua_State* L) {
+    createlib_registry(L);
     createlib_context(L);
+    createlib_proxy_server(L);
+    createlib_meter(L);
+    createlib_stream(L);
+    createlib_recorder(L);
+    createlib_player(L);
+    createlib_buffer(L);
     createlib_proplist(L);
     createlib_pulseaudio(L);
     return 1;
@@ -175,6 +302,8 @@ LUA_MOD_EXPORT int luaopen_lua_libpulse_glib(lua_State* L) {
 
 
 LUA_MOD_EXPORT int luaopen_lua_libpulse_glib_volume(lua_State* L) {
+    createlib_curve(L);
+
     luaL_newmetatable(L, LUA_PA_VOLUME);
 
     lua_createtable(L, 0, sizeof volume_f / sizeof volume_f[0]);
@@ -191,3 +320,93 @@ LUA_MOD_EXPORT int luaopen_lua_libpulse_glib_volume(lua_State* L) {
     return 1;
 }
 
+
+
+LUA_MOD_EXPORT int luaopen_lua_libpulse_glib_snapshot(lua_State* L) {
+    createlib_registry(L);
+
+    luaL_newmetatable(L, LUA_PA_SNAPSHOT);
+
+    lua_createtable(L, 0, sizeof snapshot_f / sizeof snapshot_f[0]);
+    luaL_setfuncs(L, snapshot_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, snapshot_mt, 0);
+
+#if LUA_VERSION_NUM <= 501
+    luaL_register(L, LUA_PA_SNAPSHOT, snapshot_lib);
+#else
+    luaL_newlib(L, snapshot_lib);
+#endif
+    return 1;
+}
+
+
+LUA_MOD_EXPORT int luaopen_lua_libpulse_glib_buffer(lua_State* L) {
+    createlib_buffer(L);
+
+#if LUA_VERSION_NUM <= 501
+    luaL_register(L, LUA_PA_BUFFER, buffer_lib);
+#else
+    luaL_newlib(L, buffer_lib);
+#endif
+    return 1;
+}
+
+
+LUA_MOD_EXPORT int luaopen_lua_libpulse_glib_client(lua_State* L) {
+    createlib_registry(L);
+
+    // Replies may contain volumes and property lists.
+    int top = lua_gettop(L);
+    createlib_volume(L);
+    createlib_proplist(L);
+    lua_settop(L, top);
+
+    luaL_newmetatable(L, LUA_PA_CLIENT);
+
+    // The `__index` function resolves local methods from this table, and forwards everything else.
+    lua_createtable(L, 0, sizeof client_f / sizeof client_f[0]);
+    luaL_setfuncs(L, client_f, 0);
+    luaL_setfuncs(L, client_mt, 1);
+
+#if LUA_VERSION_NUM <= 501
+    luaL_register(L, LUA_PA_CLIENT, client_lib);
+#else
+    luaL_newlib(L, client_lib);
+#endif
+    return 1;
+}
+
+
+LUA_MOD_EXPORT int luaopen_lua_libpulse_glib_volume_array(lua_State* L) {
+    createlib_registry(L);
+
+    // Entries are copied out as volumes.
+    int top = lua_gettop(L);
+    createlib_volume(L);
+    lua_settop(L, top);
+
+    luaL_newmetatable(L, LUA_PA_VOLUME_VIEW);
+    luaL_setfuncs(L, volume_view_mt, 0);
+    lua_createtable(L, 0, sizeof volume_view_f / sizeof volume_view_f[0]);
+    luaL_setfuncs(L, volume_view_f, 0);
+    lua_pushcclosure(L, volume_view__index, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+
+    luaL_newmetatable(L, LUA_PA_VOLUME_ARRAY);
+
+    lua_createtable(L, 0, sizeof volume_array_f / sizeof volume_array_f[0]);
+    luaL_setfuncs(L, volume_array_f, 0);
+    lua_setfield(L, -2, "__index");
+
+    luaL_setfuncs(L, volume_array_mt, 0);
+
+#if LUA_VERSION_NUM <= 501
+    luaL_register(L, LUA_PA_VOLUME_ARRAY, volume_array_lib);
+#else
+    luaL_newlib(L, volume_array_lib);
+#endif
+    return 1;
+}
@@ -4,6 +4,7 @@
  */
 #pragma once
 
+#include "dispatch.h"
 #include "lauxlib.h"
 #include "lua.h"
 
@@ -15,12 +16,26 @@
 
 typedef struct pulseaudio {
     pa_glib_mainloop* mainloop;
+    // Default dispatch settings for contexts created from this object.
+    dispatch_config dispatch;
 } pulseaudio;
 
 
 /** Creates a new PulseAudio object.
+ *
+ * The optional table configures how Lua callbacks are scheduled on the GLib Main Loop. These settings are
+ * used as defaults for all contexts created from this object:
+ *
+ * - `priority`: The GLib priority of the source that calls event callbacks. Use `GLib.PRIORITY_LOW` or similar
+ *   to let other sources, such as redraws, run first.
+ * - `budget_callbacks`: The maximum number of callbacks to call per main loop iteration.
+ * - `budget_usec`: The maximum time in microseconds to spend on callbacks per main loop iteration.
+ *
+ * Once the budget for an iteration is spent, the remaining callbacks are deferred to an idle source.
+ * Without any of these options, callbacks are called immediately, as they are received from the server.
  *
  * @function new
+ * @tparam[opt] table opts Dispatch options.
  * @return[type=PulseAudio]
  */
 int pulseaudio_new(lua_State*);
@@ -34,9 +49,12 @@ int pulseaudio__gc(lua_State*);
 
 
 /** Creates a new PulseAudio context
+ *
+ * The optional table accepts the same dispatch options as @{new}, and overrides them for this context.
  *
  * @function context
  * @tparam string name The application name.
+ * @tparam[opt] table opts Dispatch options.
  * @return[type=Context]
  */
 int pulseaudio_new_context(lua_State*);
@@ -0,0 +1,607 @@
+#include "recorder.h"
+
+#include "lua_util.h"
+#include "stream.h"
+
+#include <pulse/error.h>
+#include <string.h>
+
+
+#define RECORDER_DEFAULT_BATCH_SIZE     (64 * 1024)
+#define RECORDER_DEFAULT_FLUSH_INTERVAL 1000
+#define RECORDER_WAV_HEADER_SIZE        44
+
+
+static void recorder_file_pump(recorder_file*);
+static void recorder_stop_internal(recorder*, const char*);
+
+
+static void recorder_free(recorder* r) {
+    if (r->batch != NULL) {
+        g_byte_array_free(r->batch, TRUE);
+    }
+    g_free(r->path);
+    g_free(r);
+}
+
+
+static void recorder_maybe_free(recorder* r) {
+    if (r->stopped && r->open_files == 0 && r->data == NULL) {
+        recorder_free(r);
+    }
+}
+
+
+// Calls the Lua callback with an error message, or a progress report for the given file.
+static void recorder_report(recorder* r, const char* err, recorder_file* file, bool finished) {
+    if (r->data == NULL) {
+        return;
+    }
+
+    lua_State* L = r->data->L;
+    lua_pushvalue(L, 1);
+
+    if (err != NULL) {
+        lua_pushstring(L, err);
+        lua_call(L, 1, 0);
+        return;
+    }
+
+    lua_pushnil(L);
+    lua_createtable(L, 0, 5);
+
+    lua_pushstring(L, file->path);
+    lua_setfield(L, -2, "path");
+
+    lua_pushinteger(L, (lua_Integer) file->written);
+    lua_setfield(L, -2, "bytes");
+
+    lua_pushnumber(L, (lua_Number) pa_bytes_to_usec(file->written, &r->spec) / PA_USEC_PER_SEC);
+    lua_setfield(L, -2, "duration");
+
+    lua_pushinteger(L, (lua_Integer) r->total_bytes);
+    lua_setfield(L, -2, "total_bytes");
+
+    lua_pushboolean(L, finished);
+    lua_setfield(L, -2, "finished");
+
+    lua_call(L, 2, 0);
+}
+
+
+static void put_u16(unsigned char* p, uint16_t value) {
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+}
+
+
+static void put_u32(unsigned char* p, uint32_t value) {
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+
+// Returns the WAV format tag for a sample format, or `0` if WAV can't store it.
+static uint16_t recorder_wav_format(pa_sample_format_t format) {
+    switch (format) {
+    case PA_SAMPLE_U8:
+    case PA_SAMPLE_S16LE:
+    case PA_SAMPLE_S24LE:
+    case PA_SAMPLE_S32LE:
+        return 1;
+    case PA_SAMPLE_FLOAT32LE:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+
+// Writes a WAV header. While recording, the sizes are unknown and set to the maximum, which most readers
+// accept for streamed files. They are corrected when the file is finalized.
+static void recorder_wav_header(unsigned char* header, const pa_sample_spec* spec, uint32_t data_size) {
+    uint16_t bits = (uint16_t) (pa_sample_size(spec) * 8);
+    uint16_t block_align = (uint16_t) pa_frame_size(spec);
+    uint32_t riff_size = data_size == UINT32_MAX ? UINT32_MAX : data_size + RECORDER_WAV_HEADER_SIZE - 8;
+
+    memcpy(header, "RIFF", 4);
+    put_u32(header + 4, riff_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_u32(header + 16, 16);
+    put_u16(header + 20, recorder_wav_format(spec->format));
+    put_u16(header + 22, spec->channels);
+    put_u32(header + 24, spec->rate);
+    put_u32(header + 28, spec->rate * block_align);
+    put_u16(header + 32, block_align);
+    put_u16(header + 34, bits);
+    memcpy(header + 36, "data", 4);
+    put_u32(header + 40, data_size);
+}
+
+
+// Builds the path for the next file. Only rotating recorders number their files.
+static char* recorder_next_path(recorder* r) {
+    r->sequence++;
+
+    if (r->max_bytes == 0) {
+        return g_strdup(r->path);
+    }
+
+    char number[16];
+    g_snprintf(number, sizeof(number), "%u", r->sequence);
+
+    const char* placeholder = strstr(r->path, "%d");
+    GString* path = g_string_new(NULL);
+
+    if (placeholder != NULL) {
+        g_string_append_len(path, r->path, placeholder - r->path);
+        g_string_append(path, number);
+        g_string_append(path, placeholder + 2);
+    } else {
+        // Insert before the extension, if there is one in the last path component.
+        const char* slash = strrchr(r->path, '/');
+        const char* dot = strrchr(r->path, '.');
+        const char* name = slash != NULL ? slash + 1 : r->path;
+        if (dot == NULL || dot <= name) {
+            dot = r->path + strlen(r->path);
+        }
+
+        g_string_append_len(path, r->path, dot - r->path);
+        g_string_append_c(path, '-');
+        g_string_append(path, number);
+        g_string_append(path, dot);
+    }
+
+    return g_string_free(path, FALSE);
+}
+
+
+static recorder_file* recorder_file_open(recorder* r, GError** error) {
+    char* path = recorder_next_path(r);
+    GFile* gfile = g_file_new_for_path(path);
+    GFileOutputStream* out = g_file_replace(gfile, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+    g_object_unref(gfile);
+
+    if (out == NULL) {
+        g_free(path);
+        return NULL;
+    }
+
+    recorder_file* file = g_new0(recorder_file, 1);
+    file->recorder = r;
+    file->path = path;
+    file->out = out;
+    g_queue_init(&file->queue);
+    r->open_files++;
+
+    if (r->container == RECORDER_CONTAINER_WAV) {
+        recorder_wav_header(file->header, &r->spec, UINT32_MAX);
+    } else {
+        file->header_written = true;
+    }
+
+    return file;
+}
+
+
+static void recorder_file_free(recorder_file* file) {
+    recorder* r = file->recorder;
+
+    g_queue_clear_full(&file->queue, (GDestroyNotify) g_bytes_unref);
+    g_object_unref(file->out);
+    g_free(file->path);
+    g_free(file);
+
+    r->open_files--;
+    recorder_maybe_free(r);
+}
+
+
+static void recorder_file_close_done(GObject* source, GAsyncResult* result, gpointer userdata) {
+    recorder_file* file = (recorder_file*) userdata;
+    recorder* r = file->recorder;
+    GError* error = NULL;
+
+    if (!g_output_stream_close_finish(G_OUTPUT_STREAM(source), result, &error)) {
+        recorder_report(r, error->message, NULL, false);
+        g_error_free(error);
+    } else if (!file->failed) {
+        recorder_report(r, NULL, file, true);
+    }
+
+    recorder_file_free(file);
+}
+
+
+// Corrects the WAV header and closes the file. The header is tiny, so it's written synchronously.
+static void recorder_file_finalize(recorder_file* file) {
+    recorder* r = file->recorder;
+
+    if (r->container == RECORDER_CONTAINER_WAV && !file->failed) {
+        recorder_wav_header(file->header, &r->spec, (uint32_t) file->written);
+
+        GError* error = NULL;
+        if (!g_seekable_seek(G_SEEKABLE(file->out), 0, G_SEEK_SET, NULL, &error)
+            || !g_output_stream_write_all(G_OUTPUT_STREAM(file->out), file->header, sizeof(file->header), NULL,
+                                          NULL, &error)) {
+            recorder_report(r, error->message, NULL, false);
+            g_error_free(error);
+        }
+    }
+
+    g_output_stream_close_async(G_OUTPUT_STREAM(file->out), G_PRIORITY_DEFAULT, NULL, recorder_file_close_done,
+                                file);
+}
+
+
+static void recorder_file_write_done(GObject* source, GAsyncResult* result, gpointer userdata) {
+    recorder_file* file = (recorder_file*) userdata;
+    recorder* r = file->recorder;
+    GError* error = NULL;
+    gsize written = 0;
+
+    bool ok = g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, &written, &error);
+    bool was_header = file->writing_header;
+
+    if (file->writing != NULL) {
+        g_bytes_unref(file->writing);
+        file->writing = NULL;
+    }
+    file->writing_header = false;
+
+    if (!ok) {
+        // Nothing more can be written to this file, and most likely not to the next one either.
+        file->failed = true;
+        file->closing = true;
+        g_queue_clear_full(&file->queue, (GDestroyNotify) g_bytes_unref);
+        g_queue_init(&file->queue);
+
+        recorder_report(r, error->message, NULL, false);
+        g_error_free(error);
+        recorder_stop_internal(r, NULL);
+    } else if (was_header) {
+        file->header_written = true;
+    } else {
+        file->written += written;
+        r->total_bytes += written;
+        recorder_report(r, NULL, file, false);
+    }
+
+    recorder_file_pump(file);
+}
+
+
+// Starts writing the next batch, or finalizes the file when there is nothing left to write.
+static void recorder_file_pump(recorder_file* file) {
+    if (file->writing != NULL || file->writing_header) {
+        return;
+    }
+
+    if (!file->header_written && !g_queue_is_empty(&file->queue)) {
+        file->writing_header = true;
+        g_output_stream_write_all_async(G_OUTPUT_STREAM(file->out), file->header, sizeof(file->header),
+                                        G_PRIORITY_DEFAULT, NULL, recorder_file_write_done, file);
+        return;
+    }
+
+    file->writing = g_queue_pop_head(&file->queue);
+    if (file->writing == NULL) {
+        if (file->closing && !file->finalizing) {
+            file->finalizing = true;
+            recorder_file_finalize(file);
+        }
+        return;
+    }
+
+    gsize size;
+    gconstpointer data = g_bytes_get_data(file->writing, &size);
+    g_output_stream_write_all_async(G_OUTPUT_STREAM(file->out), data, size, G_PRIORITY_DEFAULT, NULL,
+                                    recorder_file_write_done, file);
+}
+
+
+// Hands the current batch over to the current file.
+static void recorder_flush(recorder* r) {
+    if (r->batch->len == 0 || r->current == NULL) {
+        return;
+    }
+
+    // After a failed write, the data has nowhere to go.
+    if (r->current->failed) {
+        g_byte_array_set_size(r->batch, 0);
+        return;
+    }
+
+    guint length = r->batch->len;
+    GBytes* bytes = g_byte_array_free_to_bytes(r->batch);
+    r->batch = g_byte_array_sized_new(r->batch_size);
+
+    r->current->data_bytes += length;
+    g_queue_push_tail(&r->current->queue, bytes);
+    recorder_file_pump(r->current);
+}
+
+
+static void recorder_rotate(recorder* r) {
+    recorder_file* previous = r->current;
+    GError* error = NULL;
+
+    r->current = recorder_file_open(r, &error);
+
+    previous->closing = true;
+    recorder_file_pump(previous);
+
+    if (r->current == NULL) {
+        recorder_report(r, error->message, NULL, false);
+        g_error_free(error);
+        recorder_stop_internal(r, NULL);
+    }
+}
+
+
+// Adds recorded data to the batch, splitting it where files are rotated. `NULL` data adds silence.
+static void recorder_append(recorder* r, const void* data, size_t length) {
+    const guint8* src = data;
+
+    while (length > 0 && r->current != NULL) {
+        size_t take = length;
+        if (r->max_bytes > 0) {
+            take = MIN(take, r->max_bytes - r->current->data_bytes - r->batch->len);
+        }
+
+        if (src != NULL) {
+            g_byte_array_append(r->batch, src, take);
+            src += take;
+        } else {
+            guint offset = r->batch->len;
+            g_byte_array_set_size(r->batch, offset + take);
+            memset(r->batch->data + offset, 0, take);
+        }
+        length -= take;
+
+        bool full = r->max_bytes > 0 && r->current->data_bytes + r->batch->len >= r->max_bytes;
+        if (full || r->batch->len >= r->batch_size) {
+            recorder_flush(r);
+        }
+        if (full) {
+            recorder_rotate(r);
+        }
+    }
+}
+
+
+static void recorder_read_callback(pa_stream* s, size_t nbytes, void* userdata) {
+    recorder* r = (recorder*) userdata;
+    const void* data;
+    size_t length;
+
+    while (pa_stream_readable_size(s) > 0) {
+        if (pa_stream_peek(s, &data, &length) < 0 || length == 0) {
+            break;
+        }
+
+        // Holes are recorded as silence, to keep the recording's timing.
+        recorder_append(r, data, length);
+        pa_stream_drop(s);
+    }
+}
+
+
+static void recorder_state_callback(pa_stream* s, void* userdata) {
+    recorder* r = (recorder*) userdata;
+
+    if (pa_stream_get_state(s) == PA_STREAM_FAILED) {
+        recorder_stop_internal(r, pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+    }
+}
+
+
+static gboolean recorder_flush_timeout(gpointer userdata) {
+    recorder_flush((recorder*) userdata);
+    return G_SOURCE_CONTINUE;
+}
+
+
+// Disconnects the stream, writes what's left and closes the current file. An error message, if given, is
+// reported first.
+static void recorder_stop_internal(recorder* r, const char* err) {
+    if (r->stopped) {
+        return;
+    }
+    r->stopped = true;
+
+    if (err != NULL) {
+        recorder_report(r, err, NULL, false);
+    }
+
+    if (r->flush_id != 0) {
+        g_source_remove(r->flush_id);
+        r->flush_id = 0;
+    }
+
+    if (r->stream != NULL) {
+        pa_stream_set_read_callback(r->stream, NULL, NULL);
+        pa_stream_set_state_callback(r->stream, NULL, NULL);
+        pa_stream_disconnect(r->stream);
+        pa_stream_unref(r->stream);
+        r->stream = NULL;
+    }
+
+    if (r->current != NULL) {
+        recorder_flush(r);
+        r->current->closing = true;
+        recorder_file_pump(r->current);
+        r->current = NULL;
+    }
+}
+
+
+int context_record_to_file(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* path = luaL_checkstring(L, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    luaL_checktype(L, 4, LUA_TFUNCTION);
+
+    pa_sample_spec spec = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 44100,
+        .channels = 2,
+    };
+    lua_getfield(L, 3, "spec");
+    if (!lua_isnil(L, -1)) {
+        sample_spec_from_lua(L, lua_gettop(L), &spec);
+    }
+    lua_pop(L, 1);
+
+    pa_buffer_attr attr;
+    buffer_attr_from_lua(L, 3, &spec, &attr);
+
+    lua_getfield(L, 3, "device");
+    const char* device = luaL_optstring(L, -1, NULL);
+
+    recorder_container container = g_str_has_suffix(path, ".wav") ? RECORDER_CONTAINER_WAV : RECORDER_CONTAINER_RAW;
+    lua_getfield(L, 3, "container");
+    if (!lua_isnil(L, -1)) {
+        const char* name = luaL_checkstring(L, -1);
+        if (g_strcmp0(name, "wav") == 0) {
+            container = RECORDER_CONTAINER_WAV;
+        } else if (g_strcmp0(name, "raw") == 0) {
+            container = RECORDER_CONTAINER_RAW;
+        } else {
+            return luaL_argerror(L, 3, "container must be either 'raw' or 'wav'");
+        }
+    }
+
+    if (container == RECORDER_CONTAINER_WAV && recorder_wav_format(spec.format) == 0) {
+        return luaL_argerror(L, 3, "sample format can't be stored in WAV");
+    }
+
+    uint64_t max_bytes = 0;
+    lua_getfield(L, 3, "max_bytes");
+    max_bytes = (uint64_t) luaL_optinteger(L, -1, 0);
+    lua_getfield(L, 3, "max_seconds");
+    if (!lua_isnil(L, -1)) {
+        uint64_t bytes = pa_usec_to_bytes((pa_usec_t) (luaL_checknumber(L, -1) * PA_USEC_PER_SEC), &spec);
+        max_bytes = max_bytes > 0 ? MIN(max_bytes, bytes) : bytes;
+    }
+
+    // A WAV header can't describe more than 4 GiB of data, so those files are always rotated before that.
+    uint64_t wav_limit = UINT32_MAX - RECORDER_WAV_HEADER_SIZE;
+    if (container == RECORDER_CONTAINER_WAV && (max_bytes == 0 || max_bytes > wav_limit)) {
+        max_bytes = wav_limit;
+    }
+
+    // Rotate on frame boundaries.
+    size_t frame_size = pa_frame_size(&spec);
+    max_bytes = max_bytes / frame_size * frame_size;
+
+    lua_getfield(L, 3, "batch_size");
+    size_t batch_size = (size_t) luaL_optinteger(L, -1, RECORDER_DEFAULT_BATCH_SIZE);
+    lua_getfield(L, 3, "flush_interval");
+    guint flush_interval = (guint) luaL_optinteger(L, -1, RECORDER_DEFAULT_FLUSH_INTERVAL);
+    lua_getfield(L, 3, "flags");
+    pa_stream_flags_t flags = (pa_stream_flags_t) luaL_optinteger(L, -1, PA_STREAM_NOFLAGS);
+
+    luaL_argcheck(L, batch_size > 0, 3, "batch_size must be positive");
+
+    if (attr.fragsize != (uint32_t) -1) {
+        flags |= PA_STREAM_ADJUST_LATENCY;
+    }
+
+    recorder* r = g_new0(recorder, 1);
+    r->ctx = ctx;
+    r->spec = spec;
+    r->container = container;
+    r->path = g_strdup(path);
+    r->max_bytes = max_bytes;
+    r->batch_size = batch_size;
+    r->batch = g_byte_array_sized_new(batch_size);
+
+    GError* error = NULL;
+    r->current = recorder_file_open(r, &error);
+    if (r->current == NULL) {
+        lua_pushnil(L);
+        lua_pushstring(L, error->message);
+        g_error_free(error);
+        recorder_free(r);
+        return 2;
+    }
+
+    r->stream = pa_stream_new(ctx->context, "Recorder", &spec, NULL);
+    if (r->stream != NULL) {
+        pa_stream_set_read_callback(r->stream, recorder_read_callback, r);
+        pa_stream_set_state_callback(r->stream, recorder_state_callback, r);
+    }
+
+    if (r->stream == NULL || pa_stream_connect_record(r->stream, device, &attr, flags) < 0) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to connect stream: %s", pa_strerror(pa_context_errno(ctx->context)));
+        // The empty file is still closed asynchronously, which frees the recorder.
+        recorder_stop_internal(r, NULL);
+        return 2;
+    }
+
+    if (flush_interval > 0) {
+        r->flush_id = g_timeout_add(flush_interval, recorder_flush_timeout, r);
+    }
+
+    r->data = prepare_lua_callback(L, 4);
+    lua_pushvalue(L, 1);
+    lua_xmove(L, r->data->L, 1);
+
+    lua_pa_recorder* userdata = lua_newuserdata(L, sizeof(lua_pa_recorder));
+    userdata->recorder = r;
+    luaL_getmetatable(L, LUA_PA_RECORDER);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+
+int recorder_stop(lua_State* L) {
+    lua_pa_recorder* userdata = luaL_checkudata(L, 1, LUA_PA_RECORDER);
+    recorder_stop_internal(userdata->recorder, NULL);
+    return 0;
+}
+
+
+int recorder_get_stats(lua_State* L) {
+    lua_pa_recorder* userdata = luaL_checkudata(L, 1, LUA_PA_RECORDER);
+    recorder* r = userdata->recorder;
+
+    lua_createtable(L, 0, 4);
+
+    if (r->current != NULL) {
+        lua_pushstring(L, r->current->path);
+        lua_setfield(L, -2, "path");
+
+        lua_pushinteger(L, (lua_Integer) r->current->written);
+        lua_setfield(L, -2, "bytes");
+    }
+
+    lua_pushinteger(L, r->sequence);
+    lua_setfield(L, -2, "files");
+
+    lua_pushinteger(L, (lua_Integer) r->total_bytes);
+    lua_setfield(L, -2, "total_bytes");
+
+    return 1;
+}
+
+
+int recorder__gc(lua_State* L) {
+    lua_pa_recorder* userdata = luaL_checkudata(L, 1, LUA_PA_RECORDER);
+    recorder* r = userdata->recorder;
+
+    // Pending writes continue in the background, but there's no one left to report to.
+    simple_callback_data* data = r->data;
+    r->data = NULL;
+    free_lua_callback(data);
+
+    recorder_stop_internal(r, NULL);
+    recorder_maybe_free(r);
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+/** Recording to files.
+ *
+ * A @{Recorder} writes the data of a record stream straight to disk, without passing it through Lua.
+ * Fragments are collected into batches and written asynchronously through GIO, so the main loop is never
+ * blocked by the disk. Lua only receives progress and error reports.
+ *
+ * Recordings can be rotated when a file reaches a given size or duration. The path may contain `%d`,
+ * which is replaced with the number of the file, starting at `1`. Without it, the number is appended
+ * to the file name, before the extension.
+ *
+ *    local recorder = ctx:record_to_file("meeting-%d.wav", {
+ *        spec = { format = "s16le", rate = 16000, channels = 1 },
+ *        max_seconds = 600,
+ *    }, function(err, progress)
+ *        if err then return print(err) end
+ *        if progress.finished then transcribe(progress.path) end
+ *    end)
+ *
+ * @module lua_libpulse_glib.recorder
+ */
+#pragma once
+
+#include "callback.h"
+#include "context.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <pulse/stream.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LUA_PA_RECORDER "pulseaudio.recorder"
+
+
+typedef enum recorder_container {
+    RECORDER_CONTAINER_RAW,
+    RECORDER_CONTAINER_WAV,
+} recorder_container;
+
+
+struct recorder;
+
+
+typedef struct recorder_file {
+    struct recorder* recorder;
+    char* path;
+    GFileOutputStream* out;
+    // Batches waiting to be written, as `GBytes*`.
+    GQueue queue;
+    // The batch that is currently being written.
+    GBytes* writing;
+    // WAV files start with a header, which is written before the first batch and rewritten when the file
+    // is finalized.
+    unsigned char header[44];
+    bool header_written;
+    bool writing_header;
+    // Set once the file is complete. It is finalized and closed when the queue is empty.
+    bool closing;
+    bool finalizing;
+    bool failed;
+    // The number of audio bytes queued for this file, not including the header.
+    uint64_t data_bytes;
+    // The number of audio bytes that have been written.
+    uint64_t written;
+} recorder_file;
+
+
+typedef struct recorder {
+    lua_pa_context* ctx;
+    pa_stream* stream;
+    pa_sample_spec spec;
+    recorder_container container;
+    char* path;
+    // The number of the current file, for rotation.
+    uint32_t sequence;
+    // The number of audio bytes per file, aligned to frames. `0` disables rotation.
+    uint64_t max_bytes;
+    size_t batch_size;
+    GByteArray* batch;
+    // Writes partial batches periodically, so that progress is visible on disk.
+    guint flush_id;
+    recorder_file* current;
+    // The number of files that have not been closed yet, including the current one.
+    int open_files;
+    uint64_t total_bytes;
+    // A thread with the callback at index 1 and the context at index 2, to keep it alive.
+    // Set to `NULL` when the userdata is collected.
+    simple_callback_data* data;
+    bool stopped;
+} recorder;
+
+
+typedef struct lua_pa_recorder {
+    recorder* recorder;
+} lua_pa_recorder;
+
+
+/// Recorder
+/// @type Recorder
+
+
+/** Stops recording.
+ *
+ * Buffered data is written and the current file is finalized. The callback receives a final report with
+ * `finished` set, once the file is closed.
+ *
+ * @function Recorder:stop
+ */
+int recorder_stop(lua_State*);
+
+/** Returns the recorder's counters.
+ *
+ * @function Recorder:get_stats
+ * @treturn table A table with the fields `path`, `files`, `bytes` and `total_bytes`.
+ */
+int recorder_get_stats(lua_State*);
+
+int recorder__gc(lua_State*);
+
+
+static const struct luaL_Reg recorder_f[] = {
+    {"stop",       recorder_stop     },
+    { "get_stats", recorder_get_stats},
+    { NULL,        NULL              }
+};
+
+
+static const struct luaL_Reg recorder_mt[] = {
+    {"__gc", recorder__gc},
+    { NULL,  NULL        }
+};
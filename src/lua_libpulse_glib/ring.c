@@ -0,0 +1,100 @@
+#include "ring.h"
+
+#include <glib.h>
+#include <string.h>
+
+
+ring_buffer* ring_new(size_t capacity) {
+    ring_buffer* ring = g_new0(ring_buffer, 1);
+    ring->data = g_malloc(capacity > 0 ? capacity : 1);
+    ring->capacity = capacity;
+    return ring;
+}
+
+
+void ring_free(ring_buffer* ring) {
+    g_free(ring->data);
+    g_free(ring);
+}
+
+
+// Copies into the buffer at its tail, which must have enough free space.
+static void ring_copy_in(ring_buffer* ring, const unsigned char* src, size_t length) {
+    size_t tail = (ring->head + ring->length) % ring->capacity;
+    size_t first = MIN(length, ring->capacity - tail);
+
+    if (src != NULL) {
+        memcpy(ring->data + tail, src, first);
+        memcpy(ring->data, src + first, length - first);
+    } else {
+        memset(ring->data + tail, 0, first);
+        memset(ring->data, 0, length - first);
+    }
+
+    ring->length += length;
+}
+
+
+size_t ring_write(ring_buffer* ring, const void* data, size_t length, size_t align, ring_overflow policy) {
+    const unsigned char* src = data;
+    size_t dropped = 0;
+
+    if (align == 0) {
+        align = 1;
+    }
+
+    if (length > ring_free_space(ring)) {
+        if (policy == RING_OVERFLOW_DROP_NEWEST) {
+            size_t fits = ring_free_space(ring) / align * align;
+            dropped = length - fits;
+            length = fits;
+        } else {
+            // When the new data alone exceeds the buffer, only its end is kept.
+            size_t keep = MIN(length, ring->capacity / align * align);
+            size_t skip = length - keep;
+            if (src != NULL) {
+                src += skip;
+            }
+            length = keep;
+            dropped = skip;
+
+            if (length > ring_free_space(ring)) {
+                size_t needed = length - ring_free_space(ring);
+                needed = (needed + align - 1) / align * align;
+                dropped += ring_discard(ring, needed);
+            }
+        }
+    }
+
+    if (length > 0) {
+        ring_copy_in(ring, src, length);
+    }
+
+    return dropped;
+}
+
+
+size_t ring_read(ring_buffer* ring, void* dest, size_t length) {
+    length = MIN(length, ring->length);
+    size_t first = MIN(length, ring->capacity - ring->head);
+
+    memcpy(dest, ring->data + ring->head, first);
+    memcpy((unsigned char*) dest + first, ring->data, length - first);
+
+    ring_discard(ring, length);
+    return length;
+}
+
+
+size_t ring_discard(ring_buffer* ring, size_t length) {
+    length = MIN(length, ring->length);
+
+    ring->length -= length;
+    if (ring->length == 0) {
+        ring->head = 0;
+    } else {
+        ring->head = (ring->head + length) % ring->capacity;
+    }
+
+    return length;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+
+
+// A fixed-size byte ring buffer. Writes never allocate, data that doesn't fit is dropped according to the
+// caller's policy.
+typedef struct ring_buffer {
+    unsigned char* data;
+    size_t capacity;
+    // The position of the oldest byte.
+    size_t head;
+    // The number of bytes stored.
+    size_t length;
+} ring_buffer;
+
+
+typedef enum ring_overflow {
+    // Makes room by discarding the oldest data, so that the buffer always holds the most recent audio.
+    RING_OVERFLOW_DROP_OLDEST,
+    // Keeps the buffered data and discards what doesn't fit.
+    RING_OVERFLOW_DROP_NEWEST,
+} ring_overflow;
+
+
+ring_buffer* ring_new(size_t);
+void ring_free(ring_buffer*);
+
+// Appends data to the buffer. When `data` is `NULL`, zeroes are written instead.
+// Data is dropped in multiples of `align` bytes. Returns the number of bytes that were dropped.
+size_t ring_write(ring_buffer*, const void*, size_t, size_t, ring_overflow);
+
+// Copies up to the given number of bytes out of the buffer and removes them. Returns the number of bytes read.
+size_t ring_read(ring_buffer*, void*, size_t);
+
+// Removes up to the given number of bytes, without copying them. Returns the number of bytes removed.
+size_t ring_discard(ring_buffer*, size_t);
+
+static inline size_t ring_free_space(const ring_buffer* ring) {
+    return ring->capacity - ring->length;
+}
@@ -0,0 +1,232 @@
+#include "buffer.h"
+#include "callback.h"
+#include "context.h"
+#include "operation.h"
+#include "proplist.h"
+#include "stream.h"
+#include "volume.h"
+
+#include <pulse/error.h>
+#include <pulse/scache.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+typedef struct sample_upload {
+    pa_stream* stream;
+    const unsigned char* data;
+    size_t length;
+    size_t offset;
+    // A thread with the callback at index 1, the uploaded string or buffer at index 2 and the context at index 3,
+    // to keep them alive until the upload is done.
+    simple_callback_data* cb;
+} sample_upload;
+
+
+static void upload_free(sample_upload* upload) {
+    pa_stream_set_state_callback(upload->stream, NULL, NULL);
+    pa_stream_set_write_callback(upload->stream, NULL, NULL);
+    pa_stream_unref(upload->stream);
+    free_lua_callback(upload->cb);
+    free(upload);
+}
+
+
+static void upload_write_callback(pa_stream* s, size_t nbytes, void* userdata) {
+    sample_upload* upload = (sample_upload*) userdata;
+
+    size_t remaining = upload->length - upload->offset;
+    if (nbytes > remaining) {
+        nbytes = remaining;
+    }
+
+    int ret = stream_write_data(s, upload->data + upload->offset, nbytes);
+    if (ret < 0) {
+        lua_State* L = upload->cb->L;
+        lua_pushvalue(L, 1);
+        lua_pushfstring(L, "failed to upload sample: %s", pa_strerror(-ret));
+        lua_call(L, 1, 0);
+
+        pa_stream_disconnect(s);
+        upload_free(upload);
+        return;
+    }
+
+    upload->offset += (size_t) ret;
+
+    if (upload->offset >= upload->length) {
+        // The stream is terminated once the server has stored the sample.
+        pa_stream_set_write_callback(s, NULL, NULL);
+        pa_stream_finish_upload(s);
+    }
+}
+
+
+static void upload_state_callback(pa_stream* s, void* userdata) {
+    sample_upload* upload = (sample_upload*) userdata;
+    lua_State* L = upload->cb->L;
+
+    switch (pa_stream_get_state(s)) {
+    case PA_STREAM_TERMINATED: {
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        lua_pushboolean(L, upload->offset >= upload->length);
+        lua_call(L, 2, 0);
+
+        upload_free(upload);
+        break;
+    }
+    case PA_STREAM_FAILED: {
+        lua_pushvalue(L, 1);
+        lua_pushfstring(L, "failed to upload sample: %s", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+        lua_call(L, 1, 0);
+
+        upload_free(upload);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+
+int context_upload_sample(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* name = luaL_checkstring(L, 2);
+    size_t length = 0;
+    const unsigned char* bytes = buffer_check_data(L, 3, &length);
+    luaL_checktype(L, 5, LUA_TFUNCTION);
+
+    pa_sample_spec spec;
+    sample_spec_from_lua(L, 4, &spec);
+
+    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
+        lua_pushvalue(L, 5);
+        lua_pushstring(L, "connection not ready");
+        lua_call(L, 1, 0);
+        return 0;
+    }
+
+    if (length == 0 || length % pa_frame_size(&spec) != 0) {
+        return luaL_argerror(L, 3, "sample data must be a non-empty sequence of whole frames");
+    }
+
+    pa_stream* s = pa_stream_new(ctx->context, name, &spec, NULL);
+    if (s == NULL) {
+        lua_pushvalue(L, 5);
+        lua_pushfstring(L, "failed to create upload stream: %s", pa_strerror(pa_context_errno(ctx->context)));
+        lua_call(L, 1, 0);
+        return 0;
+    }
+
+    sample_upload* upload = malloc(sizeof(sample_upload));
+    upload->stream = s;
+    upload->data = bytes;
+    upload->length = length;
+    upload->offset = 0;
+    upload->cb = prepare_lua_callback(L, 5);
+
+    lua_pushvalue(L, 3);
+    lua_pushvalue(L, 1);
+    lua_xmove(L, upload->cb->L, 2);
+
+    pa_stream_set_state_callback(s, upload_state_callback, upload);
+    pa_stream_set_write_callback(s, upload_write_callback, upload);
+
+    if (pa_stream_connect_upload(s, length) < 0) {
+        int error = pa_context_errno(ctx->context);
+        lua_pushvalue(L, 5);
+        lua_pushfstring(L, "failed to upload sample: %s", pa_strerror(error));
+        lua_call(L, 1, 0);
+
+        upload_free(upload);
+    }
+
+    return 0;
+}
+
+
+static void play_sample_callback(pa_context* c, uint32_t index, void* userdata) {
+    simple_callback_data* data = (simple_callback_data*) userdata;
+    lua_State* L = data->L;
+
+    lua_pushvalue(L, 1);
+    if (index == PA_INVALID_INDEX) {
+        lua_pushfstring(L, "failed to play sample: %s", pa_strerror(pa_context_errno(c)));
+        lua_call(L, 1, 0);
+    } else {
+        lua_pushnil(L);
+        lua_pushinteger(L, index + 1);
+        lua_call(L, 2, 0);
+    }
+
+    free_lua_callback(data);
+}
+
+
+int context_play_sample(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* name = luaL_checkstring(L, 2);
+    bool has_callback = !lua_isnoneornil(L, 4);
+
+    const char* device = NULL;
+    pa_volume_t volume = PA_VOLUME_INVALID;
+    pa_proplist* plist = NULL;
+
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+
+        lua_getfield(L, 3, "device");
+        device = luaL_optstring(L, -1, NULL);
+        // The string stays referenced by the options table until the request has been sent.
+        lua_pop(L, 1);
+
+        lua_getfield(L, 3, "volume");
+        if (lua_isnumber(L, -1)) {
+            volume = PA_CLAMP_VOLUME((pa_volume_t) lua_tointeger(L, -1));
+        } else if (!lua_isnil(L, -1)) {
+            pa_cvolume cvolume;
+            volume_load(luaL_checkudata(L, -1, LUA_PA_VOLUME), &cvolume);
+            volume = pa_cvolume_max(&cvolume);
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, 3, "proplist");
+        if (!lua_isnil(L, -1)) {
+            plist = ((proplist*) luaL_checkudata(L, -1, LUA_PA_PROPLIST))->plist;
+        }
+        lua_pop(L, 1);
+    }
+
+    if (pa_context_get_state(ctx->context) != PA_CONTEXT_READY) {
+        if (has_callback) {
+            lua_pushvalue(L, 4);
+            lua_pushstring(L, "connection not ready");
+            lua_call(L, 1, 0);
+        }
+        return 0;
+    }
+
+    // Without a callback, there is no need to wait for the server to report the index of the new sink input.
+    simple_callback_data* data = has_callback ? prepare_lua_callback(L, 4) : NULL;
+    pa_operation* op = pa_context_play_sample_with_proplist(
+        ctx->context, name, device, volume, plist, has_callback ? play_sample_callback : NULL, data);
+    if (op == NULL) {
+        if (has_callback) {
+            int error = pa_context_errno(ctx->context);
+            lua_pushvalue(L, 4);
+            lua_pushfstring(L, "failed to play sample '%s': %s", name, pa_strerror(error));
+            lua_call(L, 1, 0);
+            free_lua_callback(data);
+        }
+        return 0;
+    }
+
+    pa_operation_unref(op);
+    return 0;
+}
+
+
+int context_remove_sample(lua_State* L) {
+    return operation_run(L, OPERATION_REMOVE_SAMPLE);
+}
@@ -0,0 +1,736 @@
+#include "schema.h"
+
+#include "convert.h"
+#include "proplist.h"
+#include "volume.h"
+
+#include <lauxlib.h>
+#include <pulse/channelmap.h>
+#include <pulse/proplist.h>
+#include <pulse/sample.h>
+#include <pulse/volume.h>
+#include <string.h>
+
+
+#define FIELD_PTR(base, offset, type) ((const type*) ((const char*) (base) + (offset)))
+
+
+static bool field_present(const schema_field* field, const void* base) {
+    return !field->has_flag || *FIELD_PTR(base, field->flag_offset, int);
+}
+
+
+static uint32_t list_count(const schema_field* field, const void* base) {
+    switch (field->count_size) {
+    case sizeof(uint8_t):
+        return *FIELD_PTR(base, field->count_offset, uint8_t);
+    case sizeof(uint16_t):
+        return *FIELD_PTR(base, field->count_offset, uint16_t);
+    default:
+        return *FIELD_PTR(base, field->count_offset, uint32_t);
+    }
+}
+
+
+static const void* list_item(const schema_field* field, const void* base, uint32_t i) {
+    return (*FIELD_PTR(base, field->offset, void* const*))[i];
+}
+
+
+static const void* list_active(const schema_field* field, const void* base) {
+    return field->has_active ? *FIELD_PTR(base, field->active_offset, void* const) : NULL;
+}
+
+
+static int popcount(schema_mask mask) {
+    int count = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+}
+
+
+// Lua conversion
+
+
+static void push_list(lua_State* L, const schema_field* field, const void* base) {
+    uint32_t count = list_count(field, base);
+    const void* active = list_active(field, base);
+
+    lua_createtable(L, (int) count, active != NULL ? 1 : 0);
+    for (uint32_t i = 0; i < count; ++i) {
+        const void* item = list_item(field, base, i);
+        schema_to_lua(L, field->item, item);
+
+        if (item == active) {
+            lua_pushvalue(L, -1);
+            lua_setfield(L, -3, "active");
+        }
+
+        lua_rawseti(L, -2, (int) i + 1);
+    }
+}
+
+
+static void push_field(lua_State* L, const schema_field* field, const void* base) {
+    switch (field->type) {
+    case SCHEMA_STRING:
+        lua_pushstring(L, *FIELD_PTR(base, field->offset, const char*));
+        return;
+    case SCHEMA_INDEX:
+        // Convert C's 0-based index to Lua's 1-base
+        lua_pushinteger(L, (lua_Integer) *FIELD_PTR(base, field->offset, uint32_t) + 1);
+        return;
+    case SCHEMA_UINT32:
+        lua_pushinteger(L, *FIELD_PTR(base, field->offset, uint32_t));
+        return;
+    case SCHEMA_INT:
+        lua_pushinteger(L, *FIELD_PTR(base, field->offset, int));
+        return;
+    case SCHEMA_BOOLEAN:
+        lua_pushboolean(L, *FIELD_PTR(base, field->offset, int));
+        return;
+    case SCHEMA_USEC:
+        lua_pushinteger(L, (lua_Integer) *FIELD_PTR(base, field->offset, pa_usec_t));
+        return;
+    case SCHEMA_SAMPLE_SPEC:
+        sample_spec_to_lua(L, FIELD_PTR(base, field->offset, pa_sample_spec));
+        return;
+    case SCHEMA_CHANNEL_MAP:
+        channel_map_to_lua(L, FIELD_PTR(base, field->offset, pa_channel_map));
+        return;
+    case SCHEMA_CVOLUME:
+        volume_to_lua(L, FIELD_PTR(base, field->offset, pa_cvolume));
+        return;
+    case SCHEMA_PROPLIST: {
+        // The userdata gets its own copy.
+        const pa_proplist* plist = *FIELD_PTR(base, field->offset, pa_proplist*);
+        if (plist == NULL) {
+            lua_pushnil(L);
+        } else {
+            proplist_to_lua(L, (pa_proplist*) plist);
+        }
+        return;
+    }
+    case SCHEMA_OBJECT: {
+        const void* object = *FIELD_PTR(base, field->offset, void* const);
+        if (object == NULL) {
+            lua_pushnil(L);
+        } else {
+            schema_to_lua(L, field->item, object);
+        }
+        return;
+    }
+    case SCHEMA_LIST:
+        push_list(L, field, base);
+        return;
+    }
+
+    lua_pushnil(L);
+}
+
+
+void schema_to_lua(lua_State* L, const schema* s, const void* base) {
+    schema_project(L, s, base, SCHEMA_MASK_ALL);
+}
+
+
+void schema_project(lua_State* L, const schema* s, const void* base, schema_mask mask) {
+    int hint = popcount(mask);
+    lua_createtable(L, 0, hint < (int) s->n_fields ? hint : (int) s->n_fields);
+
+    for (size_t i = 0; i < s->n_fields; ++i) {
+        const schema_field* field = &s->fields[i];
+        if (!(mask & ((schema_mask) 1 << i)) || !field_present(field, base)) {
+            continue;
+        }
+
+        push_field(L, field, base);
+        lua_setfield(L, -2, field->name);
+    }
+}
+
+
+schema_mask schema_check_mask(lua_State* L, int arg, const schema* s) {
+    luaL_checktype(L, arg, LUA_TTABLE);
+
+    schema_mask mask = 0;
+    int count = (int) lua_rawlen(L, arg);
+    for (int i = 1; i <= count; ++i) {
+        lua_rawgeti(L, arg, i);
+        const char* name = lua_tostring(L, -1);
+        if (name == NULL) {
+            return luaL_argerror(L, arg, "field names must be strings");
+        }
+
+        size_t j = 0;
+        while (j < s->n_fields && strcmp(s->fields[j].name, name) != 0) {
+            j++;
+        }
+        if (j == s->n_fields) {
+            lua_pushfstring(L, "unknown field '%s' of %s", name, s->name);
+            return luaL_argerror(L, arg, lua_tostring(L, -1));
+        }
+
+        mask |= (schema_mask) 1 << j;
+        lua_pop(L, 1);
+    }
+
+    return mask;
+}
+
+
+// Comparison
+
+
+static bool proplist_equal(const pa_proplist* a, const pa_proplist* b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return pa_proplist_equal(a, b);
+}
+
+
+static bool object_equal(const schema* s, const void* a, const void* b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return schema_diff(s, a, b, SCHEMA_MASK_ALL) == 0;
+}
+
+
+static bool list_equal(const schema_field* field, const void* a, const void* b) {
+    uint32_t count = list_count(field, a);
+    if (count != list_count(field, b)) {
+        return false;
+    }
+
+    const void* active_a = list_active(field, a);
+    const void* active_b = list_active(field, b);
+    if ((active_a == NULL) != (active_b == NULL)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const void* item_a = list_item(field, a, i);
+        const void* item_b = list_item(field, b, i);
+        if ((item_a == active_a) != (item_b == active_b) || !object_equal(field->item, item_a, item_b)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool field_equal(const schema_field* field, const void* a, const void* b) {
+    size_t offset = field->offset;
+
+    switch (field->type) {
+    case SCHEMA_STRING:
+        return g_strcmp0(*FIELD_PTR(a, offset, const char*), *FIELD_PTR(b, offset, const char*)) == 0;
+    case SCHEMA_INDEX:
+    case SCHEMA_UINT32:
+        return *FIELD_PTR(a, offset, uint32_t) == *FIELD_PTR(b, offset, uint32_t);
+    case SCHEMA_INT:
+        return *FIELD_PTR(a, offset, int) == *FIELD_PTR(b, offset, int);
+    case SCHEMA_BOOLEAN:
+        return !*FIELD_PTR(a, offset, int) == !*FIELD_PTR(b, offset, int);
+    case SCHEMA_USEC:
+        return *FIELD_PTR(a, offset, pa_usec_t) == *FIELD_PTR(b, offset, pa_usec_t);
+    case SCHEMA_SAMPLE_SPEC:
+        return pa_sample_spec_equal(FIELD_PTR(a, offset, pa_sample_spec), FIELD_PTR(b, offset, pa_sample_spec));
+    case SCHEMA_CHANNEL_MAP:
+        return pa_channel_map_equal(FIELD_PTR(a, offset, pa_channel_map), FIELD_PTR(b, offset, pa_channel_map));
+    case SCHEMA_CVOLUME:
+        return pa_cvolume_equal(FIELD_PTR(a, offset, pa_cvolume), FIELD_PTR(b, offset, pa_cvolume));
+    case SCHEMA_PROPLIST:
+        return proplist_equal(*FIELD_PTR(a, offset, pa_proplist*), *FIELD_PTR(b, offset, pa_proplist*));
+    case SCHEMA_OBJECT:
+        return object_equal(field->item, *FIELD_PTR(a, offset, void* const), *FIELD_PTR(b, offset, void* const));
+    case SCHEMA_LIST:
+        return list_equal(field, a, b);
+    }
+
+    return false;
+}
+
+
+schema_mask schema_diff(const schema* s, const void* a, const void* b, schema_mask mask) {
+    schema_mask changed = 0;
+
+    for (size_t i = 0; i < s->n_fields; ++i) {
+        const schema_field* field = &s->fields[i];
+        schema_mask bit = (schema_mask) 1 << i;
+        if (!(mask & bit)) {
+            continue;
+        }
+
+        bool present = field_present(field, a);
+        if (present != field_present(field, b) || (present && !field_equal(field, a, b))) {
+            changed |= bit;
+        }
+    }
+
+    return changed;
+}
+
+
+// Binary encoding
+
+
+static void put_varint(GByteArray* buf, uint64_t value) {
+    uint8_t bytes[10];
+    size_t n = 0;
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            bytes[n] |= 0x80;
+        }
+        n++;
+    } while (value != 0);
+    g_byte_array_append(buf, bytes, (guint) n);
+}
+
+
+static void put_bytes(GByteArray* buf, const void* data, size_t len) {
+    if (data == NULL) {
+        put_varint(buf, 0);
+        return;
+    }
+
+    put_varint(buf, (uint64_t) len + 1);
+    g_byte_array_append(buf, data, (guint) len);
+}
+
+
+static void put_string(GByteArray* buf, const char* str) {
+    put_bytes(buf, str, str != NULL ? strlen(str) : 0);
+}
+
+
+static void put_proplist(GByteArray* buf, const pa_proplist* plist) {
+    if (plist == NULL) {
+        put_varint(buf, 0);
+        return;
+    }
+
+    put_varint(buf, (uint64_t) pa_proplist_size(plist) + 1);
+
+    void* state = NULL;
+    const char* key;
+    while ((key = pa_proplist_iterate(plist, &state)) != NULL) {
+        const void* data = NULL;
+        size_t len = 0;
+        pa_proplist_get(plist, key, &data, &len);
+        put_string(buf, key);
+        put_bytes(buf, data, len);
+    }
+}
+
+
+static void put_object(GByteArray* buf, const schema* s, const void* object) {
+    if (object == NULL) {
+        put_varint(buf, 0);
+        return;
+    }
+
+    put_varint(buf, 1);
+    schema_encode(buf, s, object, SCHEMA_MASK_ALL);
+}
+
+
+static void put_field(GByteArray* buf, const schema_field* field, const void* base) {
+    size_t offset = field->offset;
+
+    switch (field->type) {
+    case SCHEMA_STRING:
+        put_string(buf, *FIELD_PTR(base, offset, const char*));
+        return;
+    case SCHEMA_INDEX:
+        put_varint(buf, (uint32_t) (*FIELD_PTR(base, offset, uint32_t) + 1));
+        return;
+    case SCHEMA_UINT32:
+        put_varint(buf, *FIELD_PTR(base, offset, uint32_t));
+        return;
+    case SCHEMA_INT:
+        put_varint(buf, (uint32_t) (*FIELD_PTR(base, offset, int) + 1));
+        return;
+    case SCHEMA_BOOLEAN:
+        put_varint(buf, *FIELD_PTR(base, offset, int) != 0);
+        return;
+    case SCHEMA_USEC:
+        put_varint(buf, *FIELD_PTR(base, offset, pa_usec_t));
+        return;
+    case SCHEMA_SAMPLE_SPEC: {
+        const pa_sample_spec* spec = FIELD_PTR(base, offset, pa_sample_spec);
+        put_varint(buf, (uint32_t) (spec->format + 1));
+        put_varint(buf, spec->rate);
+        put_varint(buf, spec->channels);
+        return;
+    }
+    case SCHEMA_CHANNEL_MAP: {
+        const pa_channel_map* map = FIELD_PTR(base, offset, pa_channel_map);
+        put_varint(buf, map->channels);
+        for (int i = 0; i < map->channels; ++i) {
+            put_varint(buf, (uint32_t) (map->map[i] + 1));
+        }
+        return;
+    }
+    case SCHEMA_CVOLUME: {
+        const pa_cvolume* volume = FIELD_PTR(base, offset, pa_cvolume);
+        put_varint(buf, volume->channels);
+        for (int i = 0; i < volume->channels; ++i) {
+            put_varint(buf, volume->values[i]);
+        }
+        return;
+    }
+    case SCHEMA_PROPLIST:
+        put_proplist(buf, *FIELD_PTR(base, offset, pa_proplist*));
+        return;
+    case SCHEMA_OBJECT:
+        put_object(buf, field->item, *FIELD_PTR(base, offset, void* const));
+        return;
+    case SCHEMA_LIST: {
+        uint32_t count = list_count(field, base);
+        const void* active = list_active(field, base);
+        uint32_t active_position = 0;
+
+        put_varint(buf, count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const void* item = list_item(field, base, i);
+            put_object(buf, field->item, item);
+            if (active != NULL && item == active) {
+                active_position = i + 1;
+            }
+        }
+        put_varint(buf, active_position);
+        return;
+    }
+    }
+}
+
+
+void schema_encode(GByteArray* buf, const schema* s, const void* base, schema_mask mask) {
+    schema_mask present = 0;
+    for (size_t i = 0; i < s->n_fields; ++i) {
+        if ((mask & ((schema_mask) 1 << i)) && field_present(&s->fields[i], base)) {
+            present |= (schema_mask) 1 << i;
+        }
+    }
+
+    put_varint(buf, present);
+    for (size_t i = 0; i < s->n_fields; ++i) {
+        if (present & ((schema_mask) 1 << i)) {
+            put_field(buf, &s->fields[i], base);
+        }
+    }
+}
+
+
+// Binary decoding
+
+
+#define FIELD_MUT(base, offset, type) ((type*) ((char*) (base) + (offset)))
+
+
+typedef struct decoder {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    bool failed;
+} decoder;
+
+
+static uint64_t get_varint(decoder* d) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && d->pos < d->len; shift += 7) {
+        uint8_t byte = d->data[d->pos++];
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+
+    d->failed = true;
+    return 0;
+}
+
+
+static uint32_t get_u32(decoder* d) {
+    uint64_t value = get_varint(d);
+    if (value > UINT32_MAX) {
+        d->failed = true;
+        return 0;
+    }
+    return (uint32_t) value;
+}
+
+
+// Reverses the offset by one of indices and `int` fields.
+static uint32_t get_shifted(decoder* d) {
+    return get_u32(d) - 1;
+}
+
+
+// Returns a newly allocated copy of the bytes, with a terminating `\0` that isn't counted in `len`.
+static char* get_bytes(decoder* d, size_t* len) {
+    uint64_t size = get_varint(d);
+    *len = 0;
+    if (d->failed || size == 0) {
+        return NULL;
+    }
+    if (size - 1 > d->len - d->pos) {
+        d->failed = true;
+        return NULL;
+    }
+
+    *len = (size_t) (size - 1);
+    char* bytes = g_malloc(*len + 1);
+    memcpy(bytes, d->data + d->pos, *len);
+    bytes[*len] = '\0';
+    d->pos += *len;
+    return bytes;
+}
+
+
+static char* get_string(decoder* d) {
+    size_t len;
+    return get_bytes(d, &len);
+}
+
+
+static pa_proplist* get_proplist(decoder* d) {
+    uint64_t size = get_varint(d);
+    if (d->failed || size == 0) {
+        return NULL;
+    }
+
+    pa_proplist* plist = pa_proplist_new();
+    for (uint64_t i = 1; i < size && !d->failed; ++i) {
+        size_t len;
+        char* key = get_string(d);
+        char* data = get_bytes(d, &len);
+        if (key == NULL || data == NULL || pa_proplist_set(plist, key, data, len) < 0) {
+            d->failed = true;
+        }
+        g_free(key);
+        g_free(data);
+    }
+    return plist;
+}
+
+
+static void decode_fields(decoder*, const schema*, void*);
+
+
+static void* get_object(decoder* d, const schema* s) {
+    switch (get_varint(d)) {
+    case 0:
+        return NULL;
+    case 1: {
+        void* object = g_malloc0(s->size);
+        decode_fields(d, s, object);
+        return object;
+    }
+    default:
+        d->failed = true;
+        return NULL;
+    }
+}
+
+
+static void set_list_count(const schema_field* field, void* base, uint32_t count) {
+    switch (field->count_size) {
+    case sizeof(uint8_t):
+        *FIELD_MUT(base, field->count_offset, uint8_t) = (uint8_t) count;
+        return;
+    case sizeof(uint16_t):
+        *FIELD_MUT(base, field->count_offset, uint16_t) = (uint16_t) count;
+        return;
+    default:
+        *FIELD_MUT(base, field->count_offset, uint32_t) = count;
+        return;
+    }
+}
+
+
+static void get_list(decoder* d, const schema_field* field, void* base) {
+    uint32_t count = get_u32(d);
+    // Every item takes at least one byte, so a longer list can only come from corrupt data.
+    bool fits = field->count_size >= sizeof(uint32_t) || count >> (8 * field->count_size) == 0;
+    if (d->failed || !fits || count > d->len - d->pos) {
+        d->failed = true;
+        return;
+    }
+
+    // The list is stored before its items are read, so that `schema_clear` finds them when an item fails.
+    void** items = g_new0(void*, count);
+    *FIELD_MUT(base, field->offset, void**) = items;
+    set_list_count(field, base, count);
+
+    for (uint32_t i = 0; i < count && !d->failed; ++i) {
+        items[i] = get_object(d, field->item);
+    }
+
+    uint32_t active = get_u32(d);
+    if (active > count) {
+        d->failed = true;
+    } else if (field->has_active) {
+        *FIELD_MUT(base, field->active_offset, void*) = active > 0 ? items[active - 1] : NULL;
+    }
+}
+
+
+static void get_field(decoder* d, const schema_field* field, void* base) {
+    size_t offset = field->offset;
+
+    switch (field->type) {
+    case SCHEMA_STRING:
+        *FIELD_MUT(base, offset, char*) = get_string(d);
+        return;
+    case SCHEMA_INDEX:
+        *FIELD_MUT(base, offset, uint32_t) = get_shifted(d);
+        return;
+    case SCHEMA_UINT32:
+        *FIELD_MUT(base, offset, uint32_t) = get_u32(d);
+        return;
+    case SCHEMA_INT:
+        *FIELD_MUT(base, offset, int) = (int) get_shifted(d);
+        return;
+    case SCHEMA_BOOLEAN:
+        *FIELD_MUT(base, offset, int) = get_varint(d) != 0;
+        return;
+    case SCHEMA_USEC:
+        *FIELD_MUT(base, offset, pa_usec_t) = get_varint(d);
+        return;
+    case SCHEMA_SAMPLE_SPEC: {
+        pa_sample_spec* spec = FIELD_MUT(base, offset, pa_sample_spec);
+        spec->format = (pa_sample_format_t) (int) get_shifted(d);
+        spec->rate = get_u32(d);
+        spec->channels = (uint8_t) get_u32(d);
+        return;
+    }
+    case SCHEMA_CHANNEL_MAP: {
+        pa_channel_map* map = FIELD_MUT(base, offset, pa_channel_map);
+        uint32_t channels = get_u32(d);
+        if (channels > PA_CHANNELS_MAX) {
+            d->failed = true;
+            return;
+        }
+        map->channels = (uint8_t) channels;
+        for (int i = 0; i < map->channels; ++i) {
+            map->map[i] = (pa_channel_position_t) (int) get_shifted(d);
+        }
+        return;
+    }
+    case SCHEMA_CVOLUME: {
+        pa_cvolume* volume = FIELD_MUT(base, offset, pa_cvolume);
+        uint32_t channels = get_u32(d);
+        if (channels > PA_CHANNELS_MAX) {
+            d->failed = true;
+            return;
+        }
+        volume->channels = (uint8_t) channels;
+        for (int i = 0; i < volume->channels; ++i) {
+            volume->values[i] = get_u32(d);
+        }
+        return;
+    }
+    case SCHEMA_PROPLIST:
+        *FIELD_MUT(base, offset, pa_proplist*) = get_proplist(d);
+        return;
+    case SCHEMA_OBJECT:
+        *FIELD_MUT(base, offset, void*) = get_object(d, field->item);
+        return;
+    case SCHEMA_LIST:
+        get_list(d, field, base);
+        return;
+    }
+}
+
+
+static void decode_fields(decoder* d, const schema* s, void* base) {
+    uint64_t present = get_varint(d);
+    if (s->n_fields < SCHEMA_FIELDS_MAX && present >> s->n_fields) {
+        d->failed = true;
+        return;
+    }
+
+    for (size_t i = 0; i < s->n_fields && !d->failed; ++i) {
+        const schema_field* field = &s->fields[i];
+        if (!(present & ((schema_mask) 1 << i))) {
+            continue;
+        }
+
+        get_field(d, field, base);
+        if (field->has_flag) {
+            *FIELD_MUT(base, field->flag_offset, int) = 1;
+        }
+    }
+}
+
+
+size_t schema_decode(const schema* s, void* base, const uint8_t* data, size_t len) {
+    decoder d = { data, len, 0, false };
+    decode_fields(&d, s, base);
+
+    if (d.failed) {
+        schema_clear(s, base);
+        return 0;
+    }
+    return d.pos;
+}
+
+
+static void clear_object(const schema* s, void* object) {
+    if (object != NULL) {
+        schema_clear(s, object);
+        g_free(object);
+    }
+}
+
+
+void schema_clear(const schema* s, void* base) {
+    for (size_t i = 0; i < s->n_fields; ++i) {
+        const schema_field* field = &s->fields[i];
+        size_t offset = field->offset;
+
+        switch (field->type) {
+        case SCHEMA_STRING:
+            g_free(*FIELD_MUT(base, offset, char*));
+            *FIELD_MUT(base, offset, char*) = NULL;
+            break;
+        case SCHEMA_PROPLIST:
+            if (*FIELD_MUT(base, offset, pa_proplist*) != NULL) {
+                pa_proplist_free(*FIELD_MUT(base, offset, pa_proplist*));
+                *FIELD_MUT(base, offset, pa_proplist*) = NULL;
+            }
+            break;
+        case SCHEMA_OBJECT:
+            clear_object(field->item, *FIELD_MUT(base, offset, void*));
+            *FIELD_MUT(base, offset, void*) = NULL;
+            break;
+        case SCHEMA_LIST: {
+            void** items = *FIELD_MUT(base, offset, void**);
+            if (items != NULL) {
+                uint32_t count = list_count(field, base);
+                for (uint32_t j = 0; j < count; ++j) {
+                    clear_object(field->item, items[j]);
+                }
+                g_free(items);
+            }
+            *FIELD_MUT(base, offset, void**) = NULL;
+            set_list_count(field, base, 0);
+            if (field->has_active) {
+                *FIELD_MUT(base, field->active_offset, void*) = NULL;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,134 @@
+/* Compile-time descriptions of the `pa_*_info` structs, and of the graph mirror's entries.
+ *
+ * A `schema` lists the fields of a struct once, with their offset, type and Lua name. Everything that walks
+ * an info struct is written against schemas instead of the individual structs: converting to a Lua table,
+ * converting only some of the fields, comparing two infos field by field and encoding them into a compact
+ * binary form and back. The schemas of the info structs are defined in `convert.c`.
+ *
+ * Fields are selected by a `schema_mask`, where bit `i` stands for the schema's `i`-th field.
+ */
+#pragma once
+
+#include <glib.h>
+#include <lua.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Schemas can't have more fields than bits in a `schema_mask`.
+#define SCHEMA_FIELDS_MAX 64
+#define SCHEMA_MASK_ALL   (~(schema_mask) 0)
+
+typedef uint64_t schema_mask;
+
+
+typedef enum schema_type {
+    // A `const char*`, which may be `NULL`.
+    SCHEMA_STRING = 0,
+    // A 0-based `uint32_t` index, which Lua sees 1-based.
+    SCHEMA_INDEX,
+    SCHEMA_UINT32,
+    // An `int`, or an enum of the same size.
+    SCHEMA_INT,
+    // An `int` that Lua sees as boolean.
+    SCHEMA_BOOLEAN,
+    SCHEMA_USEC,
+    SCHEMA_SAMPLE_SPEC,
+    SCHEMA_CHANNEL_MAP,
+    SCHEMA_CVOLUME,
+    SCHEMA_PROPLIST,
+    // A pointer to a struct that is described by `item`.
+    SCHEMA_OBJECT,
+    // An array of `count` pointers to structs that are described by `item`.
+    SCHEMA_LIST,
+} schema_type;
+
+
+typedef struct schema_field {
+    const char* name;
+    schema_type type;
+    size_t offset;
+    const struct schema* item;
+    // For `SCHEMA_LIST`, where the number of items is stored, and its size in bytes.
+    size_t count_offset;
+    size_t count_size;
+    // For `SCHEMA_LIST`, an optional pointer to the active item, which is also stored as `active` in the Lua list.
+    bool has_active;
+    size_t active_offset;
+    // Fields that only exist while the `int` at `flag_offset` is set, such as the volume of a sink input.
+    bool has_flag;
+    size_t flag_offset;
+} schema_field;
+
+
+typedef struct schema {
+    // The C type, for error messages.
+    const char* name;
+    const schema_field* fields;
+    size_t n_fields;
+    // The size of the C type, to allocate nested objects when decoding.
+    size_t size;
+} schema;
+
+
+#define SCHEMA_FIELD(T, member, kind)                                                                                  \
+    { .name = #member, .type = SCHEMA_##kind, .offset = offsetof(T, member) }
+
+#define SCHEMA_FIELD_IF(T, member, kind, flag)                                                                         \
+    { .name = #member, .type = SCHEMA_##kind, .offset = offsetof(T, member), .has_flag = true,                         \
+      .flag_offset = offsetof(T, flag) }
+
+#define SCHEMA_OBJECT_FIELD(T, member, item_schema)                                                                    \
+    { .name = #member, .type = SCHEMA_OBJECT, .offset = offsetof(T, member), .item = &item_schema }
+
+#define SCHEMA_LIST_FIELD(T, member, item_schema, count)                                                               \
+    { .name = #member, .type = SCHEMA_LIST, .offset = offsetof(T, member), .item = &item_schema,                       \
+      .count_offset = offsetof(T, count), .count_size = sizeof(((T*) 0)->count) }
+
+#define SCHEMA_LIST_FIELD_ACTIVE(T, member, item_schema, count, active)                                                \
+    { .name = #member, .type = SCHEMA_LIST, .offset = offsetof(T, member), .item = &item_schema,                       \
+      .count_offset = offsetof(T, count), .count_size = sizeof(((T*) 0)->count), .has_active = true,                   \
+      .active_offset = offsetof(T, active) }
+
+// Defines the schema `name` for the struct `T`. `FIELDS(T)` has to expand to a list of the field macros above.
+#define DEFINE_SCHEMA(name, T, FIELDS)                                                                                 \
+    static const schema_field name##_fields[] = { FIELDS(T) };                                                         \
+    _Static_assert(G_N_ELEMENTS(name##_fields) <= SCHEMA_FIELDS_MAX, #T " has too many fields for a schema_mask");     \
+    const schema name = { #T, name##_fields, G_N_ELEMENTS(name##_fields), sizeof(T) }
+
+
+// Pushes a table with all fields of the struct onto the stack.
+void schema_to_lua(lua_State*, const schema*, const void*);
+
+// Pushes a table with only the fields in the mask onto the stack.
+void schema_project(lua_State*, const schema*, const void*, schema_mask);
+
+// Reads a list of field names at the given argument into a mask. Raises an error for unknown names.
+schema_mask schema_check_mask(lua_State*, int, const schema*);
+
+// Compares the fields in the mask of two structs, and returns the mask of the ones that differ.
+// Nested objects and lists are compared as a whole.
+schema_mask schema_diff(const schema*, const void*, const void*, schema_mask);
+
+/* Appends the fields in the mask to the buffer.
+ *
+ * The encoding starts with the mask of the fields that follow, which leaves out the ones whose flag isn't set.
+ * Integers are written as unsigned LEB128, with indices and `int` fields offset by one so that
+ * `PA_INVALID_INDEX` and `-1` stay short. Strings are written as length plus one, followed by the bytes, with
+ * `0` for `NULL`. Proplists are written as their size plus one, followed by pairs of key and raw value.
+ * Nested objects are written as `0` for `NULL`, or `1` followed by all their fields. Lists are written as their
+ * length, the items, and the position of the active item, or `0`.
+ */
+void schema_encode(GByteArray*, const schema*, const void*, schema_mask);
+
+/* Reads fields written by `schema_encode` into a zeroed struct.
+ *
+ * Strings, proplists, nested objects and lists are allocated, and have to be freed with `schema_clear`. Fields
+ * with a flag set it when they are present. Returns the number of bytes read, or `0` if the data is truncated
+ * or invalid, in which case the struct is cleared again.
+ */
+size_t schema_decode(const schema*, void*, const uint8_t*, size_t);
+
+// Frees what `schema_decode` allocated, and resets the pointers and list counts. Structs owned by libpulse must
+// not be passed here.
+void schema_clear(const schema*, void*);
@@ -0,0 +1,558 @@
+#include "snapshot.h"
+
+#include "lua_util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// How often readers check for the publisher to finish writing, and how often they retry a read that raced
+// with a write, before giving up with "snapshot busy".
+#define SNAPSHOT_READ_SPINS   1000
+#define SNAPSHOT_READ_RETRIES 100
+
+
+char* snapshot_default_path(void) {
+    return g_build_filename(g_get_user_runtime_dir(), "lua_libpulse_glib", "graph.shm", NULL);
+}
+
+
+static void snapshot_write_entries(snapshot_layout* layout, const mirror* m) {
+    uint32_t n = 0;
+
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        GArray* entries = m->entries[kind];
+        for (guint i = 0; i < entries->len && n < SNAPSHOT_ENTRIES_MAX; ++i) {
+            const mirror_entry* entry = &g_array_index(entries, mirror_entry, i);
+            snapshot_entry* out = &layout->entries[n++];
+
+            out->index = entry->index;
+            out->parent = entry->parent;
+            out->kind = (uint8_t) kind;
+            out->mute = entry->mute;
+            out->has_volume = entry->has_volume;
+            out->channels = entry->has_volume ? entry->volume.channels : 0;
+            memcpy(out->values, entry->volume.values, sizeof(out->values));
+            g_strlcpy(out->name, entry->name != NULL ? entry->name : "", SNAPSHOT_STRING_MAX);
+            g_strlcpy(out->description, entry->description != NULL ? entry->description : "", SNAPSHOT_STRING_MAX);
+        }
+    }
+
+    layout->n_entries = n;
+}
+
+
+// Writes the mirror's content inside a write section of the sequence lock.
+static void snapshot_publish(snapshot_publisher* pub, bool active) {
+    snapshot_layout* layout = pub->layout;
+    uint32_t sequence = atomic_load_explicit(&layout->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&layout->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    layout->magic = SNAPSHOT_MAGIC;
+    layout->version = SNAPSHOT_VERSION;
+    layout->active = active;
+    layout->generation = pub->mirror->generation;
+    g_strlcpy(layout->default_sink, pub->mirror->default_sink != NULL ? pub->mirror->default_sink : "",
+              SNAPSHOT_STRING_MAX);
+    g_strlcpy(layout->default_source, pub->mirror->default_source != NULL ? pub->mirror->default_source : "",
+              SNAPSHOT_STRING_MAX);
+    snapshot_write_entries(layout, pub->mirror);
+
+    atomic_store_explicit(&layout->sequence, sequence + 2, memory_order_release);
+
+    // Writes through a shared mapping don't generate inotify events. Touching the file's timestamps does,
+    // and readers that watch the file get an `IN_ATTRIB` event.
+    futimens(pub->fd, NULL);
+}
+
+
+static gboolean snapshot_publish_idle(gpointer userdata) {
+    snapshot_publisher* pub = (snapshot_publisher*) userdata;
+    pub->source_id = 0;
+    snapshot_publish(pub, true);
+    return G_SOURCE_REMOVE;
+}
+
+
+// A single event may change the mirror several times, and events tend to come in bursts.
+// Publishing is deferred to an idle source, so that readers get one update per main loop iteration.
+static void snapshot_mirror_changed(mirror* m, void* userdata) {
+    snapshot_publisher* pub = (snapshot_publisher*) userdata;
+    if (pub->source_id == 0) {
+        pub->source_id = g_idle_add(snapshot_publish_idle, pub);
+    }
+}
+
+
+snapshot_publisher* snapshot_publisher_new(mirror* m, const char* path, char** error) {
+    char* dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        *error = g_strdup_printf("%s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    // The file is never shrunk, as readers may still have a previous publisher's content mapped.
+    if (ftruncate(fd, sizeof(snapshot_layout)) != 0) {
+        *error = g_strdup_printf("%s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    void* map = mmap(NULL, sizeof(snapshot_layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        *error = g_strdup_printf("%s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    snapshot_publisher* pub = g_new0(snapshot_publisher, 1);
+    pub->mirror = m;
+    pub->path = g_strdup(path);
+    pub->fd = fd;
+    pub->layout = (snapshot_layout*) map;
+
+    // An odd sequence number would be left behind by a publisher that crashed while writing.
+    uint32_t sequence = atomic_load_explicit(&pub->layout->sequence, memory_order_relaxed);
+    if (sequence & 1) {
+        atomic_store_explicit(&pub->layout->sequence, sequence + 1, memory_order_relaxed);
+    }
+
+    m->changed_cb = snapshot_mirror_changed;
+    m->changed_data = pub;
+
+    snapshot_publish(pub, true);
+    return pub;
+}
+
+
+void snapshot_publisher_free(snapshot_publisher* pub) {
+    if (pub->source_id != 0) {
+        g_source_remove(pub->source_id);
+    }
+
+    pub->mirror->changed_cb = NULL;
+    pub->mirror->changed_data = NULL;
+
+    snapshot_publish(pub, false);
+
+    munmap(pub->layout, sizeof(snapshot_layout));
+    close(pub->fd);
+    g_free(pub->path);
+    g_free(pub);
+}
+
+
+// Waits for the publisher to leave its write section and stores the sequence number to validate against.
+// The write section is short and doesn't block, so spinning is cheaper than any kind of wait. A publisher that
+// died or stalled while writing would keep the number odd forever, so this gives up after a while and
+// returns `false`.
+static bool snapshot_read_begin(const snapshot_layout* layout, uint32_t* sequence) {
+    for (int i = 0; i < SNAPSHOT_READ_SPINS; ++i) {
+        *sequence = atomic_load_explicit(&layout->sequence, memory_order_acquire);
+        if (!(*sequence & 1)) {
+            return true;
+        }
+        g_thread_yield();
+    }
+    return false;
+}
+
+
+// Returns `true` when the data read since `snapshot_read_begin` may be inconsistent.
+static bool snapshot_read_retry(const snapshot_layout* layout, uint32_t sequence) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&layout->sequence, memory_order_relaxed) != sequence;
+}
+
+
+static void snapshot_push_string(lua_State* L, const char* str) {
+    lua_pushlstring(L, str, strnlen(str, SNAPSHOT_STRING_MAX));
+}
+
+
+static void snapshot_entry_to_lua(lua_State* L, const snapshot_entry* entry) {
+    lua_createtable(L, 0, 6);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "index");
+    lua_pushinteger(L, entry->index + 1);
+    lua_settable(L, table_index);
+
+    if (entry->parent != PA_INVALID_INDEX) {
+        lua_pushstring(L, "parent");
+        lua_pushinteger(L, entry->parent + 1);
+        lua_settable(L, table_index);
+    }
+
+    lua_pushstring(L, "name");
+    snapshot_push_string(L, entry->name);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "description");
+    snapshot_push_string(L, entry->description);
+    lua_settable(L, table_index);
+
+    if (entry->has_volume) {
+        uint8_t channels = entry->channels <= PA_CHANNELS_MAX ? entry->channels : PA_CHANNELS_MAX;
+
+        lua_pushstring(L, "volume");
+        lua_createtable(L, channels, 0);
+        for (uint8_t i = 0; i < channels; ++i) {
+            lua_pushinteger(L, entry->values[i]);
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_settable(L, table_index);
+    }
+
+    lua_pushstring(L, "mute");
+    lua_pushboolean(L, entry->mute);
+    lua_settable(L, table_index);
+}
+
+
+static lua_pa_snapshot* snapshot_check(lua_State* L) {
+    lua_pa_snapshot* snap = luaL_checkudata(L, 1, LUA_PA_SNAPSHOT);
+    if (snap->layout == NULL) {
+        luaL_error(L, "snapshot is closed");
+    }
+    return snap;
+}
+
+
+int snapshot_open(lua_State* L) {
+    const char* path = luaL_optstring(L, 1, NULL);
+    char* default_path = NULL;
+
+    if (path == NULL) {
+        default_path = snapshot_default_path();
+        path = default_path;
+    }
+
+    const char* error = NULL;
+    void* map = MAP_FAILED;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = strerror(errno);
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            error = strerror(errno);
+        } else if ((size_t) st.st_size < sizeof(snapshot_layout)) {
+            error = "file too small";
+        } else {
+            map = mmap(NULL, sizeof(snapshot_layout), PROT_READ, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED) {
+                error = strerror(errno);
+            }
+        }
+
+        // The mapping stays valid after the descriptor is closed.
+        close(fd);
+    }
+
+    if (error == NULL) {
+        const snapshot_layout* layout = (const snapshot_layout*) map;
+        if (layout->magic != SNAPSHOT_MAGIC || layout->version != SNAPSHOT_VERSION) {
+            error = "not a snapshot file, or unsupported version";
+            munmap(map, sizeof(snapshot_layout));
+        }
+    }
+
+    if (error != NULL) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to open snapshot %s: %s", path, error);
+        g_free(default_path);
+        return 2;
+    }
+
+    lua_pa_snapshot* snap = lua_newuserdata(L, sizeof(lua_pa_snapshot));
+    if (snap == NULL) {
+        munmap(map, sizeof(snapshot_layout));
+        g_free(default_path);
+        return luaL_error(L, "failed to create snapshot userdata");
+    }
+
+    snap->path = g_strdup(path);
+    snap->layout = (const snapshot_layout*) map;
+    snap->watch_fd = -1;
+    snap->watch_id = 0;
+    snap->watch_data = NULL;
+    g_free(default_path);
+
+    luaL_getmetatable(L, LUA_PA_SNAPSHOT);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+
+int snapshot_read(lua_State* L) {
+    lua_pa_snapshot* snap = snapshot_check(L);
+    const snapshot_layout* layout = snap->layout;
+
+    snapshot_entry* entries = g_new(snapshot_entry, SNAPSHOT_ENTRIES_MAX);
+    char default_sink[SNAPSHOT_STRING_MAX];
+    char default_source[SNAPSHOT_STRING_MAX];
+    uint64_t generation;
+    uint32_t n_entries;
+    uint32_t sequence;
+    bool active;
+    int attempts = 0;
+
+    do {
+        if (!snapshot_read_begin(layout, &sequence) || ++attempts > SNAPSHOT_READ_RETRIES) {
+            g_free(entries);
+            lua_pushnil(L);
+            lua_pushstring(L, "snapshot busy");
+            return 2;
+        }
+
+        n_entries = layout->n_entries;
+        if (n_entries > SNAPSHOT_ENTRIES_MAX) {
+            n_entries = SNAPSHOT_ENTRIES_MAX;
+        }
+
+        active = layout->active;
+        generation = layout->generation;
+        memcpy(default_sink, layout->default_sink, SNAPSHOT_STRING_MAX);
+        memcpy(default_source, layout->default_source, SNAPSHOT_STRING_MAX);
+        memcpy(entries, layout->entries, n_entries * sizeof(snapshot_entry));
+    } while (snapshot_read_retry(layout, sequence));
+
+    lua_createtable(L, 0, 9);
+    int table_index = lua_gettop(L);
+
+    lua_pushstring(L, "active");
+    lua_pushboolean(L, active);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "generation");
+    lua_pushinteger(L, (lua_Integer) generation);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "default_sink_name");
+    snapshot_push_string(L, default_sink);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "default_source_name");
+    snapshot_push_string(L, default_source);
+    lua_settable(L, table_index);
+
+    // Entries are stored grouped by kind, in the same order as the `mirror_kind` enum.
+    int kind_index[MIRROR_KIND_MAX];
+    for (int kind = 0; kind < MIRROR_KIND_MAX; ++kind) {
+        lua_newtable(L);
+        kind_index[kind] = lua_gettop(L);
+    }
+
+    for (uint32_t i = 0; i < n_entries; ++i) {
+        const snapshot_entry* entry = &entries[i];
+        if (entry->kind >= MIRROR_KIND_MAX) {
+            continue;
+        }
+
+        int list_index = kind_index[entry->kind];
+        snapshot_entry_to_lua(L, entry);
+        lua_rawseti(L, list_index, lua_rawlen(L, list_index) + 1);
+    }
+
+    lua_pushstring(L, "source_outputs");
+    lua_insert(L, -2);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "sink_inputs");
+    lua_insert(L, -2);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "sources");
+    lua_insert(L, -2);
+    lua_settable(L, table_index);
+
+    lua_pushstring(L, "sinks");
+    lua_insert(L, -2);
+    lua_settable(L, table_index);
+
+    g_free(entries);
+    return 1;
+}
+
+
+int snapshot_lookup(lua_State* L) {
+    lua_pa_snapshot* snap = snapshot_check(L);
+    const char* kind_name = luaL_checkstring(L, 2);
+    const snapshot_layout* layout = snap->layout;
+
+    int kind = 0;
+    while (kind < MIRROR_KIND_MAX && strcmp(kind_name, mirror_kind_to_string(kind)) != 0) {
+        ++kind;
+    }
+    luaL_argcheck(L, kind < MIRROR_KIND_MAX, 2, "unknown kind");
+
+    const char* name = NULL;
+    uint32_t index = PA_INVALID_INDEX;
+    if (lua_type(L, 3) == LUA_TNUMBER) {
+        index = (uint32_t) lua_tointeger(L, 3) - 1;
+    } else {
+        name = luaL_checkstring(L, 3);
+    }
+
+    snapshot_entry entry;
+    bool found;
+    uint32_t sequence;
+    int attempts = 0;
+
+    do {
+        if (!snapshot_read_begin(layout, &sequence) || ++attempts > SNAPSHOT_READ_RETRIES) {
+            lua_pushnil(L);
+            lua_pushstring(L, "snapshot busy");
+            return 2;
+        }
+        found = false;
+
+        uint32_t n_entries = layout->n_entries;
+        if (n_entries > SNAPSHOT_ENTRIES_MAX) {
+            n_entries = SNAPSHOT_ENTRIES_MAX;
+        }
+
+        for (uint32_t i = 0; i < n_entries; ++i) {
+            const snapshot_entry* candidate = &layout->entries[i];
+            if (candidate->kind != kind) {
+                continue;
+            }
+
+            if (name != NULL ? strncmp(candidate->name, name, SNAPSHOT_STRING_MAX) == 0 : candidate->index == index) {
+                memcpy(&entry, candidate, sizeof(snapshot_entry));
+                found = true;
+                break;
+            }
+        }
+    } while (snapshot_read_retry(layout, sequence));
+
+    if (!found) {
+        lua_pushnil(L);
+    } else {
+        snapshot_entry_to_lua(L, &entry);
+    }
+
+    return 1;
+}
+
+
+int snapshot_sequence(lua_State* L) {
+    lua_pa_snapshot* snap = snapshot_check(L);
+
+    uint32_t sequence;
+    if (!snapshot_read_begin(snap->layout, &sequence)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "snapshot busy");
+        return 2;
+    }
+
+    lua_pushinteger(L, sequence);
+    return 1;
+}
+
+
+static gboolean snapshot_watch_callback(gint fd, GIOCondition condition, gpointer userdata) {
+    lua_pa_snapshot* snap = (lua_pa_snapshot*) userdata;
+    char buffer[sizeof(struct inotify_event) * 16];
+
+    // Drain all pending events. Several updates result in a single call.
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+
+    // A publisher that stalled mid-write has nothing new to report. Finishing the write triggers another event.
+    uint32_t sequence;
+    if (!snapshot_read_begin(snap->layout, &sequence)) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    lua_State* L = snap->watch_data->L;
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, sequence);
+    lua_call(L, 1, 0);
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+static void snapshot_unwatch(lua_pa_snapshot* snap) {
+    if (snap->watch_id != 0) {
+        g_source_remove(snap->watch_id);
+        snap->watch_id = 0;
+    }
+
+    if (snap->watch_fd >= 0) {
+        close(snap->watch_fd);
+        snap->watch_fd = -1;
+    }
+
+    if (snap->watch_data != NULL) {
+        free_lua_callback(snap->watch_data);
+        snap->watch_data = NULL;
+    }
+}
+
+
+int snapshot_watch(lua_State* L) {
+    lua_pa_snapshot* snap = snapshot_check(L);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    snapshot_unwatch(snap);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to watch snapshot: %s", strerror(errno));
+        return 2;
+    }
+
+    if (inotify_add_watch(fd, snap->path, IN_ATTRIB | IN_MODIFY) < 0) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to watch snapshot: %s", strerror(errno));
+        close(fd);
+        return 2;
+    }
+
+    snap->watch_fd = fd;
+    snap->watch_data = prepare_lua_callback(L, 2);
+    snap->watch_id = g_unix_fd_add(fd, G_IO_IN, snapshot_watch_callback, snap);
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+
+int snapshot_close(lua_State* L) {
+    lua_pa_snapshot* snap = luaL_checkudata(L, 1, LUA_PA_SNAPSHOT);
+
+    snapshot_unwatch(snap);
+
+    if (snap->layout != NULL) {
+        munmap((void*) snap->layout, sizeof(snapshot_layout));
+        snap->layout = NULL;
+    }
+
+    g_free(snap->path);
+    snap->path = NULL;
+
+    return 0;
+}
+
+
+int snapshot__gc(lua_State* L) {
+    return snapshot_close(L);
+}
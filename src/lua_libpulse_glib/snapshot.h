@@ -0,0 +1,190 @@
+/** Read-only access to an audio graph published by another process.
+ *
+ * A process that is connected to the server can publish its audio graph with @{Context:publish_graph}.
+ * The graph is written to a memory-mapped file, which any number of other processes can open with this module.
+ * Reading from a @{Snapshot} neither needs a connection to the server nor makes any system calls.
+ *
+ * The file is guarded by a sequence lock: the publisher makes the sequence number odd while it writes,
+ * and readers retry until they get a consistent copy.
+ *
+ *    local snapshot = require("lua_libpulse_glib.snapshot")
+ *    local snap = assert(snapshot.open())
+ *    local sink = snap:lookup("sink", "alsa_output.pci-0000_00_1f.3.analog-stereo")
+ *
+ * @module lua_libpulse_glib.snapshot
+ */
+#pragma once
+
+#include "callback.h"
+#include "mirror.h"
+
+#include <glib.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <pulse/sample.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LUA_PA_SNAPSHOT "pulseaudio.snapshot"
+
+#define SNAPSHOT_MAGIC   0x534e504cU // "LPNS"
+#define SNAPSHOT_VERSION 1
+
+// Longer strings are truncated.
+#define SNAPSHOT_STRING_MAX 128
+// Entries beyond this are not published.
+#define SNAPSHOT_ENTRIES_MAX 256
+
+
+typedef struct snapshot_entry {
+    uint32_t index;
+    uint32_t parent;
+    uint8_t kind;
+    uint8_t mute;
+    uint8_t has_volume;
+    uint8_t channels;
+    uint32_t values[PA_CHANNELS_MAX];
+    char name[SNAPSHOT_STRING_MAX];
+    char description[SNAPSHOT_STRING_MAX];
+} snapshot_entry;
+
+
+// The layout of the shared file. All values are in native byte order.
+typedef struct snapshot_layout {
+    uint32_t magic;
+    uint32_t version;
+    // Odd while the publisher is writing.
+    _Atomic uint32_t sequence;
+    // Cleared when the publisher stops. The file is kept, so that readers pick up a new publisher.
+    uint32_t active;
+    uint32_t n_entries;
+    uint64_t generation;
+    char default_sink[SNAPSHOT_STRING_MAX];
+    char default_source[SNAPSHOT_STRING_MAX];
+    snapshot_entry entries[SNAPSHOT_ENTRIES_MAX];
+} snapshot_layout;
+
+
+typedef struct snapshot_publisher {
+    mirror* mirror;
+    char* path;
+    int fd;
+    snapshot_layout* layout;
+    // The idle source that coalesces changes within a main loop iteration.
+    guint source_id;
+} snapshot_publisher;
+
+
+typedef struct lua_pa_snapshot {
+    char* path;
+    const snapshot_layout* layout;
+    // The inotify descriptor and its GSource, while watched.
+    int watch_fd;
+    guint watch_id;
+    simple_callback_data* watch_data;
+} lua_pa_snapshot;
+
+
+// Returns a newly allocated path to the default snapshot file. Free with `g_free`.
+char* snapshot_default_path(void);
+
+// Creates the shared file and publishes the mirror's content whenever it changes.
+// On failure, returns `NULL` and sets the error message, which must be freed with `g_free`.
+snapshot_publisher* snapshot_publisher_new(mirror*, const char*, char**);
+
+// Stops publishing. The shared file is kept, but marked as inactive.
+void snapshot_publisher_free(snapshot_publisher*);
+
+
+/** Opens a published audio graph.
+ *
+ * @function open
+ * @tparam[opt] string path The shared file. Defaults to the same path as @{Context:publish_graph}.
+ * @treturn[opt] Snapshot
+ * @treturn[opt] string The error message.
+ */
+int snapshot_open(lua_State*);
+
+
+/// Snapshot
+/// @type Snapshot
+
+
+/** Returns a consistent copy of the whole graph.
+ *
+ * The table has the same shape as the one returned by @{Context:get_graph}, except that volumes are plain lists
+ * of channel values, so that this module doesn't depend on the @{lua_libpulse_glib.volume} module.
+ * It also has a `generation` field, which changes whenever the publisher's graph changes.
+ *
+ * Fails with `"snapshot busy"` when the publisher doesn't finish writing in time, e.g. because it died
+ * in the middle of an update.
+ *
+ * @function Snapshot:read
+ * @treturn[opt] table
+ * @treturn[opt] string The error message.
+ */
+int snapshot_read(lua_State*);
+
+/** Finds a single entry.
+ *
+ * @function Snapshot:lookup
+ * @tparam string kind One of `"sink"`, `"source"`, `"sink_input"` or `"source_output"`.
+ * @tparam number|string entry The index or name of the entry.
+ * @treturn table|nil The entry, or `nil` if it doesn't exist.
+ * @treturn[opt] string The error message, if the snapshot was busy. See @{Snapshot:read}.
+ */
+int snapshot_lookup(lua_State*);
+
+/** Returns the current sequence number.
+ *
+ * This is a cheap way to poll for changes: the number is different after every update.
+ *
+ * @function Snapshot:sequence
+ * @treturn[opt] number
+ * @treturn[opt] string The error message, if the snapshot was busy. See @{Snapshot:read}.
+ */
+int snapshot_sequence(lua_State*);
+
+/** Calls a function whenever the publisher writes an update.
+ *
+ * Notifications are received through inotify and dispatched on the GLib Main Loop. Calling this again
+ * replaces the previous function.
+ *
+ * @function Snapshot:watch
+ * @tparam function cb The callback, which receives the new sequence number.
+ * @treturn[opt] boolean
+ * @treturn[opt] string The error message.
+ */
+int snapshot_watch(lua_State*);
+
+/** Unmaps the shared file and stops watching it.
+ *
+ * This is also done when the snapshot is garbage collected.
+ *
+ * @function Snapshot:close
+ */
+int snapshot_close(lua_State*);
+int snapshot__gc(lua_State*);
+
+
+static const struct luaL_Reg snapshot_f[] = {
+    {"read",      snapshot_read    },
+    { "lookup",   snapshot_lookup  },
+    { "sequence", snapshot_sequence},
+    { "watch",    snapshot_watch   },
+    { "close",    snapshot_close   },
+    { NULL,       NULL             }
+};
+
+
+static const struct luaL_Reg snapshot_mt[] = {
+    {"__gc", snapshot__gc},
+    { NULL,  NULL        }
+};
+
+
+static const struct luaL_Reg snapshot_lib[] = {
+    {"open", snapshot_open},
+    { NULL,  NULL         }
+};
@@ -0,0 +1,1017 @@
+#include "stream.h"
+
+#include "buffer.h"
+#include "lua_util.h"
+#include "mixdown.h"
+#include "proplist.h"
+
+#include <math.h>
+#include <pulse/def.h>
+#include <pulse/error.h>
+#include <string.h>
+
+
+void sample_spec_from_lua(lua_State* L, int index, pa_sample_spec* spec) {
+    luaL_checktype(L, index, LUA_TTABLE);
+
+    lua_getfield(L, index, "format");
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        spec->format = pa_parse_sample_format(lua_tostring(L, -1));
+    } else {
+        spec->format = (pa_sample_format_t) luaL_optinteger(L, -1, PA_SAMPLE_S16NE);
+    }
+
+    lua_getfield(L, index, "rate");
+    spec->rate = (uint32_t) luaL_optinteger(L, -1, 44100);
+
+    lua_getfield(L, index, "channels");
+    spec->channels = (uint8_t) luaL_optinteger(L, -1, 2);
+
+    lua_pop(L, 3);
+
+    if (!pa_sample_spec_valid(spec)) {
+        luaL_argerror(L, index, "invalid sample spec");
+    }
+}
+
+
+void buffer_attr_from_lua(lua_State* L, int index, const pa_sample_spec* spec, pa_buffer_attr* attr) {
+    attr->maxlength = (uint32_t) -1;
+    attr->tlength = (uint32_t) -1;
+    attr->prebuf = (uint32_t) -1;
+    attr->minreq = (uint32_t) -1;
+    attr->fragsize = (uint32_t) -1;
+
+    if (lua_isnoneornil(L, index)) {
+        return;
+    }
+
+    lua_getfield(L, index, "latency");
+    if (!lua_isnil(L, -1)) {
+        uint32_t bytes = (uint32_t) pa_usec_to_bytes(luaL_checkinteger(L, -1) * PA_USEC_PER_MSEC, spec);
+        attr->tlength = bytes;
+        attr->fragsize = bytes;
+    }
+
+    lua_getfield(L, index, "maxlength");
+    attr->maxlength = (uint32_t) luaL_optinteger(L, -1, attr->maxlength);
+    lua_getfield(L, index, "tlength");
+    attr->tlength = (uint32_t) luaL_optinteger(L, -1, attr->tlength);
+    lua_getfield(L, index, "prebuf");
+    attr->prebuf = (uint32_t) luaL_optinteger(L, -1, attr->prebuf);
+    lua_getfield(L, index, "minreq");
+    attr->minreq = (uint32_t) luaL_optinteger(L, -1, attr->minreq);
+    lua_getfield(L, index, "fragsize");
+    attr->fragsize = (uint32_t) luaL_optinteger(L, -1, attr->fragsize);
+
+    lua_pop(L, 6);
+}
+
+
+int stream_write_data(pa_stream* s, const void* data, size_t length) {
+    const unsigned char* src = data;
+    size_t written = 0;
+
+    while (written < length) {
+        void* dest;
+        size_t chunk = length - written;
+
+        // libpulse may hand out less memory than asked for, in which case the rest goes into the next chunk.
+        if (pa_stream_begin_write(s, &dest, &chunk) < 0 || dest == NULL || chunk == 0) {
+            return written > 0 ? (int) written : -PA_ERR_INVALID;
+        }
+        if (chunk > length - written) {
+            chunk = length - written;
+        }
+
+        memcpy(dest, src + written, chunk);
+
+        int ret = pa_stream_write(s, dest, chunk, NULL, 0, PA_SEEK_RELATIVE);
+        if (ret < 0) {
+            return ret;
+        }
+
+        written += chunk;
+    }
+
+    return (int) written;
+}
+
+
+static lua_pa_stream* stream_check(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    if (stream->stream == NULL) {
+        luaL_error(L, "stream is closed");
+    }
+    return stream;
+}
+
+
+static void stream_state_callback(pa_stream* s, void* userdata) {
+    lua_pa_stream* stream = (lua_pa_stream*) userdata;
+    lua_State* L = stream->data->L;
+
+    if (!lua_isfunction(L, 1)) {
+        return;
+    }
+
+    pa_stream_state_t state = pa_stream_get_state(s);
+
+    lua_pushvalue(L, 1);
+    if (state == PA_STREAM_FAILED) {
+        lua_pushstring(L, pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+    } else {
+        lua_pushnil(L);
+    }
+    lua_pushinteger(L, state);
+    lua_call(L, 2, 0);
+}
+
+
+static gboolean stream_request_dispatch(gpointer userdata) {
+    lua_pa_stream* stream = (lua_pa_stream*) userdata;
+    lua_State* L = stream->data->L;
+
+    stream->request_id = 0;
+    stream->requested = 0;
+
+    if (stream->stream == NULL || !lua_isfunction(L, 2)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    lua_pushvalue(L, 2);
+    if (stream->ring != NULL) {
+        lua_pushinteger(L, (lua_Integer) stream->ring->length);
+    } else {
+        lua_pushinteger(L, (lua_Integer) pa_stream_writable_size(stream->stream));
+    }
+    lua_call(L, 1, 0);
+
+    return G_SOURCE_REMOVE;
+}
+
+
+static void stream_write_callback(pa_stream* s, size_t nbytes, void* userdata) {
+    lua_pa_stream* stream = (lua_pa_stream*) userdata;
+
+    stream->requested += nbytes;
+    if (stream->request_id == 0) {
+        stream->request_id = g_idle_add(stream_request_dispatch, stream);
+    }
+}
+
+
+static void stream_dispatch_vad_events(lua_pa_stream* stream) {
+    vad* v = stream->vad;
+    simple_callback_data* data = stream->vad_data;
+    lua_State* L = data->L;
+    uint32_t generation = stream->vad_generation;
+    vad_event events[VAD_MAX_EVENTS];
+    size_t count = v->event_count;
+    lua_Number level = 20.0 * log10(v->rms + 1e-10);
+
+    memcpy(events, v->events, count * sizeof(vad_event));
+    v->event_count = 0;
+
+    stream->vad_dispatching = true;
+    for (size_t i = 0; i < count && stream->vad_generation == generation; i++) {
+        lua_pushvalue(L, 1);
+        lua_pushstring(L, vad_event_name(events[i]));
+        lua_pushnumber(L, level);
+        lua_call(L, 2, 0);
+    }
+    stream->vad_dispatching = false;
+
+    if (stream->vad_free_pending) {
+        stream->vad_free_pending = false;
+        vad_free(v);
+        free_lua_callback(data);
+    }
+}
+
+
+static void stream_read_callback(pa_stream* s, size_t nbytes, void* userdata) {
+    lua_pa_stream* stream = (lua_pa_stream*) userdata;
+    size_t frame_size = pa_frame_size(&stream->spec);
+    const void* data;
+    size_t length;
+
+    while (pa_stream_readable_size(s) > 0) {
+        if (pa_stream_peek(s, &data, &length) < 0 || length == 0) {
+            break;
+        }
+
+        if (stream->analyser != NULL) {
+            analyser_feed(stream->analyser, data, length);
+        }
+        if (stream->vad != NULL) {
+            vad_feed(stream->vad, data, length);
+        }
+
+        // A hole in the stream, where the server had no data. `ring_write` fills it with silence, so that
+        // the recording keeps its timing.
+
+        size_t dropped = ring_write(stream->ring, data, length, frame_size, stream->overflow);
+        if (dropped > 0) {
+            stream->overruns++;
+            stream->dropped += dropped;
+        }
+
+        pa_stream_drop(s);
+    }
+
+    if (stream->request_id == 0) {
+        stream->request_id = g_idle_add(stream_request_dispatch, stream);
+    }
+
+    // Transitions are reported last, as the callback may stop the detector or close the stream.
+    if (stream->vad != NULL && stream->vad->event_count > 0) {
+        stream_dispatch_vad_events(stream);
+    }
+}
+
+
+// Like `success_callback`, but for stream operations.
+static void stream_success_callback(pa_stream* s, int success, void* userdata) {
+    simple_callback_data* data = (simple_callback_data*) userdata;
+    lua_State* L = data->L;
+
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lua_pushboolean(L, success);
+    lua_call(L, 2, 0);
+
+    free_lua_callback(data);
+}
+
+
+int context_new_stream(lua_State* L) {
+    lua_pa_context* ctx = luaL_checkudata(L, 1, LUA_PA_CONTEXT);
+    const char* name = luaL_checkstring(L, 2);
+
+    pa_sample_spec spec;
+    sample_spec_from_lua(L, 3, &spec);
+
+    pa_proplist* plist = NULL;
+    if (!lua_isnoneornil(L, 4)) {
+        plist = ((proplist*) luaL_checkudata(L, 4, LUA_PA_PROPLIST))->plist;
+    }
+
+    pa_stream* s = pa_stream_new_with_proplist(ctx->context, name, &spec, NULL, plist);
+    if (s == NULL) {
+        return luaL_error(L, "failed to create stream: %s", pa_strerror(pa_context_errno(ctx->context)));
+    }
+
+    lua_pa_stream* stream = lua_newuserdata(L, sizeof(lua_pa_stream));
+    stream->ctx = ctx;
+    stream->stream = s;
+    stream->spec = spec;
+    stream->requested = 0;
+    stream->request_id = 0;
+    stream->ring = NULL;
+    stream->overflow = RING_OVERFLOW_DROP_OLDEST;
+    stream->overruns = 0;
+    stream->dropped = 0;
+    stream->latency_id = 0;
+    memset(&stream->latency, 0, sizeof(latency_histogram));
+    stream->analyser = NULL;
+    stream->analyser_id = 0;
+    stream->analyser_data = NULL;
+    stream->analyser_generation = 0;
+    stream->analyser_dispatching = false;
+    stream->analyser_free_pending = false;
+    stream->vad = NULL;
+    stream->vad_data = NULL;
+    stream->vad_generation = 0;
+    stream->vad_dispatching = false;
+    stream->vad_free_pending = false;
+    stream->data = prepare_lua_callback(L, 0);
+
+    lua_State* thread_L = stream->data->L;
+    lua_pushnil(thread_L);
+    lua_pushnil(thread_L);
+    lua_pushvalue(L, 1);
+    lua_xmove(L, thread_L, 1);
+
+    luaL_getmetatable(L, LUA_PA_STREAM);
+    lua_setmetatable(L, -2);
+
+    pa_stream_set_state_callback(s, stream_state_callback, stream);
+
+    return 1;
+}
+
+
+int stream_connect_playback(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    const char* device = luaL_optstring(L, 2, NULL);
+    luaL_checktype(L, 4, LUA_TFUNCTION);
+
+    pa_buffer_attr attr;
+    buffer_attr_from_lua(L, 3, &stream->spec, &attr);
+
+    pa_stream_flags_t flags = PA_STREAM_NOFLAGS;
+    if (!lua_isnoneornil(L, 3)) {
+        lua_getfield(L, 3, "flags");
+        flags = (pa_stream_flags_t) luaL_optinteger(L, -1, flags);
+        lua_pop(L, 1);
+    }
+
+    if (attr.tlength != (uint32_t) -1 || attr.minreq != (uint32_t) -1) {
+        flags |= PA_STREAM_ADJUST_LATENCY;
+    }
+    flags |= PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE;
+
+    lua_pushvalue(L, 4);
+    lua_xmove(L, stream->data->L, 1);
+    lua_replace(stream->data->L, 1);
+
+    pa_stream_set_write_callback(stream->stream, stream_write_callback, stream);
+
+    if (pa_stream_connect_playback(stream->stream, device, &attr, flags, NULL, NULL) < 0) {
+        return luaL_error(L, "failed to connect stream: %s",
+                          pa_strerror(pa_context_errno(pa_stream_get_context(stream->stream))));
+    }
+
+    return 0;
+}
+
+
+int stream_connect_record(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    const char* device = luaL_optstring(L, 2, NULL);
+    luaL_checktype(L, 4, LUA_TFUNCTION);
+
+    pa_buffer_attr attr;
+    buffer_attr_from_lua(L, 3, &stream->spec, &attr);
+
+    size_t frame_size = pa_frame_size(&stream->spec);
+    size_t buffer_size = pa_bytes_per_second(&stream->spec);
+    pa_stream_flags_t flags = PA_STREAM_NOFLAGS;
+    ring_overflow overflow = RING_OVERFLOW_DROP_OLDEST;
+
+    if (!lua_isnoneornil(L, 3)) {
+        lua_getfield(L, 3, "flags");
+        flags = (pa_stream_flags_t) luaL_optinteger(L, -1, flags);
+        lua_getfield(L, 3, "buffer_size");
+        buffer_size = (size_t) luaL_optinteger(L, -1, (lua_Integer) buffer_size);
+        lua_getfield(L, 3, "overflow");
+        const char* policy = luaL_optstring(L, -1, "drop_oldest");
+        if (g_strcmp0(policy, "drop_newest") == 0) {
+            overflow = RING_OVERFLOW_DROP_NEWEST;
+        } else if (g_strcmp0(policy, "drop_oldest") != 0) {
+            return luaL_argerror(L, 3, "overflow must be either 'drop_oldest' or 'drop_newest'");
+        }
+        lua_pop(L, 3);
+    }
+
+    // Keep the ring buffer aligned to frames, so that dropping data never splits one.
+    buffer_size = buffer_size / frame_size * frame_size;
+    luaL_argcheck(L, buffer_size > 0, 3, "buffer_size must hold at least one frame");
+
+    if (attr.fragsize != (uint32_t) -1) {
+        flags |= PA_STREAM_ADJUST_LATENCY;
+    }
+    flags |= PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE;
+
+    lua_pushvalue(L, 4);
+    lua_xmove(L, stream->data->L, 1);
+    lua_replace(stream->data->L, 1);
+
+    if (stream->ring != NULL) {
+        ring_free(stream->ring);
+    }
+    stream->ring = ring_new(buffer_size);
+    stream->overflow = overflow;
+
+    pa_stream_set_read_callback(stream->stream, stream_read_callback, stream);
+
+    if (pa_stream_connect_record(stream->stream, device, &attr, flags) < 0) {
+        return luaL_error(L, "failed to connect stream: %s",
+                          pa_strerror(pa_context_errno(pa_stream_get_context(stream->stream))));
+    }
+
+    return 0;
+}
+
+
+// Stores the callback for `Stream:on_write` and `Stream:on_read`. Only one of them is used, depending on
+// the stream's direction.
+static int stream_set_request_callback(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    lua_settop(L, 2);
+    if (!lua_isnil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+    }
+
+    lua_pushvalue(L, 2);
+    lua_xmove(L, stream->data->L, 1);
+    lua_replace(stream->data->L, 2);
+
+    return 0;
+}
+
+
+int stream_on_write(lua_State* L) {
+    return stream_set_request_callback(L);
+}
+
+
+int stream_on_read(lua_State* L) {
+    return stream_set_request_callback(L);
+}
+
+
+static lua_pa_stream* stream_check_record(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    if (stream->ring == NULL) {
+        luaL_error(L, "not a record stream");
+    }
+    return stream;
+}
+
+
+int stream_read(lua_State* L) {
+    lua_pa_stream* stream = stream_check_record(L);
+    ring_buffer* ring = stream->ring;
+    size_t frame_size = pa_frame_size(&stream->spec);
+
+    size_t length = ring->length;
+    if (!lua_isnoneornil(L, 2)) {
+        lua_Integer nbytes = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, nbytes >= 0, 2, "nbytes must not be negative");
+        length = MIN(length, (size_t) nbytes);
+    }
+
+    if (!lua_isnoneornil(L, 3)) {
+        lua_pa_buffer* buf = luaL_checkudata(L, 3, LUA_PA_BUFFER);
+        length = MIN(length, buf->capacity);
+        length = length / frame_size * frame_size;
+
+        buf->length = ring_read(ring, buf->data, length);
+        lua_pushinteger(L, (lua_Integer) buf->length);
+        return 1;
+    }
+
+    length = length / frame_size * frame_size;
+
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    while (length > 0) {
+        size_t chunk = ring_read(ring, luaL_prepbuffer(&b), MIN(length, LUAL_BUFFERSIZE));
+        luaL_addsize(&b, chunk);
+        length -= chunk;
+    }
+    luaL_pushresult(&b);
+
+    return 1;
+}
+
+
+int stream_get_readable_size(lua_State* L) {
+    lua_pa_stream* stream = stream_check_record(L);
+    lua_pushinteger(L, (lua_Integer) stream->ring->length);
+    return 1;
+}
+
+
+int stream_get_stats(lua_State* L) {
+    lua_pa_stream* stream = stream_check_record(L);
+
+    lua_createtable(L, 0, 4);
+
+    lua_pushinteger(L, (lua_Integer) stream->ring->length);
+    lua_setfield(L, -2, "buffered");
+
+    lua_pushinteger(L, (lua_Integer) stream->ring->capacity);
+    lua_setfield(L, -2, "capacity");
+
+    lua_pushinteger(L, (lua_Integer) stream->overruns);
+    lua_setfield(L, -2, "overruns");
+
+    lua_pushinteger(L, (lua_Integer) stream->dropped);
+    lua_setfield(L, -2, "dropped");
+
+    return 1;
+}
+
+
+int stream_write(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    size_t length;
+    const void* data = buffer_check_data(L, 2, &length);
+
+    int ret = stream_write_data(stream->stream, data, length);
+    if (ret < 0) {
+        return luaL_error(L, "failed to write: %s", pa_strerror(-ret));
+    }
+
+    lua_pushinteger(L, ret);
+    return 1;
+}
+
+
+int stream_get_writable_size(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    size_t size = pa_stream_writable_size(stream->stream);
+
+    lua_pushinteger(L, size != (size_t) -1 ? (lua_Integer) size : 0);
+    return 1;
+}
+
+
+int stream_drain(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    simple_callback_data* data = prepare_lua_callback(L, 2);
+    pa_operation* op = pa_stream_drain(stream->stream, stream_success_callback, data);
+    if (op == NULL) {
+        free_lua_callback(data);
+        return luaL_error(L, "failed to drain: %s", pa_strerror(pa_context_errno(stream->ctx->context)));
+    }
+    pa_operation_unref(op);
+
+    return 0;
+}
+
+
+int stream_cork(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+
+    simple_callback_data* data = NULL;
+    if (!lua_isnoneornil(L, 3)) {
+        data = prepare_lua_callback(L, 3);
+    }
+
+    pa_operation* op =
+        pa_stream_cork(stream->stream, lua_toboolean(L, 2), data != NULL ? stream_success_callback : NULL, data);
+    if (op == NULL) {
+        if (data != NULL) {
+            free_lua_callback(data);
+        }
+        return luaL_error(L, "failed to cork: %s", pa_strerror(pa_context_errno(stream->ctx->context)));
+    }
+    pa_operation_unref(op);
+
+    return 0;
+}
+
+
+int stream_get_state(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+
+    lua_pushinteger(L, stream->stream != NULL ? pa_stream_get_state(stream->stream) : PA_STREAM_TERMINATED);
+    return 1;
+}
+
+
+int stream_get_index(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    uint32_t index = pa_stream_get_index(stream->stream);
+
+    if (index == PA_INVALID_INDEX) {
+        lua_pushnil(L);
+    } else {
+        lua_pushinteger(L, index + 1);
+    }
+    return 1;
+}
+
+
+int stream_get_latency(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    pa_usec_t latency;
+    int negative = 0;
+
+    if (pa_stream_get_latency(stream->stream, &latency, &negative) < 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, pa_strerror(pa_context_errno(stream->ctx->context)));
+        return 2;
+    }
+
+    lua_pushinteger(L, (lua_Integer) latency);
+    lua_pushboolean(L, negative);
+    return 2;
+}
+
+
+int stream_get_time(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    pa_usec_t time;
+
+    if (pa_stream_get_time(stream->stream, &time) < 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, pa_strerror(pa_context_errno(stream->ctx->context)));
+        return 2;
+    }
+
+    lua_pushinteger(L, (lua_Integer) time);
+    return 1;
+}
+
+
+static void latency_histogram_add(latency_histogram* histogram, pa_usec_t latency) {
+    int bucket = 0;
+    // The index of the highest set bit, so that bucket `i` holds latencies below `2^(i + 1)`.
+    for (pa_usec_t rest = latency >> 1; rest > 0 && bucket < STREAM_LATENCY_BUCKETS - 1; rest >>= 1) {
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    if (histogram->count == 0 || latency < histogram->min) {
+        histogram->min = latency;
+    }
+    if (latency > histogram->max) {
+        histogram->max = latency;
+    }
+    histogram->sum += latency;
+    histogram->count++;
+}
+
+
+static gboolean stream_latency_tick(gpointer userdata) {
+    lua_pa_stream* stream = (lua_pa_stream*) userdata;
+    pa_usec_t latency;
+    int negative = 0;
+
+    if (stream->stream == NULL) {
+        stream->latency_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    if (pa_stream_get_state(stream->stream) != PA_STREAM_READY
+        || pa_stream_get_latency(stream->stream, &latency, &negative) < 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    latency_histogram_add(&stream->latency, negative ? 0 : latency);
+    return G_SOURCE_CONTINUE;
+}
+
+
+int stream_start_latency_sampler(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    lua_Integer interval = luaL_optinteger(L, 2, 100);
+    luaL_argcheck(L, interval > 0, 2, "interval must be positive");
+
+    if (stream->latency_id != 0) {
+        g_source_remove(stream->latency_id);
+    }
+    memset(&stream->latency, 0, sizeof(latency_histogram));
+    stream->latency_id = g_timeout_add((guint) interval, stream_latency_tick, stream);
+
+    return 0;
+}
+
+
+int stream_stop_latency_sampler(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+
+    if (stream->latency_id != 0) {
+        g_source_remove(stream->latency_id);
+        stream->latency_id = 0;
+    }
+
+    return 0;
+}
+
+
+int stream_get_latency_histogram(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    latency_histogram* histogram = &stream->latency;
+
+    lua_createtable(L, 0, 5);
+
+    lua_pushinteger(L, (lua_Integer) histogram->count);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, (lua_Integer) histogram->min);
+    lua_setfield(L, -2, "min");
+    lua_pushinteger(L, (lua_Integer) histogram->max);
+    lua_setfield(L, -2, "max");
+    lua_pushnumber(L, histogram->count > 0 ? (lua_Number) histogram->sum / (lua_Number) histogram->count : 0);
+    lua_setfield(L, -2, "mean");
+
+    int first = 0;
+    int last = -1;
+    for (int i = 0; i < STREAM_LATENCY_BUCKETS; i++) {
+        if (histogram->buckets[i] > 0) {
+            if (last < 0) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+
+    lua_createtable(L, last - first + 1, 0);
+    for (int i = first; i <= last; i++) {
+        lua_createtable(L, 0, 2);
+        lua_pushinteger(L, (lua_Integer) 1 << (i + 1));
+        lua_setfield(L, -2, "le");
+        lua_pushinteger(L, (lua_Integer) histogram->buckets[i]);
+        lua_setfield(L, -2, "count");
+        lua_rawseti(L, -2, i - first + 1);
+    }
+    lua_setfield(L, -2, "buckets");
+
+    if (lua_toboolean(L, 2)) {
+        memset(histogram, 0, sizeof(latency_histogram));
+    }
+
+    return 1;
+}
+
+
+static gboolean stream_analyser_tick(gpointer userdata) {
+    lua_pa_stream* stream = (lua_pa_stream*) userdata;
+    analyser* a = stream->analyser;
+    simple_callback_data* data = stream->analyser_data;
+    lua_State* L = data->L;
+    uint32_t generation = stream->analyser_generation;
+
+    analyser_process(a);
+
+    for (size_t i = 0; i < a->bands; i++) {
+        lua_pushnumber(L, a->levels[i]);
+        lua_rawseti(L, 2, (int) i + 1);
+    }
+
+    stream->analyser_dispatching = true;
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_call(L, 1, 0);
+    stream->analyser_dispatching = false;
+
+    if (stream->analyser_free_pending) {
+        stream->analyser_free_pending = false;
+        analyser_free(a);
+        free_lua_callback(data);
+    }
+
+    return stream->analyser_generation == generation ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+
+static void stream_free_analyser(lua_pa_stream* stream) {
+    if (stream->analyser_id != 0) {
+        g_source_remove(stream->analyser_id);
+        stream->analyser_id = 0;
+    }
+
+    stream->analyser_generation++;
+
+    // The first analyser to be stopped during a tick is the one whose thread is running. The tick frees it
+    // once the callback returns.
+    if (stream->analyser_dispatching && !stream->analyser_free_pending && stream->analyser != NULL) {
+        stream->analyser_free_pending = true;
+        stream->analyser = NULL;
+        stream->analyser_data = NULL;
+        return;
+    }
+
+    if (stream->analyser != NULL) {
+        analyser_free(stream->analyser);
+        stream->analyser = NULL;
+    }
+
+    if (stream->analyser_data != NULL) {
+        free_lua_callback(stream->analyser_data);
+        stream->analyser_data = NULL;
+    }
+}
+
+
+int stream_start_analyser(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    lua_Integer bands = 16;
+    lua_Integer size = 2048;
+    lua_Number fps = 30;
+    lua_Number attack = 0.5;
+    lua_Number decay = 0.1;
+    lua_Number min_freq = 40;
+    lua_Number max_freq = 16000;
+    lua_Number floor_db = -70;
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "bands");
+        bands = luaL_optinteger(L, -1, bands);
+        lua_getfield(L, 2, "size");
+        size = luaL_optinteger(L, -1, size);
+        lua_getfield(L, 2, "fps");
+        fps = luaL_optnumber(L, -1, fps);
+        lua_getfield(L, 2, "attack");
+        attack = luaL_optnumber(L, -1, attack);
+        lua_getfield(L, 2, "decay");
+        decay = luaL_optnumber(L, -1, decay);
+        lua_getfield(L, 2, "min_freq");
+        min_freq = luaL_optnumber(L, -1, min_freq);
+        lua_getfield(L, 2, "max_freq");
+        max_freq = luaL_optnumber(L, -1, max_freq);
+        lua_getfield(L, 2, "floor");
+        floor_db = luaL_optnumber(L, -1, floor_db);
+        lua_pop(L, 8);
+    }
+
+    luaL_argcheck(L, bands > 0 && bands <= 1024, 2, "bands must be between 1 and 1024");
+    luaL_argcheck(L, size >= 64 && size <= 65536, 2, "size must be between 64 and 65536");
+    luaL_argcheck(L, fps > 0 && fps <= 1000, 2, "fps must be between 0 and 1000");
+    luaL_argcheck(L, attack > 0 && attack <= 1 && decay > 0 && decay <= 1, 2,
+                  "attack and decay must be between 0 and 1");
+    luaL_argcheck(L, min_freq > 0 && max_freq > min_freq, 2, "invalid frequency range");
+    luaL_argcheck(L, floor_db < 0, 2, "floor must be negative");
+
+    if (!mixdown_supports_format(stream->spec.format)) {
+        return luaL_error(L, "the analyser requires samples in float32ne or s16ne format");
+    }
+
+    stream_free_analyser(stream);
+
+    analyser* a = analyser_new(&stream->spec, (size_t) size, (size_t) bands, min_freq, max_freq);
+    a->attack = (float) attack;
+    a->decay = (float) decay;
+    a->floor = (float) floor_db;
+    stream->analyser = a;
+
+    stream->analyser_data = prepare_lua_callback(L, 3);
+    lua_createtable(stream->analyser_data->L, (int) bands, 0);
+
+    stream->analyser_id = g_timeout_add((guint) (1000.0 / fps), stream_analyser_tick, stream);
+
+    return 0;
+}
+
+
+int stream_stop_analyser(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    stream_free_analyser(stream);
+    return 0;
+}
+
+
+static void stream_free_vad(lua_pa_stream* stream) {
+    stream->vad_generation++;
+
+    // The first detector to be stopped during a dispatch is the one whose thread is running. The dispatch
+    // loop frees it once the callback returns.
+    if (stream->vad_dispatching && !stream->vad_free_pending && stream->vad != NULL) {
+        stream->vad_free_pending = true;
+        stream->vad = NULL;
+        stream->vad_data = NULL;
+        return;
+    }
+
+    if (stream->vad != NULL) {
+        vad_free(stream->vad);
+        stream->vad = NULL;
+    }
+
+    if (stream->vad_data != NULL) {
+        free_lua_callback(stream->vad_data);
+        stream->vad_data = NULL;
+    }
+}
+
+
+int stream_start_vad(lua_State* L) {
+    lua_pa_stream* stream = stream_check(L);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    lua_Number threshold = -40;
+    lua_Number hysteresis = 6;
+    lua_Number max_zcr = 0.25;
+    lua_Integer start_delay = 60;
+    lua_Integer end_delay = 400;
+    lua_Integer silence_timeout = 0;
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "threshold");
+        threshold = luaL_optnumber(L, -1, threshold);
+        lua_getfield(L, 2, "hysteresis");
+        hysteresis = luaL_optnumber(L, -1, hysteresis);
+        lua_getfield(L, 2, "max_zcr");
+        max_zcr = luaL_optnumber(L, -1, max_zcr);
+        lua_getfield(L, 2, "start_delay");
+        start_delay = luaL_optinteger(L, -1, start_delay);
+        lua_getfield(L, 2, "end_delay");
+        end_delay = luaL_optinteger(L, -1, end_delay);
+        lua_getfield(L, 2, "silence_timeout");
+        silence_timeout = luaL_optinteger(L, -1, silence_timeout);
+        lua_pop(L, 6);
+    }
+
+    luaL_argcheck(L, threshold < 0, 2, "threshold must be negative");
+    luaL_argcheck(L, hysteresis >= 0, 2, "hysteresis must not be negative");
+    luaL_argcheck(L, max_zcr > 0 && max_zcr <= 1, 2, "max_zcr must be between 0 and 1");
+    luaL_argcheck(L, start_delay >= 0 && end_delay >= 0 && silence_timeout >= 0, 2, "delays must not be negative");
+
+    if (!mixdown_supports_format(stream->spec.format)) {
+        return luaL_error(L, "voice activity detection requires samples in float32ne or s16ne format");
+    }
+
+    stream_free_vad(stream);
+
+    vad* v = vad_new(&stream->spec);
+    v->threshold = (float) threshold;
+    v->hysteresis = (float) hysteresis;
+    v->max_zcr = (float) max_zcr;
+    v->start_blocks = MAX(vad_blocks((uint32_t) start_delay), 1);
+    v->end_blocks = MAX(vad_blocks((uint32_t) end_delay), 1);
+    v->silence_blocks = vad_blocks((uint32_t) silence_timeout);
+    stream->vad = v;
+    stream->vad_data = prepare_lua_callback(L, 3);
+
+    return 0;
+}
+
+
+int stream_stop_vad(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    stream_free_vad(stream);
+    return 0;
+}
+
+
+int stream_is_speaking(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    lua_pushboolean(L, stream->vad != NULL && stream->vad->speaking);
+    return 1;
+}
+
+
+int stream_get_rms(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    if (stream->vad == NULL) {
+        return luaL_error(L, "voice activity detection is not running");
+    }
+
+    lua_pushnumber(L, stream->vad->rms);
+    lua_pushnumber(L, 20.0 * log10(stream->vad->rms + 1e-10));
+    return 2;
+}
+
+
+static void stream_close(lua_pa_stream* stream) {
+    if (stream->request_id != 0) {
+        g_source_remove(stream->request_id);
+        stream->request_id = 0;
+    }
+
+    if (stream->latency_id != 0) {
+        g_source_remove(stream->latency_id);
+        stream->latency_id = 0;
+    }
+
+    if (stream->analyser_id != 0) {
+        g_source_remove(stream->analyser_id);
+        stream->analyser_id = 0;
+    }
+
+    if (stream->stream == NULL) {
+        return;
+    }
+
+    pa_stream_set_state_callback(stream->stream, NULL, NULL);
+    pa_stream_set_write_callback(stream->stream, NULL, NULL);
+    pa_stream_set_read_callback(stream->stream, NULL, NULL);
+
+    if (pa_stream_get_state(stream->stream) != PA_STREAM_UNCONNECTED) {
+        pa_stream_disconnect(stream->stream);
+    }
+    pa_stream_unref(stream->stream);
+    stream->stream = NULL;
+}
+
+
+int stream_disconnect(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+    stream_close(stream);
+    return 0;
+}
+
+
+int stream__gc(lua_State* L) {
+    lua_pa_stream* stream = luaL_checkudata(L, 1, LUA_PA_STREAM);
+
+    stream_close(stream);
+    stream_free_analyser(stream);
+    stream_free_vad(stream);
+
+    if (stream->ring != NULL) {
+        ring_free(stream->ring);
+        stream->ring = NULL;
+    }
+
+    if (stream->data != NULL) {
+        free_lua_callback(stream->data);
+        stream->data = NULL;
+    }
+
+    return 0;
+}
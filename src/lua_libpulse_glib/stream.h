@@ -0,0 +1,435 @@
+/** Audio streams.
+ *
+ * A @{Stream} sends audio data to the server, without going through an external player. Data is copied from
+ * a Lua string or a @{lua_libpulse_glib.buffer.Buffer} directly into the memory that libpulse sends to the
+ * server.
+ *
+ * Record streams work the other way around. Recorded data is collected in C, and read by Lua in chunks of
+ * its choosing.
+ *
+ * Streams are created with @{Context:new_stream}, and are closed when they are garbage collected. A stream
+ * has to be kept referenced for as long as it should play.
+ *
+ *    local stream = ctx:new_stream("notification", { format = "s16le", rate = 44100, channels = 2 })
+ *    stream:on_write(function(nbytes)
+ *        stream:write(next_chunk(nbytes))
+ *    end)
+ *    stream:connect_playback(nil, { latency = 20 }, function(err, state) end)
+ *
+ * @module lua_libpulse_glib.stream
+ */
+#pragma once
+
+#include "analyser.h"
+#include "callback.h"
+#include "context.h"
+#include "ring.h"
+#include "vad.h"
+
+#include <glib.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <pulse/stream.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LUA_PA_STREAM "pulseaudio.stream"
+
+// Bucket `i` of a latency histogram counts latencies below `2^(i + 1)` microseconds.
+#define STREAM_LATENCY_BUCKETS 32
+
+
+typedef struct latency_histogram {
+    uint64_t buckets[STREAM_LATENCY_BUCKETS];
+    uint64_t count;
+    pa_usec_t min;
+    pa_usec_t max;
+    pa_usec_t sum;
+} latency_histogram;
+
+
+typedef struct lua_pa_stream {
+    lua_pa_context* ctx;
+    pa_stream* stream;
+    pa_sample_spec spec;
+    // Bytes the server has asked for since the write callback was last called.
+    size_t requested;
+    // The idle source that calls the write or read callback. Requests are collected until it runs, so the
+    // callback is called at most once per main loop iteration.
+    guint request_id;
+    // Record streams copy incoming fragments into this buffer, from where they are read on demand.
+    // `NULL` for playback streams.
+    ring_buffer* ring;
+    ring_overflow overflow;
+    // The number of times incoming data didn't fit into the ring buffer, and the total number of bytes
+    // that were dropped because of that.
+    uint64_t overruns;
+    uint64_t dropped;
+    // The timer of the latency sampler, and the latencies it has collected.
+    guint latency_id;
+    latency_histogram latency;
+    // The spectrum analyser, its frame timer, and a thread with its callback at index 1 and the reused band
+    // table at index 2.
+    analyser* analyser;
+    guint analyser_id;
+    simple_callback_data* analyser_data;
+    // Bumped whenever the analyser is stopped or replaced. While a frame is delivered, stopping it only marks
+    // it for freeing, the same as the detector below.
+    uint32_t analyser_generation;
+    bool analyser_dispatching;
+    bool analyser_free_pending;
+    // The voice activity detector, and a thread with its callback at index 1.
+    vad* vad;
+    simple_callback_data* vad_data;
+    // Bumped whenever the detector is stopped or replaced. While its events are dispatched, stopping it only
+    // marks it for freeing, as its thread is still running the callback.
+    uint32_t vad_generation;
+    bool vad_dispatching;
+    bool vad_free_pending;
+    // A thread with the state callback at index 1, the write or read callback at index 2 and the context at
+    // index 3, to keep it alive.
+    simple_callback_data* data;
+} lua_pa_stream;
+
+
+// Reads a sample spec from a table `{ format, rate, channels }` at the given index. The format may be given
+// as a name, like `"s16le"` or `"float32ne"`, or as a `PA_SAMPLE_*` value.
+void sample_spec_from_lua(lua_State*, int, pa_sample_spec*);
+
+// Reads the buffer metrics from an options table at the given index. Fields that are not set keep the
+// server's defaults. A `latency` field, in milliseconds, is converted to `tlength` and `fragsize` for the
+// given spec.
+void buffer_attr_from_lua(lua_State*, int, const pa_sample_spec*, pa_buffer_attr*);
+
+// Copies data into the stream, using memory from `pa_stream_begin_write`. Returns the number of bytes
+// written, or a negative error code.
+int stream_write_data(pa_stream*, const void*, size_t);
+
+
+/// Stream
+/// @type Stream
+
+
+/** Connects the stream to a sink for playback.
+ *
+ * The buffer metrics are given in bytes. For low latency playback, set `latency` or `tlength`, and a
+ * small `minreq`. `PA_STREAM_ADJUST_LATENCY` is added to the flags whenever any of them are set.
+ *
+ * `PA_STREAM_INTERPOLATE_TIMING` and `PA_STREAM_AUTO_TIMING_UPDATE` are always added, so that
+ * @{Stream:get_latency} can be answered without a round trip to the server.
+ *
+ * @function Stream:connect_playback
+ * @async
+ * @tparam[opt=nil] string device The sink's name or index. Defaults to the default sink.
+ * @tparam[opt] table opts
+ * @tparam[opt] number opts.latency The target latency in milliseconds.
+ * @tparam[opt] number opts.maxlength
+ * @tparam[opt] number opts.tlength
+ * @tparam[opt] number opts.prebuf
+ * @tparam[opt] number opts.minreq
+ * @tparam[opt] number opts.flags A combination of `PA_STREAM_*` flags.
+ * @tparam function cb The state callback. Called on every state change.
+ * @treturn[opt] string The error message, when the stream failed.
+ * @treturn number The state.
+ */
+int stream_connect_playback(lua_State*);
+
+/** Connects the stream to a source for recording.
+ *
+ * Fragments from the server are copied into a ring buffer in C, and can be taken out with @{Stream:read}
+ * whenever convenient. When the buffer is full, either the oldest data or the incoming data is dropped,
+ * depending on `overflow`. This is reported by @{Stream:get_stats}.
+ *
+ * As with playback, timing interpolation is always enabled.
+ *
+ * @function Stream:connect_record
+ * @async
+ * @tparam[opt=nil] string device The source's name or index. Defaults to the default source.
+ * @tparam[opt] table opts
+ * @tparam[opt] number opts.latency The fragment latency in milliseconds.
+ * @tparam[opt] number opts.maxlength
+ * @tparam[opt] number opts.fragsize
+ * @tparam[opt] number opts.flags A combination of `PA_STREAM_*` flags.
+ * @tparam[opt] number opts.buffer_size The ring buffer's size in bytes. Defaults to one second of audio.
+ * @tparam[opt="drop_oldest"] string opts.overflow Either `"drop_oldest"` or `"drop_newest"`.
+ * @tparam function cb The state callback. Called on every state change.
+ * @treturn[opt] string The error message, when the stream failed.
+ * @treturn number The state.
+ */
+int stream_connect_record(lua_State*);
+
+/** Sets the function that is called when the server wants more data.
+ *
+ * Requests from the server are batched, so the callback is called at most once per main loop iteration,
+ * with the number of bytes that can be written.
+ *
+ * @function Stream:on_write
+ * @tparam function|nil cb Receives the number of bytes that can be written.
+ */
+int stream_on_write(lua_State*);
+
+/** Writes audio data to the stream.
+ *
+ * The data is copied into memory from `pa_stream_begin_write`, so there is no intermediate copy.
+ *
+ * @function Stream:write
+ * @tparam string|Buffer data
+ * @treturn number The number of bytes written.
+ */
+int stream_write(lua_State*);
+
+/** Sets the function that is called when recorded data is available.
+ *
+ * Like @{Stream:on_write}, this is called at most once per main loop iteration.
+ *
+ * @function Stream:on_read
+ * @tparam function|nil cb Receives the number of bytes that can be read.
+ */
+int stream_on_read(lua_State*);
+
+/** Takes recorded data out of the ring buffer.
+ *
+ * Only whole frames are returned, so the data is always aligned to the sample spec.
+ *
+ * When a @{lua_libpulse_glib.buffer.Buffer} is given, the data is copied into it, up to its capacity, and
+ * no string is created.
+ *
+ * @function Stream:read
+ * @tparam[opt] number nbytes The maximum number of bytes to read. Defaults to everything available.
+ * @tparam[opt] Buffer buffer
+ * @treturn string|number The data, or the number of bytes copied into the buffer.
+ */
+int stream_read(lua_State*);
+
+/** Returns the number of bytes in the ring buffer.
+ *
+ * @function Stream:get_readable_size
+ * @treturn number
+ */
+int stream_get_readable_size(lua_State*);
+
+/** Returns the ring buffer's counters.
+ *
+ * @function Stream:get_stats
+ * @treturn table A table with the fields `buffered`, `capacity`, `overruns` and `dropped`.
+ */
+int stream_get_stats(lua_State*);
+
+/** Returns the number of bytes that can be written without exceeding the buffer.
+ *
+ * @function Stream:get_writable_size
+ * @treturn number
+ */
+int stream_get_writable_size(lua_State*);
+
+/** Waits until all data that was written has been played.
+ *
+ * @function Stream:drain
+ * @async
+ * @tparam function cb
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int stream_drain(lua_State*);
+
+/** Pauses or resumes playback.
+ *
+ * @function Stream:cork
+ * @async
+ * @tparam boolean pause
+ * @tparam[opt] function cb
+ * @treturn[opt] string
+ * @treturn boolean
+ */
+int stream_cork(lua_State*);
+
+/** Returns the stream's state.
+ *
+ * @function Stream:get_state
+ * @treturn number
+ */
+int stream_get_state(lua_State*);
+
+/** Returns the index of the sink input or source output that this stream is connected to.
+ *
+ * @function Stream:get_index
+ * @treturn number|nil
+ */
+int stream_get_index(lua_State*);
+
+/** Returns the stream's current latency.
+ *
+ * For playback streams, this is the time until data that is written now will be heard. For record streams,
+ * it is the time since the oldest data in the buffer was recorded, and may be negative.
+ *
+ * The value is interpolated from the last timing update, so no request is sent to the server. Timing
+ * information is available shortly after the stream is ready.
+ *
+ * @function Stream:get_latency
+ * @treturn[1] number The latency in microseconds.
+ * @treturn[1] boolean Whether the latency is negative.
+ * @treturn[2] nil
+ * @treturn[2] string The error message, when no timing information is available yet.
+ */
+int stream_get_latency(lua_State*);
+
+/** Returns the stream's playback or recording time.
+ *
+ * Like @{Stream:get_latency}, this is interpolated locally.
+ *
+ * @function Stream:get_time
+ * @treturn[1] number The time in microseconds.
+ * @treturn[2] nil
+ * @treturn[2] string The error message, when no timing information is available yet.
+ */
+int stream_get_time(lua_State*);
+
+/** Periodically samples the stream's latency into a histogram.
+ *
+ * Previously collected samples are discarded. Samples that can't be taken, e.g. before the stream is ready,
+ * are skipped. Negative latencies of record streams are counted as `0`.
+ *
+ * @function Stream:start_latency_sampler
+ * @tparam[opt=100] number interval The sampling interval in milliseconds.
+ */
+int stream_start_latency_sampler(lua_State*);
+
+/** Stops sampling the stream's latency. The collected samples are kept.
+ *
+ * @function Stream:stop_latency_sampler
+ */
+int stream_stop_latency_sampler(lua_State*);
+
+/** Returns the latencies collected by the sampler.
+ *
+ * `buckets` is a list of tables with the fields `le`, the bucket's upper bound in microseconds, and `count`.
+ * The list starts at the lowest and ends at the highest bucket that has any samples.
+ *
+ * @function Stream:get_latency_histogram
+ * @tparam[opt=false] boolean reset Discard the samples after reading them.
+ * @treturn table A table with the fields `count`, `min`, `max`, `mean` and `buckets`.
+ */
+int stream_get_latency_histogram(lua_State*);
+
+/** Starts a spectrum analyser on a record stream.
+ *
+ * Recorded samples are mixed down to mono and transformed in C. The spectrum is reduced to `bands`
+ * log-spaced bands between `min_freq` and `max_freq`, which are smoothed with `attack` when rising and
+ * `decay` when falling. Each is the fraction of the difference that is applied per frame, between 0 and 1.
+ *
+ * Band levels are between 0 and 1, mapped linearly from `floor` dB to 0 dB, where a full-scale sine is
+ * at 0 dB.
+ *
+ * The callback receives the same table every frame, so it must copy values it wants to keep. The stream's
+ * sample format must be `float32ne` or `s16ne`. Recorded data still goes into the ring buffer as well.
+ *
+ * @function Stream:start_analyser
+ * @tparam[opt] table opts
+ * @tparam[opt=16] number opts.bands
+ * @tparam[opt=2048] number opts.size The transform size, rounded up to a power of two.
+ * @tparam[opt=30] number opts.fps How often the callback is called.
+ * @tparam[opt=0.5] number opts.attack
+ * @tparam[opt=0.1] number opts.decay
+ * @tparam[opt=40] number opts.min_freq
+ * @tparam[opt=16000] number opts.max_freq
+ * @tparam[opt=-70] number opts.floor
+ * @tparam function cb Receives a list of band levels.
+ */
+int stream_start_analyser(lua_State*);
+
+/** Stops the spectrum analyser.
+ *
+ * @function Stream:stop_analyser
+ */
+int stream_stop_analyser(lua_State*);
+
+/** Starts voice activity detection on a record stream.
+ *
+ * Recorded samples are measured in C, in blocks of 10 ms. Speech starts when the level stays above
+ * `threshold` for `start_delay`, and the zero-crossing rate is low enough to rule out broadband noise.
+ * It ends when the level stays below `threshold - hysteresis` for `end_delay`.
+ *
+ * The callback is only called on transitions, with one of `"speech_start"`, `"speech_end"` or `"silence"`,
+ * and the current level in dB. `"silence"` is sent once after no activity for `silence_timeout`.
+ *
+ * The stream's sample format must be `float32ne` or `s16ne`.
+ *
+ * @function Stream:start_vad
+ * @tparam[opt] table opts
+ * @tparam[opt=-40] number opts.threshold The level in dB that starts speech.
+ * @tparam[opt=6] number opts.hysteresis How far in dB the level may drop below the threshold during speech.
+ * @tparam[opt=0.25] number opts.max_zcr The highest zero-crossing rate, per sample, that can start speech.
+ * @tparam[opt=60] number opts.start_delay In milliseconds.
+ * @tparam[opt=400] number opts.end_delay In milliseconds.
+ * @tparam[opt] number opts.silence_timeout In milliseconds. Disabled by default.
+ * @tparam function cb
+ */
+int stream_start_vad(lua_State*);
+
+/** Stops voice activity detection.
+ *
+ * @function Stream:stop_vad
+ */
+int stream_stop_vad(lua_State*);
+
+/** Returns whether the voice activity detector currently detects speech.
+ *
+ * @function Stream:is_speaking
+ * @treturn boolean
+ */
+int stream_is_speaking(lua_State*);
+
+/** Returns the level of the last 10 ms measured by the voice activity detector.
+ *
+ * @function Stream:get_rms
+ * @treturn number The RMS level, where `1` is full scale.
+ * @treturn number The level in dB.
+ */
+int stream_get_rms(lua_State*);
+
+/** Disconnects the stream.
+ *
+ * A stream can't be connected again, a new one has to be created instead.
+ *
+ * @function Stream:disconnect
+ */
+int stream_disconnect(lua_State*);
+
+int stream__gc(lua_State*);
+
+
+static const struct luaL_Reg stream_f[] = {
+    {"connect_playback",       stream_connect_playback     },
+    { "connect_record",        stream_connect_record       },
+    { "on_write",              stream_on_write             },
+    { "on_read",               stream_on_read              },
+    { "read",                  stream_read                 },
+    { "get_readable_size",     stream_get_readable_size    },
+    { "get_stats",             stream_get_stats            },
+    { "write",                 stream_write                },
+    { "get_writable_size",     stream_get_writable_size    },
+    { "drain",                 stream_drain                },
+    { "cork",                  stream_cork                 },
+    { "get_state",             stream_get_state            },
+    { "get_index",             stream_get_index            },
+    { "get_latency",           stream_get_latency          },
+    { "get_time",              stream_get_time             },
+    { "start_latency_sampler", stream_start_latency_sampler},
+    { "stop_latency_sampler",  stream_stop_latency_sampler },
+    { "get_latency_histogram", stream_get_latency_histogram},
+    { "start_analyser",        stream_start_analyser       },
+    { "stop_analyser",         stream_stop_analyser        },
+    { "start_vad",             stream_start_vad            },
+    { "stop_vad",              stream_stop_vad             },
+    { "is_speaking",           stream_is_speaking          },
+    { "get_rms",               stream_get_rms              },
+    { "disconnect",            stream_disconnect           },
+    { NULL,                    NULL                        }
+};
+
+
+static const struct luaL_Reg stream_mt[] = {
+    {"__gc", stream__gc},
+    { NULL,  NULL      }
+};
@@ -0,0 +1,114 @@
+#include "vad.h"
+
+#include "mixdown.h"
+
+#include <glib.h>
+#include <math.h>
+
+
+// The length of a measurement block in milliseconds.
+#define VAD_BLOCK_MS 10
+
+
+uint32_t vad_blocks(uint32_t ms) {
+    return (ms + VAD_BLOCK_MS - 1) / VAD_BLOCK_MS;
+}
+
+
+vad* vad_new(const pa_sample_spec* spec) {
+    vad* v = g_new0(vad, 1);
+    v->spec = *spec;
+    v->block_frames = MAX(spec->rate * VAD_BLOCK_MS / 1000, 1);
+    v->threshold = -40.0f;
+    v->hysteresis = 6.0f;
+    v->max_zcr = 0.25f;
+    v->start_blocks = vad_blocks(60);
+    v->end_blocks = vad_blocks(400);
+    v->rms = 0.0f;
+    return v;
+}
+
+
+void vad_free(vad* v) {
+    g_free(v);
+}
+
+
+const char* vad_event_name(vad_event event) {
+    switch (event) {
+    case VAD_EVENT_SPEECH_START:
+        return "speech_start";
+    case VAD_EVENT_SPEECH_END:
+        return "speech_end";
+    case VAD_EVENT_SILENCE:
+        return "silence";
+    }
+    return NULL;
+}
+
+
+static void vad_push_event(vad* v, vad_event event) {
+    if (v->event_count < VAD_MAX_EVENTS) {
+        v->events[v->event_count++] = event;
+    }
+}
+
+
+static void vad_end_block(vad* v) {
+    v->rms = (float) sqrt(v->energy / (double) v->frames);
+    v->zcr = (float) v->crossings / (float) v->frames;
+    v->energy = 0;
+    v->crossings = 0;
+    v->frames = 0;
+
+    float db = 20.0f * log10f(v->rms + 1e-10f);
+    bool active = v->speaking ? db >= v->threshold - v->hysteresis : db >= v->threshold && v->zcr <= v->max_zcr;
+
+    if (active) {
+        v->active_run++;
+        v->inactive_run = 0;
+        v->silence_reported = false;
+
+        if (!v->speaking && v->active_run >= v->start_blocks) {
+            v->speaking = true;
+            vad_push_event(v, VAD_EVENT_SPEECH_START);
+        }
+    } else {
+        v->inactive_run++;
+        v->active_run = 0;
+
+        if (v->speaking && v->inactive_run >= v->end_blocks) {
+            v->speaking = false;
+            vad_push_event(v, VAD_EVENT_SPEECH_END);
+        }
+
+        if (!v->speaking && !v->silence_reported && v->silence_blocks > 0 && v->inactive_run >= v->silence_blocks) {
+            v->silence_reported = true;
+            vad_push_event(v, VAD_EVENT_SILENCE);
+        }
+    }
+}
+
+
+void vad_feed(vad* v, const void* data, size_t length) {
+    size_t frames = length / pa_frame_size(&v->spec);
+    float mono[MIXDOWN_CHUNK_FRAMES];
+
+    for (size_t f = 0; f < frames; f += MIXDOWN_CHUNK_FRAMES) {
+        size_t count = MIN(frames - f, MIXDOWN_CHUNK_FRAMES);
+        mixdown(&v->spec, data, f, count, mono);
+
+        for (size_t i = 0; i < count; i++) {
+            float sample = mono[i];
+            v->energy += (double) sample * sample;
+            if ((sample >= 0) != (v->previous >= 0)) {
+                v->crossings++;
+            }
+            v->previous = sample;
+
+            if (++v->frames == v->block_frames) {
+                vad_end_block(v);
+            }
+        }
+    }
+}
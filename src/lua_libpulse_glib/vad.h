@@ -0,0 +1,72 @@
+#pragma once
+
+#include <pulse/sample.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The maximum number of transitions that are collected until the caller takes them. Further ones are dropped.
+#define VAD_MAX_EVENTS 8
+
+
+typedef enum vad_event {
+    VAD_EVENT_SPEECH_START,
+    VAD_EVENT_SPEECH_END,
+    VAD_EVENT_SILENCE,
+} vad_event;
+
+
+// A voice activity detector, based on signal energy and zero-crossing rate.
+//
+// Samples are mixed down to mono and measured in blocks of 10 ms. A block starts speech when its level is above
+// `threshold` and its zero-crossing rate is below `max_zcr`, which rejects broadband noise such as fans or hiss.
+// Once speaking, blocks only need to stay above `threshold - hysteresis`, so that quiet and unvoiced sounds
+// don't cut speech short.
+//
+// Speech starts after `start_blocks` active blocks in a row, and ends after `end_blocks` inactive ones.
+// Silence is reported once, after `silence_blocks` inactive blocks.
+typedef struct vad {
+    pa_sample_spec spec;
+    size_t block_frames;
+
+    // The block that is currently being measured.
+    size_t frames;
+    double energy;
+    uint32_t crossings;
+    float previous;
+
+    // The measurements of the last complete block.
+    float rms;
+    float zcr;
+
+    float threshold;
+    float hysteresis;
+    float max_zcr;
+    uint32_t start_blocks;
+    uint32_t end_blocks;
+    // `0` disables silence events.
+    uint32_t silence_blocks;
+
+    uint32_t active_run;
+    uint32_t inactive_run;
+    bool speaking;
+    bool silence_reported;
+
+    // Transitions that have not been taken yet, in order. The caller resets `event_count` after handling them.
+    vad_event events[VAD_MAX_EVENTS];
+    size_t event_count;
+} vad;
+
+
+vad* vad_new(const pa_sample_spec*);
+void vad_free(vad*);
+
+// Converts a duration in milliseconds to a number of blocks, rounding up.
+uint32_t vad_blocks(uint32_t ms);
+
+// Measures interleaved frames and records any transitions. When `data` is `NULL`, silence is measured instead.
+// The stream's format has to be one that `mixdown_supports_format` accepts.
+void vad_feed(vad*, const void* data, size_t length);
+
+// Returns the name of an event, as passed to Lua.
+const char* vad_event_name(vad_event);
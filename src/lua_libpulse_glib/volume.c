@@ -1,16 +1,50 @@
 #include "volume.h"
 
 #include "lua_util.h"
+#include "lut.h"
 
 #include <pulse/xmalloc.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 
 int volume_new(lua_State* L) {
-    pa_cvolume* cvol = volume_from_lua(L, 1);
-    return volume_to_lua(L, cvol);
+    pa_cvolume cvol;
+    volume_from_lua(L, 1, &cvol);
+    return volume_to_lua(L, &cvol);
+}
+
+
+static inline bool volume_is_inline(const volume_t* volume) {
+    return volume->values == volume->inline_values;
+}
+
+
+// Moves the values to the heap, when `channels` don't fit inline. Heap storage always has room for
+// `PA_CHANNELS_MAX` values, and is kept until the volume is collected.
+static void volume_reserve(volume_t* volume, unsigned int channels) {
+    if (channels <= VOLUME_INLINE_CHANNELS || !volume_is_inline(volume)) {
+        return;
+    }
+
+    pa_volume_t* values = pa_xnew0(pa_volume_t, PA_CHANNELS_MAX);
+    memcpy(values, volume->inline_values, sizeof(volume->inline_values));
+    volume->values = values;
+}
+
+
+void volume_load(const volume_t* volume, pa_cvolume* cvolume) {
+    cvolume->channels = volume->channels;
+    memcpy(cvolume->values, volume->values, volume->channels * sizeof(pa_volume_t));
+}
+
+
+void volume_store(volume_t* volume, const pa_cvolume* cvolume) {
+    volume_reserve(volume, cvolume->channels);
+    volume->channels = cvolume->channels;
+    memcpy(volume->values, cvolume->values, cvolume->channels * sizeof(pa_volume_t));
 }
 
 
@@ -23,18 +57,14 @@ int volume_to_lua(lua_State* L, const pa_cvolume* pa_volume) {
     luaL_getmetatable(L, LUA_PA_VOLUME);
     lua_setmetatable(L, -2);
 
-    volume->inner = *pa_volume;
+    volume->values = volume->inline_values;
+    memset(volume->inline_values, 0, sizeof(volume->inline_values));
+    volume_store(volume, pa_volume);
     return 1;
 }
 
 
-// When the value is a plain Lua table, a new `pa_cvolume` is allocated and the caller is
-// responsible of freeing it with `pa_xfree`.
-// If a userdata is passed instead, memory is owned by Lua and not be freed.
-// TODO: Maybe construct userdata from the table, so that memory management is always handled
-// by GC. Makes this easier to use. But only do so after the current version has been committed
-// once, just so it stays available.
-pa_cvolume* volume_from_lua(lua_State* L, int index) {
+void volume_from_lua(lua_State* L, int index, pa_cvolume* volume) {
     switch (lua_type(L, index)) {
     case LUA_TTABLE: {
         uint8_t channels = (uint8_t) lua_rawlen(L, index);
@@ -42,7 +72,6 @@ pa_cvolume* volume_from_lua(lua_State* L, int index) {
             channels = PA_CHANNELS_MAX;
         }
 
-        pa_cvolume* volume = pa_xnew(pa_cvolume, 1);
         volume->channels = channels;
 
         for (int i = 0; i < channels; ++i) {
@@ -53,15 +82,15 @@ pa_cvolume* volume_from_lua(lua_State* L, int index) {
             lua_pop(L, 1);
         }
 
-        return volume;
+        return;
     }
     case LUA_TUSERDATA: {
-        volume_t* volume = luaL_checkudata(L, index, LUA_PA_VOLUME);
-        return &volume->inner;
+        volume_load(luaL_checkudata(L, index, LUA_PA_VOLUME), volume);
+        return;
     }
     default: {
         luaL_argerror(L, index, "expected table or userdata");
-        return NULL;
+        return;
     }
     }
 }
@@ -69,7 +98,7 @@ pa_cvolume* volume_from_lua(lua_State* L, int index) {
 
 int volume__len(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
-    lua_pushinteger(L, volume->inner.channels);
+    lua_pushinteger(L, volume->channels);
     return 1;
 }
 
@@ -77,16 +106,27 @@ int volume__len(lua_State* L) {
 int volume__eq(lua_State* L) {
     volume_t* left = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     volume_t* right = luaL_checkudata(L, 2, LUA_PA_VOLUME);
-    lua_pushboolean(L, pa_cvolume_equal(&left->inner, &right->inner));
+    bool equal = left->channels == right->channels
+                 && memcmp(left->values, right->values, left->channels * sizeof(pa_volume_t)) == 0;
+    lua_pushboolean(L, equal);
     return 1;
 }
 
 
+// Reads a channel's value. Channels beyond the ones that are stored read as muted.
+static inline pa_volume_t volume_get_value(const volume_t* volume, lua_Integer index) {
+    if (volume_is_inline(volume) && index >= VOLUME_INLINE_CHANNELS) {
+        return PA_VOLUME_MUTED;
+    }
+    return volume->values[index];
+}
+
+
 int volume__index(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     int index = (int) luaL_checkinteger(L, 2);
-    luaL_argcheck(L, index >= 1 && index <= (PA_CHANNELS_MAX + 1), 2, "channel index out of bounds");
-    lua_pushinteger(L, volume->inner.values[index - 1]);
+    luaL_argcheck(L, index >= 1 && index <= PA_CHANNELS_MAX, 2, "channel index out of bounds");
+    lua_pushinteger(L, volume_get_value(volume, index - 1));
     return 1;
 }
 
@@ -95,21 +135,34 @@ int volume__newindex(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     lua_Integer index = luaL_checkinteger(L, 2);
     lua_Integer value = luaL_checkinteger(L, 3);
-    luaL_argcheck(L, index >= 1 && index <= (PA_CHANNELS_MAX + 1), 2, "channel index out of bounds");
+    luaL_argcheck(L, index >= 1 && index <= PA_CHANNELS_MAX, 2, "channel index out of bounds");
     luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 3, "volume value is invalid");
-    volume->inner.values[index - 1] = value;
+    volume_reserve(volume, (unsigned int) index);
+    volume->values[index - 1] = value;
     return 0;
 }
 
 
 int volume__tostring(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
     char s[PA_CVOLUME_SNPRINT_MAX];
-    pa_cvolume_snprint(s, PA_CVOLUME_SNPRINT_MAX, &volume->inner);
+    pa_cvolume_snprint(s, PA_CVOLUME_SNPRINT_MAX, &cvolume);
     lua_pushstring(L, s);
     return 1;
 }
 
+
+int volume__gc(lua_State* L) {
+    volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
+    if (!volume_is_inline(volume)) {
+        pa_xfree(volume->values);
+        volume->values = volume->inline_values;
+    }
+    return 0;
+}
+
 int volume_is_valid(lua_State* L) {
     // Lua's `checkudata` throws an error, and catching that is expensive.
     // So we have to manually implement the check.
@@ -118,7 +171,15 @@ int volume_is_valid(lua_State* L) {
     bool is_userdata = volume != NULL && lua_getmetatable(L, 1) && lua_rawequal(L, -1, -2);
     // Remove the two metatables
     lua_pop(L, 2);
-    lua_pushboolean(L, is_userdata && pa_cvolume_valid(&volume->inner));
+
+    bool is_valid = false;
+    if (is_userdata) {
+        pa_cvolume cvolume;
+        volume_load(volume, &cvolume);
+        is_valid = pa_cvolume_valid(&cvolume);
+    }
+
+    lua_pushboolean(L, is_valid);
     return 1;
 }
 
@@ -129,21 +190,27 @@ int volume_channels_equal_to(lua_State* L) {
 
     luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 2, "volume out of bounds");
 
-    lua_pushboolean(L, pa_cvolume_channels_equal_to(&volume->inner, (pa_volume_t) value));
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    lua_pushboolean(L, pa_cvolume_channels_equal_to(&cvolume, (pa_volume_t) value));
     return 1;
 }
 
 
 int volume_is_muted(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
-    lua_pushboolean(L, pa_cvolume_is_muted(&volume->inner));
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    lua_pushboolean(L, pa_cvolume_is_muted(&cvolume));
     return 1;
 }
 
 
 int volume_is_norm(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
-    lua_pushboolean(L, pa_cvolume_is_norm(&volume->inner));
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    lua_pushboolean(L, pa_cvolume_is_norm(&cvolume));
     return 1;
 }
 
@@ -156,7 +223,9 @@ int volume_set_channels(lua_State* L) {
     luaL_argcheck(L, channels >= 0 && channels <= PA_CHANNELS_MAX, 2, "channel count out of bounds");
     luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 3, "volume out of bounds");
 
-    pa_cvolume_set(&volume->inner, (unsigned int) channels, (pa_volume_t) value);
+    pa_cvolume cvolume;
+    pa_cvolume_set(&cvolume, (unsigned int) channels, (pa_volume_t) value);
+    volume_store(volume, &cvolume);
     return 0;
 }
 
@@ -166,10 +235,18 @@ int volume_set(lua_State* L) {
     lua_Integer index = luaL_checkinteger(L, 2) - 1;
     lua_Integer value = luaL_checkinteger(L, 3);
 
-    luaL_argcheck(L, index >= 0 && index <= PA_CHANNELS_MAX, 2, "channel index out of bounds");
+    luaL_argcheck(L, index >= 0 && index < PA_CHANNELS_MAX, 2, "channel index out of bounds");
     luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 3, "volume out of bounds");
 
-    volume->inner.values[index] = (pa_volume_t) value;
+    volume_reserve(volume, (unsigned int) index + 1);
+    // Channels that are added along the way start out muted.
+    for (lua_Integer i = volume->channels; i < index; i++) {
+        volume->values[i] = PA_VOLUME_MUTED;
+    }
+    if (index >= volume->channels) {
+        volume->channels = (uint8_t) index + 1;
+    }
+    volume->values[index] = (pa_volume_t) value;
     return 0;
 }
 
@@ -178,9 +255,9 @@ int volume_get(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     lua_Integer index = luaL_checkinteger(L, 2) - 1;
 
-    luaL_argcheck(L, index > 0 && index < volume->inner.channels, 2, "channel index out of bounds");
+    luaL_argcheck(L, index >= 0 && index < volume->channels, 2, "channel index out of bounds");
 
-    lua_pushinteger(L, volume->inner.values[index]);
+    lua_pushinteger(L, volume->values[index]);
     return 1;
 }
 
@@ -189,7 +266,9 @@ int volume_reset(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     lua_Integer channels = luaL_checkinteger(L, 2);
     luaL_argcheck(L, channels >= 0 && channels <= PA_CHANNELS_MAX, 2, "channel count out of bounds");
-    pa_cvolume_reset(&volume->inner, channels);
+    pa_cvolume cvolume;
+    pa_cvolume_reset(&cvolume, channels);
+    volume_store(volume, &cvolume);
     return 0;
 }
 
@@ -198,28 +277,36 @@ int volume_mute(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     lua_Integer channels = luaL_checkinteger(L, 2);
     luaL_argcheck(L, channels >= 0 && channels <= PA_CHANNELS_MAX, 2, "channel count out of bounds");
-    pa_cvolume_mute(&volume->inner, channels);
+    pa_cvolume cvolume;
+    pa_cvolume_mute(&cvolume, channels);
+    volume_store(volume, &cvolume);
     return 0;
 }
 
 
 int volume_avg(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
-    lua_pushinteger(L, pa_cvolume_avg(&volume->inner));
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    lua_pushinteger(L, pa_cvolume_avg(&cvolume));
     return 1;
 }
 
 
 int volume_min(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
-    lua_pushinteger(L, pa_cvolume_min(&volume->inner));
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    lua_pushinteger(L, pa_cvolume_min(&cvolume));
     return 1;
 }
 
 
 int volume_max(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
-    lua_pushinteger(L, pa_cvolume_max(&volume->inner));
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    lua_pushinteger(L, pa_cvolume_max(&cvolume));
     return 1;
 }
 
@@ -228,10 +315,13 @@ int volume_inc(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     lua_Integer value = luaL_checkinteger(L, 2);
     luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 2, "volume out of bounds");
-    if (!pa_cvolume_inc(&volume->inner, (pa_volume_t) value)) {
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    if (!pa_cvolume_inc(&cvolume, (pa_volume_t) value)) {
         return luaL_error(L, "failed to increase volume");
     }
 
+    volume_store(volume, &cvolume);
     return 0;
 }
 
@@ -240,10 +330,13 @@ int volume_dec(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     lua_Integer value = luaL_checkinteger(L, 2);
     luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 2, "volume out of bounds");
-    if (!pa_cvolume_dec(&volume->inner, (pa_volume_t) value)) {
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    if (!pa_cvolume_dec(&cvolume, (pa_volume_t) value)) {
         return luaL_error(L, "failed to decrease volume");
     }
 
+    volume_store(volume, &cvolume);
     return 0;
 }
 
@@ -252,33 +345,41 @@ int volume_scale(lua_State* L) {
     volume_t* volume = luaL_checkudata(L, 1, LUA_PA_VOLUME);
     lua_Integer value = luaL_checkinteger(L, 2);
     luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 2, "volume out of bounds");
-    if (!pa_cvolume_scale(&volume->inner, (pa_volume_t) value)) {
+    pa_cvolume cvolume;
+    volume_load(volume, &cvolume);
+    if (!pa_cvolume_scale(&cvolume, (pa_volume_t) value)) {
         return luaL_error(L, "failed to scale volume");
     }
 
+    volume_store(volume, &cvolume);
     return 0;
 }
 
 
 int volume_multiply(lua_State* L) {
     volume_t* left = luaL_checkudata(L, 1, LUA_PA_VOLUME);
+    pa_cvolume cvolume;
+    volume_load(left, &cvolume);
 
     switch (lua_type(L, 2)) {
     case LUA_TNUMBER: {
         lua_Integer value = luaL_checkinteger(L, 2);
         luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 2, "volume out of bounds");
-        if (!pa_sw_cvolume_multiply_scalar(&left->inner, &left->inner, (pa_volume_t) value)) {
+        if (!pa_sw_cvolume_multiply_scalar(&cvolume, &cvolume, (pa_volume_t) value)) {
             return luaL_error(L, "failed to multiply volume");
         }
 
+        volume_store(left, &cvolume);
         return 0;
     }
     case LUA_TUSERDATA: {
-        volume_t* right = luaL_checkudata(L, 2, LUA_PA_VOLUME);
-        if (!pa_sw_cvolume_multiply(&left->inner, &left->inner, &right->inner)) {
+        pa_cvolume right;
+        volume_load(luaL_checkudata(L, 2, LUA_PA_VOLUME), &right);
+        if (!pa_sw_cvolume_multiply(&cvolume, &cvolume, &right)) {
             return luaL_error(L, "failed to multiply volume");
         }
 
+        volume_store(left, &cvolume);
         return 0;
     }
     default: {
@@ -289,23 +390,28 @@ int volume_multiply(lua_State* L) {
 
 int volume_divide(lua_State* L) {
     volume_t* left = luaL_checkudata(L, 1, LUA_PA_VOLUME);
+    pa_cvolume cvolume;
+    volume_load(left, &cvolume);
 
     switch (lua_type(L, 2)) {
     case LUA_TNUMBER: {
         lua_Integer value = luaL_checkinteger(L, 2);
         luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 2, "volume out of bounds");
-        if (!pa_sw_cvolume_divide_scalar(&left->inner, &left->inner, (pa_volume_t) value)) {
+        if (!pa_sw_cvolume_divide_scalar(&cvolume, &cvolume, (pa_volume_t) value)) {
             return luaL_error(L, "failed to divide volume");
         }
 
+        volume_store(left, &cvolume);
         return 0;
     }
     case LUA_TUSERDATA: {
-        volume_t* right = luaL_checkudata(L, 2, LUA_PA_VOLUME);
-        if (!pa_sw_cvolume_divide(&left->inner, &left->inner, &right->inner)) {
+        pa_cvolume right;
+        volume_load(luaL_checkudata(L, 2, LUA_PA_VOLUME), &right);
+        if (!pa_sw_cvolume_divide(&cvolume, &cvolume, &right)) {
             return luaL_error(L, "failed to divide volume");
         }
 
+        volume_store(left, &cvolume);
         return 0;
     }
     default: {
@@ -315,7 +421,55 @@ int volume_divide(lua_State* L) {
 }
 
 
+// Converts the channels of a volume, or a list of volume values, at `index` into a new list.
+static int volume_list_to(lua_State* L, int index, double (*convert)(pa_volume_t)) {
+    volume_t* volume = luaU_testudata(L, index, LUA_PA_VOLUME);
+    if (volume != NULL) {
+        lua_createtable(L, volume->channels, 0);
+        for (int i = 0; i < volume->channels; i++) {
+            lua_pushnumber(L, convert(volume->values[i]));
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+
+    luaL_checktype(L, index, LUA_TTABLE);
+    int count = (int) lua_rawlen(L, index);
+    lua_createtable(L, count, 0);
+    for (int i = 1; i <= count; i++) {
+        lua_rawgeti(L, index, i);
+        pa_volume_t value = PA_CLAMP_VOLUME((pa_volume_t) luaL_checkinteger(L, -1));
+        lua_pop(L, 1);
+        lua_pushnumber(L, convert(value));
+        lua_rawseti(L, -2, i);
+    }
+    return 1;
+}
+
+
+// Converts a list of values at `index` into a new volume, one channel per value.
+static int volume_list_from(lua_State* L, int index, pa_volume_t (*convert)(double)) {
+    size_t channels = lua_rawlen(L, index);
+    if (channels > PA_CHANNELS_MAX) {
+        channels = PA_CHANNELS_MAX;
+    }
+
+    pa_cvolume volume;
+    volume.channels = (uint8_t) channels;
+    for (int i = 0; i < volume.channels; i++) {
+        lua_rawgeti(L, index, i + 1);
+        volume.values[i] = convert(luaL_checknumber(L, -1));
+        lua_pop(L, 1);
+    }
+    return volume_to_lua(L, &volume);
+}
+
+
 int volume_from_dB(lua_State* L) {
+    if (lua_istable(L, 1)) {
+        return volume_list_from(L, 1, lut_volume_from_dB);
+    }
+
     double value = (double) luaL_checknumber(L, 1);
     lua_pushinteger(L, pa_sw_volume_from_dB(value));
     return 1;
@@ -323,6 +477,10 @@ int volume_from_dB(lua_State* L) {
 
 
 int volume_to_dB(lua_State* L) {
+    if (!lua_isnumber(L, 1)) {
+        return volume_list_to(L, 1, lut_volume_to_dB);
+    }
+
     pa_volume_t value = luaL_checkinteger(L, 1);
     lua_pushnumber(L, pa_sw_volume_to_dB(value));
     return 1;
@@ -330,6 +488,10 @@ int volume_to_dB(lua_State* L) {
 
 
 int volume_from_linear(lua_State* L) {
+    if (lua_istable(L, 1)) {
+        return volume_list_from(L, 1, lut_volume_from_linear);
+    }
+
     double value = (double) luaL_checknumber(L, 1);
     lua_pushinteger(L, pa_sw_volume_from_linear(value));
     return 1;
@@ -337,7 +499,42 @@ int volume_from_linear(lua_State* L) {
 
 
 int volume_to_linear(lua_State* L) {
+    if (!lua_isnumber(L, 1)) {
+        return volume_list_to(L, 1, lut_volume_to_linear);
+    }
+
     pa_volume_t value = luaL_checkinteger(L, 1);
     lua_pushnumber(L, pa_sw_volume_to_linear(value));
     return 1;
 }
+
+
+int volume_lut_error(lua_State* L) {
+    const lut_error* error = lut_get_error();
+    lua_createtable(L, 0, 3);
+    lua_pushnumber(L, error->to_dB);
+    lua_setfield(L, -2, "to_dB");
+    lua_pushnumber(L, error->from_dB);
+    lua_setfield(L, -2, "from_dB");
+    lua_pushnumber(L, error->from_linear);
+    lua_setfield(L, -2, "from_linear");
+    return 1;
+}
+
+
+int volume_layout(lua_State* L) {
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, sizeof(volume_t));
+    lua_setfield(L, -2, "size");
+    lua_pushinteger(L, offsetof(volume_t, channels));
+    lua_setfield(L, -2, "channels_offset");
+    lua_pushinteger(L, offsetof(volume_t, values));
+    lua_setfield(L, -2, "values_offset");
+    lua_pushinteger(L, offsetof(volume_t, inline_values));
+    lua_setfield(L, -2, "inline_offset");
+    lua_pushinteger(L, VOLUME_INLINE_CHANNELS);
+    lua_setfield(L, -2, "inline_channels");
+    lua_pushinteger(L, PA_CHANNELS_MAX);
+    lua_setfield(L, -2, "channels_max");
+    return 1;
+}
@@ -15,8 +15,18 @@
 #define LUA_PA_VOLUME "lua_libpulse_glib.volume"
 
 
+// Volumes with up to this many channels are stored inline. Nearly all devices and streams are mono or stereo.
+#define VOLUME_INLINE_CHANNELS 2
+
+
+// A compact `pa_cvolume`. A full one has room for `PA_CHANNELS_MAX` values, 132 bytes, most of which would go
+// unused.
 typedef struct volume_t {
-    pa_cvolume inner;
+    // Points to `inline_values`, or to a heap allocation with room for `PA_CHANNELS_MAX` values once more
+    // channels are needed. Valid for at least `channels` values.
+    pa_volume_t* values;
+    uint8_t channels;
+    pa_volume_t inline_values[VOLUME_INLINE_CHANNELS];
 } volume_t;
 
 
@@ -30,9 +40,13 @@ typedef struct volume_t {
  */
 int volume_to_lua(lua_State*, const pa_cvolume*);
 
-/* Creates a pa_cvolume from Lua userdata
+/* Reads a pa_cvolume from a @{Volume} or a plain list of channel volumes.
  */
-pa_cvolume* volume_from_lua(lua_State*, int);
+void volume_from_lua(lua_State*, int, pa_cvolume*);
+
+// Copies between a @{Volume}'s compact storage and a full `pa_cvolume`.
+void volume_load(const volume_t*, pa_cvolume*);
+void volume_store(volume_t*, const pa_cvolume*);
 
 /* Implements the `#` length operator.
  * This simply proxies to the `.channels` value.
@@ -42,6 +56,7 @@ int volume__eq(lua_State*);
 int volume__tostring(lua_State*);
 int volume__index(lua_State*);
 int volume__newindex(lua_State*);
+int volume__gc(lua_State*);
 
 
 /// Static Functions
@@ -63,52 +78,101 @@ int volume_new(lua_State*);
  */
 int volume_is_valid(lua_State*);
 
-/** Converts a decibel value to an integer volume value.
+/** Converts decibel values to integer volume values.
  *
- * This is only valid for software volumes. It does not operate
- * on instances of @{Volume}.
+ * This is only valid for software volumes.
+ *
+ * A single number is converted exactly, through libpulse. A list of values is converted into a @{Volume}
+ * with one channel per value, using lookup tables instead of `pow` and `cbrt`. See @{lut_error} for how far
+ * those results may be off.
  *
  * @function from_dB
- * @tparam number value
- * @treturn number
+ * @tparam number|table value A value, or a list of channel values.
+ * @treturn number|Volume
  */
 int volume_from_dB(lua_State*);
 
-/** Converts an integer volume value to a decibel value.
+/** Converts integer volume values to decibel values.
+ *
+ * This is only valid for software volumes.
  *
- * This is only valid for software volumes. It does not operate
- * on instances of @{Volume}.
+ * A single number is converted exactly, through libpulse. The channels of a @{Volume}, or a list of values,
+ * are converted into a list using lookup tables instead of `log`.
  *
  * @function to_dB
- * @tparam number value
- * @treturn number
+ * @tparam number|table|Volume value
+ * @treturn number|table
  */
 int volume_to_dB(lua_State*);
 
-/** Converts a linear factor to an integer volume value.
+/** Converts linear factors to integer volume values.
  *
- * `0.0` and less is muted, `1.0` is normal volume.
+ * `0.0` and less is muted, `1.0` is normal volume. Like in libpulse, factors within `0.001` of `1.0` are
+ * normal volume as well.
  *
- * This is only valid for software volumes. It does not operate
- * on instances of @{Volume}.
+ * This is only valid for software volumes. Lists are converted into a @{Volume}, like with @{from_dB}.
  *
  * @function from_linear
- * @tparam number value
- * @treturn number
+ * @tparam number|table value A value, or a list of channel values.
+ * @treturn number|Volume
  */
 int volume_from_linear(lua_State*);
 
-/** Converts an integer volume value to linear factor.
+/** Converts integer volume values to linear factors.
  *
- * This is only valid for software volumes. It does not operate
- * on instances of @{Volume}.
+ * This is only valid for software volumes. The channels of a @{Volume}, or a list of values, are converted
+ * into a list.
  *
  * @function to_linear
- * @tparam number value
- * @treturn number
+ * @tparam number|table|Volume value
+ * @treturn number|table
  */
 int volume_to_linear(lua_State*);
 
+/** Returns the worst-case error of the lookup tables used to convert lists and @{Volume}s.
+ *
+ * The bounds are derived from the exact interpolation error of every table segment when the tables are built.
+ * The table has the fields `to_dB`, in dB, as well as `from_dB` and `from_linear`, relative to the exact
+ * result before it is rounded to an integer volume.
+ *
+ * @function lut_error
+ * @treturn table
+ */
+int volume_lut_error(lua_State*);
+
+/** Compiles a slider curve into a @{lua_libpulse_glib.curve.Curve}.
+ *
+ * The curve is either one of the following names, a list of `{ position, volume }` breakpoints that are
+ * interpolated linearly, or a function that takes a position and returns a volume. It must not decrease.
+ *
+ * - `"cubic"`: Positions are proportional to volumes, i.e. the cube root of the amplitude. This is what
+ *   libpulse's own volume scale does.
+ * - `"linear"`: Positions are proportional to the amplitude.
+ * - `"log"`: Equal steps in position are equal steps in dB, over `range` dB. The bottom end is offset
+ *   slightly, so that position `0` is muted.
+ *
+ * Options are `size`, the number of table segments (default `1024`), `max`, the volume at position `1`
+ * (default `PA_VOLUME_NORM`, ignored for breakpoints and functions), and `range` (default `60`).
+ *
+ * @function curve
+ * @tparam string|table|function kind
+ * @tparam[opt] table options
+ * @treturn Curve
+ */
+int curve_new(lua_State*);
+
+
+/** Returns the memory layout of @{Volume} userdata.
+ *
+ * This is used by @{lua_libpulse_glib.volume_ffi} to verify its declarations before accessing volumes
+ * directly. The table has the fields `size`, `channels_offset`, `values_offset` (of the pointer to the
+ * values), `inline_offset`, `inline_channels` and `channels_max`.
+ *
+ * @function layout
+ * @treturn table
+ */
+int volume_layout(lua_State*);
+
 
 /// Volume
 /// @type Volume
@@ -233,6 +297,8 @@ int volume_reset(lua_State*);
 int volume_scale(lua_State*);
 
 /** Sets a channel to the given value.
+ *
+ * Setting a channel beyond the current channel count adds channels up to it. The ones in between are muted.
  *
  * @function Volume:set
  * @tparam number index The channel index.
@@ -277,6 +343,7 @@ static const struct luaL_Reg volume_mt[] = {
     { "__tostring", volume__tostring},
     { "__eq",       volume__eq      },
     { "__newindex", volume__newindex},
+    { "__gc",       volume__gc      },
     { NULL,         NULL            }
 };
 
@@ -288,6 +355,9 @@ static const struct luaL_Reg volume_lib[] = {
     { "from_linear", volume_from_linear},
     { "to_linear",   volume_to_linear  },
     { "is_valid",    volume_is_valid   },
+    { "lut_error",   volume_lut_error  },
+    { "curve",       curve_new         },
+    { "layout",      volume_layout     },
     { NULL,          NULL              }
 };
 
@@ -0,0 +1,660 @@
+#include "volume_array.h"
+
+#include "lua_util.h"
+#include "lut.h"
+#include "pulseaudio.h"
+#include "volume.h"
+
+#include <glib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// The number of entries that the kernels process at once.
+#define LANES 4
+
+
+static volume_array* volume_array_check(lua_State* L, int index) {
+    return luaL_checkudata(L, index, LUA_PA_VOLUME_ARRAY);
+}
+
+
+static size_t volume_array_check_index(lua_State* L, volume_array* array, int arg) {
+    lua_Integer index = luaL_checkinteger(L, arg);
+    luaL_argcheck(L, index >= 1 && (size_t) index <= array->length, arg, "index out of bounds");
+    return (size_t) index - 1;
+}
+
+
+static lua_Integer check_volume_value(lua_State* L, int arg) {
+    lua_Integer value = luaL_checkinteger(L, arg);
+    luaL_argcheck(L, PA_VOLUME_IS_VALID(value), arg, "volume out of bounds");
+    return value;
+}
+
+
+static inline uint32_t* row(volume_array* array, uint32_t channel) {
+    return array->values + (size_t) channel * array->stride;
+}
+
+
+static void volume_array_store(volume_array* array, size_t index, const pa_cvolume* volume) {
+    array->channels[index] = volume->channels;
+    for (uint32_t c = 0; c < PA_CHANNELS_MAX; c++) {
+        row(array, c)[index] = c < volume->channels ? volume->values[c] : PA_VOLUME_MUTED;
+    }
+    array->max_channels = MAX(array->max_channels, volume->channels);
+}
+
+
+static void volume_array_load(volume_array* array, size_t index, pa_cvolume* volume) {
+    volume->channels = (uint8_t) array->channels[index];
+    for (uint32_t c = 0; c < volume->channels; c++) {
+        volume->values[c] = row(array, c)[index];
+    }
+}
+
+
+int volume_array_new(lua_State* L) {
+    lua_Integer length = luaL_checkinteger(L, 1);
+    lua_Integer channels = luaL_optinteger(L, 2, 0);
+    lua_Integer value = luaL_optinteger(L, 3, PA_VOLUME_NORM);
+
+    luaL_argcheck(L, length >= 0 && length <= INT32_MAX, 1, "length out of bounds");
+    luaL_argcheck(L, channels >= 0 && channels <= PA_CHANNELS_MAX, 2, "channel count out of bounds");
+    luaL_argcheck(L, PA_VOLUME_IS_VALID(value), 3, "volume out of bounds");
+
+    volume_array* array = lua_newuserdata(L, sizeof(volume_array));
+    array->length = (size_t) length;
+    array->stride = ((size_t) length + LANES - 1) / LANES * LANES;
+    array->max_channels = 0;
+    // Padding entries have no channels, so the kernels can run over whole blocks without affecting anything.
+    array->channels = g_new0(uint32_t, MAX(array->stride, 1));
+    array->values = g_new0(uint32_t, MAX(array->stride, 1) * PA_CHANNELS_MAX);
+
+    luaL_getmetatable(L, LUA_PA_VOLUME_ARRAY);
+    lua_setmetatable(L, -2);
+
+    pa_cvolume initial;
+    initial.channels = (uint8_t) channels;
+    for (int c = 0; c < channels; c++) {
+        initial.values[c] = (pa_volume_t) value;
+    }
+    for (size_t i = 0; i < array->length; i++) {
+        volume_array_store(array, i, &initial);
+    }
+
+    return 1;
+}
+
+
+int volume_array_set(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    size_t index = volume_array_check_index(L, array, 2);
+
+    volume_t* volume = luaU_testudata(L, 3, LUA_PA_VOLUME);
+    if (volume != NULL) {
+        pa_cvolume cvolume;
+        volume_load(volume, &cvolume);
+        volume_array_store(array, index, &cvolume);
+        return 0;
+    }
+
+    luaL_checktype(L, 3, LUA_TTABLE);
+    pa_cvolume cvolume;
+    cvolume.channels = (uint8_t) MIN(lua_rawlen(L, 3), PA_CHANNELS_MAX);
+    for (int c = 0; c < cvolume.channels; c++) {
+        lua_rawgeti(L, 3, c + 1);
+        pa_volume_t value = (pa_volume_t) luaL_checkinteger(L, -1);
+        cvolume.values[c] = PA_CLAMP_VOLUME(value);
+        lua_pop(L, 1);
+    }
+
+    volume_array_store(array, index, &cvolume);
+    return 0;
+}
+
+
+int volume_array_get(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    size_t index = volume_array_check_index(L, array, 2);
+
+    pa_cvolume volume;
+    volume_array_load(array, index, &volume);
+    return volume_to_lua(L, &volume);
+}
+
+
+int volume_array_view(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    size_t index = volume_array_check_index(L, array, 2);
+
+    volume_view* view = lua_newuserdata(L, sizeof(volume_view));
+    view->array = array;
+    view->index = index;
+
+    lua_pushstring(L, LUA_PULSEAUDIO);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    lua_pushstring(L, LUA_PA_REGISTRY);
+    lua_gettable(L, -2);
+    lua_pushvalue(L, 1);
+    view->array_ref = luaL_ref(L, -2);
+    lua_pop(L, 2);
+
+    luaL_getmetatable(L, LUA_PA_VOLUME_VIEW);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+
+#if defined(__SSE2__)
+// Returns a mask of the entries in the block that have the given channel.
+static inline __m128i channel_mask(const volume_array* array, size_t i, uint32_t channel) {
+    __m128i channels = _mm_loadu_si128((const __m128i*) (array->channels + i));
+    return _mm_cmpgt_epi32(channels, _mm_set1_epi32((int) channel));
+}
+
+
+static inline __m128i select_epi32(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+
+// Volumes are at most `PA_VOLUME_MAX`, so they can be converted as signed integers.
+static inline void unpack_pd(__m128i v, __m128d* lo, __m128d* hi) {
+    *lo = _mm_cvtepi32_pd(v);
+    *hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2)));
+}
+
+
+// Truncates to integers, clamping to `PA_VOLUME_MAX`.
+static inline __m128i pack_pd(__m128d lo, __m128d hi) {
+    __m128d max = _mm_set1_pd((double) PA_VOLUME_MAX);
+    lo = _mm_min_pd(lo, max);
+    hi = _mm_min_pd(hi, max);
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+#endif
+
+
+// `pa_sw_volume_multiply`: `(a * b + NORM / 2) / NORM`. The products are exact in double precision up to the
+// point where the result is clamped anyway.
+static void kernel_multiply(volume_array* array, uint32_t channel, const uint32_t* other, uint32_t scalar) {
+    uint32_t* values = row(array, channel);
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128d scale = _mm_set1_pd(1.0 / PA_VOLUME_NORM);
+    const __m128d half = _mm_set1_pd(0.5);
+    __m128d b_lo, b_hi;
+    unpack_pd(_mm_set1_epi32((int) scalar), &b_lo, &b_hi);
+
+    for (; i < array->stride; i += LANES) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (values + i));
+        __m128d a_lo, a_hi;
+        unpack_pd(a, &a_lo, &a_hi);
+        if (other != NULL) {
+            unpack_pd(_mm_loadu_si128((const __m128i*) (other + i)), &b_lo, &b_hi);
+        }
+
+        __m128d r_lo = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(a_lo, b_lo), scale), half);
+        __m128d r_hi = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(a_hi, b_hi), scale), half);
+
+        __m128i r = select_epi32(channel_mask(array, i, channel), pack_pd(r_lo, r_hi), a);
+        _mm_storeu_si128((__m128i*) (values + i), r);
+    }
+#endif
+
+    for (; i < array->stride; i++) {
+        if (channel < array->channels[i]) {
+            uint64_t b = other != NULL ? other[i] : scalar;
+            values[i] = PA_CLAMP_VOLUME((values[i] * b + PA_VOLUME_NORM / 2) / PA_VOLUME_NORM);
+        }
+    }
+}
+
+
+// `pa_sw_volume_divide`: `(a * NORM + b / 2) / b`, or `0` when dividing by `0`. The dividend stays below 2^48, so
+// the quotient is exact enough in double precision to truncate correctly.
+static void kernel_divide(volume_array* array, uint32_t channel, const uint32_t* other, uint32_t scalar) {
+    uint32_t* values = row(array, channel);
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128d norm = _mm_set1_pd(PA_VOLUME_NORM);
+    __m128i b = _mm_set1_epi32((int) scalar);
+
+    for (; i < array->stride; i += LANES) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (values + i));
+        if (other != NULL) {
+            b = _mm_loadu_si128((const __m128i*) (other + i));
+        }
+
+        __m128d a_lo, a_hi, b_lo, b_hi, h_lo, h_hi;
+        unpack_pd(a, &a_lo, &a_hi);
+        unpack_pd(b, &b_lo, &b_hi);
+        unpack_pd(_mm_srli_epi32(b, 1), &h_lo, &h_hi);
+
+        __m128d r_lo = _mm_div_pd(_mm_add_pd(_mm_mul_pd(a_lo, norm), h_lo), b_lo);
+        __m128d r_hi = _mm_div_pd(_mm_add_pd(_mm_mul_pd(a_hi, norm), h_hi), b_hi);
+
+        __m128i zero = _mm_cmpeq_epi32(b, _mm_setzero_si128());
+        __m128i r = _mm_andnot_si128(zero, pack_pd(r_lo, r_hi));
+        r = select_epi32(channel_mask(array, i, channel), r, a);
+        _mm_storeu_si128((__m128i*) (values + i), r);
+    }
+#endif
+
+    for (; i < array->stride; i++) {
+        if (channel < array->channels[i]) {
+            uint64_t b = other != NULL ? other[i] : scalar;
+            values[i] = b == 0 ? 0 : PA_CLAMP_VOLUME(((uint64_t) values[i] * PA_VOLUME_NORM + b / 2) / b);
+        }
+    }
+}
+
+
+static void kernel_clamp(volume_array* array, uint32_t channel, uint32_t min, uint32_t max) {
+    uint32_t* values = row(array, channel);
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i lo = _mm_set1_epi32((int) min);
+    const __m128i hi = _mm_set1_epi32((int) max);
+
+    for (; i < array->stride; i += LANES) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (values + i));
+        __m128i r = select_epi32(_mm_cmpgt_epi32(lo, v), lo, v);
+        r = select_epi32(_mm_cmpgt_epi32(r, hi), hi, r);
+        r = select_epi32(channel_mask(array, i, channel), r, v);
+        _mm_storeu_si128((__m128i*) (values + i), r);
+    }
+#endif
+
+    for (; i < array->stride; i++) {
+        if (channel < array->channels[i]) {
+            values[i] = CLAMP(values[i], min, max);
+        }
+    }
+}
+
+
+typedef enum reduction {
+    REDUCTION_MIN,
+    REDUCTION_MAX,
+    REDUCTION_AVG,
+} reduction;
+
+
+// Reduces the channels of the block of entries starting at `i`.
+static void kernel_reduce(volume_array* array, size_t i, reduction op, uint32_t out[LANES]) {
+#if defined(__SSE2__)
+    if (op != REDUCTION_AVG) {
+        __m128i acc = _mm_set1_epi32(op == REDUCTION_MIN ? (int) PA_VOLUME_MAX : (int) PA_VOLUME_MUTED);
+
+        for (uint32_t c = 0; c < array->max_channels; c++) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (row(array, c) + i));
+            __m128i better = op == REDUCTION_MIN ? _mm_cmpgt_epi32(acc, v) : _mm_cmpgt_epi32(v, acc);
+            acc = select_epi32(_mm_and_si128(better, channel_mask(array, i, c)), v, acc);
+        }
+
+        _mm_storeu_si128((__m128i*) out, acc);
+
+        // Entries without channels keep the initial value. Like `pa_cvolume_min` and `pa_cvolume_max`, they
+        // reduce to muted instead.
+        for (size_t l = 0; l < LANES; l++) {
+            if (array->channels[i + l] == 0) {
+                out[l] = PA_VOLUME_MUTED;
+            }
+        }
+        return;
+    }
+
+    // Channels beyond an entry's count are `0`, so they can be summed without a mask.
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum_lo = zero;
+    __m128i sum_hi = zero;
+    for (uint32_t c = 0; c < array->max_channels; c++) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (row(array, c) + i));
+        sum_lo = _mm_add_epi64(sum_lo, _mm_unpacklo_epi32(v, zero));
+        sum_hi = _mm_add_epi64(sum_hi, _mm_unpackhi_epi32(v, zero));
+    }
+
+    uint64_t sums[LANES];
+    _mm_storeu_si128((__m128i*) sums, sum_lo);
+    _mm_storeu_si128((__m128i*) (sums + 2), sum_hi);
+    for (size_t l = 0; l < LANES; l++) {
+        uint32_t channels = array->channels[i + l];
+        out[l] = channels > 0 ? (uint32_t) (sums[l] / channels) : PA_VOLUME_MUTED;
+    }
+#else
+    for (size_t l = 0; l < LANES; l++) {
+        pa_cvolume volume;
+        volume_array_load(array, i + l, &volume);
+        switch (op) {
+        case REDUCTION_MIN:
+            out[l] = pa_cvolume_min(&volume);
+            break;
+        case REDUCTION_MAX:
+            out[l] = pa_cvolume_max(&volume);
+            break;
+        case REDUCTION_AVG:
+            out[l] = volume.channels > 0 ? pa_cvolume_avg(&volume) : PA_VOLUME_MUTED;
+            break;
+        }
+    }
+#endif
+}
+
+
+static int volume_array_reduce(lua_State* L, reduction op) {
+    volume_array* array = volume_array_check(L, 1);
+
+    if (lua_isnoneornil(L, 2)) {
+        lua_createtable(L, (int) array->length, 0);
+    } else {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_pushvalue(L, 2);
+    }
+
+    uint32_t out[LANES];
+    for (size_t i = 0; i < array->length; i += LANES) {
+        kernel_reduce(array, i, op, out);
+        for (size_t l = 0; l < LANES && i + l < array->length; l++) {
+            lua_pushinteger(L, out[l]);
+            lua_rawseti(L, -2, (int) (i + l + 1));
+        }
+    }
+
+    return 1;
+}
+
+
+int volume_array_min(lua_State* L) {
+    return volume_array_reduce(L, REDUCTION_MIN);
+}
+
+
+int volume_array_max(lua_State* L) {
+    return volume_array_reduce(L, REDUCTION_MAX);
+}
+
+
+int volume_array_avg(lua_State* L) {
+    return volume_array_reduce(L, REDUCTION_AVG);
+}
+
+
+static int volume_array_convert_to(lua_State* L, double (*convert)(pa_volume_t)) {
+    volume_array* array = volume_array_check(L, 1);
+
+    if (lua_isnoneornil(L, 2)) {
+        lua_createtable(L, (int) array->length, 0);
+    } else {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_pushvalue(L, 2);
+    }
+
+    for (size_t i = 0; i < array->length; i++) {
+        int channels = (int) array->channels[i];
+
+        lua_rawgeti(L, -1, (int) i + 1);
+        if (lua_istable(L, -1)) {
+            // Drop values left over from an entry that had more channels.
+            for (int c = (int) lua_rawlen(L, -1); c > channels; c--) {
+                lua_pushnil(L);
+                lua_rawseti(L, -2, c);
+            }
+        } else {
+            lua_pop(L, 1);
+            lua_createtable(L, channels, 0);
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, (int) i + 1);
+        }
+
+        for (int c = 0; c < channels; c++) {
+            lua_pushnumber(L, convert(row(array, (uint32_t) c)[i]));
+            lua_rawseti(L, -2, c + 1);
+        }
+        lua_pop(L, 1);
+    }
+
+    return 1;
+}
+
+
+static int volume_array_convert_from(lua_State* L, pa_volume_t (*convert)(double)) {
+    volume_array* array = volume_array_check(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_argcheck(L, lua_rawlen(L, 2) == array->length, 2, "expected one list per entry");
+
+    // Convert everything before storing anything, so that an invalid value leaves the array unchanged.
+    pa_cvolume* volumes = lua_newuserdata(L, MAX(array->length, 1) * sizeof(pa_cvolume));
+    for (size_t i = 0; i < array->length; i++) {
+        lua_rawgeti(L, 2, (int) i + 1);
+        luaL_argcheck(L, lua_istable(L, -1), 2, "expected one list per entry");
+
+        volumes[i].channels = (uint8_t) MIN(lua_rawlen(L, -1), PA_CHANNELS_MAX);
+        for (int c = 0; c < volumes[i].channels; c++) {
+            lua_rawgeti(L, -1, c + 1);
+            volumes[i].values[c] = convert(luaL_checknumber(L, -1));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+
+    array->max_channels = 0;
+    for (size_t i = 0; i < array->length; i++) {
+        volume_array_store(array, i, &volumes[i]);
+    }
+
+    return 0;
+}
+
+
+int volume_array_to_dB(lua_State* L) {
+    return volume_array_convert_to(L, lut_volume_to_dB);
+}
+
+
+int volume_array_to_linear(lua_State* L) {
+    return volume_array_convert_to(L, lut_volume_to_linear);
+}
+
+
+int volume_array_from_dB(lua_State* L) {
+    return volume_array_convert_from(L, lut_volume_from_dB);
+}
+
+
+int volume_array_from_linear(lua_State* L) {
+    return volume_array_convert_from(L, lut_volume_from_linear);
+}
+
+
+int volume_array_scale(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    uint32_t value = (uint32_t) check_volume_value(L, 2);
+
+    uint32_t max[LANES];
+    for (size_t i = 0; i < array->stride; i += LANES) {
+        kernel_reduce(array, i, REDUCTION_MAX, max);
+
+        // Like `pa_cvolume_scale`: `v * value / max`, or `value` for entries that are muted entirely.
+#if defined(__SSE2__)
+        __m128d t_lo, t_hi, s_lo, s_hi;
+        __m128i t = _mm_loadu_si128((const __m128i*) max);
+        __m128i s = _mm_set1_epi32((int) value);
+        __m128i muted = _mm_cmpeq_epi32(t, _mm_setzero_si128());
+        unpack_pd(t, &t_lo, &t_hi);
+        unpack_pd(s, &s_lo, &s_hi);
+
+        for (uint32_t c = 0; c < array->max_channels; c++) {
+            uint32_t* values = row(array, c) + i;
+            __m128i v = _mm_loadu_si128((const __m128i*) values);
+            __m128d v_lo, v_hi;
+            unpack_pd(v, &v_lo, &v_hi);
+
+            __m128i r = pack_pd(_mm_div_pd(_mm_mul_pd(v_lo, s_lo), t_lo), _mm_div_pd(_mm_mul_pd(v_hi, s_hi), t_hi));
+            r = select_epi32(muted, s, r);
+            r = select_epi32(channel_mask(array, i, c), r, v);
+            _mm_storeu_si128((__m128i*) values, r);
+        }
+#else
+        for (uint32_t c = 0; c < array->max_channels; c++) {
+            uint32_t* values = row(array, c) + i;
+            for (size_t l = 0; l < LANES; l++) {
+                if (c < array->channels[i + l]) {
+                    values[l] = max[l] == PA_VOLUME_MUTED ? value
+                                                          : (uint32_t) ((uint64_t) values[l] * value / max[l]);
+                }
+            }
+        }
+#endif
+    }
+
+    return 0;
+}
+
+
+// Reads the argument of `multiply` and `divide`, which is either a volume or another array of the same length.
+// Returns the other array, or `NULL` when a volume was given.
+static volume_array* check_operand(lua_State* L, volume_array* array, uint32_t* scalar) {
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        *scalar = (uint32_t) check_volume_value(L, 2);
+        return NULL;
+    }
+
+    volume_array* other = volume_array_check(L, 2);
+    luaL_argcheck(L, other->length == array->length, 2, "arrays must have the same length");
+    *scalar = 0;
+    return other;
+}
+
+
+int volume_array_multiply(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    uint32_t scalar;
+    volume_array* other = check_operand(L, array, &scalar);
+
+    for (uint32_t c = 0; c < array->max_channels; c++) {
+        kernel_multiply(array, c, other != NULL ? row(other, c) : NULL, scalar);
+    }
+
+    return 0;
+}
+
+
+int volume_array_divide(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    uint32_t scalar;
+    volume_array* other = check_operand(L, array, &scalar);
+
+    for (uint32_t c = 0; c < array->max_channels; c++) {
+        kernel_divide(array, c, other != NULL ? row(other, c) : NULL, scalar);
+    }
+
+    return 0;
+}
+
+
+int volume_array_clamp(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    uint32_t min = (uint32_t) check_volume_value(L, 2);
+    uint32_t max = (uint32_t) check_volume_value(L, 3);
+    luaL_argcheck(L, min <= max, 3, "max must not be less than min");
+
+    for (uint32_t c = 0; c < array->max_channels; c++) {
+        kernel_clamp(array, c, min, max);
+    }
+
+    return 0;
+}
+
+
+int volume_array__len(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    lua_pushinteger(L, (lua_Integer) array->length);
+    return 1;
+}
+
+
+int volume_array__gc(lua_State* L) {
+    volume_array* array = volume_array_check(L, 1);
+    g_free(array->channels);
+    g_free(array->values);
+    array->channels = NULL;
+    array->values = NULL;
+    array->length = 0;
+    array->stride = 0;
+    return 0;
+}
+
+
+static volume_view* volume_view_check(lua_State* L, int index) {
+    return luaL_checkudata(L, index, LUA_PA_VOLUME_VIEW);
+}
+
+
+int volume_view_to_volume(lua_State* L) {
+    volume_view* view = volume_view_check(L, 1);
+    pa_cvolume volume;
+    volume_array_load(view->array, view->index, &volume);
+    return volume_to_lua(L, &volume);
+}
+
+
+int volume_view__index(lua_State* L) {
+    volume_view* view = volume_view_check(L, 1);
+
+    if (lua_type(L, 2) != LUA_TNUMBER) {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    lua_Integer channel = lua_tointeger(L, 2);
+    if (channel < 1 || channel > view->array->channels[view->index]) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, row(view->array, (uint32_t) channel - 1)[view->index]);
+    return 1;
+}
+
+
+int volume_view__newindex(lua_State* L) {
+    volume_view* view = volume_view_check(L, 1);
+    lua_Integer channel = luaL_checkinteger(L, 2);
+    lua_Integer value = check_volume_value(L, 3);
+
+    luaL_argcheck(L, channel >= 1 && channel <= view->array->channels[view->index], 2, "channel index out of bounds");
+    row(view->array, (uint32_t) channel - 1)[view->index] = (uint32_t) value;
+    return 0;
+}
+
+
+int volume_view__len(lua_State* L) {
+    volume_view* view = volume_view_check(L, 1);
+    lua_pushinteger(L, view->array->channels[view->index]);
+    return 1;
+}
+
+
+int volume_view__gc(lua_State* L) {
+    volume_view* view = volume_view_check(L, 1);
+
+    lua_pushstring(L, LUA_PULSEAUDIO);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    lua_pushstring(L, LUA_PA_REGISTRY);
+    lua_gettable(L, -2);
+    luaL_unref(L, -1, view->array_ref);
+    lua_pop(L, 2);
+
+    return 0;
+}
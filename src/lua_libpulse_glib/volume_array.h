@@ -0,0 +1,254 @@
+/** Arrays of volumes.
+ *
+ * A @{VolumeArray} stores many channel volumes in one block of memory, so that they can be updated together
+ * in a single call. This is meant for mixers that recompute the volumes of many streams at once.
+ *
+ * Volumes are stored as structure of arrays: the values for channel 1 of all entries are contiguous, followed
+ * by those for channel 2, and so on. Batch operations run over these rows with SIMD instructions where
+ * available.
+ *
+ *    local volume_array = require("lua_libpulse_glib.volume_array")
+ *    local arr = volume_array.new(#streams)
+ *    for i, stream in ipairs(streams) do arr:set(i, stream.volume) end
+ *    arr:multiply(master)
+ *    arr:clamp(0, volume.from_dB(0))
+ *
+ * @module lua_libpulse_glib.volume_array
+ */
+#pragma once
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <pulse/volume.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LUA_PA_VOLUME_ARRAY "lua_libpulse_glib.volume_array"
+#define LUA_PA_VOLUME_VIEW  "lua_libpulse_glib.volume_view"
+
+
+typedef struct volume_array {
+    // The number of entries.
+    size_t length;
+    // The distance between two channel rows, in values. Rounded up to a multiple of 4, for the SIMD kernels.
+    size_t stride;
+    // The highest channel count of any entry, so that unused rows can be skipped.
+    uint32_t max_channels;
+    // The channel count of every entry.
+    uint32_t* channels;
+    // `PA_CHANNELS_MAX` rows of `stride` values. Channels beyond an entry's channel count are kept at `0`.
+    uint32_t* values;
+} volume_array;
+
+
+// A reference to a single entry of an array. Reads and writes go directly to the array's memory.
+typedef struct volume_view {
+    volume_array* array;
+    size_t index;
+    // A reference to the array's userdata in the registry, to keep it alive.
+    int array_ref;
+} volume_view;
+
+
+/// Static Functions
+/// @section static
+
+
+/** Creates a new array.
+ *
+ * @function new
+ * @tparam number length The number of entries.
+ * @tparam[opt=0] number channels The initial channel count of every entry.
+ * @tparam[opt=PA_VOLUME_NORM] number value The initial volume of every channel.
+ * @treturn VolumeArray
+ */
+int volume_array_new(lua_State*);
+
+
+/// VolumeArray
+/// @type VolumeArray
+
+
+/** Replaces an entry.
+ *
+ * @function VolumeArray:set
+ * @tparam number index
+ * @tparam Volume|table volume A @{lua_libpulse_glib.volume.Volume} or a list of channel volumes.
+ */
+int volume_array_set(lua_State*);
+
+/** Returns a copy of an entry.
+ *
+ * @function VolumeArray:get
+ * @tparam number index
+ * @treturn Volume
+ */
+int volume_array_get(lua_State*);
+
+/** Returns a view of an entry.
+ *
+ * The view reads and writes the array's memory directly, without copying the volume.
+ *
+ * @function VolumeArray:view
+ * @tparam number index
+ * @treturn VolumeView
+ */
+int volume_array_view(lua_State*);
+
+/** Scales every entry, so that its loudest channel is at the given volume.
+ *
+ * Results are exact as long as the product of a channel's volume and the target is below 2^53.
+ *
+ * @function VolumeArray:scale
+ * @tparam number value
+ */
+int volume_array_scale(lua_State*);
+
+/** Multiplies every entry, like @{lua_libpulse_glib.volume.Volume:multiply}.
+ *
+ * When another array is given, entries are multiplied pairwise. It must have the same length.
+ *
+ * @function VolumeArray:multiply
+ * @tparam number|VolumeArray value
+ */
+int volume_array_multiply(lua_State*);
+
+/** Divides every entry, like @{lua_libpulse_glib.volume.Volume:divide}.
+ *
+ * @function VolumeArray:divide
+ * @tparam number|VolumeArray value
+ */
+int volume_array_divide(lua_State*);
+
+/** Clamps every channel volume to the given range.
+ *
+ * @function VolumeArray:clamp
+ * @tparam number min
+ * @tparam number max
+ */
+int volume_array_clamp(lua_State*);
+
+/** Returns the volume of each entry's quietest channel.
+ *
+ * @function VolumeArray:min
+ * @tparam[opt] table out A table to store the results in, instead of creating a new one.
+ * @treturn table
+ */
+int volume_array_min(lua_State*);
+
+/** Returns the volume of each entry's loudest channel.
+ *
+ * @function VolumeArray:max
+ * @tparam[opt] table out
+ * @treturn table
+ */
+int volume_array_max(lua_State*);
+
+/** Returns the average volume of each entry.
+ *
+ * @function VolumeArray:avg
+ * @tparam[opt] table out
+ * @treturn table
+ */
+int volume_array_avg(lua_State*);
+
+/** Converts every entry to decibel values.
+ *
+ * Like @{lua_libpulse_glib.volume.to_dB}, this uses lookup tables. The result is a list with one list of
+ * channel values per entry.
+ *
+ * @function VolumeArray:to_dB
+ * @tparam[opt] table out A table to store the results in. Lists already in it are reused.
+ * @treturn table
+ */
+int volume_array_to_dB(lua_State*);
+
+/** Converts every entry to linear factors.
+ *
+ * @function VolumeArray:to_linear
+ * @tparam[opt] table out
+ * @treturn table
+ */
+int volume_array_to_linear(lua_State*);
+
+/** Replaces every entry with volumes converted from decibel values.
+ *
+ * @function VolumeArray:from_dB
+ * @tparam table values A list with one list of channel values per entry. It must have the array's length.
+ */
+int volume_array_from_dB(lua_State*);
+
+/** Replaces every entry with volumes converted from linear factors.
+ *
+ * @function VolumeArray:from_linear
+ * @tparam table values
+ */
+int volume_array_from_linear(lua_State*);
+
+int volume_array__len(lua_State*);
+int volume_array__gc(lua_State*);
+
+
+/// VolumeView
+/// @type VolumeView
+
+
+/** Returns the channel volumes as a new @{lua_libpulse_glib.volume.Volume}.
+ *
+ * @function VolumeView:to_volume
+ * @treturn Volume
+ */
+int volume_view_to_volume(lua_State*);
+
+// Implements `view[channel]` for reads, and method lookups for string keys.
+int volume_view__index(lua_State*);
+int volume_view__newindex(lua_State*);
+int volume_view__len(lua_State*);
+int volume_view__gc(lua_State*);
+
+
+static const struct luaL_Reg volume_array_f[] = {
+    {"set",          volume_array_set        },
+    { "get",         volume_array_get        },
+    { "view",        volume_array_view       },
+    { "scale",       volume_array_scale      },
+    { "multiply",    volume_array_multiply   },
+    { "divide",      volume_array_divide     },
+    { "clamp",       volume_array_clamp      },
+    { "min",         volume_array_min        },
+    { "max",         volume_array_max        },
+    { "avg",         volume_array_avg        },
+    { "to_dB",       volume_array_to_dB      },
+    { "to_linear",   volume_array_to_linear  },
+    { "from_dB",     volume_array_from_dB    },
+    { "from_linear", volume_array_from_linear},
+    { NULL,          NULL                    }
+};
+
+
+static const struct luaL_Reg volume_array_mt[] = {
+    {"__len", volume_array__len},
+    { "__gc", volume_array__gc },
+    { NULL,   NULL             }
+};
+
+
+static const struct luaL_Reg volume_view_f[] = {
+    {"to_volume", volume_view_to_volume},
+    { NULL,       NULL                 }
+};
+
+
+// `__index` is a function, with `volume_view_f` as upvalue.
+static const struct luaL_Reg volume_view_mt[] = {
+    {"__newindex", volume_view__newindex},
+    { "__len",     volume_view__len     },
+    { "__gc",      volume_view__gc      },
+    { NULL,        NULL                 }
+};
+
+
+static const struct luaL_Reg volume_array_lib[] = {
+    {"new", volume_array_new},
+    { NULL, NULL            }
+};
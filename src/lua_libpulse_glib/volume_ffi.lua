@@ -0,0 +1,254 @@
+--- Fast access to @{lua_libpulse_glib.volume.Volume} values.
+--
+-- Under LuaJIT, volumes are accessed through the FFI. The userdata's layout is declared as C type, so reading
+-- and writing channels, as well as the arithmetic below, compiles to plain loads and stores instead of calls
+-- into the C API.
+--
+-- On PUC Lua, or when the declared layout doesn't match the library's, every function falls back to the
+-- equivalent @{lua_libpulse_glib.volume.Volume} method. Code written against this module runs unchanged on
+-- both.
+--
+--    local vffi = require("lua_libpulse_glib.volume_ffi")
+--    for i = 1, vffi.channels(vol) do
+--        vffi.set(vol, i, math.floor(vffi.get(vol, i) / 2))
+--    end
+--
+-- @module lua_libpulse_glib.volume_ffi
+
+local volume = require("lua_libpulse_glib.volume")
+
+local PA_VOLUME_MUTED = 0
+local PA_VOLUME_MAX = 0x7fffffff
+local PA_CHANNELS_MAX = 32
+
+local M = {}
+
+local has_ffi, ffi = pcall(require, "ffi")
+
+local function declare()
+    if not has_ffi then
+        return nil
+    end
+
+    local layout = volume.layout()
+
+    -- Declaring the type fails when it already exists, e.g. when the module is loaded again.
+    pcall(ffi.cdef, string.format([[
+        typedef struct {
+            uint32_t* values;
+            uint8_t channels;
+            uint32_t inline_values[%d];
+        } lua_pa_volume_t;
+    ]], layout.inline_channels))
+
+    local ok, ct = pcall(ffi.typeof, "lua_pa_volume_t*")
+    if not ok then
+        return nil
+    end
+
+    -- Only take the fast path when it's guaranteed to match what the C library writes.
+    if ffi.sizeof("lua_pa_volume_t") ~= layout.size
+        or ffi.offsetof("lua_pa_volume_t", "channels") ~= layout.channels_offset
+        or ffi.offsetof("lua_pa_volume_t", "values") ~= layout.values_offset
+        or ffi.offsetof("lua_pa_volume_t", "inline_values") ~= layout.inline_offset then
+        return nil
+    end
+
+    return ct
+end
+
+local volume_ptr = declare()
+
+--- Whether the FFI fast path is in use.
+-- @tfield boolean enabled
+M.enabled = volume_ptr ~= nil
+
+local function check_value(value)
+    if value < PA_VOLUME_MUTED or value > PA_VOLUME_MAX then
+        error("volume out of bounds", 3)
+    end
+end
+
+if volume_ptr then
+    local cast = ffi.cast
+    local floor = math.floor
+    local getmetatable = getmetatable
+    local tonumber = tonumber
+    local type = type
+    local uint64 = ffi.typeof("uint64_t")
+
+    local volume_mt = getmetatable(volume.from_linear({ 1 }))
+
+    -- Casts a volume to the declared layout. Casting any other userdata would read and write unrelated memory.
+    local function to_pointer(vol)
+        if type(vol) ~= "userdata" or getmetatable(vol) ~= volume_mt then
+            error("bad argument #1 (Volume expected, got " .. type(vol) .. ")", 3)
+        end
+        return cast(volume_ptr, vol)
+    end
+
+    --- Returns a pointer to the volume's data.
+    --
+    -- The pointer is only valid for as long as the volume is referenced. Holding on to it saves the cast in
+    -- tight loops. Only available when @{enabled} is `true`.
+    --
+    -- @function pointer
+    -- @tparam Volume vol
+    -- @treturn cdata
+    function M.pointer(vol)
+        return to_pointer(vol)
+    end
+
+    --- Returns the number of channels.
+    -- @function channels
+    -- @tparam Volume vol
+    -- @treturn number
+    function M.channels(vol)
+        return to_pointer(vol).channels
+    end
+
+    --- Returns the volume of a channel.
+    -- @function get
+    -- @tparam Volume vol
+    -- @tparam number channel The 1-based channel index.
+    -- @treturn number
+    function M.get(vol, channel)
+        local data = to_pointer(vol)
+        if channel < 1 or channel > data.channels then
+            error("channel index out of bounds", 2)
+        end
+        return data.values[channel - 1]
+    end
+
+    --- Sets the volume of a channel.
+    -- @function set
+    -- @tparam Volume vol
+    -- @tparam number channel The 1-based channel index.
+    -- @tparam number value
+    function M.set(vol, channel, value)
+        local data = to_pointer(vol)
+        if channel < 1 or channel > PA_CHANNELS_MAX then
+            error("channel index out of bounds", 2)
+        end
+        check_value(value)
+
+        -- Adding channels may have to move the values to the heap, which only the C side can do.
+        if channel > data.channels then
+            vol:set(channel, value)
+            return
+        end
+        data.values[channel - 1] = value
+    end
+
+    --- Returns the average volume of all channels.
+    -- @function avg
+    -- @tparam Volume vol
+    -- @treturn number
+    function M.avg(vol)
+        local data = to_pointer(vol)
+        local channels = data.channels
+        if channels == 0 then
+            return PA_VOLUME_MUTED
+        end
+
+        local sum = 0
+        for i = 0, channels - 1 do
+            sum = sum + data.values[i]
+        end
+        return floor(sum / channels)
+    end
+
+    --- Returns the volume of the loudest channel.
+    -- @function max
+    -- @tparam Volume vol
+    -- @treturn number
+    function M.max(vol)
+        local data = to_pointer(vol)
+        local m = PA_VOLUME_MUTED
+        for i = 0, data.channels - 1 do
+            local v = data.values[i]
+            if v > m then
+                m = v
+            end
+        end
+        return m
+    end
+
+    --- Returns the volume of the quietest channel.
+    -- @function min
+    -- @tparam Volume vol
+    -- @treturn number
+    function M.min(vol)
+        local data = to_pointer(vol)
+        if data.channels == 0 then
+            return PA_VOLUME_MUTED
+        end
+
+        local m = PA_VOLUME_MAX
+        for i = 0, data.channels - 1 do
+            local v = data.values[i]
+            if v < m then
+                m = v
+            end
+        end
+        return m
+    end
+
+    --- Scales all channels so that the loudest one is at the given volume, keeping their balance.
+    --
+    -- Like `pa_cvolume_scale`, this rounds down in 64-bit integer arithmetic, and fails for a volume without
+    -- channels.
+    --
+    -- @function scale
+    -- @tparam Volume vol
+    -- @tparam number value
+    function M.scale(vol, value)
+        check_value(value)
+        local data = to_pointer(vol)
+        if data.channels == 0 then
+            error("failed to scale volume", 2)
+        end
+
+        local t = M.max(vol)
+        for i = 0, data.channels - 1 do
+            if t <= PA_VOLUME_MUTED then
+                data.values[i] = value
+            else
+                data.values[i] = tonumber(uint64(data.values[i]) * value / t)
+            end
+        end
+    end
+else
+    function M.channels(vol)
+        return #vol
+    end
+
+    function M.get(vol, channel)
+        return vol:get(channel)
+    end
+
+    function M.set(vol, channel, value)
+        if channel < 1 or channel > PA_CHANNELS_MAX then
+            error("channel index out of bounds", 2)
+        end
+        vol:set(channel, value)
+    end
+
+    function M.avg(vol)
+        return vol:avg()
+    end
+
+    function M.max(vol)
+        return vol:max()
+    end
+
+    function M.min(vol)
+        return vol:min()
+    end
+
+    function M.scale(vol, value)
+        vol:scale(value)
+    end
+end
+
+return M